@@ -18,38 +18,53 @@
 #include <opmip/base.hpp>
 #include <opmip/debug.hpp>
 #include <opmip/exception.hpp>
+#include <opmip/log_backend.hpp>
+#include <opmip/metrics_server.hpp>
 #include <opmip/pmip/lma.hpp>
 #include <opmip/pmip/node_db.hpp>
 #include "options.hpp"
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/signal_set.hpp>
 #include <boost/lexical_cast.hpp>
 #include <iostream>
-#include <fstream>
 #include <cstring>
 
 ///////////////////////////////////////////////////////////////////////////////
 static opmip::logger log_("opmip-lma", std::cout);
 
 ///////////////////////////////////////////////////////////////////////////////
-static void load_node_database(const std::string& file_name, opmip::pmip::node_db& ndb)
+static void load_progress(size_t done, size_t total)
 {
-	std::ifstream in(file_name.c_str());
+	if (done != total)
+		log_(0, "loaded ", done, " of ", total, " mobile nodes from database");
+}
 
-	if (!in)
-		opmip::throw_exception(opmip::errc::make_error_code(opmip::errc::no_such_file_or_directory),
-		                       "Failed to open \"" + file_name + "\" node database file");
+static void load_node_database(const std::string& file_name, opmip::pmip::node_db& ndb)
+{
+	std::pair<size_t, size_t> n = ndb.load_file(file_name, load_progress);
 
-	std::pair<size_t, size_t> n = ndb.load(in);
 	log_(0, "loaded ", n.first, " router nodes and ", n.second, " mobile nodes from database");
 }
 
-void signal_handler(const boost::system::error_code& error, opmip::pmip::lma& lma)
+///
+/// SIGHUP reloads the node database, any other signal stops the LMA
+///
+void signal_handler(const boost::system::error_code& error, int signal, boost::asio::signal_set& sigs,
+                    const std::string& node_db, opmip::pmip::lma& lma, opmip::metrics::server& ms)
 {
+	if (!error && signal == SIGHUP) {
+		lma.reload(node_db);
+		sigs.async_wait(boost::bind(signal_handler, _1, _2, boost::ref(sigs), node_db, boost::ref(lma),
+		                            boost::ref(ms)));
+		return;
+	}
+
 	std::cout << "\r";
 	log_(0, "stopping the LMA service");
+	ms.close();
 	lma.stop();
 }
 
@@ -59,6 +74,7 @@ int main(int argc, char** argv)
 	opmip::setup_crash_handler();
 
 	try {
+		opmip::log_backend          logging;
 		opmip::app::cmdline_options opts;
 
 		if (!opts.parse(argc, argv))
@@ -66,17 +82,39 @@ int main(int argc, char** argv)
 
 		size_t                  concurrency = boost::thread::hardware_concurrency();
 		boost::asio::io_service ios(concurrency);
-		boost::asio::signal_set sigs(ios, SIGINT, SIGTERM);
+		boost::asio::signal_set sigs(ios, SIGINT, SIGTERM, SIGHUP);
 		opmip::pmip::node_db    ndb;
-		opmip::pmip::lma        lma(ios, ndb, concurrency);
+		boost::scoped_ptr<opmip::pmip::memory_data_plane> dp;
+
+		if (opts.data_plane == "memory") {
+			dp.reset(new opmip::pmip::memory_data_plane(ios));
+			dp->completion_delay(opts.data_plane_delay);
+			log_(0, "using the memory data plane, no routes or tunnels are programmed");
+		}
+
+		opmip::pmip::lma        lma(ios, ndb, concurrency, dp.get());
+		opmip::metrics::server  ms(ios, lma.get_metrics());
 
 		log_(0, "chrono resolution ", opmip::chrono::get_resolution());
 
+		ndb.set_cache_capacity(opts.node_cache);
 		load_node_database(opts.node_db, ndb);
 
-		lma.start(opts.identifier.c_str(), opts.tunnel_global_address);
+		if (!opts.trace_file.empty())
+			lma.open_trace(opts.trace_file, opts.trace_sample);
+		if (!opts.journal.empty())
+			lma.open_journal(opts.journal);
+
+		lma.start(opts.identifier.c_str(), opts.tunnel_global_address, opts.tunnel_provisioning,
+		          opts.flow_tunnel, opts.tunnel_prefix_length);
+
+		if (!opts.metrics.empty()) {
+			ms.open(opts.metrics);
+			log_(0, "exporting metrics on ", opts.metrics);
+		}
 
-		sigs.async_wait(boost::bind(signal_handler, _1, boost::ref(lma)));
+		sigs.async_wait(boost::bind(signal_handler, _1, _2, boost::ref(sigs), opts.node_db, boost::ref(lma),
+		                            boost::ref(ms)));
 
 		boost::thread_group tg;
 		for (size_t i = 1; i < concurrency; ++i)
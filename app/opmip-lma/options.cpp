@@ -18,6 +18,7 @@
 #include "options.hpp"
 #include <boost/program_options.hpp>
 #include <boost/asio/ip/host_name.hpp>
+#include <algorithm>
 #include <iostream>
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -40,9 +41,29 @@ bool cmdline_options::parse(int argc, char** argv)
 		                   "router identifier on the node database")
 		("database,d",     po::value<std::string>()->default_value("node.db"),
 		                   "node database")
+		("node-cache",     po::value<uint>()->default_value(0),
+		                   "mobile nodes kept in memory when the node database is an image, 0 keeps all")
 		("log,l",          "optional log file, defaults to the standard output")
 		("tga,t",     	   po::value<bool>()->default_value("false"),
-		                   "set tunnel global address (LMAA)");
+		                   "set tunnel global address (LMAA)")
+		("tunnel-prefix-length", po::value<uint>()->default_value(64),
+		                   "prefix length of the tunnel global address")
+		("provision-tunnels,p", po::value<bool>()->default_value(false),
+		                   "open the tunnels to every MAG of the node database at startup")
+		("flow-tunnel,f",  po::value<bool>()->default_value(false),
+		                   "use a single external tunnel with per route encapsulation instead of one tunnel per MAG")
+		("metrics,m",      po::value<std::string>()->default_value(""),
+		                   "export metrics on a local endpoint, unix:<path> or [<address>:]<port>")
+		("trace-file",     po::value<std::string>()->default_value(""),
+		                   "write sampled PBU pipeline traces to a binary ring file")
+		("trace-sample",   po::value<uint>()->default_value(1024),
+		                   "trace one in every N PBUs to the trace file")
+		("journal,j",      po::value<std::string>()->default_value(""),
+		                   "keep the bindings in a journal file, restored on restart along with their tunnels and routes")
+		("data-plane",     po::value<std::string>()->default_value("kernel"),
+		                   "where routes and tunnels are programmed, available: kernel, memory")
+		("data-plane-delay", po::value<uint>()->default_value(0),
+		                   "delay, in microseconds, of the route completions of the memory data plane");
 
 
 	options.add(config);
@@ -57,7 +78,27 @@ bool cmdline_options::parse(int argc, char** argv)
 
 	identifier = vm["id"].as<std::string>();
 	node_db = vm["database"].as<std::string>();
+	node_cache = vm["node-cache"].as<uint>();
 	tunnel_global_address = vm["tga"].as<bool>();
+	tunnel_prefix_length = vm["tunnel-prefix-length"].as<uint>();
+	tunnel_provisioning = vm["provision-tunnels"].as<bool>();
+	flow_tunnel = vm["flow-tunnel"].as<bool>();
+	metrics = vm["metrics"].as<std::string>();
+	trace_file = vm["trace-file"].as<std::string>();
+	trace_sample = std::max(vm["trace-sample"].as<uint>(), 1u);
+	journal = vm["journal"].as<std::string>();
+	data_plane = vm["data-plane"].as<std::string>();
+	data_plane_delay = vm["data-plane-delay"].as<uint>();
+
+	if (data_plane != "kernel" && data_plane != "memory") {
+		std::cerr << "invalid data plane: " << data_plane << std::endl;
+		return false;
+	}
+
+	if (tunnel_prefix_length > 128) {
+		std::cerr << "invalid tunnel prefix length: " << tunnel_prefix_length << std::endl;
+		return false;
+	}
 
 	return true;
 }
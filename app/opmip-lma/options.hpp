@@ -31,7 +31,17 @@ namespace opmip { namespace app {
 struct cmdline_options {
 	std::string identifier;
 	std::string node_db;
+	uint node_cache;
 	bool tunnel_global_address;
+	uint tunnel_prefix_length;
+	bool tunnel_provisioning;
+	bool flow_tunnel;
+	std::string metrics;
+	std::string trace_file;
+	uint trace_sample;
+	std::string journal;
+	std::string data_plane;
+	uint data_plane_delay;
 	bool parse(int argc, char** argv);
 };
 
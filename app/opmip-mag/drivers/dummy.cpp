@@ -55,23 +55,28 @@ void dummy_driver::start(const std::vector<std::string>& options)
 
 void dummy_driver::start_(float frequency, const std::vector<std::string>& clients)
 {
-	pmip::node_db& db = _mag.get_node_database();
+	rcu_pointer<pmip::node_db>::reader ndb(_mag.get_node_database());
+	const pmip::node_db&               db = *ndb;
 
 	_timer.cancel();
 	_clients.clear();
 	_frequency = frequency;
 
-	if (clients.empty())
-		for (pmip::node_db::mobile_node_iterator i = db.mobile_node_begin(), e = db.mobile_node_end(); i != e; ++i)
-			_clients.push_back(client_state(i->link_addresses().front(), false));
-	else
+	if (clients.empty()) {
+		for (uint32 i = 0; i < db.mobile_node_count(); ++i) {
+			pmip::mobile_node_ptr mn = db.mobile_node_at(i);
+			if (mn)
+				_clients.push_back(client_state(mn->link_addresses().front(), false));
+		}
+	} else {
 		for (std::vector<std::string>::const_iterator i = clients.begin(), e = clients.end(); i != e; ++i) {
-			const pmip::mobile_node* mn = db.find_mobile_node(*i);
+			pmip::mobile_node_ptr mn = db.find_mobile_node(*i);
 			if (mn)
 				_clients.push_back(client_state(mn->link_addresses().front(), false));
 			else
 				log_(0, "mobile node ", *i, " not found in database");
 		}
+	}
 
 	log_(0, "using ", _clients.size(), " mobile node(s), about to generate ", frequency, " message(s) per second");
 
@@ -102,7 +107,8 @@ void dummy_driver::timer_handler(const boost::system::error_code& ec)
 
 	log_(0, "after ", _chrono.get(), " seconds we rolled the dice and got ", n);
 
-	const opmip::pmip::mobile_node* mn = _mag.get_node_database().find_mobile_node(_clients[n].first);
+	rcu_pointer<pmip::node_db>::reader ndb(_mag.get_node_database());
+	opmip::pmip::mobile_node_ptr       mn = ndb->find_mobile_node(_clients[n].first);
 
 	if (!mn)
 		return;
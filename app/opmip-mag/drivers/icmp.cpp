@@ -167,7 +167,8 @@ void icmp_drv::handle_recv(const boost::system::error_code& ec, size_t rbytes, b
 
 void icmp_drv::handle_rs(net::ip::address_v6& ep, net::link::address_mac& laddr)
 {
-	const pmip::mobile_node* mn = _mag.get_node_database().find_mobile_node(laddr);
+	rcu_pointer<pmip::node_db>::reader ndb(_mag.get_node_database());
+	pmip::mobile_node_ptr              mn = ndb->find_mobile_node(laddr);
 	if (!mn) {
 		log_(0, "router advertisement from ", ep, " - ", laddr, " ignored. not authorized");
 		return;
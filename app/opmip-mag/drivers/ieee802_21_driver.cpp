@@ -321,7 +321,8 @@ void ieee802_21_driver::event_handler(odtone::mih::message& msg, const boost::sy
 			return;
 		}
 
-		const opmip::pmip::mobile_node* mn = _mag.get_node_database().find_mobile_node(mn_address);
+		opmip::rcu_pointer<opmip::pmip::node_db>::reader ndb(_mag.get_node_database());
+		opmip::pmip::mobile_node_ptr                     mn = ndb->find_mobile_node(mn_address);
 		if(!mn) {
 			log_(0, "node ", mn_address, " not authorized");
 			return;
@@ -45,7 +45,8 @@ static void link_event(const boost::system::error_code& ec, const madwifi_driver
 	if (ec)
 		return;
 
-	const opmip::pmip::mobile_node* mn = mag.get_node_database().find_mobile_node(ev.mn_address);
+	opmip::rcu_pointer<opmip::pmip::node_db>::reader ndb(mag.get_node_database());
+	opmip::pmip::mobile_node_ptr                     mn = ndb->find_mobile_node(ev.mn_address);
 
 	if(!mn) {
 		if (!mn) {
@@ -19,38 +19,54 @@
 #include <opmip/debug.hpp>
 #include <opmip/logger.hpp>
 #include <opmip/exception.hpp>
+#include <opmip/log_backend.hpp>
+#include <opmip/metrics_server.hpp>
 #include <opmip/pmip/mag.hpp>
 #include <opmip/pmip/node_db.hpp>
 #include "driver.hpp"
 #include "options.hpp"
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/signal_set.hpp>
 #include <boost/lexical_cast.hpp>
 #include <iostream>
-#include <fstream>
 #include <cstring>
 
 ///////////////////////////////////////////////////////////////////////////////
 static opmip::logger log_("opmip-mag", std::cout);
 
 ///////////////////////////////////////////////////////////////////////////////
-static void load_node_database(const std::string& file_name, opmip::pmip::node_db& ndb)
+static void load_progress(size_t done, size_t total)
 {
-	std::ifstream in(file_name.c_str());
+	if (done != total)
+		log_(0, "loaded ", done, " of ", total, " mobile nodes from database");
+}
 
-	if (!in)
-		opmip::throw_exception(opmip::errc::make_error_code(opmip::errc::no_such_file_or_directory),
-		                       "Failed to open \"" + file_name + "\" node database file");
+static void load_node_database(const std::string& file_name, opmip::pmip::node_db& ndb)
+{
+	std::pair<size_t, size_t> n = ndb.load_file(file_name, load_progress);
 
-	std::pair<size_t, size_t> n = ndb.load(in);
 	log_(0, "loaded ", n.first, " router nodes and ", n.second, " mobile nodes from database");
 }
 
-static void signal_handler(const boost::system::error_code& error, opmip::app::driver_ptr& drv, opmip::pmip::mag& mag)
+///
+/// SIGHUP reloads the node database, any other signal stops the MAG
+///
+static void signal_handler(const boost::system::error_code& error, int signal, boost::asio::signal_set& sigs,
+                           const std::string& database, opmip::app::driver_ptr& drv, opmip::pmip::mag& mag,
+                           opmip::metrics::server& ms)
 {
+	if (!error && signal == SIGHUP) {
+		mag.reload(database);
+		sigs.async_wait(boost::bind(signal_handler, _1, _2, boost::ref(sigs), database, drv, boost::ref(mag),
+		                            boost::ref(ms)));
+		return;
+	}
+
 	std::cout << "\r";
+	ms.close();
 	log_(0, "stopping driver");
 	drv->stop();
 	log_(0, "stopping the MAG service");
@@ -63,6 +79,7 @@ int main(int argc, char** argv)
 	opmip::setup_crash_handler();
 
 	try {
+		opmip::log_backend          logging;
 		opmip::app::cmdline_options opts;
 
 		if (!opts.parse(argc, argv, std::cerr))
@@ -70,17 +87,28 @@ int main(int argc, char** argv)
 
 		size_t                       concurrency = boost::thread::hardware_concurrency();
 		boost::asio::io_service      ios(concurrency);
-		boost::asio::signal_set      sigs(ios, SIGINT, SIGTERM);
+		boost::asio::signal_set      sigs(ios, SIGINT, SIGTERM, SIGHUP);
 		opmip::pmip::node_db         ndb;
 		opmip::pmip::addrconf_server addrconf(ios);
-		opmip::pmip::mag             mag(ios, ndb, addrconf, concurrency);
+		boost::scoped_ptr<opmip::pmip::memory_data_plane> dp;
+
+		if (opts.data_plane == "memory") {
+			dp.reset(new opmip::pmip::memory_data_plane(ios));
+			dp->completion_delay(opts.data_plane_delay);
+			log_(0, "using the memory data plane, no routes or tunnels are programmed");
+		}
+
+		opmip::pmip::mag             mag(ios, ndb, addrconf, concurrency, dp.get());
+		opmip::metrics::server       ms(ios, mag.get_metrics());
 		opmip::app::driver_ptr       drv;
 
+		ndb.set_cache_capacity(opts.node_cache);
 		load_node_database(opts.database, ndb);
 
 		log_(0, "chrono resolution ", opmip::chrono::get_resolution());
 
-		mag.start(opts.identifier.c_str(), opts.link_local_ip, opts.tunnel_global_address);
+		mag.start(opts.identifier.c_str(), opts.link_local_ip, opts.tunnel_global_address,
+		          opts.tunnel_prefix_length);
 
 		drv = opmip::app::make_driver(ios, mag, opts.driver);
 		if (!drv) {
@@ -89,7 +117,13 @@ int main(int argc, char** argv)
 		}
 		drv->start(opts.driver_options);
 
-		sigs.async_wait(boost::bind(signal_handler, _1, drv, boost::ref(mag)));
+		if (!opts.metrics.empty()) {
+			ms.open(opts.metrics);
+			log_(0, "exporting metrics on ", opts.metrics);
+		}
+
+		sigs.async_wait(boost::bind(signal_handler, _1, _2, boost::ref(sigs), opts.database, drv, boost::ref(mag),
+		                            boost::ref(ms)));
 
 		boost::thread_group tg;
 		for (size_t i = 1; i < concurrency; ++i)
@@ -39,13 +39,23 @@ bool cmdline_options::parse(int argc, char** argv, std::ostream& out)
 		                   "router identifier on the node database")
 		("database,d",     po::value<std::string>()->default_value("node.db"),
 		                   "node database")
+		("node-cache",     po::value<uint>()->default_value(0),
+		                   "mobile nodes kept in memory when the node database is an image, 0 keeps all")
 		("log,l",          "optional log file, defaults to the standard output")
 		("tga,t",          po::value<bool>()->default_value(false),
                                    "set tunnel global address")
+		("tunnel-prefix-length", po::value<uint>()->default_value(64),
+		                   "prefix length of the tunnel global address")
 		("driver,e",       po::value<std::string>()->default_value("madwifi"),
 		                   "event driver to be used, available: madwifi, 802.11, dummy")
 		("link-local-ip",  po::value<std::string>()->default_value("fe80::1"),
 		                   "link local IP address for all access links")
+		("metrics,m",      po::value<std::string>()->default_value(""),
+		                   "export metrics on a local endpoint, unix:<path> or [<address>:]<port>")
+		("data-plane",     po::value<std::string>()->default_value("kernel"),
+		                   "where routes and tunnels are programmed, available: kernel, memory")
+		("data-plane-delay", po::value<uint>()->default_value(0),
+		                   "delay, in microseconds, of the route completions of the memory data plane")
 		("driver-options",  po::value<std::vector<std::string> >(), "driver specific options");
 
 	po.add("driver-options", -1);
@@ -60,8 +70,23 @@ bool cmdline_options::parse(int argc, char** argv, std::ostream& out)
 
 	identifier = vm["id"].as<std::string>();
 	database = vm["database"].as<std::string>();
+	node_cache = vm["node-cache"].as<uint>();
 	driver = vm["driver"].as<std::string>();
 	tunnel_global_address = vm["tga"].as<bool>();
+	tunnel_prefix_length = vm["tunnel-prefix-length"].as<uint>();
+	metrics = vm["metrics"].as<std::string>();
+	data_plane = vm["data-plane"].as<std::string>();
+	data_plane_delay = vm["data-plane-delay"].as<uint>();
+
+	if (data_plane != "kernel" && data_plane != "memory") {
+		out << "invalid data plane: " << data_plane << std::endl;
+		return false;
+	}
+
+	if (tunnel_prefix_length > 128) {
+		out << "invalid tunnel prefix length: " << tunnel_prefix_length << std::endl;
+		return false;
+	}
 
 	if (vm.count("driver-options"))
 		driver_options = vm["driver-options"].as<std::vector<std::string> >();
@@ -33,10 +33,15 @@ namespace opmip { namespace app {
 struct cmdline_options {
 	std::string              identifier;
 	std::string              database;
+	uint                     node_cache;
 	std::string              driver;
 	std::vector<std::string> driver_options;
 	bool                     tunnel_global_address;
+	uint                     tunnel_prefix_length;
 	ip::address_v6           link_local_ip; //TODO: deprecate
+	std::string              metrics;
+	std::string              data_plane;
+	uint                     data_plane_delay;
 
 
 	bool parse(int argc, char** argv, std::ostream& out);
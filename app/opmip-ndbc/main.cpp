@@ -0,0 +1,79 @@
+//=============================================================================
+// Brief   : Node Database Compiler
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/pmip/node_db.hpp>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+
+///////////////////////////////////////////////////////////////////////////////
+static void load_progress(size_t done, size_t total)
+{
+	std::cout << "\rloaded " << done << " of " << total << " mobile nodes" << std::flush;
+	if (done == total)
+		std::cout << "\n";
+}
+
+///
+/// Compiles a JSON node database into the binary image mapped by the LMA and
+/// MAG. The image is written to a temporary file and renamed over the output,
+/// processes that have the old image mapped keep using it.
+///
+int main(int argc, char** argv)
+{
+	opmip::pmip::node_db      db;
+	std::pair<size_t, size_t> cnt;
+
+	if (argc != 3) {
+		std::cerr << "usage: opmip-ndbc node-database-file image-file\n\n";
+		return 1;
+	}
+
+	std::ifstream in(argv[1]);
+	if (!in) {
+		std::cerr << "failed to open database file: " << argv[1] << "\n\n";
+		return 1;
+	}
+
+	try {
+		cnt = db.load(in, load_progress);
+
+	} catch (std::exception& e) {
+		std::cerr << "database parse error: " << e.what() << "\n\n";
+		return 1;
+	}
+
+	std::string   tmp = std::string(argv[2]) + ".tmp";
+	std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+
+	if (out)
+		db.write_image(out);
+	out.close();
+
+	if (!out || std::rename(tmp.c_str(), argv[2])) {
+		std::cerr << "failed to write image file: " << argv[2] << "\n\n";
+		std::remove(tmp.c_str());
+		return 1;
+	}
+
+	std::cout << "compiled " << cnt.first << " router and " << cnt.second
+	          << " mobile node entries into " << argv[2] << "\n";
+	return 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
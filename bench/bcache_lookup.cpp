@@ -0,0 +1,150 @@
+//=============================================================================
+// Brief   : Binding Cache Lookup Benchmark
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/chrono.hpp>
+#include <opmip/hash_index.hpp>
+#include <boost/intrusive/rbtree.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+///
+/// Binding cache entry stand-in carrying both the rbtree hook used before
+/// and the key used by the hash index
+///
+struct entry {
+	entry(const std::string& id)
+		: _id(id)
+	{ }
+
+	const std::string& id() const { return _id; }
+
+	boost::intrusive::set_member_hook<> hook;
+	std::string                         _id;
+};
+
+struct compare {
+	bool operator()(const entry& rhs, const entry& lhs) const        { return rhs._id < lhs._id; }
+	bool operator()(const entry& rhs, const std::string& key) const  { return rhs._id < key; }
+	bool operator()(const std::string& key, const entry& lhs) const  { return key < lhs._id; }
+};
+
+typedef boost::intrusive::rbtree<entry,
+                                 boost::intrusive::member_hook<entry,
+                                                               boost::intrusive::set_member_hook<>,
+                                                               &entry::hook>,
+                                 boost::intrusive::compare<compare> > id_tree;
+
+typedef hash_index<entry, std::string, &entry::id> id_index;
+
+static const size_t k_lookups = 2000000;
+
+///////////////////////////////////////////////////////////////////////////////
+static double to_ns(const ptime& tm, size_t n)
+{
+	return (double(tm.seconds()) * 1e9 + tm.nanoseconds()) / n;
+}
+
+static void run(size_t count)
+{
+	std::vector<entry*>      entries;
+	std::vector<std::string> keys;
+	id_tree                  tree;
+	id_index                 index;
+	chrono                   cr;
+	size_t                   found;
+
+	//
+	// NAIs of the same operator share most of their characters, which is
+	// the worst case for the string compares of the rbtree
+	//
+	entries.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+		entries.push_back(new entry("mobile-node-" + boost::lexical_cast<std::string>(i * 7919 % count) + "@opmip.example.org"));
+
+	for (size_t i = 0; i < k_lookups; ++i)
+		keys.push_back(entries[(i * 2654435761u) % count]->id());
+
+	cr.start();
+	for (size_t i = 0; i < count; ++i)
+		tree.insert_unique(*entries[i]);
+	cr.stop();
+	double tree_insert = to_ns(cr.get(), count);
+
+	cr.start();
+	for (size_t i = 0; i < count; ++i)
+		index.insert_unique(*entries[i]);
+	cr.stop();
+	double index_insert = to_ns(cr.get(), count);
+
+	found = 0;
+	cr.start();
+	for (size_t i = 0; i < k_lookups; ++i)
+		found += tree.find(keys[i], compare()) != tree.end();
+	cr.stop();
+	double tree_find = to_ns(cr.get(), k_lookups);
+
+	if (found != k_lookups)
+		std::cerr << "rbtree lookup failed\n";
+
+	found = 0;
+	cr.start();
+	for (size_t i = 0; i < k_lookups; ++i)
+		found += index.find(keys[i]) != nullptr;
+	cr.stop();
+	double index_find = to_ns(cr.get(), k_lookups);
+
+	if (found != k_lookups)
+		std::cerr << "hash index lookup failed\n";
+
+	std::cout << std::setw(9) << count
+	          << std::fixed << std::setprecision(1)
+	          << std::setw(14) << tree_insert << std::setw(14) << index_insert
+	          << std::setw(14) << tree_find << std::setw(14) << index_find
+	          << std::setw(10) << std::setprecision(2) << (tree_find / index_find) << "x"
+	          << std::endl;
+
+	tree.clear();
+	index.clear();
+	for (size_t i = 0; i < count; ++i)
+		delete entries[i];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	std::cout << std::setw(9) << "entries"
+	          << std::setw(14) << "rbtree-insert" << std::setw(14) << "hash-insert"
+	          << std::setw(14) << "rbtree-find" << std::setw(14) << "hash-find"
+	          << std::setw(11) << "speedup" << "\n"
+	          << std::setw(9) << ""
+	          << std::setw(14) << "(ns/op)" << std::setw(14) << "(ns/op)"
+	          << std::setw(14) << "(ns/op)" << std::setw(14) << "(ns/op)" << std::endl;
+
+	run(10000);
+	run(100000);
+	run(1000000);
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
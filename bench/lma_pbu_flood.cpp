@@ -0,0 +1,423 @@
+//=============================================================================
+// Brief   : LMA PBU Flood Benchmark
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/metrics.hpp>
+#include <opmip/tracer.hpp>
+#include <opmip/pmip/data_plane.hpp>
+#include <opmip/pmip/lma.hpp>
+#include <opmip/pmip/mp_batch.hpp>
+#include <opmip/pmip/node_db.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <time.h>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const char* const k_lma_id = "lma";
+
+///
+/// Load parameters, see usage()
+///
+struct options {
+	options()
+		: mags(16), mns(10000), count(200000), rate(0),
+		  concurrency(boost::thread::hardware_concurrency()), lifetime(3600)
+	{
+		mix[0] = 60;
+		mix[1] = 30;
+		mix[2] = 10;
+	}
+
+	size_t mags;
+	size_t mns;
+	size_t count;
+	size_t rate;
+	size_t concurrency;
+	uint   lifetime;
+	uint   mix[3]; ///renew:handoff:dereg weights
+};
+
+///
+/// Generator view of one mobile node. The MN has at most one PBU in flight,
+/// the PBA handler clears the flag once it reports the answer.
+///
+struct mobile {
+	mobile()
+		: mag(0), sequence(0), registered(false), in_flight(false), sent(0)
+	{ }
+
+	size_t mag;
+	uint16 sequence;
+	bool   registered;
+	bool   in_flight;
+	uint64 sent;
+};
+
+enum operation {
+	k_registration,
+	k_renewal,
+	k_handoff,
+	k_deregistration,
+
+	k_operations
+};
+
+static const char* const k_operation_names[k_operations] = {
+	"registration", "renewal", "handoff", "de-registration"
+};
+
+///////////////////////////////////////////////////////////////////////////////
+struct collector {
+	collector(std::vector<mobile>& mns_)
+		: mns(mns_)
+	{ }
+
+	void operator()(const pmip::proxy_binding_info& pbinfo)
+	{
+		mobile& mn = mns[pbinfo.mn_index];
+
+		latency.record((tracer::now() - mn.sent) / 1000);
+		if (pbinfo.status == ip::mproto::pba::status_ok)
+			accepted.inc();
+		else
+			rejected.inc();
+
+		__atomic_store_n(&mn.in_flight, false, __ATOMIC_RELEASE);
+		completed.inc();
+	}
+
+	std::vector<mobile>& mns;
+	metrics::histogram   latency;
+	metrics::counter     accepted;
+	metrics::counter     rejected;
+	metrics::counter     completed;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+static std::string mag_address(size_t i)
+{
+	char buf[64];
+
+	std::sprintf(buf, "fd00::%x", uint(i + 0x100));
+	return buf;
+}
+
+static std::string node_database(const options& opts)
+{
+	std::ostringstream os;
+	char               buf[64];
+
+	os << "{\n\"router-nodes\": [\n"
+	   << "{ \"id\": \"" << k_lma_id << "\", \"ip-address\": \"fd00::1\", \"ip-scope-id\": 0 }";
+	for (size_t i = 0; i < opts.mags; ++i)
+		os << ",\n{ \"id\": \"mag" << i << "\", \"ip-address\": \"" << mag_address(i) << "\", \"ip-scope-id\": 0 }";
+
+	os << "\n],\n\"mobile-nodes\": [\n";
+	for (size_t i = 0; i < opts.mns; ++i) {
+		if (i)
+			os << ",\n";
+
+		std::sprintf(buf, "\"2001:db8:%x:%x::/64\"", uint(i >> 16), uint(i & 0xffff));
+		os << "{ \"id\": \"mn" << i << "@opmip.example.org\", \"ip-prefix\": [ " << buf << " ], ";
+
+		std::sprintf(buf, "\"02:00:%02x:%02x:%02x:%02x\"",
+		             uint(i >> 24) & 0xff, uint(i >> 16) & 0xff, uint(i >> 8) & 0xff, uint(i) & 0xff);
+		os << "\"link-address\": [ " << buf << " ], \"lma-id\": \"" << k_lma_id << "\" }";
+	}
+	os << "\n]\n}\n";
+
+	return os.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static operation next_operation(const options& opts, const mobile& mn, uint64& rnd)
+{
+	if (!mn.registered)
+		return k_registration;
+
+	rnd = rnd * 6364136223846793005ull + 1442695040888963407ull;
+
+	uint total = opts.mix[0] + opts.mix[1] + opts.mix[2];
+	uint pick = uint(rnd >> 33) % total;
+
+	if (pick < opts.mix[0])
+		return k_renewal;
+	if (pick < opts.mix[0] + opts.mix[1])
+		return k_handoff;
+	return k_deregistration;
+}
+
+static void fill_pbu(const options& opts, size_t index, mobile& mn, operation op,
+                     const std::vector<ip::address_v6>& mags, const std::vector<ip::prefix_v6>& prefixes,
+                     pmip::proxy_binding_info& pbinfo)
+{
+	pbinfo.id = "mn" + boost::lexical_cast<std::string>(index) + "@opmip.example.org";
+	pbinfo.sequence = ++mn.sequence;
+	pbinfo.lifetime = opts.lifetime;
+	pbinfo.handoff = ip::mproto::option::handoff::k_unknown;
+	pbinfo.link_type = ll::k_tech_ieee802_3;
+	pbinfo.prefix_list.push_back(prefixes[index]);
+
+	switch (op) {
+	case k_registration:
+		mn.registered = true;
+		break;
+
+	case k_renewal:
+		pbinfo.handoff = ip::mproto::option::handoff::k_not_changed;
+		break;
+
+	case k_handoff:
+		mn.mag = (mn.mag + 1) % mags.size();
+		break;
+
+	case k_deregistration:
+		pbinfo.lifetime = 0;
+		mn.registered = false;
+		break;
+
+	default:
+		break;
+	}
+
+	pbinfo.address = mags[mn.mag];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static uint64 cpu_usec(int who)
+{
+	::rusage ru;
+
+	::getrusage(who, &ru);
+	return uint64(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+	       + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static void usage(const char* name)
+{
+	std::cerr << "usage: " << name << " [--mags K] [--mns M] [--count N] [--rate PBU/s]\n"
+	             "       [--mix renew:handoff:dereg] [--concurrency T] [--lifetime s]\n"
+	             "\n"
+	             "Drives N PBUs from M mobile nodes spread over K MAGs into an LMA, through\n"
+	             "an in-process transport and an in-memory data plane. Unregistered MNs\n"
+	             "always register, registered ones pick an operation by the mix weights.\n"
+	             "A rate of 0 sends as fast as the LMA answers.\n";
+}
+
+static bool parse_options(int argc, char* argv[], options& opts)
+{
+	try {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg(argv[i]);
+
+			if (i + 1 == argc)
+				return false;
+
+			std::string val(argv[++i]);
+
+			if (arg == "--mags")
+				opts.mags = boost::lexical_cast<size_t>(val);
+			else if (arg == "--mns")
+				opts.mns = boost::lexical_cast<size_t>(val);
+			else if (arg == "--count")
+				opts.count = boost::lexical_cast<size_t>(val);
+			else if (arg == "--rate")
+				opts.rate = boost::lexical_cast<size_t>(val);
+			else if (arg == "--concurrency")
+				opts.concurrency = boost::lexical_cast<size_t>(val);
+			else if (arg == "--lifetime")
+				opts.lifetime = boost::lexical_cast<uint>(val);
+			else if (arg == "--mix") {
+				if (std::sscanf(val.c_str(), "%u:%u:%u", &opts.mix[0], &opts.mix[1], &opts.mix[2]) != 3)
+					return false;
+			} else
+				return false;
+		}
+
+	} catch (boost::bad_lexical_cast&) {
+		return false;
+	}
+
+	return opts.mags && opts.mns && opts.concurrency && opts.lifetime
+	       && (opts.mix[0] + opts.mix[1] + opts.mix[2]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+	options opts;
+
+	if (!parse_options(argc, argv, opts)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	//
+	// The LMA and the node database log every PBU to std::cout, a failed
+	// stream makes the loggers skip the formatting altogether
+	//
+	std::ostream out(std::cout.rdbuf());
+
+	std::cout.setstate(std::ios::badbit);
+
+	boost::asio::io_service                        ios;
+	boost::scoped_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(ios));
+	pmip::node_db                                  ndb;
+	pmip::memory_data_plane                        dp(ios);
+	std::vector<mobile>                            mns(opts.mns);
+	collector                                      pbas(mns);
+	pmip::lma                                      lma(ios, ndb, opts.concurrency, &dp);
+
+	std::istringstream db(node_database(opts));
+	ndb.load(db);
+
+	std::vector<ip::address_v6> mags;
+	std::vector<ip::prefix_v6>  prefixes;
+
+	for (size_t i = 0; i < opts.mags; ++i)
+		mags.push_back(ip::address_v6::from_string(mag_address(i)));
+	for (size_t i = 0; i < opts.mns; ++i) {
+		mns[i].mag = i % opts.mags;
+		prefixes.push_back(*ndb.mobile_node_at(i)->prefix_list().begin());
+	}
+
+	lma.use_local_transport(boost::ref(pbas));
+	lma.start(k_lma_id, false);
+
+	boost::thread_group tg;
+	for (size_t i = 0; i < opts.concurrency; ++i)
+		tg.create_thread(boost::bind(&boost::asio::io_service::run, &ios));
+
+	//
+	// Batches are handed over when full or when the next PBU is not due
+	// yet, so a throttled run does not hold PBUs back
+	//
+	size_t           ops[k_operations] = { 0 };
+	size_t           next = 0;
+	uint64           rnd = 0x9e3779b97f4a7c15ull;
+	pmip::pbinfo_batch_ptr pbb;
+	uint64           start = tracer::now();
+	uint64           cpu = cpu_usec(RUSAGE_SELF);
+	uint64           generator = cpu_usec(RUSAGE_THREAD);
+
+	for (size_t n = 0; n < opts.count; ++n) {
+		if (opts.rate) {
+			uint64 due = start + uint64(n) * 1000000000 / opts.rate;
+
+			if (tracer::now() < due) {
+				if (pbb) {
+					lma.receive(pbb);
+					pbb.reset();
+				}
+				for (uint64 now = tracer::now(); now < due; now = tracer::now()) {
+					::timespec ts = { 0, long(due - now) };
+
+					::nanosleep(&ts, nullptr);
+				}
+			}
+		}
+
+		size_t index = next;
+		while (__atomic_load_n(&mns[index].in_flight, __ATOMIC_ACQUIRE)) {
+			index = (index + 1) % mns.size();
+			if (index == next) {
+				if (pbb) {
+					lma.receive(pbb);
+					pbb.reset();
+				}
+				boost::this_thread::yield();
+			}
+		}
+		next = (index + 1) % mns.size();
+
+		mobile&   mn = mns[index];
+		operation op = next_operation(opts, mn, rnd);
+
+		if (!pbb)
+			pbb = pmip::pbinfo_batch::make();
+
+		fill_pbu(opts, index, mn, op, mags, prefixes, pbb->push());
+		++ops[op];
+
+		mn.in_flight = true;
+		mn.sent = tracer::now();
+
+		if (pbb->full()) {
+			lma.receive(pbb);
+			pbb.reset();
+		}
+	}
+
+	if (pbb)
+		lma.receive(pbb);
+
+	while (pbas.completed.value() < opts.count)
+		boost::this_thread::yield();
+
+	uint64 elapsed = tracer::now() - start;
+
+	//
+	// The generator thread is left out, its spinning is not LMA work
+	//
+	cpu = cpu_usec(RUSAGE_SELF) - cpu - (cpu_usec(RUSAGE_THREAD) - generator);
+
+	size_t routes = dp.route_count();
+
+	lma.stop();
+	work.reset();
+	ios.stop();
+	tg.join_all();
+
+	double seconds = double(elapsed) / 1e9;
+
+	out << std::fixed << std::setprecision(1)
+	    << "mags              " << opts.mags << "\n"
+	    << "mns               " << opts.mns << "\n"
+	    << "concurrency       " << opts.concurrency << "\n"
+	    << "rate              " << (opts.rate ? boost::lexical_cast<std::string>(opts.rate) : "unthrottled") << "\n";
+	for (uint i = 0; i < k_operations; ++i)
+		out << std::left << std::setw(18) << k_operation_names[i] << std::right << ops[i] << "\n";
+	out << "pbus              " << opts.count << "\n"
+	    << "accepted          " << pbas.accepted.value() << "\n"
+	    << "rejected          " << pbas.rejected.value() << "\n"
+	    << "routes            " << routes << "\n"
+	    << "duration          " << std::setprecision(3) << seconds << " s\n"
+	    << "throughput        " << std::setprecision(0) << (opts.count / seconds) << " PBU/s\n"
+	    << "latency-p50       " << pbas.latency.quantile(0.5) << " us\n"
+	    << "latency-p90       " << pbas.latency.quantile(0.9) << " us\n"
+	    << "latency-p99       " << pbas.latency.quantile(0.99) << " us\n"
+	    << "latency-p999      " << pbas.latency.quantile(0.999) << " us\n"
+	    << "cpu-per-1k        " << std::setprecision(2) << (double(cpu) / 1000 / (double(opts.count) / 1000))
+	    << " ms\n";
+
+	return pbas.rejected.value() ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,656 @@
+//=============================================================================
+// Brief   : Core Data Structures and Codecs Microbenchmarks
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/chrono.hpp>
+#include <opmip/ip/checksum.hpp>
+#include <opmip/ip/icmp.hpp>
+#include <opmip/net/ip/dhcp_v6.hpp>
+#include <opmip/net/ip/icmp_parser.hpp>
+#include <opmip/net/ip/pim_gen_parser.hpp>
+#include <opmip/pmip/bcache.hpp>
+#include <opmip/pmip/bulist.hpp>
+#include <opmip/pmip/icmp_sender.hpp>
+#include <opmip/pmip/mp_receiver.hpp>
+#include <opmip/pmip/mp_sender.hpp>
+#include <opmip/pmip/node_db.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+namespace dhcp6 = opmip::net::ip::dhcp_v6;
+
+///
+/// Every timed region is reported as one line of JSON, with the best time of
+/// all repetitions, so runs before and after a change can be compared with
+/// any JSON tool
+///
+class report {
+	struct result {
+		size_t ops;
+		double ns_per_op;
+	};
+
+public:
+	static void add(const std::string& name, size_t ops, const ptime& tm)
+	{
+		double ns = (double(tm.seconds()) * 1e9 + tm.nanoseconds()) / ops;
+		std::map<std::string, result>::iterator i = _results.find(name);
+
+		if (i == _results.end()) {
+			result res = { ops, ns };
+
+			_names.push_back(name);
+			_results.insert(std::make_pair(name, res));
+
+		} else if (ns < i->second.ns_per_op) {
+			i->second.ns_per_op = ns;
+		}
+	}
+
+	static void print(std::ostream& os, size_t repeat)
+	{
+		char buf[256];
+
+		for (std::vector<std::string>::const_iterator i = _names.begin(), e = _names.end(); i != e; ++i) {
+			const result& res = _results[*i];
+
+			std::snprintf(buf, sizeof(buf),
+			              "{\"benchmark\": \"%s\", \"ops\": %zu, \"repeat\": %zu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f}",
+			              i->c_str(), res.ops, repeat, res.ns_per_op, 1e9 / res.ns_per_op);
+			os << buf << '\n';
+		}
+		os.flush();
+	}
+
+private:
+	static std::vector<std::string>      _names;
+	static std::map<std::string, result> _results;
+};
+
+std::vector<std::string>              report::_names;
+std::map<std::string, report::result> report::_results;
+
+///
+/// Times one region of a benchmark
+///
+class measure {
+public:
+	measure(const char* name)
+		: _name(name)
+	{
+		_cr.start();
+	}
+
+	void stop(size_t ops)
+	{
+		_cr.stop();
+		report::add(_name, ops, _cr.get());
+	}
+
+private:
+	const char* _name;
+	chrono      _cr;
+};
+
+///
+/// Keeps the compiler from dropping the benchmarked work
+///
+static volatile size_t sink;
+
+///////////////////////////////////////////////////////////////////////////////
+static const size_t k_mobile_nodes = 100000;
+static const size_t k_codec_ops    = 1000000;
+
+static pmip::node_db* ndb;
+static std::string    ndb_json;
+
+static ll::mac_address mn_link_address(size_t i)
+{
+	char buf[32];
+
+	std::sprintf(buf, "02:00:%02x:%02x:%02x:%02x",
+	             uint(i >> 24) & 0xff, uint(i >> 16) & 0xff, uint(i >> 8) & 0xff, uint(i) & 0xff);
+	return ll::mac_address::from_string(buf);
+}
+
+static std::string mn_id(size_t i)
+{
+	return "mobile-node-" + boost::lexical_cast<std::string>(i) + "@opmip.example.org";
+}
+
+static void load_node_db()
+{
+	std::ostringstream os;
+	char               buf[64];
+
+	os << "{\n\"router-nodes\": [\n"
+	   << "{ \"id\": \"lma\", \"ip-address\": \"fd00::1\", \"ip-scope-id\": 0 },\n"
+	   << "{ \"id\": \"mag\", \"ip-address\": \"fd00::2\", \"ip-scope-id\": 0 }\n"
+	   << "],\n\"mobile-nodes\": [\n";
+	for (size_t i = 0; i < k_mobile_nodes; ++i) {
+		if (i)
+			os << ",\n";
+
+		std::sprintf(buf, "\"2001:db8:%x:%x::/64\"", uint(i >> 16), uint(i & 0xffff));
+		os << "{ \"id\": \"" << mn_id(i) << "\", \"ip-prefix\": [ " << buf << " ], "
+		   << "\"link-address\": [ \"" << mn_link_address(i) << "\" ], \"lma-id\": \"lma\" }";
+	}
+	os << "\n]\n}\n";
+
+	ndb_json = os.str();
+
+	std::istringstream is(ndb_json);
+
+	ndb = new pmip::node_db;
+	ndb->load(is);
+}
+
+///
+/// Lookup order spread over the whole table, the same for every run
+///
+static std::vector<uint32> lookup_order(size_t count)
+{
+	std::vector<uint32> order(count);
+
+	for (size_t i = 0; i < count; ++i)
+		order[i] = uint32((i * 2654435761u) % k_mobile_nodes);
+
+	return order;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void bench_bcache()
+{
+	std::vector<uint32> order = lookup_order(k_mobile_nodes);
+	pmip::bcache        bc;
+	size_t              found = 0;
+
+	measure insert("bcache.insert");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		bc.insert(new pmip::bcache_entry(*ndb->mobile_node_at(order[i])));
+	insert.stop(k_mobile_nodes);
+
+	measure find("bcache.find");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		found += bc.find(order[i]) != nullptr;
+	find.stop(k_mobile_nodes);
+
+	measure remove("bcache.remove");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		bc.remove(bc.find(order[i]));
+	remove.stop(k_mobile_nodes);
+
+	sink = found;
+}
+
+static void bench_bulist()
+{
+	std::vector<uint32>          order = lookup_order(k_mobile_nodes);
+	std::vector<ll::mac_address> macs;
+	pmip::bulist                 bl;
+	ip::address_v6               lma = ip::address_v6::from_string("fd00::1");
+	ll::mac_address              poa = ll::mac_address::from_string("02:ff:00:00:00:01");
+	size_t                       found = 0;
+
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		macs.push_back(mn_link_address(order[i]));
+
+	measure insert("bulist.insert");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		bl.insert(new pmip::bulist_entry(*ndb->mobile_node_at(order[i]), macs[i], lma, 1, poa));
+	insert.stop(k_mobile_nodes);
+
+	measure find("bulist.find");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		found += bl.find(order[i]) != nullptr;
+	find.stop(k_mobile_nodes);
+
+	measure find_mac("bulist.find_link_address");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		found += bl.find(macs[i]) != nullptr;
+	find_mac.stop(k_mobile_nodes);
+
+	measure remove("bulist.remove");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		bl.remove(bl.find(order[i]));
+	remove.stop(k_mobile_nodes);
+
+	sink = found;
+}
+
+static void bench_node_db()
+{
+	std::vector<uint32>          order = lookup_order(k_mobile_nodes);
+	std::vector<std::string>     ids;
+	std::vector<ll::mac_address> macs;
+	size_t                       found = 0;
+
+	for (size_t i = 0; i < k_mobile_nodes; ++i) {
+		ids.push_back(mn_id(order[i]));
+		macs.push_back(mn_link_address(order[i]));
+	}
+
+	measure by_id("node_db.find_mobile_node.id");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		found += ndb->find_mobile_node(ids[i]) ? 1 : 0;
+	by_id.stop(k_mobile_nodes);
+
+	measure by_mac("node_db.find_mobile_node.link_address");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		found += ndb->find_mobile_node(macs[i]) ? 1 : 0;
+	by_mac.stop(k_mobile_nodes);
+
+	pmip::node_db::router_key mag = pmip::node_db::router_key::from_string("fd00::2");
+
+	measure by_addr("node_db.find_router.address");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		found += ndb->find_router(mag) != nullptr;
+	by_addr.stop(k_mobile_nodes);
+
+	std::istringstream is(ndb_json);
+	pmip::node_db      json;
+
+	measure load_json("node_db.load");
+	json.load(is);
+	load_json.stop(k_mobile_nodes);
+
+	//
+	// The same lookups on the binary image, the first one of each mobile
+	// node builds it from its record
+	//
+	std::string   file = "micro-node_db.ndb";
+	std::ofstream out(file.c_str(), std::ios::binary);
+
+	ndb->write_image(out);
+	out.close();
+
+	pmip::node_db img;
+
+	measure load("node_db.load_image");
+	img.load_image(file);
+	load.stop(1);
+
+	measure first("node_db.image.find_mobile_node.first");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		found += img.find_mobile_node(ids[i]) ? 1 : 0;
+	first.stop(k_mobile_nodes);
+
+	measure img_by_id("node_db.image.find_mobile_node.id");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		found += img.find_mobile_node(ids[i]) ? 1 : 0;
+	img_by_id.stop(k_mobile_nodes);
+
+	measure img_by_mac("node_db.image.find_mobile_node.link_address");
+	for (size_t i = 0; i < k_mobile_nodes; ++i)
+		found += img.find_mobile_node(macs[i]) ? 1 : 0;
+	img_by_mac.stop(k_mobile_nodes);
+
+	std::remove(file.c_str());
+	sink = found;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void bench_mp_codec()
+{
+	pmip::proxy_binding_info pbinfo;
+	uchar                    pbu[pmip::k_mp_buffer_size];
+	uchar                    pba[pmip::k_mp_buffer_size];
+	size_t                   pbu_len = 0;
+	size_t                   pba_len = 0;
+	ip::mproto::endpoint     ep(ip::address_v6::from_string("fd00::2"));
+	size_t                   ok = 0;
+
+	pbinfo.id = mn_id(12345);
+	pbinfo.address = ep.address();
+	pbinfo.sequence = 1000;
+	pbinfo.lifetime = 3600;
+	pbinfo.handoff = ip::mproto::option::handoff::k_unknown;
+	pbinfo.link_type = ll::k_tech_ieee802_3;
+	pbinfo.link_address = mn_link_address(12345);
+	pbinfo.prefix_list.push_back(ip::prefix_v6::from_string("2001:db8:0:3039::/64"));
+
+	measure encode_pbu("mp.encode_pbu");
+	for (size_t i = 0; i < k_codec_ops; ++i)
+		pbu_len = pmip::encode_pbu(pbinfo, pbu);
+	encode_pbu.stop(k_codec_ops);
+
+	measure encode_pba("mp.encode_pba");
+	for (size_t i = 0; i < k_codec_ops; ++i)
+		pba_len = pmip::encode_pba(pbinfo, pba);
+	encode_pba.stop(k_codec_ops);
+
+	pmip::mp_template tpl;
+	uchar             copy[pmip::k_mp_buffer_size];
+
+	tpl.encode_pbu(pbinfo);
+	measure template_pbu("mp.template_pbu");
+	for (size_t i = 0; i < k_codec_ops; ++i) {
+		pbinfo.sequence = uint16(i);
+		sink = tpl.copy(pbinfo, copy);
+	}
+	template_pbu.stop(k_codec_ops);
+
+	measure parse_pbu("mp.parse_pbu");
+	for (size_t i = 0; i < k_codec_ops; ++i) {
+		pbinfo.clear();
+		ok += pmip::parse_pbu(ep, pbu, pbu_len, pbinfo);
+	}
+	parse_pbu.stop(k_codec_ops);
+
+	measure parse_pba("mp.parse_pba");
+	for (size_t i = 0; i < k_codec_ops; ++i) {
+		pbinfo.clear();
+		ok += pmip::parse_pba(ep, pba, pba_len, pbinfo);
+	}
+	parse_pba.stop(k_codec_ops);
+
+	if (ok != 2 * k_codec_ops)
+		std::cerr << "mobility message parse failed\n";
+	sink = ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void bench_checksum()
+{
+	static const size_t sizes[] = { 40, 64, 1500 };
+	static const char*  kernels[] = { "scalar", "sse2", "avx2" };
+
+	ip::checksum::kernel dispatched = ip::checksum::selected();
+	std::vector<uchar>   data(1501);
+	uint16               sum = 0;
+
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = uchar(i * 40503u);
+
+	//
+	// Every kernel the CPU runs, the odd length starts one byte off
+	//
+	for (uint k = ip::checksum::k_scalar; k <= ip::checksum::k_avx2; ++k) {
+		if (!ip::checksum::select(ip::checksum::kernel(k)))
+			continue;
+
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+			std::string name = "checksum.update." + boost::lexical_cast<std::string>(sizes[s]) + "." + kernels[k];
+			measure     m(name.c_str());
+
+			for (size_t i = 0; i < k_codec_ops; ++i) {
+				ip::checksum cs;
+
+				cs.update(&data[0], sizes[s]);
+				sum += cs.final();
+			}
+			m.stop(k_codec_ops);
+		}
+
+		std::string name = std::string("checksum.update.1499.") + kernels[k];
+		measure     m(name.c_str());
+
+		for (size_t i = 0; i < k_codec_ops; ++i) {
+			ip::checksum cs;
+
+			cs.update(&data[1], 1499);
+			sum += cs.final();
+		}
+		m.stop(k_codec_ops);
+	}
+	ip::checksum::select(dispatched);
+
+	measure adjust("checksum.adjust");
+	for (size_t i = 0; i < k_codec_ops; ++i)
+		sum = ip::checksum::adjust(sum, uint16(i), uint16(i + 1));
+	adjust.stop(k_codec_ops);
+
+	sink = sum;
+}
+
+static void bench_icmp_ra()
+{
+	pmip::router_advertisement_info rainfo;
+	size_t                          len = 0;
+
+	rainfo.device_id = 2;
+	rainfo.link_address = ll::mac_address::from_string("02:ff:00:00:00:01");
+	rainfo.dst_link_address = mn_link_address(12345);
+	rainfo.prefix_list.push_back(ip::prefix_v6::from_string("2001:db8:0:3039::/64"));
+	rainfo.source = ip::address_v6::from_string("fe80::1");
+	rainfo.destination = ip::address_v6::from_string("ff02::1");
+	rainfo.home_addr = ip::address_v6::from_string("2001:db8:0:3039::1");
+
+	measure m("icmp_ra_sender.construct");
+	for (size_t i = 0; i < k_codec_ops; ++i) {
+		pmip::icmp_ra_sender ras(rainfo);
+
+		len += boost::asio::buffer_size(ras._ipv6_pkt.cbuffer());
+	}
+	m.stop(k_codec_ops);
+
+	sink = len;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void bench_dhcp_v6()
+{
+	uchar              cid_data[] = { 0, 1, 0, 1, 0x1c, 0x39, 0xcf, 0x88, 0x02, 0x00, 0x00, 0x00, 0x30, 0x39 };
+	dhcp6::buffer_type cid(cid_data, cid_data + sizeof(cid_data));
+	ll::mac_address    poa = ll::mac_address::from_string("02:ff:00:00:00:01");
+	ip::address_v6     home = ip::address_v6::from_string("2001:db8:0:3039::1");
+	uchar              msg[1024];
+	size_t             len = 0;
+	size_t             ok = 0;
+
+	//
+	// A reply as addrconf_server makes them
+	//
+	measure gen("dhcp_v6.gen_reply");
+	for (size_t i = 0; i < k_codec_ops; ++i) {
+		dhcp6::buffer_type buff(msg, msg + sizeof(msg));
+		dhcp6::buffer_type state;
+
+		ok += dhcp6::gen_message(buff, dhcp6::reply, 0x123456, poa, cid)
+		      && dhcp6::gen_option_ia(buff, 1, 1800, 2880, &state)
+		      && dhcp6::gen_option_addr(buff, home, 3600, 3600, state);
+		len = buff.first - msg;
+	}
+	gen.stop(k_codec_ops);
+
+	//
+	// And parsed as addrconf_server parses the requests
+	//
+	measure parse("dhcp_v6.parse");
+	for (size_t i = 0; i < k_codec_ops; ++i) {
+		dhcp6::buffer_type buff(msg, msg + len);
+		dhcp6::buffer_type data;
+		dhcp6::opcode      op;
+		dhcp6::option      opt;
+		uint               tid;
+		ll::mac_address    mac;
+		uint32             id, t1, t2;
+
+		if (!dhcp6::parse_header(buff, op, tid))
+			continue;
+
+		while (dhcp6::buffer_size(buff)) {
+			if (!dhcp6::parse_option(buff, opt, data))
+				break;
+
+			if (opt == dhcp6::client_id || opt == dhcp6::server_id)
+				dhcp6::parse_option_duid(data, mac);
+			else if (opt == dhcp6::ia_na)
+				dhcp6::parse_option_ia(data, id, t1, t2);
+		}
+		ok += !dhcp6::buffer_size(buff);
+	}
+	parse.stop(k_codec_ops);
+
+	if (ok != 2 * k_codec_ops)
+		std::cerr << "dhcp_v6 gen/parse failed\n";
+	sink = ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static size_t make_mld_report(uchar* buffer, size_t records, size_t sources)
+{
+	size_t pos = 8;
+
+	std::fill(buffer, buffer + pos, 0);
+	buffer[0] = ip::icmp::mld_report::type_value;
+	buffer[6] = uchar(records >> 8);
+	buffer[7] = uchar(records);
+
+	for (size_t r = 0; r < records; ++r) {
+		ip::address_v6::bytes_type group = ip::address_v6::from_string("ff3e::8000:" + boost::lexical_cast<std::string>(r + 1)).to_bytes();
+
+		buffer[pos++] = uchar(r % 6 + 1); //record type
+		buffer[pos++] = 0;                //aux data length
+		buffer[pos++] = uchar(sources >> 8);
+		buffer[pos++] = uchar(sources);
+		pos = std::copy(group.begin(), group.end(), buffer + pos) - buffer;
+
+		for (size_t s = 0; s < sources; ++s) {
+			ip::address_v6::bytes_type src = ip::address_v6::from_string("2001:db8::" + boost::lexical_cast<std::string>(s + 1)).to_bytes();
+
+			pos = std::copy(src.begin(), src.end(), buffer + pos) - buffer;
+		}
+	}
+
+	return pos;
+}
+
+static void bench_mcast()
+{
+	uchar  mld[1460];
+	uchar  jp[1460];
+	size_t mld_len = make_mld_report(mld, 4, 2);
+	size_t jp_len = 0;
+	size_t ok = 0;
+
+	measure mld_parse("icmp_mld_report_parser.parse");
+	for (size_t i = 0; i < k_codec_ops; ++i) {
+		net::ip::icmp_mld_report_parser parser;
+
+		ok += parser.parse(mld, mld_len) && parser.includes.size() == 1;
+	}
+	mld_parse.stop(k_codec_ops);
+
+	net::ip::join_prune_msg msg;
+
+	msg.uplink = ip::address_v6::from_string("fe80::2");
+	for (size_t g = 0; g < 4; ++g) {
+		net::ip::join_prune_msg::mcast_group mg;
+
+		mg.group = ip::address_v6::from_string("ff3e::8000:" + boost::lexical_cast<std::string>(g + 1));
+		mg.joins.push_back(ip::address_v6::from_string("2001:db8::1"));
+		mg.prunes.push_back(ip::address_v6::from_string("2001:db8::2"));
+		msg.mcast_groups.push_back(mg);
+	}
+
+	measure jp_gen("join_prune_msg.gen");
+	for (size_t i = 0; i < k_codec_ops; ++i)
+		jp_len = msg.gen(jp, sizeof(jp));
+	jp_gen.stop(k_codec_ops);
+
+	measure jp_parse("join_prune_msg.parse");
+	for (size_t i = 0; i < k_codec_ops; ++i) {
+		net::ip::join_prune_msg parsed;
+
+		ok += parsed.parse(jp, jp_len) && parsed.mcast_groups.size() == 4;
+	}
+	jp_parse.stop(k_codec_ops);
+
+	if (ok != 2 * k_codec_ops)
+		std::cerr << "multicast message parse failed\n";
+	sink = ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+struct benchmark {
+	const char* name;
+	void      (*run)();
+};
+
+static const benchmark k_benchmarks[] = {
+	{ "bcache",         bench_bcache },
+	{ "bulist",         bench_bulist },
+	{ "node_db",        bench_node_db },
+	{ "mp",             bench_mp_codec },
+	{ "checksum",       bench_checksum },
+	{ "icmp_ra_sender", bench_icmp_ra },
+	{ "dhcp_v6",        bench_dhcp_v6 },
+	{ "mcast",          bench_mcast },
+};
+
+static bool selected(const std::vector<std::string>& filters, const char* name)
+{
+	if (filters.empty())
+		return true;
+
+	for (std::vector<std::string>::const_iterator i = filters.begin(), e = filters.end(); i != e; ++i)
+		if (*i == name)
+			return true;
+
+	return false;
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> filters;
+	size_t                   repeat = 5;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!std::strcmp(argv[i], "--repeat") && i + 1 < argc) {
+			repeat = std::max(boost::lexical_cast<size_t>(argv[++i]), size_t(1));
+
+		} else if (argv[i][0] == '-') {
+			std::cerr << "usage: " << argv[0] << " [--repeat N] [benchmark...]\n\nbenchmarks:";
+			for (size_t b = 0; b < sizeof(k_benchmarks) / sizeof(k_benchmarks[0]); ++b)
+				std::cerr << ' ' << k_benchmarks[b].name;
+			std::cerr << std::endl;
+			return 1;
+
+		} else {
+			filters.push_back(argv[i]);
+		}
+	}
+
+	//
+	// The node database logs every node it loads
+	//
+	std::cout.setstate(std::ios::badbit);
+	load_node_db();
+	std::cout.clear();
+
+	for (size_t b = 0; b < sizeof(k_benchmarks) / sizeof(k_benchmarks[0]); ++b)
+		if (selected(filters, k_benchmarks[b].name))
+			for (size_t r = 0; r < repeat; ++r)
+				k_benchmarks[b].run();
+
+	report::print(std::cout, repeat);
+	delete ndb;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,229 @@
+//=============================================================================
+// Brief   : Open Addressing Hash Index
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_HASH_INDEX__HPP_
+#define OPMIP_HASH_INDEX__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/utility.hpp>
+#include <functional>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Non-owning index of T objects by the key returned from KeyOf. Slots are
+/// kept in a single flat array with linear probing and hold the full hash
+/// of the key along with the object pointer, so the object itself is only
+/// touched, and the keys compared, when the stored hashes match. Removal
+/// shifts back the following entries, there are no tombstones.
+///
+template<class T, class Key, const Key& (T::* KeyOf)() const,
+         class Hash = boost::hash<Key>, class Equal = std::equal_to<Key> >
+class hash_index : boost::noncopyable {
+	struct slot {
+		slot() : hash(0), value(nullptr)
+		{ }
+
+		std::size_t hash;
+		T*          value;
+	};
+
+	typedef std::vector<slot> slot_list;
+
+	static const std::size_t k_min_capacity = 16;
+
+public:
+	typedef T           value_type;
+	typedef Key         key_type;
+	typedef std::size_t size_type;
+
+public:
+	hash_index()
+		: _size(0), _bits(0)
+	{ }
+
+	static std::size_t hash(const key_type& key)
+	{
+		return Hash()(key);
+	}
+
+	bool insert_unique(T& value)
+	{
+		return insert_unique(value, hash((value.*KeyOf)()));
+	}
+
+	bool insert_unique(T& value, std::size_t h)
+	{
+		if ((_size + 1) * 4 > _slots.size() * 3)
+			rehash(_slots.empty() ? k_min_capacity : _slots.size() * 2);
+
+		const key_type& key = (value.*KeyOf)();
+		std::size_t     mask = _slots.size() - 1;
+
+		for (std::size_t i = bucket(h); ; i = (i + 1) & mask) {
+			slot& s = _slots[i];
+
+			if (!s.value) {
+				s.hash = h;
+				s.value = &value;
+				++_size;
+				return true;
+			}
+
+			if (s.hash == h && Equal()((s.value->*KeyOf)(), key))
+				return false;
+		}
+	}
+
+	T* find(const key_type& key) const
+	{
+		return find(key, hash(key));
+	}
+
+	T* find(const key_type& key, std::size_t h) const
+	{
+		if (!_size)
+			return nullptr;
+
+		std::size_t mask = _slots.size() - 1;
+
+		for (std::size_t i = bucket(h); ; i = (i + 1) & mask) {
+			const slot& s = _slots[i];
+
+			if (!s.value)
+				return nullptr;
+
+			if (s.hash == h && Equal()((s.value->*KeyOf)(), key))
+				return s.value;
+		}
+	}
+
+	bool erase(T& value)
+	{
+		if (!_size)
+			return false;
+
+		std::size_t mask = _slots.size() - 1;
+		std::size_t i = bucket(hash((value.*KeyOf)()));
+
+		while (_slots[i].value != &value) {
+			if (!_slots[i].value)
+				return false;
+			i = (i + 1) & mask;
+		}
+
+		//
+		// Shift back the entries of the probe sequence that follows, unless
+		// they already sit between their home bucket and the freed slot
+		//
+		for (std::size_t j = (i + 1) & mask; _slots[j].value; j = (j + 1) & mask) {
+			std::size_t home = bucket(_slots[j].hash);
+
+			if (((j - home) & mask) >= ((j - i) & mask)) {
+				_slots[i] = _slots[j];
+				i = j;
+			}
+		}
+
+		_slots[i] = slot();
+		--_size;
+		return true;
+	}
+
+	template<class Disposer>
+	void clear_and_dispose(Disposer disposer)
+	{
+		for (typename slot_list::iterator i = _slots.begin(), e = _slots.end(); i != e; ++i) {
+			if (i->value) {
+				T* value = i->value;
+
+				*i = slot();
+				disposer(value);
+			}
+		}
+
+		_size = 0;
+	}
+
+	void clear()
+	{
+		slot_list().swap(_slots);
+		_size = 0;
+	}
+
+	void reserve(size_type n)
+	{
+		std::size_t capacity = k_min_capacity;
+
+		while (capacity * 3 < n * 4)
+			capacity *= 2;
+
+		if (capacity > _slots.size())
+			rehash(capacity);
+	}
+
+	size_type size() const  { return _size; }
+	bool      empty() const { return !_size; }
+
+private:
+	std::size_t bucket(std::size_t h) const
+	{
+		//
+		// Fibonacci hashing, spreads weak hashes over the whole table
+		//
+		return std::size_t(uint64(h) * 0x9e3779b97f4a7c15ULL >> (64 - _bits)) & (_slots.size() - 1);
+	}
+
+	void rehash(std::size_t capacity)
+	{
+		slot_list slots(capacity);
+
+		_slots.swap(slots);
+		for (_bits = 0; (std::size_t(1) << _bits) < capacity; ++_bits)
+			;
+
+		std::size_t mask = capacity - 1;
+
+		for (typename slot_list::const_iterator i = slots.begin(), e = slots.end(); i != e; ++i) {
+			if (!i->value)
+				continue;
+
+			std::size_t j = bucket(i->hash);
+
+			while (_slots[j].value)
+				j = (j + 1) & mask;
+
+			_slots[j] = *i;
+		}
+	}
+
+private:
+	slot_list _slots;
+	size_type _size;
+	uint      _bits;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_HASH_INDEX__HPP_ */
@@ -4,8 +4,8 @@
 // ----------------------------------------------------------------------------
 // OPMIP - Open Proxy Mobile IP
 //
-// Copyright (C) 2010 Universidade de Aveiro
-// Copyrigth (C) 2010 Instituto de Telecomunicações - Pólo de Aveiro
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
 //
 // This software is distributed under a license. The full license
 // agreement can be found in the file LICENSE in this distribution.
@@ -20,42 +20,52 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 #include <opmip/base.hpp>
-#include <opmip/exception.hpp>
-#include <boost/system/error_code.hpp>
+#include <opmip/ip/address.hpp>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace ip {
 
 ///////////////////////////////////////////////////////////////////////////////
+///
+/// RFC 1071 Internet checksum. Data can be added in chunks of any length,
+/// the sum is kept as if the chunks were contiguous. The words are summed
+/// in memory byte order, as the result is stored back in the same order.
+///
+/// The sum kernel is picked at runtime from the CPU features, SSE2 and AVX2
+/// on x86, with a portable fallback everywhere else.
+///
 class checksum {
+public:
+	enum kernel {
+		k_scalar,
+		k_sse2,
+		k_avx2
+	};
+
 public:
 	checksum()
-		: _sum(0)
+		: _sum(0), _odd(false)
 	{ }
 
 	void update(const void* data, size_t len)
 	{
-		if (len % 2)
-			OPMIP_THROW_EXCEPTION(exception(boost::system::errc::invalid_argument,
-			                                boost::system::generic_category(),
-			                                __func__));
-
-		update(reinterpret_cast<const uint16*>(data), len / 2);
-	}
-
-	void update(const uint16* data, size_t len)
-	{
-		uint32 sum = _sum;
+		uint32 sum = partial(data, len);
 
-		for (size_t i = 0; i < len; ++i)
-			sum += data[i];
+		//
+		// A chunk after an odd length one starts at the second byte of a word
+		//
+		if (_odd)
+			sum = ((sum & 0xff) << 8) | (sum >> 8);
 
-		while (sum >> 16)
-			sum = (sum & 0xffff) + (sum >> 16);
-
-		_sum = static_cast<uint16>(sum);
+		_sum = fold(_sum + sum);
+		_odd ^= len & 1;
 	}
 
+	///
+	/// Adds the IPv6 pseudo header of RFC 2460, section 8.1
+	///
+	void update_pseudo_header(const address_v6& src, const address_v6& dst, uint32 len, uint8 next_header);
+
 	uint16 final() const
 	{
 		return ~_sum;
@@ -64,12 +74,51 @@ public:
 	void clear()
 	{
 		_sum = 0;
+		_odd = false;
+	}
+
+	///
+	/// RFC 1624 incremental update of checksum cs, when a 16 bit word of the
+	/// checksummed data changes from old_value to new_value. The values are
+	/// in the same byte order as the data.
+	///
+	static uint16 adjust(uint16 cs, uint16 old_value, uint16 new_value)
+	{
+		return ~uint16(fold(uint16(~cs) + uint16(~old_value) + uint32(new_value)));
 	}
 
+	///
+	/// As above, for a range of len bytes at an even offset of the data
+	///
+	static uint16 adjust(uint16 cs, const void* old_data, const void* new_data, size_t len)
+	{
+		return ~uint16(fold(uint16(~cs) + uint16(~partial(old_data, len)) + partial(new_data, len)));
+	}
+
+	static uint16 partial(const void* data, size_t len);
+
+	static bool   select(kernel k);
+	static kernel selected();
+
 private:
-	uint16 _sum;
+	static uint32 fold(uint32 sum)
+	{
+		sum = (sum & 0xffff) + (sum >> 16);
+		return (sum & 0xffff) + (sum >> 16);
+	}
+
+private:
+	uint32 _sum;
+	bool   _odd;
 };
 
+///
+/// Checksum of an upper layer packet carried over IPv6, with the pseudo
+/// header. The checksum field of the packet must be zero.
+///
+uint16 ipv6_checksum(const address_v6& src, const address_v6& dst, uint8 next_header,
+                     const void* data, size_t len);
+
 ///////////////////////////////////////////////////////////////////////////////
 } /* namespace ip */ } /* namespace opmip */
 
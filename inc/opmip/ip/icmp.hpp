@@ -61,8 +61,9 @@ public:
 		: _type(type), _code(code), _checksum(0)
 	{ }
 
-	uint8 type() const { return _type; }
-	uint8 code() const { return _code; }
+	uint8  type() const     { return _type; }
+	uint8  code() const     { return _code; }
+	uint16 checksum() const { return _checksum; }
 
 	void checksum(uint16 csum) { _checksum = csum; }
 
@@ -217,7 +218,7 @@ struct icmp::mld_report : icmp::header {
 	struct mcast_address {
 		mcast_address* next()
 		{
-			size_t offset = align_to<4>(sizeof(*this) + aux_data_len + sizeof(address_v6::bytes_type) * source_count);
+			size_t offset = align_to<4>(sizeof(*this) + aux_data_len + sizeof(address_v6::bytes_type) * ntohs(source_count));
 
 			return offset_cast<mcast_address*>(this, offset);
 		}
@@ -0,0 +1,80 @@
+//=============================================================================
+// Brief   : Streaming JSON Reader
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_JSON_READER__HPP_
+#define OPMIP_JSON_READER__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Pull parser over a JSON text in memory. The caller walks the document
+/// and reads the values it wants, nothing is built for the rest. Strings,
+/// numbers and literals are all read as text, like the property tree does.
+/// Errors throw an opmip::exception with the line they were found at.
+///
+/// Reading can start at any value, with seek, so independent values of
+/// the same text can be read concurrently by different readers.
+///
+class json_reader {
+public:
+	json_reader(const char* begin, const char* end);
+
+	void begin_object();
+	bool next_member(std::string& name); ///False, and the object is left, at its end
+	void begin_array();
+	bool next_element();                 ///False, and the array is left, at its end
+
+	bool at_array();
+	bool at_string();
+
+	///
+	/// Reads a string, number or literal as text
+	///
+	void value(std::string& str);
+	void skip();
+
+	const char* position() const { return _pos; }
+	void        seek(const char* pos);
+
+	void error(const std::string& what) const;
+
+private:
+	void skip_space();
+	void expect(char c);
+	bool next(char close);
+	void string(std::string& str);
+	void skip_string();
+
+private:
+	const char*       _begin;
+	const char*       _end;
+	const char*       _pos;
+	std::vector<bool> _first;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_JSON_READER__HPP_ */
@@ -0,0 +1,469 @@
+//=============================================================================
+// Brief   : Asynchronous Logging Backend
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_LOG_BACKEND__HPP_
+#define OPMIP_LOG_BACKEND__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/ptime.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/utility.hpp>
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <new>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+namespace detail {
+
+///////////////////////////////////////////////////////////////////////////////
+struct log_record {
+	uint32        length; ///Record size, including the arguments, 0 marks the ring wrap
+	uint32        level;
+	ptime         time;
+	const char*   name;
+	std::ostream* sink;
+	void        (*format)(std::ostream& os, void* args); ///Prints and destroys the arguments
+};
+
+static const size_t k_log_record_align = 16;
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Single producer, single consumer ring of variable size records. The
+/// producer is the thread that owns the ring, the consumer the backend
+/// thread. A record that does not fit is dropped and counted.
+///
+/// The ring is released by both sides, the owner thread when it exits and
+/// the backend when it goes away. The first to release it marks it, the
+/// second frees it.
+///
+class log_ring : boost::noncopyable {
+public:
+	log_ring(size_t capacity)
+		: _data(new uchar[capacity]), _mask(capacity - 1), _head(0), _tail(0), _dropped(0), _released(false)
+	{
+		BOOST_ASSERT(!(capacity & _mask));
+	}
+
+	~log_ring()
+	{
+		delete [] _data;
+	}
+
+	log_record* reserve(size_t length, size_t& next)
+	{
+		size_t head = _head;
+		size_t tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+		size_t capacity = _mask + 1;
+		size_t room = capacity - (head & _mask);
+		size_t skip = (room < length) ? room : 0;
+
+		if (capacity - (head - tail) < length + skip) {
+			__atomic_store_n(&_dropped, _dropped + 1, __ATOMIC_RELAXED);
+			return nullptr;
+		}
+
+		if (skip) {
+			reinterpret_cast<log_record*>(_data + (head & _mask))->length = 0;
+			head += skip;
+		}
+
+		next = head + length;
+		return reinterpret_cast<log_record*>(_data + (head & _mask));
+	}
+
+	void commit(size_t next)
+	{
+		__atomic_store_n(&_head, next, __ATOMIC_RELEASE);
+	}
+
+	log_record* front()
+	{
+		size_t head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+
+		while (_tail != head) {
+			log_record* rec = reinterpret_cast<log_record*>(_data + (_tail & _mask));
+
+			if (rec->length)
+				return rec;
+
+			__atomic_store_n(&_tail, _tail + (_mask + 1) - (_tail & _mask), __ATOMIC_RELEASE);
+		}
+
+		return nullptr;
+	}
+
+	bool empty() const
+	{
+		return _tail == __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+	}
+
+	void pop(const log_record* rec)
+	{
+		__atomic_store_n(&_tail, _tail + rec->length, __ATOMIC_RELEASE);
+	}
+
+	uint64 dropped() const { return __atomic_load_n(&_dropped, __ATOMIC_RELAXED); }
+
+	///
+	/// Returns true when the other side released the ring first
+	///
+	bool release()  { return __atomic_exchange_n(&_released, true, __ATOMIC_ACQ_REL); }
+	bool released() const { return __atomic_load_n(&_released, __ATOMIC_ACQUIRE); }
+
+private:
+	uchar* _data;
+	size_t _mask;
+	size_t _head;
+	size_t _tail;
+	uint64 _dropped;
+	bool   _released;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// String argument copied into the record itself, so logging a string does
+/// not touch the heap. A record with a string longer than k_log_string_size
+/// is not queued, the logger formats it synchronously instead.
+///
+static const size_t k_log_string_size = 120;
+
+class log_string {
+public:
+	log_string(const char* str)
+		: _size(std::strlen(str)), _length(std::min(_size, k_log_string_size))
+	{
+		std::memcpy(_data, str, _length);
+	}
+
+	log_string(const std::string& str)
+		: _size(str.length()), _length(std::min(_size, k_log_string_size))
+	{
+		std::memcpy(_data, str.data(), _length);
+	}
+
+	bool fits() const { return _size == _length; }
+
+	friend std::ostream& operator<<(std::ostream& os, const log_string& str)
+	{
+		return os.write(str._data, str._length);
+	}
+
+private:
+	size_t _size;
+	size_t _length;
+	char   _data[k_log_string_size];
+};
+
+template<class T>
+inline bool log_fits(const T&)
+{
+	return true;
+}
+
+inline bool log_fits(const log_string& str)
+{
+	return str.fits();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// How each argument is kept until the backend thread formats it. Char
+/// arrays are taken as string literals and only their address is kept, any
+/// other string is copied into a log_string. Everything else is copied as
+/// is.
+///
+template<class T>
+struct log_arg { typedef T type; };
+
+template<size_t N>
+struct log_arg<char[N]> { typedef const char* type; };
+
+template<>
+struct log_arg<char*> { typedef log_string type; };
+
+template<>
+struct log_arg<const char*> { typedef log_string type; };
+
+template<>
+struct log_arg<std::string> { typedef log_string type; };
+
+#ifndef BOOST_NO_VARIADIC_TEMPLATES
+template<class ...T>
+struct log_args;
+
+template<>
+struct log_args<> {
+	bool fits() const
+	{
+		return true;
+	}
+
+	void print(std::ostream&) const
+	{ }
+};
+
+template<class T, class ...R>
+struct log_args<T, R...> {
+	log_args(const T& arg, const R& ...args)
+		: head(arg), tail(args...)
+	{ }
+
+	bool fits() const
+	{
+		return log_fits(head) && tail.fits();
+	}
+
+	void print(std::ostream& os) const
+	{
+		os << head;
+		tail.print(os);
+	}
+
+	typename log_arg<T>::type head;
+	log_args<R...>            tail;
+};
+#else
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Without variadic templates, the arguments past the last one given are
+/// log_nil, which prints nothing
+///
+struct log_nil { };
+
+inline std::ostream& operator<<(std::ostream& os, const log_nil&)
+{
+	return os;
+}
+
+template<class T1 = log_nil, class T2 = log_nil, class T3 = log_nil, class T4 = log_nil, class T5 = log_nil,
+         class T6 = log_nil, class T7 = log_nil, class T8 = log_nil, class T9 = log_nil, class T10 = log_nil,
+         class T11 = log_nil>
+struct log_args {
+	log_args(const T1& arg1, const T2& arg2 = T2(), const T3& arg3 = T3(), const T4& arg4 = T4(),
+	         const T5& arg5 = T5(), const T6& arg6 = T6(), const T7& arg7 = T7(), const T8& arg8 = T8(),
+	         const T9& arg9 = T9(), const T10& arg10 = T10(), const T11& arg11 = T11())
+		: head(arg1), tail(arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10, arg11)
+	{ }
+
+	bool fits() const
+	{
+		return log_fits(head) && tail.fits();
+	}
+
+	void print(std::ostream& os) const
+	{
+		os << head;
+		tail.print(os);
+	}
+
+	typename log_arg<T1>::type                       head;
+	log_args<T2, T3, T4, T5, T6, T7, T8, T9, T10, T11> tail;
+};
+
+template<>
+struct log_args<> {
+	log_args(const log_nil& = log_nil(), const log_nil& = log_nil(), const log_nil& = log_nil(),
+	         const log_nil& = log_nil(), const log_nil& = log_nil(), const log_nil& = log_nil(),
+	         const log_nil& = log_nil(), const log_nil& = log_nil(), const log_nil& = log_nil(),
+	         const log_nil& = log_nil(), const log_nil& = log_nil())
+	{ }
+
+	bool fits() const
+	{
+		return true;
+	}
+
+	void print(std::ostream&) const
+	{ }
+};
+#endif
+
+template<class Args>
+void log_format(std::ostream& os, void* args)
+{
+	Args* tmp = static_cast<Args*>(args);
+
+	tmp->print(os);
+	tmp->~Args();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace detail */
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Moves log formatting and output off the calling threads. While a backend
+/// exists, loggers push a compact record with the arguments, unformatted,
+/// into a ring owned by the calling thread, and the backend thread formats
+/// and writes them in timestamp order. Records that do not fit the ring are
+/// dropped rather than blocking the caller, the backend reports how many.
+/// Only one backend may exist at a time, it drains every ring when
+/// destroyed. The ring of a thread that exits is freed once drained.
+///
+/// The backend thread sleeps while every ring is empty. It flags itself
+/// idle before looking at the rings a last time, and producers wake it when
+/// they find the flag set after committing a record.
+///
+class log_backend : boost::noncopyable {
+public:
+	static const size_t k_ring_size = 1 << 18; ///Per thread ring size (bytes)
+
+public:
+	log_backend();
+	~log_backend();
+
+	uint64 dropped() const;
+
+	static bool active() { return __atomic_load_n(&_instance, __ATOMIC_ACQUIRE); }
+
+#ifndef BOOST_NO_VARIADIC_TEMPLATES
+	template<class ...T>
+	static bool push(uint level, const char* name, std::ostream& sink, const T& ...args);
+#else
+	template<class Args>
+	static bool push(uint level, const char* name, std::ostream& sink, const Args& args);
+#endif
+
+private:
+	template<class Args>
+	void* reserve(uint level, const char* name, std::ostream& sink, detail::log_ring*& rg, size_t& next);
+	void  commit(detail::log_ring& rg, size_t next);
+
+	detail::log_ring& ring();
+	void              run();
+	bool              drain();
+	bool              pending() const;
+	void              wake();
+
+	static void release_ring(detail::log_ring* rg);
+
+private:
+	static log_backend* _instance;
+
+	boost::thread_specific_ptr<detail::log_ring> _local;
+	mutable boost::mutex                         _mutex;
+	boost::ptr_vector<detail::log_ring>          _rings;
+	std::vector<uint64>                          _reported;
+	uint64                                       _released_dropped; ///Dropped by the rings freed so far
+	bool                                         _stop;
+	bool                                         _idle;
+	boost::mutex                                 _wake_mutex;
+	boost::condition_variable                    _wake;
+	boost::thread                                _thread;
+};
+
+template<class Args>
+inline void* log_backend::reserve(uint level, const char* name, std::ostream& sink, detail::log_ring*& rg,
+                                  size_t& next)
+{
+	const size_t hlen = align_to_<detail::k_log_record_align, sizeof(detail::log_record)>::value;
+	const size_t len  = hlen + align_to_<detail::k_log_record_align, sizeof(Args)>::value;
+
+	rg = &ring();
+
+	detail::log_record* rec = rg->reserve(len, next);
+
+	if (!rec)
+		return nullptr;
+
+	rec->length = len;
+	rec->level = level;
+	rec->time = ptime::get_monotonic();
+	rec->name = name;
+	rec->sink = &sink;
+	rec->format = &detail::log_format<Args>;
+
+	return reinterpret_cast<uchar*>(rec) + hlen;
+}
+
+inline void log_backend::commit(detail::log_ring& rg, size_t next)
+{
+	rg.commit(next);
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&_idle, __ATOMIC_RELAXED))
+		wake();
+}
+
+#ifndef BOOST_NO_VARIADIC_TEMPLATES
+template<class ...T>
+inline bool log_backend::push(uint level, const char* name, std::ostream& sink, const T& ...args)
+{
+	typedef detail::log_args<T...> args_type;
+
+	log_backend* self = __atomic_load_n(&_instance, __ATOMIC_ACQUIRE);
+	if (!self)
+		return false;
+
+	detail::log_ring* rg;
+	size_t            next;
+	void*             buf = self->reserve<args_type>(level, name, sink, rg, next);
+
+	if (buf) {
+		args_type* tmp = new(buf) args_type(args...);
+
+		//
+		// Left uncommitted, the space is taken again by the next record
+		//
+		if (!tmp->fits()) {
+			tmp->~args_type();
+			return false;
+		}
+
+		self->commit(*rg, next);
+	}
+
+	return true;
+}
+#else
+template<class Args>
+inline bool log_backend::push(uint level, const char* name, std::ostream& sink, const Args& args)
+{
+	log_backend* self = __atomic_load_n(&_instance, __ATOMIC_ACQUIRE);
+	if (!self || !args.fits())
+		return false;
+
+	detail::log_ring* rg;
+	size_t            next;
+	void*             buf = self->reserve<Args>(level, name, sink, rg, next);
+
+	if (buf) {
+		new(buf) Args(args);
+		self->commit(*rg, next);
+	}
+
+	return true;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_LOG_BACKEND__HPP_ */
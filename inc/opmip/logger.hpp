@@ -20,13 +20,27 @@
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #include <opmip/base.hpp>
+#include <opmip/log_backend.hpp>
 #include <boost/utility.hpp>
 #include <ostream>
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Highest log level compiled in, calls above it are removed by the compiler. Note that the arguments are
+/// still evaluated when they have side effects.
+///
+#ifndef OPMIP_LOG_LEVEL
+#	define OPMIP_LOG_LEVEL (~0u)
+#endif
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
 namespace opmip {
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Writes the arguments of each call as one line, prefixed by the logger name. While a log_backend exists
+/// the line is formatted and written by the backend thread, otherwise it is written right away.
+///
 class logger : boost::noncopyable {
 #ifndef BOOST_NO_VARIADIC_TEMPLATES
 	template<class T, class ...Args>
@@ -57,7 +71,10 @@ public:
 	template<class ...T>
 	void operator()(uint level, const T& ...args)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::push(level, _name, _sink, args...))
 			return;
 
 		_sink << _name << ": ";
@@ -68,7 +85,11 @@ public:
 	template<class T1>
 	void operator()(uint level, const T1& arg1)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1>(arg1)))
 			return;
 
 		_sink << _name << ": " << arg1 << std::endl;
@@ -78,7 +99,11 @@ public:
 	template<class T1, class T2>
 	void operator()(uint level, const T1& arg1, const T2& arg2)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1, T2>(arg1, arg2)))
 			return;
 
 		_sink << _name << ": " << arg1 << arg2 << std::endl;
@@ -88,7 +113,11 @@ public:
 	template<class T1, class T2, class T3>
 	void operator()(uint level, const T1& arg1, const T2& arg2, const T3& arg3)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1, T2, T3>(arg1, arg2, arg3)))
 			return;
 
 		_sink << _name << ": " << arg1 << arg2 << arg3 << std::endl;
@@ -98,7 +127,11 @@ public:
 	template<class T1, class T2, class T3, class T4>
 	void operator()(uint level, const T1& arg1, const T2& arg2, const T3& arg3, const T4& arg4)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1, T2, T3, T4>(arg1, arg2, arg3, arg4)))
 			return;
 
 		_sink << _name << ": " << arg1 << arg2 << arg3 << arg4 << std::endl;
@@ -108,7 +141,11 @@ public:
 	template<class T1, class T2, class T3, class T4, class T5>
 	void operator()(uint level, const T1& arg1, const T2& arg2, const T3& arg3, const T4& arg4, const T5& arg5)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1, T2, T3, T4, T5>(arg1, arg2, arg3, arg4, arg5)))
 			return;
 
 		_sink << _name << ": " << arg1 << arg2 << arg3 << arg4 << arg5 << std::endl;
@@ -118,7 +155,11 @@ public:
 	template<class T1, class T2, class T3, class T4, class T5, class T6>
 	void operator()(uint level, const T1& arg1, const T2& arg2, const T3& arg3, const T4& arg4, const T5& arg5, const T6& arg6)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1, T2, T3, T4, T5, T6>(arg1, arg2, arg3, arg4, arg5, arg6)))
 			return;
 
 		_sink << _name << ": " << arg1 << arg2 << arg3 << arg4 << arg5 << arg6 << std::endl;
@@ -128,7 +169,11 @@ public:
 	template<class T1, class T2, class T3, class T4, class T5, class T6, class T7>
 	void operator()(uint level, const T1& arg1, const T2& arg2, const T3& arg3, const T4& arg4, const T5& arg5, const T6& arg6, const T7& arg7)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1, T2, T3, T4, T5, T6, T7>(arg1, arg2, arg3, arg4, arg5, arg6, arg7)))
 			return;
 
 		_sink << _name << ": " << arg1 << arg2 << arg3 << arg4 << arg5 << arg6 << arg7 << std::endl;
@@ -138,7 +183,11 @@ public:
 	template<class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8>
 	void operator()(uint level, const T1& arg1, const T2& arg2, const T3& arg3, const T4& arg4, const T5& arg5, const T6& arg6, const T7& arg7, const T8& arg8)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1, T2, T3, T4, T5, T6, T7, T8>(arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8)))
 			return;
 
 		_sink << _name << ": " << arg1 << arg2 << arg3 << arg4 << arg5 << arg6 << arg7 << arg8 << std::endl;
@@ -148,7 +197,11 @@ public:
 	template<class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9>
 	void operator()(uint level, const T1& arg1, const T2& arg2, const T3& arg3, const T4& arg4, const T5& arg5, const T6& arg6, const T7& arg7, const T8& arg8, const T9& arg9)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1, T2, T3, T4, T5, T6, T7, T8, T9>(arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9)))
 			return;
 
 		_sink << _name << ": " << arg1 << arg2 << arg3 << arg4 << arg5 << arg6 << arg7 << arg8 << arg9 << std::endl;
@@ -158,7 +211,11 @@ public:
 	template<class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10>
 	void operator()(uint level, const T1& arg1, const T2& arg2, const T3& arg3, const T4& arg4, const T5& arg5, const T6& arg6, const T7& arg7, const T8& arg8, const T9& arg9, const T10& arg10)
 	{
-		if ((level > _level) || !_sink)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1, T2, T3, T4, T5, T6, T7, T8, T9, T10>(arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10)))
 			return;
 
 		_sink << _name << ": " << arg1 << arg2 << arg3 << arg4 << arg5 << arg6 << arg7 << arg8 << arg9 << arg10 << std::endl;
@@ -168,7 +225,11 @@ public:
 	template<class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10, class T11>
 	void operator()(uint level, const T1& arg1, const T2& arg2, const T3& arg3, const T4& arg4, const T5& arg5, const T6& arg6, const T7& arg7, const T8& arg8, const T9& arg9, const T10& arg10, const T11& arg11)
 	{
-		if (level > _level)
+		if ((level > OPMIP_LOG_LEVEL) || (level > _level) || !_sink)
+			return;
+
+		if (log_backend::active()
+		    && log_backend::push(level, _name, _sink, detail::log_args<T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11>(arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10, arg11)))
 			return;
 
 		_sink << _name << ": " << arg1 << arg2 << arg3 << arg4 << arg5 << arg6 << arg7 << arg8 << arg9 << arg10 << arg11 << std::endl;
@@ -0,0 +1,168 @@
+//=============================================================================
+// Brief   : Performance Metrics
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_METRICS__HPP_
+#define OPMIP_METRICS__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/ptime.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace metrics {
+
+///////////////////////////////////////////////////////////////////////////////
+class counter : boost::noncopyable {
+public:
+	counter()
+		: _value(0)
+	{ }
+
+	void inc(uint64 n = 1) { __atomic_fetch_add(&_value, n, __ATOMIC_RELAXED); }
+
+	uint64 value() const { return __atomic_load_n(&_value, __ATOMIC_RELAXED); }
+
+private:
+	uint64 _value;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+class gauge : boost::noncopyable {
+public:
+	gauge()
+		: _value(0)
+	{ }
+
+	void set(sint64 n) { __atomic_store_n(&_value, n, __ATOMIC_RELAXED); }
+	void add(sint64 n) { __atomic_fetch_add(&_value, n, __ATOMIC_RELAXED); }
+	void inc()         { add(1); }
+	void dec()         { add(-1); }
+
+	sint64 value() const { return __atomic_load_n(&_value, __ATOMIC_RELAXED); }
+
+private:
+	sint64 _value;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Latency histogram in microseconds with HDR style buckets: values are
+/// kept exact below 2^k_sub_bits and with k_sub_bits bits of precision
+/// above, a relative error under 12.5%. Recording is a couple of relaxed
+/// atomic adds, so it is safe from any thread.
+///
+class histogram : boost::noncopyable {
+public:
+	static const uint k_sub_bits = 3;
+	static const uint k_sub_count = 1 << k_sub_bits;
+	static const uint k_max_bits = 40; ///Values from 2^40 us (~12 days) up are clamped
+	static const uint k_buckets = (k_max_bits - k_sub_bits + 1) * k_sub_count;
+
+public:
+	histogram();
+
+	void record(uint64 usec)
+	{
+		__atomic_fetch_add(&_buckets[bucket(usec)], 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&_sum, usec, __ATOMIC_RELAXED);
+	}
+
+	void record(const ptime& tm)
+	{
+		record(uint64(tm.seconds()) * 1000000 + tm.nanoseconds() / 1000);
+	}
+
+	uint64 count() const;
+	uint64 sum() const { return __atomic_load_n(&_sum, __ATOMIC_RELAXED); }
+
+	uint64 count_below(uint64 usec) const;
+	uint64 quantile(double q) const;
+
+	static uint   bucket(uint64 usec);
+	static uint64 bucket_low(uint index);
+	static uint64 bucket_high(uint index);
+
+private:
+	uint64 _buckets[k_buckets];
+	uint64 _sum;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Named metrics exported in the Prometheus text format. Metrics are
+/// registered once, by reference, and must outlive the registry. Metrics
+/// sharing a name form a family and are told apart by their labels, given
+/// as Prometheus label pairs, e.g. status="0". Histograms are exported in
+/// seconds with power of two buckets.
+///
+class registry : boost::noncopyable {
+	enum kind {
+		k_counter,
+		k_gauge,
+		k_histogram,
+	};
+
+	struct metric {
+		metric(const std::string& labels_, const void* value_)
+			: labels(labels_), value(value_)
+		{ }
+
+		std::string labels;
+		const void* value;
+	};
+
+	struct family {
+		std::string         help;
+		kind                type;
+		std::vector<metric> metrics;
+	};
+
+	typedef std::map<std::string, family> family_map;
+
+public:
+	registry();
+
+	void add(const std::string& name, const std::string& help, const counter& c,
+	         const std::string& labels = std::string());
+	void add(const std::string& name, const std::string& help, const gauge& g,
+	         const std::string& labels = std::string());
+	void add(const std::string& name, const std::string& help, const histogram& h,
+	         const std::string& labels = std::string());
+
+	void write(std::ostream& os) const;
+
+private:
+	void add(const std::string& name, const std::string& help, kind type,
+	         const std::string& labels, const void* value);
+
+private:
+	mutable boost::mutex     _mutex;
+	family_map               _families;
+	std::vector<std::string> _order;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace metrics */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_METRICS__HPP_ */
@@ -0,0 +1,81 @@
+//=============================================================================
+// Brief   : Performance Metrics Export Endpoint
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_METRICS_SERVER__HPP_
+#define OPMIP_METRICS_SERVER__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/logger.hpp>
+#include <opmip/metrics.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <string>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace metrics {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Serves the metrics of a registry over HTTP, as Prometheus scrapes them,
+/// on a local unix socket ("unix:/path/to/socket") or a TCP endpoint
+/// ("address:port", "[ipv6-address]:port" or only a port, bound to the
+/// loopback). Every request gets the whole registry and the connection is
+/// closed. A connection not done within k_session_timeout is closed too.
+///
+class server : boost::noncopyable {
+	typedef boost::asio::ip::tcp              tcp;
+	typedef boost::asio::local::stream_protocol local;
+
+public:
+	static const uint k_session_timeout = 5;    ///Seconds to read the request and write the response
+	static const uint k_accept_retry    = 1000; ///Milliseconds to wait after a failed accept
+
+public:
+	server(boost::asio::io_service& ios, const registry& reg);
+	~server();
+
+	void open(const std::string& endpoint);
+	void close();
+
+private:
+	void accept_tcp();
+	void accept_local();
+	void tcp_accept_handler(const boost::system::error_code& ec, boost::shared_ptr<tcp::socket>& sock);
+	void local_accept_handler(const boost::system::error_code& ec, boost::shared_ptr<local::socket>& sock);
+	void tcp_accept_retry(const boost::system::error_code& ec);
+	void local_accept_retry(const boost::system::error_code& ec);
+
+private:
+	const registry&              _registry;
+	tcp::acceptor                _tcp;
+	local::acceptor              _local;
+	std::string                  _path;
+	boost::asio::deadline_timer  _tcp_retry;
+	boost::asio::deadline_timer  _local_retry;
+	logger                       _log;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace metrics */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_METRICS_SERVER__HPP_ */
@@ -78,16 +78,28 @@ public:
 		return new(&_options[pos]) Option(len);
 	}
 
-	void notify(const ipv6_packet::pseudo_header& ph)
+	void notify(const opmip::ip::address_v6& src, const opmip::ip::address_v6& dst, uint32 len, uint8 next_header)
 	{
 		_header.checksum(0);
 		_checksum.clear();
-		_checksum.update(&ph, sizeof(ph));
+		_checksum.update_pseudo_header(src, dst, len, next_header);
 		_checksum.update(&_header, sizeof(_header));
 		_checksum.update(&_options[0], _options.size());
 		_header.checksum(_checksum.final());
 	}
 
+	///
+	/// Changes the router lifetime of a notified packet, the checksum is
+	/// updated in place
+	///
+	void lifetime(uint16 val)
+	{
+		uint16 old = htons(_header.lifetime());
+
+		_header.lifetime(val);
+		_header.checksum(opmip::ip::checksum::adjust(_header.checksum(), old, htons(val)));
+	}
+
 	size_t size() const { return sizeof(_header) + _options.size(); }
 
 	const_buffers cbuffer() const
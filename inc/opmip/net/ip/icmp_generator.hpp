@@ -37,6 +37,11 @@ struct icmp_mld_query {
 
 size_t icmp_mld_query_generator(const icmp_mld_query& imq, uchar* buffer, size_t length);
 
+///
+/// Sets the checksum of a generated message, it covers the IPv6 pseudo header
+///
+void icmp_checksum(uchar* buffer, size_t length, const address_v6& src, const address_v6& dst);
+
 ///////////////////////////////////////////////////////////////////////////////
 } /* namespace ip */ } /* namespace net */ } /* namespace opmip */
 
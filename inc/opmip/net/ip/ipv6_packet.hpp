@@ -40,28 +40,6 @@ public:
 		ip6_addr dst_addr;
 	};
 
-	struct pseudo_header {
-		pseudo_header(const opmip::ip::address_v6& src_ip,
-		              const opmip::ip::address_v6& dst_ip,
-		              uint32 payload_len,
-		              uint8 next_header)
-			: src(src_ip.to_bytes()), dst(dst_ip.to_bytes()),
-			  len(htonl(payload_len)), next(next_header)
-		{
-			pad[0] = 0;
-			pad[1] = 0;
-			pad[2] = 0;
-		}
-
-		typedef opmip::ip::address_v6::bytes_type ip6_addr;
-
-		ip6_addr src;
-		ip6_addr dst;
-		uint32   len;
-		uint8    pad[3];
-		uint8    next;
-	};
-
 	typedef std::vector<boost::asio::const_buffers_1> const_buffers;
 
 public:
@@ -92,7 +70,7 @@ public:
 		_header.src_addr = src.to_bytes();
 		_header.dst_addr = dst.to_bytes();
 
-		payload.notify(pseudo_header(src, dst, len, nxh));
+		payload.notify(src, dst, len, nxh);
 
 		_payload = payload.cbuffer();
 	}
@@ -29,12 +29,11 @@
 namespace opmip {	namespace net {	namespace ip {
 
 ///////////////////////////////////////////////////////////////////////////////
+///
+/// Sets the checksum of a generated message, it covers the IPv6 pseudo header
+///
+void pim_checksum(uchar* buffer, size_t length, const address_v6& src, const address_v6& dst);
 
-/*
-uint16 inchksum(const void *data, uint32 length);
-
-uint16 ipv6_checksum(uint8 protocol, const address_v6 &src, const address_v6 &dst, const void *data, uint16 len);
-*/
 
 struct hello_msg {
 	boost::optional<uint16> holdtime;
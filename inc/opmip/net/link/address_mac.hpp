@@ -74,6 +74,16 @@ public:
 		return _address < lhs._address;
 	}
 
+	bool operator==(const address_mac& lhs) const
+	{
+		return _address == lhs._address;
+	}
+
+	bool operator!=(const address_mac& lhs) const
+	{
+		return _address != lhs._address;
+	}
+
 	std::string       to_string() const;
 	const bytes_type& to_bytes() const { return _address; }
 
@@ -82,6 +92,16 @@ public:
 		return out << mac.to_string();
 	}
 
+	friend std::size_t hash_value(const address_mac& mac)
+	{
+		std::size_t h = 0;
+
+		for (bytes_type::const_iterator i = mac._address.begin(), e = mac._address.end(); i != e; ++i)
+			h = (h << 8) | *i;
+
+		return h;
+	}
+
 public:
 	bytes_type _address;
 };
@@ -0,0 +1,163 @@
+//=============================================================================
+// Brief   : Minimal Perfect Hash
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_PERFECT_HASH__HPP_
+#define OPMIP_PERFECT_HASH__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <boost/utility.hpp>
+#include <utility>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Minimal perfect hash of a fixed set of distinct 64 bit key hashes, built
+/// with hash and displace: the keys are spread over buckets of a few keys
+/// each, and each bucket gets the displacement that sends all of its keys to
+/// free slots. A key is placed by its bucket displacement alone, so the
+/// displacements take about one byte per key and the slots are exactly as
+/// many as the keys.
+///
+class perfect_hash {
+	static const uint32 k_bucket_size = 4;
+
+public:
+	perfect_hash()
+		: _size(0), _salt(0)
+	{ }
+
+	///
+	/// Fails if two hashes are the same
+	///
+	bool build(const std::vector<uint64>& hashes);
+
+	uint32 slot(uint64 h) const
+	{
+		h = mix(h ^ _salt);
+
+		return range(uint32(mix(h + _displacements[range(uint32(h >> 32), _displacements.size())])), _size);
+	}
+
+	uint32 size() const  { return _size; }
+	bool   empty() const { return !_size; }
+
+	void clear()
+	{
+		std::vector<uint32>().swap(_displacements);
+		_size = 0;
+	}
+
+private:
+	static uint64 mix(uint64 h)
+	{
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+		return h ^ (h >> 31);
+	}
+
+	///
+	/// Maps v to [0, n) without a division
+	///
+	static uint32 range(uint32 v, uint32 n)
+	{
+		return uint32((uint64(v) * n) >> 32);
+	}
+
+	bool place(const std::vector<uint64>& mixed, uint32 buckets);
+
+private:
+	std::vector<uint32> _displacements;
+	uint32              _size;
+	uint64              _salt;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Non-owning read-only index of T objects by a 64 bit key hash, with the
+/// entries in a single array laid out by perfect_hash slot. A lookup reads
+/// one entry, found only if the stored hash matches. The caller compares
+/// the keys unless the hash is the key itself.
+///
+template<class T>
+class perfect_hash_index : boost::noncopyable {
+	struct entry {
+		uint64 hash;
+		T*     value;
+	};
+
+public:
+	typedef std::vector<std::pair<uint64, T*> > value_list;
+
+public:
+	///
+	/// Fails if two values have the same hash, the index is left empty
+	///
+	bool build(const value_list& values)
+	{
+		std::vector<uint64> hashes;
+
+		clear();
+		hashes.reserve(values.size());
+		for (typename value_list::const_iterator i = values.begin(), e = values.end(); i != e; ++i)
+			hashes.push_back(i->first);
+
+		if (!_hash.build(hashes))
+			return false;
+
+		_entries.resize(values.size());
+		for (typename value_list::const_iterator i = values.begin(), e = values.end(); i != e; ++i) {
+			entry& ent = _entries[_hash.slot(i->first)];
+
+			ent.hash = i->first;
+			ent.value = i->second;
+		}
+
+		return true;
+	}
+
+	T* find(uint64 h) const
+	{
+		if (_hash.empty())
+			return nullptr;
+
+		const entry& ent = _entries[_hash.slot(h)];
+
+		return (ent.hash == h) ? ent.value : nullptr;
+	}
+
+	bool empty() const { return _hash.empty(); }
+
+	void clear()
+	{
+		_hash.clear();
+		std::vector<entry>().swap(_entries);
+	}
+
+private:
+	perfect_hash       _hash;
+	std::vector<entry> _entries;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_PERFECT_HASH__HPP_ */
@@ -20,6 +20,7 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 #include <opmip/base.hpp>
+#include <opmip/metrics.hpp>
 #include <opmip/net/ip/prefix.hpp>
 #include <opmip/net/ip/address.hpp>
 #include <opmip/net/ip/dhcp_v6.hpp>
@@ -75,6 +76,12 @@ private:
 
 	typedef boost::shared_ptr<dhcp_receive_data> dhcp_receive_data_ptr;
 
+	struct stats {
+		metrics::counter ra_sent;
+		metrics::counter dhcp6_received;
+		metrics::counter dhcp6_replied;
+	};
+
 public:
 	addrconf_server(boost::asio::io_service& ios);
 	~addrconf_server();
@@ -86,6 +93,8 @@ public:
 	bool del(const link_address& addr);
 	void clear();
 
+	void register_metrics(metrics::registry& reg) const;
+
 private:
 	void router_advertisement(const boost::system::error_code& ec,
 	                          icmp_ra_sender_ptr& ras,
@@ -114,6 +123,7 @@ private:
 //	boost::asio::ip::icmp::socket _icmp_sock;
 	boost::asio::ip::udp::socket  _udp_sock;
 	std::set<uint>                _mcast_interfaces;
+	stats                         _stats;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -24,8 +24,8 @@
 #include <opmip/ip/prefix.hpp>
 #include <opmip/ll/technology.hpp>
 #include <opmip/ll/mac_address.hpp>
-#include <boost/asio/deadline_timer.hpp>
-#include <boost/intrusive/rbtree.hpp>
+#include <opmip/pmip/node_db.hpp>
+#include <opmip/timer_wheel.hpp>
 #include <string>
 #include <vector>
 
@@ -50,23 +50,29 @@ public:
 	};
 
 public:
-	bcache_entry(boost::asio::io_service& ios, const std::string& mn_id,
-	                                           const net_prefix_list& mn_prefix_list)
-		: _id(mn_id), _prefix_list(mn_prefix_list),
+	bcache_entry(const mobile_node& mn)
+		: _mn(&mn),
 		  lifetime(0), sequence(0),
 		  link_type(ll::k_tech_unknown),
-		  bind_status(k_bind_unknown),
-		  timer(ios)
+		  bind_status(k_bind_unknown)
 	{ }
 
-	const std::string&     id() const          { return _id; }
-	const net_prefix_list& prefix_list() const { return _prefix_list; }
+	const mobile_node&     mn() const          { return *_mn; }
+	uint32                 mn_index() const    { return _mn->index(); }
+	const std::string&     id() const          { return _mn->id(); }
+	const net_prefix_list& prefix_list() const { return _mn->prefix_list(); }
 
-private:
-	boost::intrusive::set_member_hook<> _id_hook;
+	///
+	/// Moves the entry to the same mobile node of a reloaded node_db
+	///
+	void rebind(const mobile_node& mn)
+	{
+		BOOST_ASSERT((mn.index() == _mn->index()));
+		_mn = &mn;
+	}
 
-	net_access_id    _id;          ///MN Identifier
-	net_prefix_list  _prefix_list; ///MN List of Network Prefixes
+private:
+	mobile_node_ptr _mn; ///MN Identifier and List of Network Prefixes, held from the node_db
 
 public:
 	net_address care_of_address; ///MN Care of Address
@@ -74,38 +80,19 @@ public:
 	uint16      sequence;        ///Sequence Number from last binding update, see also section 9.5.1
 	link_tech   link_type;       ///MN Link-Layer Technology
 
-	bind_status_t               bind_status;
-	boost::asio::deadline_timer timer;
+	bind_status_t    bind_status;
+	timer_wheel_hook timer;       ///Expiration or removal timer, depending on bind_status
 };
 
 ///////////////////////////////////////////////////////////////////////////////
+///
+/// Binding cache entries are kept in a dense table indexed by the node_db
+/// mobile node index. When mobile nodes are partitioned by index among
+/// several caches, each cache only holds indexes congruent modulo stride
+/// and its table is stride times smaller.
+///
 class bcache {
-	struct compare {
-		bool operator()(const bcache_entry& rhs, const bcache_entry& lhs) const
-		{
-			return rhs._id < lhs._id;
-		}
-
-		bool operator()(const bcache_entry& rhs, const bcache_entry::net_access_id& key) const
-		{
-			return rhs._id < key;
-		}
-
-		bool operator()(const bcache_entry::net_access_id& key, const bcache_entry& lhs) const
-		{
-			return key < lhs._id;
-		}
-	};
-
-	typedef boost::intrusive::compare<compare> compare_option;
-
-	typedef boost::intrusive::member_hook<bcache_entry,
-	                                      boost::intrusive::set_member_hook<>,
-	                                      &bcache_entry::_id_hook> member_hook_option;
-
-	typedef boost::intrusive::rbtree<bcache_entry,
-	                                 member_hook_option,
-	                                 compare_option> id_tree;
+	typedef std::vector<bcache_entry*> entry_table;
 
 public:
 	typedef bcache_entry                  entry_type;
@@ -116,18 +103,27 @@ public:
 	typedef bcache_entry::link_tech       link_tech;
 
 public:
-	bcache();
+	explicit bcache(uint32 stride = 1);
 	~bcache();
 
 	bool insert(bcache_entry* entry);
 	bool remove(bcache_entry* entry);
 
-	bcache_entry* find(const std::string& mn_id);
+	bcache_entry* find(uint32 mn_index)
+	{
+		uint32 i = mn_index / _stride;
+
+		return (i < _entries.size()) ? _entries[i] : nullptr;
+	}
+
+	size_t size() const { return _size; }
 
 	void clear();
 
 private:
-	id_tree _id_tree;
+	entry_table _entries;
+	uint32      _stride;
+	size_t      _size;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
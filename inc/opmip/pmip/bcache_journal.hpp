@@ -0,0 +1,125 @@
+//=============================================================================
+// Brief   : Binding Cache Journal
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_PMIP_BCACHE_JOURNAL__HPP_
+#define OPMIP_PMIP_BCACHE_JOURNAL__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/ip/address.hpp>
+#include <opmip/ip/prefix.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility.hpp>
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace pmip {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Append only journal of the LMA bindings, from which a restarted LMA
+/// takes them back instead of having every mobile node register again.
+///
+/// Each change appends a record with the whole binding, keyed by the
+/// mobile node NAI, so the last record of a NAI is its binding. Once the
+/// journal holds mostly superseded records, it is set aside as path.prev
+/// and starts over, while a background thread writes a copy of the live
+/// bindings to a snapshot, path.snap, then removes path.prev. Replaying
+/// the snapshot, path.prev and the journal, in that order, gives the same
+/// bindings wherever this was cut short. Expiry times are on the wall
+/// clock, which survives a restart.
+///
+/// A batch of records goes out in a single write, without a sync: the
+/// journal outlives the LMA process, not the host. A record cut short is
+/// dropped, along with whatever follows it, when the journal is opened.
+///
+class bcache_journal : boost::noncopyable {
+public:
+	typedef ip::address_v6         ip_address;
+	typedef ip::prefix_v6          ip_prefix;
+	typedef std::vector<ip_prefix> ip_prefix_list;
+
+	struct binding {
+		binding()
+			: expiry(0), lifetime(0), sequence(0), link_type(0)
+		{ }
+
+		std::string    id;
+		ip_address     care_of_address;
+		uint64         expiry;          ///Seconds since the epoch, 0 for a removed binding
+		uint32         lifetime;        ///Seconds, as granted
+		uint16         sequence;
+		uint8          link_type;
+		ip_prefix_list prefixes;        ///Routed to the care-of address, so a binding dropped on restart can be unrouted
+	};
+
+	typedef std::vector<binding> binding_list;
+
+private:
+	typedef boost::unordered_map<std::string, binding> binding_map;
+
+	static const size_t k_min_compact = 1 << 16; ///Records before the journal is worth compacting
+
+public:
+	bcache_journal();
+	~bcache_journal();
+
+	///
+	/// Opens the journal at path, creating it if there is none, and gets
+	/// the bindings it holds
+	///
+	void open(const std::string& path, binding_list& bindings);
+	void close();
+
+	bool is_open() const { return _fd >= 0; }
+
+	///
+	/// Appends the records of batch, which is cleared. May be called from
+	/// any thread, does nothing once closed. The error of a compaction
+	/// is reported by the commit following it.
+	///
+	void commit(binding_list& batch, boost::system::error_code& ec);
+
+	size_t size() const { return _bindings.size(); } ///Live bindings
+
+private:
+	bool replay(int fd, bool truncate);
+	void compact(boost::system::error_code& ec);
+	void write_snapshot();
+
+private:
+	boost::mutex              _mutex;
+	std::string               _path;
+	int                       _fd;
+	size_t                    _records;    ///Committed since the last compaction
+	binding_map               _bindings;
+	bool                      _rotated;    ///path.prev is there, until a snapshot holds its records
+	bool                      _compacting; ///The compactor owns _snapshot
+	binding_map               _snapshot;   ///Copy of the bindings being written
+	boost::system::error_code _compact_ec;
+	boost::thread             _compactor;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace pmip */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_PMIP_BCACHE_JOURNAL__HPP_ */
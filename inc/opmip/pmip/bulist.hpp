@@ -25,10 +25,12 @@
 #include <opmip/ip/prefix.hpp>
 #include <opmip/ll/technology.hpp>
 #include <opmip/ll/mac_address.hpp>
+#include <opmip/hash_index.hpp>
+#include <opmip/pmip/node_db.hpp>
+#include <opmip/pmip/mp_sender.hpp>
 #include <opmip/net/link/ethernet.hpp>
-#include <boost/asio/deadline_timer.hpp>
+#include <opmip/timer_wheel.hpp>
 #include <boost/asio/ip/icmp.hpp>
-#include <boost/intrusive/rbtree.hpp>
 #include <boost/function.hpp>
 #include <string>
 #include <vector>
@@ -57,42 +59,45 @@ public:
 	};
 
 public:
-	bulist_entry(boost::asio::io_service& ios, const std::string& mn_id,
-	                                           const link_address& mn_link_address,
-	                                           const ip_prefix_list& mn_prefix_list,
-	                                           const ip_address& home_addr,
-	                                           const ip_address& lma_address,
-	                                           uint poa_dev_id,
-	                                           const link_address& poa_address)
-
-		: _mn_id(mn_id), _mn_link_addr(mn_link_address),
-		  _mn_prefix_list(mn_prefix_list), _home_addr(home_addr),
+	bulist_entry(const mobile_node& mn,
+	             const link_address& mn_link_address,
+	             const ip_address& lma_address,
+	             uint poa_dev_id,
+	             const link_address& poa_address)
+
+		: _mn(&mn), _mn_link_addr(mn_link_address),
 		  _lma_addr(lma_address),
 		  _poa_dev_id(poa_dev_id), _poa_addr(poa_address),
 		  lifetime(60), sequence_number(std::time(nullptr)),
 		  timestamp(std::time(nullptr)), bind_status(k_bind_unknown),
-		  retry_count(0), mtu(1460), timer(ios)//, ra_sock(ios)
+		  retry_count(0), mtu(1460)
 	{ }
 
-	const std::string&     mn_id() const           { return _mn_id; }
+	const mobile_node&     mn() const              { return *_mn; }
+	uint32                 mn_index() const        { return _mn->index(); }
+	const std::string&     mn_id() const           { return _mn->id(); }
 	const link_address&    mn_link_address() const { return _mn_link_addr; }
-	const ip_prefix_list&  mn_prefix_list() const  { return _mn_prefix_list; }
-	const ip_address&      home_address() const    { return _home_addr; }
+	const ip_prefix_list&  mn_prefix_list() const  { return _mn->prefix_list(); }
+	const ip_address&      home_address() const    { return _mn->home_address(); }
 	const ip_address&      lma_address() const     { return _lma_addr; }
 	uint                   poa_dev_id() const      { return _poa_dev_id; }
 	const link_address&    poa_address() const     { return _poa_addr; }
 
-private:
-	boost::intrusive::set_member_hook<> _mn_id_hook;
-	boost::intrusive::set_member_hook<> _mn_link_addr_hook;
+	///
+	/// Moves the entry to the same mobile node of a reloaded node_db
+	///
+	void rebind(const mobile_node& mn)
+	{
+		BOOST_ASSERT((mn.index() == _mn->index()));
+		_mn = &mn;
+	}
 
-	std::string     _mn_id;               ///MN Identifier
-	link_address    _mn_link_addr;        ///MN Link Address for the MN access point
-	ip_prefix_list  _mn_prefix_list;      ///MN List of Network Prefixes
-	ip_address      _home_addr;
-	ip_address      _lma_addr;            ///LMA Address
-	uint            _poa_dev_id;          ///Point of Attachment device identifier
-	link_address    _poa_addr;            ///Point of Attachment link layer address
+private:
+	mobile_node_ptr _mn;           ///MN Identifier, List of Network Prefixes and Home Address
+	link_address    _mn_link_addr; ///MN Link Address for the MN access point
+	ip_address      _lma_addr;     ///LMA Address
+	uint            _poa_dev_id;   ///Point of Attachment device identifier
+	link_address    _poa_addr;     ///Point of Attachment link layer address
 
 public:
 	uint64        lifetime;            ///Initial Lifetime
@@ -102,7 +107,8 @@ public:
 	uint          retry_count;
 	uint          mtu;
 
-	boost::asio::deadline_timer   timer;
+	timer_wheel_hook timer;            ///Retry or renew timer, depending on bind_status
+	mp_template      pbu;              ///PBU encoded at attach, resent with the current sequence and lifetime
 //	net::link::ethernet::socket   ra_sock;
 //	net::link::ethernet::endpoint ra_ep;
 
@@ -112,56 +118,9 @@ public:
 
 ///////////////////////////////////////////////////////////////////////////////
 class bulist {
-	struct compare_mn_id {
-		bool operator()(const bulist_entry& rhs, const bulist_entry& lhs) const
-		{
-			return rhs._mn_id < lhs._mn_id;
-		}
-
-		bool operator()(const bulist_entry& rhs, const std::string& key) const
-		{
-			return rhs._mn_id < key;
-		}
-
-		bool operator()(const std::string& key, const bulist_entry& lhs) const
-		{
-			return key < lhs._mn_id;
-		}
-	};
-
-	struct compare_mn_link_address {
-		bool operator()(const bulist_entry& rhs, const bulist_entry& lhs) const
-		{
-			return rhs._mn_link_addr < lhs._mn_link_addr;
-		}
-
-		bool operator()(const bulist_entry& rhs, const bulist_entry::link_address& key) const
-		{
-			return rhs._mn_link_addr < key;
-		}
-
-		bool operator()(const bulist_entry::link_address& key, const bulist_entry& lhs) const
-		{
-			return key < lhs._mn_link_addr;
-		}
-	};
-
-	typedef boost::intrusive::compare<compare_mn_id>           compare_mn_id_option;
-	typedef boost::intrusive::compare<compare_mn_link_address> compare_mn_link_addr_option;
-
-	typedef boost::intrusive::member_hook<bulist_entry,
-	                                      boost::intrusive::set_member_hook<>,
-	                                      &bulist_entry::_mn_id_hook> mn_id_hook_option;
-	typedef boost::intrusive::member_hook<bulist_entry,
-	                                      boost::intrusive::set_member_hook<>,
-	                                      &bulist_entry::_mn_link_addr_hook> mn_link_addr_hook_option;
-
-	typedef boost::intrusive::rbtree<bulist_entry,
-	                                 mn_id_hook_option,
-	                                 compare_mn_id_option> mn_id_tree;
-	typedef boost::intrusive::rbtree<bulist_entry,
-	                                 mn_link_addr_hook_option,
-	                                 compare_mn_link_addr_option> mn_link_addr_tree;
+	typedef std::vector<bulist_entry*> entry_table;
+	typedef hash_index<bulist_entry, bulist_entry::link_address,
+	                   &bulist_entry::mn_link_address>                 mn_link_addr_index;
 
 public:
 	typedef bulist_entry                 entry_type;
@@ -177,14 +136,18 @@ public:
 	bool insert(bulist_entry* entry);
 	bool remove(bulist_entry* entry);
 
-	bulist_entry* find(const std::string& mn_id);
+	bulist_entry* find(uint32 mn_index)
+	{
+		return (mn_index < _entries.size()) ? _entries[mn_index] : nullptr;
+	}
+
 	bulist_entry* find(const link_address& mn_link_address);
 
 	void clear();
 
 private:
-	mn_id_tree        _mn_id_tree;
-	mn_link_addr_tree _mn_link_addr_tree;
+	entry_table        _entries;            ///Indexed by the node_db mobile node index
+	mn_link_addr_index _mn_link_addr_index;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,221 @@
+//=============================================================================
+// Brief   : PMIP Data Plane Backends
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_PMIP_DATA_PLANE__HPP_
+#define OPMIP_PMIP_DATA_PLANE__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/ptime.hpp>
+#include <opmip/ip/address.hpp>
+#include <opmip/ip/prefix.hpp>
+#include <opmip/pmip/tunnels.hpp>
+#include <opmip/sys/route_table.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+#include <map>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace pmip {
+
+///////////////////////////////////////////////////////////////////////////////
+static const uint k_tunnel_prefix_length = 64; ///Default prefix length of the local address on the tunnels
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Forwarding state programmed by the control plane: one tunnel per remote
+/// peer, reference counted, and the routes of the mobile node prefixes.
+/// Route batches follow the sys::route_table semantics, the backend state
+/// is updated right away and the handlers report the completion later.
+/// Callers serialize their use of a backend, the handlers may run on any
+/// thread of the io_service.
+///
+/// Closing a backend releases the tunnels only, flush removes every route
+/// in a single pass. Detaching leaves both in place for the next run, whose
+/// tunnels and routes to the same remotes and prefixes take them over, and
+/// which collects the tunnels it did not take over.
+///
+class data_plane : boost::noncopyable {
+public:
+	typedef ip::address_v6                       ip_address;
+	typedef ip::prefix_v6                        ip_prefix;
+	typedef sys::route_table::entry              route_entry;
+	typedef sys::route_table::batch              route_batch;
+	typedef sys::route_table::completion_handler completion_handler;
+
+public:
+	virtual ~data_plane()
+	{ }
+
+	virtual void open(const ip_address& local, uint prefix_length, bool global_address, bool external) = 0;
+	virtual void close() = 0;
+	virtual void detach() = 0;
+
+	virtual uint   acquire_tunnel(const ip_address& remote) = 0;
+	virtual void   release_tunnel(const ip_address& remote) = 0;
+	virtual uint   move_tunnel(const ip_address& from, const ip_address& to) = 0;
+	virtual size_t provision_tunnels(const std::vector<ip_address>& remotes, size_t concurrency) = 0;
+	virtual size_t collect_tunnels() = 0;
+	virtual size_t tunnel_count() const = 0;
+	virtual bool   is_external() const = 0;
+
+	virtual size_t commit(route_batch& routes) = 0;
+	virtual void   flush() = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// The Linux kernel: ip6tnl devices and rtnetlink routes
+///
+class kernel_data_plane : public data_plane {
+public:
+	kernel_data_plane(boost::asio::io_service& ios);
+
+	void open(const ip_address& local, uint prefix_length, bool global_address, bool external);
+	void close();
+	void detach();
+
+	uint   acquire_tunnel(const ip_address& remote);
+	void   release_tunnel(const ip_address& remote);
+	uint   move_tunnel(const ip_address& from, const ip_address& to);
+	size_t provision_tunnels(const std::vector<ip_address>& remotes, size_t concurrency);
+	size_t collect_tunnels();
+	size_t tunnel_count() const;
+	bool   is_external() const;
+
+	size_t commit(route_batch& routes);
+	void   flush();
+
+private:
+	ip6_tunnels      _tunnels;
+	sys::route_table _routes;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Keeps the forwarding state in memory only, tunnels get made up device
+/// numbers and every route operation succeeds. Handlers are posted to the
+/// io_service, as the kernel replies would be. No privileges are needed,
+/// it is meant to exercise the control plane on its own.
+///
+/// The kernel costs can be emulated: the commit delay is spent inside commit,
+/// as the rtnetlink send would, and the completion delay before the handlers
+/// of a commit run. Operations can also be recorded, for inspection.
+///
+class memory_data_plane : public data_plane {
+	struct tunnel {
+		tunnel(uint device_)
+			: device(device_), refcount(0)
+		{ }
+
+		uint device;
+		uint refcount;
+	};
+
+	typedef std::map<ip_address, tunnel>                   tunnel_map;
+	typedef std::map<ip_prefix, route_entry>               route_map;
+	typedef std::vector<completion_handler>                handler_list;
+	typedef boost::shared_ptr<handler_list>                handler_list_ptr;
+	typedef boost::shared_ptr<boost::asio::deadline_timer> timer_ptr;
+
+	static const uint k_external_device = 999;
+	static const uint k_first_device    = 1000;
+
+public:
+	struct record {
+		enum kind {
+			k_tunnel_acquire,
+			k_tunnel_release,
+			k_route_add,
+			k_route_replace,
+			k_route_remove,
+			k_flush
+		};
+
+		kind       type;
+		ptime      time;   ///Monotonic
+		ip_address remote; ///Tunnel remote address, or route encapsulation endpoint
+		uint       device; ///Tunnel device, or route output device
+		bool       by_src;
+		ip_prefix  prefix;
+	};
+
+public:
+	memory_data_plane(boost::asio::io_service& ios);
+
+	void commit_delay(uint usec)     { _commit_delay = usec; }
+	void completion_delay(uint usec) { _completion_delay = usec; }
+
+	void recording(bool enable);
+	void take_records(std::vector<record>& records);
+
+	void open(const ip_address& local, uint prefix_length, bool global_address, bool external);
+	void close();
+	void detach();
+
+	uint   acquire_tunnel(const ip_address& remote);
+	void   release_tunnel(const ip_address& remote);
+	uint   move_tunnel(const ip_address& from, const ip_address& to);
+	size_t provision_tunnels(const std::vector<ip_address>& remotes, size_t concurrency);
+	size_t collect_tunnels();
+	size_t tunnel_count() const;
+	bool   is_external() const;
+
+	size_t commit(route_batch& routes);
+	void   flush();
+
+	bool   find_by_src(const ip_prefix& prefix, route_entry& route) const;
+	bool   find_by_dst(const ip_prefix& prefix, route_entry& route) const;
+	size_t route_count() const;
+
+private:
+	uint acquire(const ip_address& remote);
+	void release(const ip_address& remote);
+	bool apply(const sys::route_table::operation& op);
+	void log(record::kind type, const ip_address& remote, uint device);
+	void log(const sys::route_table::operation& op);
+
+	static bool find(const route_map& routes, const ip_prefix& prefix, route_entry& route);
+
+	static void delayed_completion(const boost::system::error_code& ec, timer_ptr& timer,
+	                               handler_list_ptr& handlers);
+
+private:
+	boost::asio::io_service& _io_service;
+	mutable boost::mutex     _mutex; ///The state can be inspected while the control plane runs
+	bool                     _external;
+	uint                     _next_device;
+	tunnel_map               _tunnels;
+	route_map                _by_src;
+	route_map                _by_dst;
+	route_map                _left_by_src; ///Left in place by detach, until taken over or collected
+	route_map                _left_by_dst;
+	uint                     _commit_delay;     ///usec
+	uint                     _completion_delay; ///usec
+	bool                     _recording;
+	std::vector<record>      _records;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace pmip */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_PMIP_DATA_PLANE__HPP_ */
@@ -22,14 +22,28 @@
 #include <opmip/base.hpp>
 #include <opmip/chrono.hpp>
 #include <opmip/logger.hpp>
+#include <opmip/metrics.hpp>
+#include <opmip/rcu_pointer.hpp>
+#include <opmip/timer_wheel.hpp>
+#include <opmip/tracer.hpp>
 #include <opmip/ip/mproto.hpp>
 #include <opmip/pmip/bcache.hpp>
+#include <opmip/pmip/bcache_journal.hpp>
+#include <opmip/pmip/data_plane.hpp>
 #include <opmip/pmip/node_db.hpp>
 #include <opmip/pmip/mp_receiver.hpp>
+#include <opmip/pmip/mp_batch.hpp>
 #include <opmip/pmip/tunnels.hpp>
 #include <opmip/sys/route_table.hpp>
+#include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
@@ -38,9 +52,98 @@ namespace opmip { namespace pmip {
 class lma {
 	typedef boost::asio::io_service::strand strand;
 
+	///
+	/// The binding cache is partitioned by the MN node_db index. Each
+	/// shard serializes the processing of its own bindings, including timers
+	/// and PBA transmission, so PBUs for different MNs run in parallel. The
+	/// shards send their PBAs on the LMA socket, sendmmsg being thread safe.
+	///
+	struct shard : boost::noncopyable {
+		shard(boost::asio::io_service& ios, lma& owner, uint32 shard_count)
+			: service(ios), cache(shard_count),
+			  timers(service, boost::bind(&lma::binding_timeout, &owner, boost::ref(*this), _1))
+		{ }
+
+		strand          service;
+		bcache          cache;
+		timer_wheel     timers;    ///Binding cache entries expiration and removal
+		mp_batch_sender pba_batch; ///PBAs queued during the current processing pass
+
+		bcache_journal::binding_list journal; ///Binding changes of the current processing pass
+	};
+
+	typedef boost::ptr_vector<shard> shard_list;
+
+	struct stats {
+		metrics::counter   pbu_received;
+		metrics::counter   pba_accepted;
+		metrics::counter   pba_bad_sequence;
+		metrics::counter   pba_not_lma;
+		metrics::counter   pba_not_authorized;
+		metrics::counter   pba_other;
+		metrics::counter   pba_dropped;
+		metrics::counter   handoffs;
+		metrics::counter   expiries;
+		metrics::gauge     bindings;
+		metrics::gauge     tunnels;
+		metrics::counter   reloads;
+		metrics::counter   revocations;
+		metrics::counter   fetches;
+		metrics::counter   restored;
+		metrics::histogram pbu_batch_delay;
+		metrics::histogram netlink_latency;
+	};
+
+	///
+	/// Stages of the PBU pipeline traced for every PBU
+	///
+	enum trace_stage {
+		k_trace_readable,   ///Socket reported readable
+		k_trace_parsed,     ///Received batch parsed and split by shard
+		k_trace_strand,     ///Shard strand entered
+		k_trace_lookup,     ///Binding cache lookup and MAG check-in done
+		k_trace_routes,     ///Tunnel and route programming requested
+		k_trace_pba_queued, ///PBA queued on the shard batch
+		k_trace_pba_sent,   ///PBA batch sent
+
+		k_trace_stages
+	};
+
+	static const size_t k_max_shards = 64;
+
+	///
+	/// Node database reload in progress. The shards revoke or rebind their
+	/// bindings to the new database, a batch of indexes at a time, and the
+	/// previous database is deleted once every shard is done with it. The
+	/// generation counts the published databases, telling PBUs resumed after
+	/// a mobile node load whether the database they looked up is still the
+	/// current one.
+	///
+	struct reload_state {
+		reload_state()
+			: running(false), loaded(nullptr), previous(nullptr), epoch(0), generation(0), shards_pending(0),
+			  revoked(0), rebound(0)
+		{ }
+
+		bool     running;
+		node_db* loaded;   ///Handed by the loader thread, until published
+		node_db* previous; ///Replaced database, until reclaimed
+		uint     epoch;
+		uint     generation; ///Read by the shards
+		size_t   shards_pending;
+		size_t   revoked;
+		size_t   rebound;
+		chrono   delay;
+	};
+
+	static const uint32 k_reload_batch = 256;
+	static const uint   k_reload_reclaim_retry = 1; ///Wait for dispatch_pbus to leave the replaced database (ms)
+
 public:
 	typedef	ip::address_v6 ip_address;
 
+	typedef boost::function<void(const proxy_binding_info&)> pba_handler;
+
 	struct config {
 		config()
 			: min_delay_before_BCE_delete(10000),
@@ -52,43 +155,131 @@ public:
 	};
 
 public:
-	lma(boost::asio::io_service& ios, node_db& ndb, size_t concurrency);
+	///
+	/// Routes and tunnels are programmed on the given data plane, or on the
+	/// kernel when none is given. The data plane must outlive the LMA.
+	///
+	lma(boost::asio::io_service& ios, node_db& ndb, size_t concurrency, data_plane* dp = nullptr);
+	~lma();
 
-	void start(const std::string& id, bool tunnel_global_address);
+	void start(const std::string& id, bool tunnel_global_address, bool tunnel_provisioning = false,
+	           bool flow_tunnel = false, uint tunnel_prefix_length = k_tunnel_prefix_length);
 	void stop();
 
+	///
+	/// Loads the node database again from file_name, in the background,
+	/// and replaces the current one with it. Bindings of mobile nodes that
+	/// were removed, changed or moved to another LMA are revoked. A reload
+	/// requested while another is running is ignored.
+	///
+	void reload(const std::string& file_name);
+
+	void open_trace(const std::string& path, uint sample_rate) { _tracer.open(path, sample_rate); }
+
+	///
+	/// Keeps the bindings in a journal at path, which start takes them back
+	/// from. Stopping then leaves the tunnels and routes in place, so a
+	/// restarted LMA goes on forwarding and its MAGs only renew as usual.
+	/// Must be called before start.
+	///
+	void open_journal(const std::string& path);
+
+	///
+	/// Runs without mobility sockets, which need privileges: PBUs are given
+	/// already parsed to receive and each PBA is handed to the handler, on
+	/// its shard strand, instead of being sent. Must be called before start.
+	///
+	void use_local_transport(const pba_handler& handler) { _local_pba = handler; }
+	void receive(const pbinfo_batch_ptr& pbb);
+
+	const metrics::registry& get_metrics() const { return _metrics; }
+
 private:
-	void mp_send_handler(const boost::system::error_code& ec);
-	void mp_receive_handler(const boost::system::error_code& ec, const proxy_binding_info& pbinfo, pbu_receiver_ptr& pbur, chrono& delay);
+	void mp_receive_handler(const boost::system::error_code& ec, mp_batch_receiver_ptr& mbr, chrono& delay);
+	void mp_flush(shard& sh);
+	void dispatch_pbus(pbinfo_batch& received, chrono& delay);
 
 private:
-	void start_(const std::string& id, bool tunnel_global_address);
+	void start_(const std::string& id, bool tunnel_global_address, bool tunnel_provisioning, bool flow_tunnel,
+	            uint tunnel_prefix_length);
+	void provision_tunnels();
 	void stop_();
 
-	void          proxy_binding_update(proxy_binding_info& pbinfo, chrono& delay);
-	bcache_entry* pbu_get_be(proxy_binding_info& pbinfo);
+	void stop_shard(shard& sh);
+	void stop_shard_done();
+
+	void restore_bindings();
+	void restore_shard(shard& sh, bcache_journal::binding_list& bindings, const node_db::mobile_node_ptr_list& mns);
+	void restore_done();
+	void purge_route_entries(const bcache_journal::binding_list& bindings);
+	void journal_binding(shard& sh, const bcache_entry& be);
+	void journal_removal(shard& sh, const bcache_entry& be);
+	void journal_flush(shard& sh);
+
+	void reload_(const std::string& file_name);
+	void reload_load(const std::string& file_name);
+	void reload_publish();
+	void reload_shard(shard& sh, uint32 first, size_t revoked, size_t rebound);
+	void reload_shard_fetched(shard& sh, uint32 next, size_t revoked, size_t rebound,
+	                          const std::vector<uint32>& indexes, const node_db::mobile_node_ptr_list& mns);
+	void reload_shard_next(shard& sh, uint32 next, size_t revoked, size_t rebound);
+	bool reload_rebind(shard& sh, bcache_entry& be, const mobile_node_ptr& mn);
+	void reload_shard_done(size_t revoked, size_t rebound);
+	void reload_reclaim(const boost::system::error_code& ec);
+
+	size_t shard_index(uint32 mn_index) const;
+
+	void          proxy_binding_update(shard& sh, pbinfo_batch_ptr& pbb, chrono& delay);
+	void          proxy_binding_defer(shard& sh, pbinfo_batch& pbb, bool* deferred, chrono& delay);
+	void          proxy_binding_fetched(shard& sh, pbinfo_batch_ptr& pbb, chrono& delay, uint generation,
+	                                    const node_db::mobile_node_ptr_list& mns);
+	bcache_entry* pbu_get_be(shard& sh, proxy_binding_info& pbinfo);
 	bool          pbu_mag_checkin(bcache_entry& be, proxy_binding_info& pbinfo);
-	void          pbu_process(proxy_binding_info& pbinfo);
+	void          pbu_process(shard& sh, proxy_binding_info& pbinfo, tracer::record& tr);
 
-	void expired_entry(const boost::system::error_code& ec, const std::string& mn_id);
-	void remove_entry(const boost::system::error_code& ec, const std::string& mn_id);
+	void binding_timeout(shard& sh, timer_wheel_hook& timer);
+	void expired_entry(shard& sh, bcache_entry& be);
+	void remove_entry(shard& sh, bcache_entry& be);
 
 	void add_route_entries(bcache_entry* be);
 	void del_route_entries(bcache_entry* be);
+	void move_route_entries(bcache_entry* be, const ip_address& prev_coa);
+	sys::route_table::entry route_entry(uint tdev, const ip_address& coa) const;
+	void route_entry_completion(const boost::system::error_code& ec, const std::string& id, const ip::prefix_v6& prefix,
+	                            const ptime& start);
+
+	void register_metrics();
+	void count_pba(uint status);
 
 private:
-	strand   _service;
-	bcache   _bcache;
-	config   _config;
-	node_db& _node_db;
-	logger   _log;
+	strand     _service;
+	shard_list _shards;
+	config     _config;
+	rcu_pointer<node_db> _node_db;
+	node_db&             _initial_node_db; ///Not owned, reloaded ones are
+	logger               _log;
+
+	reload_state                _reload;
+	boost::thread               _reload_thread;
+	boost::asio::deadline_timer _reclaim_timer;
+	size_t                      _stop_pending;    ///Shards yet to stop, the data plane is released by the last one
+	size_t                      _restore_pending; ///Shards yet to restore, the last one collects the tunnels
 
 	ip::mproto::socket _mp_sock;
+	pba_handler        _local_pba;
+
+	std::string                   _identifier;
+	boost::mutex                  _dp_mutex;       ///Serializes shard access to the data plane
+	boost::scoped_ptr<data_plane> _own_data_plane; ///The kernel, unless a data plane was given
+	data_plane&                   _data_plane;
+	size_t                        _concurrency;
+
+	stats             _stats;
+	tracer            _tracer;
+	metrics::registry _metrics;
 
-	std::string       _identifier;
-	pmip::ip6_tunnels _tunnels;
-	sys::route_table  _route_table;
-	size_t            _concurrency;
+	bcache_journal               _journal;
+	bcache_journal::binding_list _restored; ///Taken from the journal, until start
 };
 
 ///////////////////////////////////////////////////////////////////////////////
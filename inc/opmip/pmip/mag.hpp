@@ -21,16 +21,22 @@
 ///////////////////////////////////////////////////////////////////////////////
 #include <opmip/base.hpp>
 #include <opmip/logger.hpp>
+#include <opmip/metrics.hpp>
+#include <opmip/rcu_pointer.hpp>
+#include <opmip/timer_wheel.hpp>
 #include <opmip/pmip/bulist.hpp>
+#include <opmip/pmip/data_plane.hpp>
 #include <opmip/pmip/node_db.hpp>
 #include <opmip/pmip/mp_receiver.hpp>
-#include <opmip/pmip/tunnels.hpp>
+#include <opmip/pmip/mp_batch.hpp>
 #include <opmip/pmip/addrconf_server.hpp>
-#include <opmip/sys/route_table.hpp>
+#include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/asio/ip/icmp.hpp>
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
@@ -50,6 +56,44 @@ class mag {
 	typedef boost::asio::io_service::strand                         strand;
 	typedef boost::function<void(const boost::system::error_code&)> completion_functor;
 
+	struct stats {
+		metrics::counter   attaches;
+		metrics::counter   detaches;
+		metrics::counter   retries;
+		metrics::counter   timeouts;
+		metrics::counter   dropped;
+		metrics::gauge     bindings;
+		metrics::histogram handover_delay;
+		metrics::counter   reloads;
+		metrics::counter   revocations;
+		metrics::counter   fetches;
+	};
+
+	///
+	/// Node database reload in progress. The binding update list is walked
+	/// a batch of indexes at a time and the previous database is deleted
+	/// once the walk is done. The generation counts the published databases,
+	/// telling an attachment resumed after a mobile node load whether the
+	/// database it looked up is still the current one.
+	///
+	struct reload_state {
+		reload_state()
+			: running(false), loaded(nullptr), previous(nullptr), epoch(0), generation(0), revoked(0), rebound(0)
+		{ }
+
+		bool     running;
+		node_db* loaded;   ///Handed by the loader thread, until published
+		node_db* previous; ///Replaced database, until reclaimed
+		uint     epoch;
+		uint     generation;
+		size_t   revoked;
+		size_t   rebound;
+		chrono   delay;
+	};
+
+	static const uint32 k_reload_batch = 256;
+	static const uint   k_reload_reclaim_retry = 1; ///Wait for lookups to leave the replaced database (ms)
+
 public:
 	typedef ip::address_v6  ip_address;
 	typedef ll::mac_address mac_address;
@@ -90,51 +134,102 @@ public:
 
 
 public:
-	mag(boost::asio::io_service& ios, node_db& ndb, addrconf_server& asrv, size_t concurrency);
-
-	void start(const std::string& id, const ip_address& link_local_ip, bool tunnel_global_address);
+	///
+	/// Routes and tunnels are programmed on the given data plane, or on the
+	/// kernel when none is given. The data plane must outlive the MAG.
+	///
+	mag(boost::asio::io_service& ios, node_db& ndb, addrconf_server& asrv, size_t concurrency,
+	    data_plane* dp = nullptr);
+	~mag();
+
+	void start(const std::string& id, const ip_address& link_local_ip, bool tunnel_global_address,
+	           uint tunnel_prefix_length = k_tunnel_prefix_length);
 	void stop();
 
+	///
+	/// Loads the node database again from file_name, in the background,
+	/// and replaces the current one with it. Bindings of mobile nodes that
+	/// were removed or changed are de-registered. A reload requested while
+	/// another is running is ignored.
+	///
+	void reload(const std::string& file_name);
+
 	template<class CompletionHandler>
 	void mobile_node_attach(const attach_info& ai, CompletionHandler handler);
 
 	template<class CompletionHandler>
 	void mobile_node_detach(const attach_info& ai, CompletionHandler handler);
 
-	node_db& get_node_database() { return _node_db; }
+	///
+	/// Lookups from outside the MAG hold a rcu_pointer<node_db>::reader for
+	/// as long as they use what they found
+	///
+	const rcu_pointer<node_db>& get_node_database() const { return _node_db; }
+
+	const metrics::registry& get_metrics() const { return _metrics; }
 
 private:
-	void mp_send_handler(const boost::system::error_code& ec);
-	void mp_receive_handler(const boost::system::error_code& ec, const proxy_binding_info& pbinfo, pba_receiver_ptr& pbar, chrono& delay);
+	void mp_receive_handler(const boost::system::error_code& ec, mp_batch_receiver_ptr& mbr, chrono& delay);
+	void mp_send(const bulist_entry& be, const proxy_binding_info& pbinfo);
+	void mp_flush();
 
 private:
-	void start_(const std::string& id, const ip_address& mn_access_link, bool tunnel_global_address);
+	void start_(const std::string& id, const ip_address& mn_access_link, bool tunnel_global_address,
+	            uint tunnel_prefix_length);
 	void stop_();
 
+	void reload_(const std::string& file_name);
+	void reload_load(const std::string& file_name);
+	void reload_publish();
+	void reload_bulist(uint32 first);
+	void reload_bulist_fetched(uint32 next, const std::vector<uint32>& indexes,
+	                           const node_db::mobile_node_ptr_list& mns);
+	void reload_bulist_next(uint32 next);
+	void reload_rebind(bulist_entry& be, const mobile_node_ptr& mn);
+	void reload_reclaim(const boost::system::error_code& ec);
+
 	void mobile_node_attach_(const attach_info& ai, completion_functor& completion_handler);
+	void mobile_node_attach_load(const attach_info& ai, completion_functor& completion_handler, uint generation,
+	                             const node_db::mobile_node_ptr_list& mns);
 	void mobile_node_detach_(const attach_info& ai, completion_functor& completion_handler);
 
+	void proxy_binding_ack_list(pbinfo_batch_ptr& pbb, chrono& delay);
 	void proxy_binding_ack(const proxy_binding_info& pbinfo, chrono& delay);
-	void proxy_binding_retry(const boost::system::error_code& ec, proxy_binding_info& pbinfo);
-	void proxy_binding_renew(const boost::system::error_code& ec, const std::string& id);
+	void proxy_binding_timeout(timer_wheel_hook& timer);
+	void proxy_binding_retry(bulist_entry& be);
+	void proxy_binding_renew(bulist_entry& be);
 
 	void add_route_entries(bulist_entry& be);
 	void del_route_entries(bulist_entry& be);
+	void route_entry_completion(const boost::system::error_code& ec, const std::string& id, const ip::prefix_v6& prefix);
+
+	void register_metrics();
 
 private:
-	strand   _service;
-	bulist   _bulist;
-	node_db& _node_db;
-	logger   _log;
+	strand               _service;
+	bulist               _bulist;
+	timer_wheel          _timers;
+	rcu_pointer<node_db> _node_db;
+	node_db&             _initial_node_db; ///Not owned, reloaded ones are
+	logger               _log;
+
+	reload_state                _reload;
+	boost::thread               _reload_thread;
+	boost::asio::deadline_timer _reclaim_timer;
 
 	addrconf_server&   _addrconf;
 	ip::mproto::socket _mp_sock;
+	mp_batch_sender    _pbu_batch;
+	bool               _pbu_flush_pending;
+
+	std::string                   _identifier;
+	ip_address                    _link_local_ip;
+	boost::scoped_ptr<data_plane> _own_data_plane; ///The kernel, unless a data plane was given
+	data_plane&                   _data_plane;
+	size_t                        _concurrency;
 
-	std::string       _identifier;
-	ip_address        _link_local_ip;
-	pmip::ip6_tunnels _tunnels;
-	sys::route_table  _route_table;
-	size_t            _concurrency;
+	stats             _stats;
+	metrics::registry _metrics;
 };
 
 template<class CompletionHandler>
@@ -0,0 +1,308 @@
+//=============================================================================
+// Brief   : Mobility Protocol Batch Receiver/Sender
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_PMIP_MP_BATCH__HPP_
+#define OPMIP_PMIP_MP_BATCH__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/chrono.hpp>
+#include <opmip/ip/mproto.hpp>
+#include <opmip/pmip/types.hpp>
+#include <opmip/pmip/mp_sender.hpp>
+#include <opmip/pool.hpp>
+#include <opmip/tracer.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/utility.hpp>
+#include <sys/socket.h>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace pmip {
+
+///////////////////////////////////////////////////////////////////////////////
+static const size_t k_mp_batch_size = 32;
+
+///////////////////////////////////////////////////////////////////////////////
+class pbinfo_batch;
+
+typedef boost::intrusive_ptr<pbinfo_batch> pbinfo_batch_ptr;
+
+///
+/// Parsed binding information of one received batch. Batches are recycled
+/// through per-thread freelists and shared by an intrusive reference count,
+/// so handing them between strands never touches the heap.
+///
+class pbinfo_batch : boost::noncopyable {
+	friend class pool<pbinfo_batch>;
+
+	template<class Handler>
+	struct handler;
+
+public:
+	typedef proxy_binding_info*       iterator;
+	typedef const proxy_binding_info* const_iterator;
+
+public:
+	static pbinfo_batch_ptr make()
+	{
+		return pbinfo_batch_ptr(pool<pbinfo_batch>::alloc());
+	}
+
+	proxy_binding_info& push()
+	{
+		BOOST_ASSERT(!full());
+
+		proxy_binding_info& pbinfo = _items[_count++];
+
+		pbinfo.clear();
+		return pbinfo;
+	}
+
+	void pop()
+	{
+		BOOST_ASSERT(_count);
+		--_count;
+	}
+
+	size_t size() const { return _count; }
+	bool   full() const { return _count == k_mp_batch_size; }
+
+	iterator begin() { return _items; }
+	iterator end()   { return _items + _count; }
+
+	const_iterator begin() const { return _items; }
+	const_iterator end() const   { return _items + _count; }
+
+	tracer::record&       trace()       { return _trace; }
+	const tracer::record& trace() const { return _trace; }
+
+	///
+	/// Wraps a handler that holds this batch, so that asio queues it in
+	/// memory of the batch instead of the heap when the strand it is
+	/// dispatched to is running on another thread.
+	///
+	template<class Handler>
+	handler<Handler> wrap(Handler h)
+	{
+		return handler<Handler>(this, h);
+	}
+
+	friend void intrusive_ptr_add_ref(pbinfo_batch* pbb)
+	{
+		__atomic_fetch_add(&pbb->_refcount, 1, __ATOMIC_RELAXED);
+	}
+
+	friend void intrusive_ptr_release(pbinfo_batch* pbb)
+	{
+		if (__atomic_sub_fetch(&pbb->_refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+			pbb->_count = 0;
+			pbb->_trace.clear();
+			pool<pbinfo_batch>::free(pbb);
+		}
+	}
+
+private:
+	static const size_t k_reserved_id_length = 64;
+	static const size_t k_reserved_prefixes  = 4;
+	static const size_t k_handler_memory_size = 128;
+
+	pbinfo_batch()
+		: _refcount(0), _count(0), _handler_memory_used(false)
+	{
+		for (size_t i = 0; i < k_mp_batch_size; ++i) {
+			_items[i].id.reserve(k_reserved_id_length);
+			_items[i].prefix_list.reserve(k_reserved_prefixes);
+		}
+	}
+
+	void* handler_allocate(size_t size)
+	{
+		if (_handler_memory_used || size > sizeof(_handler_memory))
+			return ::operator new(size);
+
+		_handler_memory_used = true;
+		return &_handler_memory;
+	}
+
+	void handler_deallocate(void* ptr)
+	{
+		if (ptr == &_handler_memory)
+			_handler_memory_used = false;
+		else
+			::operator delete(ptr);
+	}
+
+private:
+	uint               _refcount;
+	size_t             _count;
+	proxy_binding_info _items[k_mp_batch_size];
+	tracer::record     _trace;
+
+	boost::aligned_storage<k_handler_memory_size>::type _handler_memory;
+	bool                                                _handler_memory_used;
+};
+
+template<class Handler>
+struct pbinfo_batch::handler {
+	handler(pbinfo_batch* pbb, Handler h)
+		: _pbb(pbb), _handler(h)
+	{ }
+
+	void operator()()
+	{
+		_handler();
+	}
+
+	void* allocate(size_t size) { return _pbb->handler_allocate(size); }
+	void  deallocate(void* ptr) { _pbb->handler_deallocate(ptr); }
+
+	friend void* asio_handler_allocate(size_t size, handler* h)
+	{
+		return h->allocate(size);
+	}
+
+	friend void asio_handler_deallocate(void* ptr, size_t, handler* h)
+	{
+		h->deallocate(ptr);
+	}
+
+	pbinfo_batch* _pbb;
+	Handler       _handler;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Drains up to k_mp_batch_size mobility messages per socket wakeup with a
+/// single recvmmsg call into a ring of preallocated buffers.
+///
+class mp_batch_receiver : public boost::enable_shared_from_this<mp_batch_receiver>,
+                          boost::noncopyable {
+	template<class Handler>
+	struct asio_handler;
+
+public:
+	mp_batch_receiver();
+
+	template<class Handler>
+	void async_receive(ip::mproto::socket& sock, Handler handler)
+	{
+		sock.async_receive(boost::asio::null_buffers(),
+		                   asio_handler<Handler>(this, sock, handler));
+	}
+
+	size_t size() const     { return _count; }
+	uint64 readable() const { return _readable; } ///tracer::now() when the socket was reported readable
+
+	bool parse_pbu(size_t i, proxy_binding_info& pbinfo);
+	bool parse_pba(size_t i, proxy_binding_info& pbinfo);
+
+private:
+	void receive(ip::mproto::socket& sock, boost::system::error_code& ec);
+
+private:
+	size_t               _count;
+	uint64               _readable;
+	::mmsghdr            _msgs[k_mp_batch_size];
+	::iovec              _iovs[k_mp_batch_size];
+	ip::mproto::endpoint _endpoints[k_mp_batch_size];
+	uchar                _buffers[k_mp_batch_size][k_mp_buffer_size];
+};
+
+typedef boost::shared_ptr<mp_batch_receiver> mp_batch_receiver_ptr;
+
+template<class Handler>
+struct mp_batch_receiver::asio_handler {
+	asio_handler(mp_batch_receiver* mbr, ip::mproto::socket& sock, Handler handler)
+		: _mbr(mbr->shared_from_this()), _sock(sock), _handler(handler)
+	{ }
+
+	void operator()(boost::system::error_code ec, size_t)
+	{
+		chrono delay;
+
+		delay.start();
+		_mbr->_readable = tracer::now();
+		if (!ec) {
+			_mbr->receive(_sock, ec);
+
+			//
+			// Other receivers waiting on the same socket may have drained
+			// the queue first, just wait for the next wakeup
+			//
+			if (ec == boost::asio::error::would_block) {
+				_mbr->async_receive(_sock, _handler);
+				return;
+			}
+		}
+
+		_handler(ec, _mbr, delay);
+	}
+
+	mp_batch_receiver_ptr _mbr;
+	ip::mproto::socket&   _sock;
+	Handler               _handler;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Queues encoded mobility messages and sends them with a single sendmmsg
+/// call when flushed.
+///
+class mp_batch_sender : boost::noncopyable {
+public:
+	mp_batch_sender();
+
+	void push_pbu(const proxy_binding_info& pbinfo);
+	void push_pba(const proxy_binding_info& pbinfo);
+	void push(const mp_template& tpl, const proxy_binding_info& pbinfo);
+
+	size_t size() const  { return _count; }
+	bool   empty() const { return !_count; }
+	bool   full() const  { return _count == k_mp_batch_size; }
+
+	const uchar* data(size_t i) const   { return _buffers[i]; }
+	size_t       length(size_t i) const { return _iovs[i].iov_len; }
+
+	void clear() { _count = 0; }
+
+	///
+	/// Sends the queued messages without blocking and empties the batch.
+	/// Returns how many were sent, those left out by a full socket buffer
+	/// are dropped with ec set to would_block.
+	///
+	size_t flush(ip::mproto::socket& sock, boost::system::error_code& ec);
+
+private:
+	::mmsghdr* push(const ip::address_v6& address);
+
+private:
+	size_t               _count;
+	::mmsghdr            _msgs[k_mp_batch_size];
+	::iovec              _iovs[k_mp_batch_size];
+	ip::mproto::endpoint _endpoints[k_mp_batch_size];
+	uchar                _buffers[k_mp_batch_size][k_mp_buffer_size];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace pmip */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_PMIP_MP_BATCH__HPP_ */
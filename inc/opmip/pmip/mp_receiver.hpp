@@ -29,6 +29,10 @@
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
 
+///////////////////////////////////////////////////////////////////////////////
+bool parse_pbu(const ip::mproto::endpoint& ep, uchar* buffer, size_t rbytes, proxy_binding_info& pbinfo);
+bool parse_pba(const ip::mproto::endpoint& ep, uchar* buffer, size_t rbytes, proxy_binding_info& pbinfo);
+
 ///////////////////////////////////////////////////////////////////////////////
 class pbu_receiver : public boost::enable_shared_from_this<pbu_receiver> {
 	template<class Handler>
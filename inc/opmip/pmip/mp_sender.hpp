@@ -24,10 +24,45 @@
 #include <opmip/pmip/types.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <vector>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
 
+///////////////////////////////////////////////////////////////////////////////
+static const size_t k_mp_buffer_size = 1460;
+
+///////////////////////////////////////////////////////////////////////////////
+size_t encode_pbu(const proxy_binding_info& pbinfo, uchar* buffer);
+size_t encode_pba(const proxy_binding_info& pbinfo, uchar* buffer);
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// A PBU encoded once per binding. The PBUs of a binding only differ on the
+/// sequence, lifetime, handoff indicator and access technology, which are
+/// patched on each copy, so sending is a copy of the template and a few
+/// stores. The template must be encoded again when the mobile node
+/// identifier or prefixes change.
+///
+class mp_template {
+public:
+	mp_template()
+		: _trailer(0)
+	{ }
+
+	void encode_pbu(const proxy_binding_info& pbinfo);
+
+	bool   empty() const  { return _buffer.empty(); }
+	size_t length() const { return _buffer.size(); }
+
+	size_t copy(const proxy_binding_info& pbinfo, uchar* buffer) const;
+	void   clear()        { _buffer.clear(); }
+
+private:
+	std::vector<uchar> _buffer;
+	uint16             _trailer; ///Offset of the handoff and access technology options
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 class pbu_sender : public boost::enable_shared_from_this<pbu_sender> {
 	template<class Handler>
@@ -47,7 +82,7 @@ public:
 public:
 	ip::mproto::endpoint _endpoint;
 	uint                 _length;
-	uchar                _buffer[1460];
+	uchar                _buffer[k_mp_buffer_size];
 };
 
 typedef boost::shared_ptr<pbu_sender> pbu_sender_ptr;
@@ -87,7 +122,7 @@ public:
 private:
 	ip::mproto::endpoint _endpoint;
 	uint                 _length;
-	uchar                _buffer[1460];
+	uchar                _buffer[k_mp_buffer_size];
 };
 
 typedef boost::shared_ptr<pba_sender> pba_sender_ptr;
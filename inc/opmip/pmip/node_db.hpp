@@ -21,9 +21,19 @@
 ///////////////////////////////////////////////////////////////////////////////
 #include <opmip/base.hpp>
 #include <opmip/rbtree.hpp>
+#include <opmip/hash_index.hpp>
+#include <opmip/perfect_hash.hpp>
+#include <opmip/json_reader.hpp>
+#include <opmip/pmip/types.hpp>
+#include <opmip/pmip/subscriber_store.hpp>
 #include <opmip/ip/address.hpp>
 #include <opmip/ip/prefix.hpp>
 #include <opmip/ll/mac_address.hpp>
+#include <boost/function.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <iosfwd>
+#include <memory>
 #include <vector>
 #include <map>
 
@@ -106,6 +116,12 @@ protected:
 };
 
 ///////////////////////////////////////////////////////////////////////////////
+///
+/// Mobile nodes are shared by an intrusive reference count. The node_db
+/// holds the nodes it keeps and the binding entries hold their node, so a
+/// node evicted from the node_db cache, or from a replaced node_db, lives
+/// on for as long as something uses it.
+///
 class mobile_node : public node {
 	friend class node_db;
 
@@ -119,24 +135,68 @@ public:
 	mobile_node(const std::string& id, const ip_prefix_list& prefs,
 	            const link_address_list& link_addrs, const std::string& lma_id,
 	            const ip_address& home_addr)
-		: node(id), _prefixes(prefs), _link_addrs(link_addrs), _lma_id(lma_id),
-		  _home_addr(home_addr)
+		: node(id), _refcount(0), _index(k_mn_index_invalid), _prefixes(prefs), _link_addrs(link_addrs),
+		  _lma_id(lma_id), _home_addr(home_addr)
 	{ }
 
+	uint32                   index() const          { return _index; }
 	const ip_prefix_list&    prefix_list() const    { return _prefixes; }
 	const link_address_list& link_addresses() const { return _link_addrs; }
 	const ip_address&        home_address() const   { return _home_addr; }
 	const std::string&       lma_id() const         { return _lma_id; }
 
+	///
+	/// Same node with the same attributes, the index aside
+	///
+	bool equivalent(const mobile_node& mn) const
+	{
+		return _id == mn._id && _prefixes == mn._prefixes && _link_addrs == mn._link_addrs
+		       && _lma_id == mn._lma_id && _home_addr == mn._home_addr;
+	}
+
+	friend void intrusive_ptr_add_ref(const mobile_node* mn)
+	{
+		__atomic_fetch_add(&mn->_refcount, 1, __ATOMIC_RELAXED);
+	}
+
+	friend void intrusive_ptr_release(const mobile_node* mn)
+	{
+		if (__atomic_sub_fetch(&mn->_refcount, 1, __ATOMIC_ACQ_REL) == 0)
+			delete mn;
+	}
+
 private:
 	rbtree_hook       _hook;
+	mutable uint      _refcount;
+	uint32            _index;      ///Dense index assigned by the node_db on insertion
 	ip_prefix_list    _prefixes;
 	link_address_list _link_addrs;
 	std::string       _lma_id;
 	ip_address        _home_addr;
 };
 
+typedef boost::intrusive_ptr<const mobile_node> mobile_node_ptr;
+
 ///////////////////////////////////////////////////////////////////////////////
+///
+/// The database is either loaded from JSON or mapped from a binary image
+/// written by write_image. The image is mapped read-only and shared by every
+/// process that maps the same file. Its indexes are searched in place and
+/// a mobile_node is only built from its image record on the first lookup,
+/// router nodes, being few, are built when the image is loaded.
+///
+/// The image is one subscriber_store, the mobile nodes may come from any
+/// other given to load_store. The mobile nodes built from a store are kept
+/// for good or, with a cache capacity, in a cache that evicts the least
+/// recently used ones not in use, so memory follows the active mobile
+/// nodes rather than the provisioned ones. Lookups that would have to read
+/// the store can be done by async_load, on a loader thread.
+///
+/// Once loaded, lookups go through minimal perfect hash indexes built for
+/// the loaded set, one probe into a flat array for the NAI and link address
+/// of a mobile node and the address of a router. The trees are only kept to
+/// check for duplicates and to walk the nodes.
+///
 class node_db {
 	typedef rbtree<router_node, &router_node::_hook, node::compare> router_node_tree;
 	typedef rbtree<mobile_node, &mobile_node::_hook, node::compare> mobile_node_tree;
@@ -146,6 +206,12 @@ class node_db {
 
 	typedef std::map<mobile_node::link_address, mobile_node*> mobile_node_key_tree;
 
+	typedef hash_index<node, std::string, &node::id> mobile_node_id_index;
+	typedef std::vector<mobile_node*>                mobile_node_list;
+
+	typedef perfect_hash_index<const router_node> router_node_lookup;
+	typedef perfect_hash_index<const mobile_node> mobile_node_lookup;
+
 public:
 	typedef std::string                    key;
 	typedef router_node::ip_address        router_key;
@@ -158,21 +224,122 @@ public:
 	typedef router_node_tree::iterator     router_node_iterator;
 	typedef mobile_node_tree::iterator     mobile_node_iterator;
 
+	typedef boost::function<void(size_t done, size_t total)> progress_handler;
+
+	typedef std::vector<mobile_node_ptr>                       mobile_node_ptr_list;
+	typedef boost::function<void(const mobile_node_ptr_list&)> load_handler;
+
 public:
 	node_db();
 	~node_db();
 
-	std::pair<size_t, size_t> load(std::istream& input);
+	///
+	/// The JSON text is read in a single pass that builds the nodes directly,
+	/// the mobile nodes being parsed in parallel for large databases. The
+	/// progress handler is called as mobile nodes are inserted.
+	///
+	std::pair<size_t, size_t> load(std::istream& input, const progress_handler& progress = progress_handler());
+	std::pair<size_t, size_t> load_image(const std::string& file_name);
+	std::pair<size_t, size_t> load_file(const std::string& file_name,
+	                                    const progress_handler& progress = progress_handler());
+	void                      write_image(std::ostream& output) const;
+
+	static bool is_image(const std::string& file_name);
+
+	///
+	/// Takes the mobile nodes from store, the router nodes having to be
+	/// loaded beforehand, from JSON with no mobile nodes. Returns the number
+	/// of mobile node indexes.
+	///
+	size_t load_store(std::auto_ptr<subscriber_store> store);
+
+	///
+	/// Renumbers a freshly loaded database so the mobile nodes also found in
+	/// previous keep their index there. The others take the indexes left
+	/// unused in previous, lowest first, and then are numbered after its
+	/// last index. The indexes of the mobile nodes missing from this
+	/// database are left unused, until the next reload gives them out again,
+	/// so the index space only grows by the nodes added in one reload.
+	/// Called before the database is used, for the database to replace
+	/// previous.
+	///
+	void keep_indexes(const node_db& previous);
+
+	///
+	/// Bounds how many mobile nodes built from a store are kept, 0 keeps
+	/// them all. Mobile nodes in use are kept regardless. Set before the
+	/// store is loaded.
+	///
+	void   set_cache_capacity(size_t capacity) { _cache_capacity = capacity; }
+	size_t cache_capacity() const              { return _cache_capacity; }
+
+	///
+	/// Spreads the cached mobile nodes over stripes by index modulo the
+	/// stripe count, each stripe with its own lock. The LMA sets it to its
+	/// shard count, so each shard looks up a stripe of its own. Set before
+	/// the store is loaded.
+	///
+	void   set_cache_stripes(size_t stripes) { _cache_stripes = stripes; }
+	size_t cache_stripes() const             { return _cache_stripes; }
 
 	const router_node* find_router(const key& key) const;
-	const mobile_node* find_mobile_node(const key& key) const;
+	mobile_node_ptr    find_mobile_node(const key& key) const;
 
 	const router_node* find_router(const router_key& key) const;
-	const mobile_node* find_mobile_node(const mn_key& key) const;
+	mobile_node_ptr    find_mobile_node(const mn_key& key) const;
+
+	///
+	/// The index of a mobile node, without building it from a store,
+	/// k_mn_index_invalid if not found
+	///
+	uint32 index_of(const key& key) const;
+
+	///
+	/// Mobile nodes are numbered from 0 to mobile_node_count() - 1 in the
+	/// order they are loaded, or as given by keep_indexes, in which case some
+	/// indexes may have no mobile node. The index of a mobile node never
+	/// changes.
+	///
+	mobile_node_ptr mobile_node_at(uint32 index) const
+	{
+		mobile_node_ptr mn = peek_mobile_node(index);
+
+		return (mn || !_store) ? mn : load_mobile_node(index);
+	}
+
+	///
+	/// The mobile node if at hand, nullptr if it has to be read from the
+	/// store first or if there is no mobile node at index
+	///
+	mobile_node_ptr peek_mobile_node(uint32 index) const
+	{
+		if (_cache)
+			return cache_find(index);
+
+		if (index >= _mobile_nodes.size())
+			return mobile_node_ptr();
+
+		return __atomic_load_n(&_mobile_nodes[index], __ATOMIC_ACQUIRE);
+	}
+
+	///
+	/// Gets the mobile nodes at indexes on the loader thread, which calls
+	/// handler with them in the same order, nullptr where there is no
+	/// mobile node. Loads are done in the order they are asked for, those
+	/// still pending when the database is deleted complete with no mobile
+	/// nodes.
+	///
+	void async_load(const std::vector<uint32>& indexes, const load_handler& handler) const;
+
+	size_t mobile_node_count() const { return _cache ? _index_count : _mobile_nodes.size(); }
 
 	router_node_iterator router_node_begin() { return _router_nodes_by_id.begin(); }
 	router_node_iterator router_node_end()   { return _router_nodes_by_id.end(); }
 
+	///
+	/// Only the mobile nodes loaded from JSON, use mobile_node_at to walk
+	/// the mobile nodes of a store
+	///
 	mobile_node_iterator mobile_node_begin() { return _mobile_nodes_by_id.begin(); }
 	mobile_node_iterator mobile_node_end()   { return _mobile_nodes_by_id.end(); }
 
@@ -182,11 +349,39 @@ protected:
 	                        const link_address_list& link_addrs, const std::string& lma_id,
 	                        const ip_address& home_addr);
 
+private:
+	class mobile_node_cache;
+	class loader;
+
+	bool insert_mobile_node(std::auto_ptr<mobile_node>& mn);
+	bool load_router(json_reader& js);
+	void build_lookups();
+
+	mobile_node_ptr    load_mobile_node(uint32 index) const;
+	mobile_node_ptr    cache_find(uint32 index) const;
+	uint32             record_index(uint32 record) const;
+	bool               index_used(uint32 index) const;
+	const mobile_node* find_loaded(const key& key) const;
+
 private:
 	router_node_tree     _router_nodes_by_id;
 	mobile_node_tree     _mobile_nodes_by_id;
 	router_node_key_tree _router_nodes_by_key;
 	mobile_node_key_tree _mobile_nodes_by_key;
+	mobile_node_id_index _mobile_nodes_by_hash;
+	mobile_node_list     _mobile_nodes;
+	router_node_lookup   _router_nodes_by_address;
+	mobile_node_lookup   _mobile_nodes_by_nai;
+	mobile_node_lookup   _mobile_nodes_by_link_address;
+	std::vector<uint32>  _store_index;  ///Store record to index, empty when the same
+	std::vector<uint32>  _store_record; ///Index to store record, empty when the same
+	size_t               _index_count;  ///Mobile node indexes, when cached
+
+	boost::scoped_ptr<subscriber_store>  _store;
+	boost::scoped_ptr<mobile_node_cache> _cache;
+	size_t                               _cache_capacity;
+	size_t                               _cache_stripes;
+	mutable loader*                      _loader; ///Started by the first async_load
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,74 @@
+//=============================================================================
+// Brief   : Subscriber Store
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_PMIP_SUBSCRIBER_STORE__HPP_
+#define OPMIP_PMIP_SUBSCRIBER_STORE__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/ll/mac_address.hpp>
+#include <boost/utility.hpp>
+#include <string>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace pmip {
+
+///////////////////////////////////////////////////////////////////////////////
+class mobile_node;
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Storage of the mobile nodes of a node_db that does not keep them all in
+/// memory. The records are numbered from 0 to record_count() - 1 and found
+/// by NAI or link address. The keys are expected to be found without
+/// blocking, only reading a record may wait on I/O, which the node_db does
+/// on its loader thread for asynchronous lookups. Every method may be
+/// called concurrently.
+///
+/// The binary image written by node_db::write_image is the store used by
+/// node_db::load_image, other stores are given to node_db::load_store.
+///
+class subscriber_store : boost::noncopyable {
+public:
+	virtual ~subscriber_store()
+	{ }
+
+	virtual uint32 record_count() const = 0;
+
+	///
+	/// The record of the mobile node, k_mn_index_invalid if not found
+	///
+	virtual uint32 find_record(const std::string& id) const = 0;
+	virtual uint32 find_record(const ll::mac_address& addr) const = 0;
+
+	///
+	/// The NAI of a record, empty if the record is unusable
+	///
+	virtual std::string record_id(uint32 record) const = 0;
+
+	///
+	/// A new mobile node built from a record, nullptr if the record is
+	/// unusable
+	///
+	virtual mobile_node* read_record(uint32 record) const = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace pmip */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_PMIP_SUBSCRIBER_STORE__HPP_ */
@@ -24,19 +24,30 @@
 #include <opmip/sys/ip6_tunnel.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
 #include <set>
+#include <vector>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
 
 ///////////////////////////////////////////////////////////////////////////////
+///
+/// Tunnels to the remote peers, one ip6tnl device per remote. In external
+/// mode a single collect metadata device is shared by all the remotes and
+/// the remote is given by the encapsulation of each route instead.
+///
+/// Tunnels are named after their remote, so one left behind by a previous
+/// run, on purpose by detach or not, is adopted if it still goes to the
+/// same remote.
+///
 class ip6_tunnels {
 	struct entry {
 		entry(boost::asio::io_service& ios)
-			: tunnel(ios), refcount(1)
+			: tunnel(ios), refcount(1), pinned(false)
 		{ }
 
 		sys::ip6_tunnel tunnel;
 		uint            refcount;
+		bool            pinned;   ///Provisioned, never garbage collected
 	};
 
 	typedef boost::ptr_map<ip::address_v6, entry> map;
@@ -48,20 +59,55 @@ public:
 	ip6_tunnels(boost::asio::io_service& ios);
 	~ip6_tunnels();
 
-	void open(const ip::address_v6& address, bool global_address = false);
+	///
+	/// With global_address the local address is also given to the tunnel
+	/// devices, as part of a prefix_length long prefix
+	///
+	void open(const ip::address_v6& address, uint prefix_length, bool global_address = false,
+	          bool external = false);
 	void close();
 
+	///
+	/// Closes leaving the tunnel devices in place, for the next run
+	///
+	void detach();
+
 	uint get(const ip::address_v6& remote);
 	void del(const ip::address_v6& remote);
+	uint move(const ip::address_v6& from, const ip::address_v6& to);
+
+	///
+	/// Opens the tunnels to the given remotes ahead of their first use,
+	/// spread over up to concurrency threads. Returns how many are ready,
+	/// the others are still opened on demand by get.
+	///
+	size_t provision(const std::vector<ip::address_v6>& remotes, size_t concurrency);
+
+	///
+	/// Deletes the tunnels from the local address left behind by a previous
+	/// run and not taken over since open, and with them the routes through
+	/// them. Returns how many were deleted.
+	///
+	size_t collect();
 
 	const ip::address_v6& get_local_address() const { return _local; }
+	bool                  is_external() const       { return _external.is_open(); }
+	size_t                size() const              { return _tunnels.size() + is_external(); }
+
+private:
+	void open_tunnel(entry& tun, const ip::address_v6& remote, boost::system::error_code& ec);
+	void open_tunnel(entry& tun, const char* name, const ip::address_v6& remote, boost::system::error_code& ec);
+	void provision_range(const std::vector<std::pair<ip::address_v6, entry*> >& tunnels,
+	                     size_t first, size_t step);
 
 private:
 	boost::asio::io_service& _io_service;
 	ip::address_v6           _local;
+	uint                     _prefix_length;
 	map                      _tunnels;
 	map_gc                   _gc;
 	bool                     _global_address;
+	sys::ip6_tunnel          _external;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -25,22 +25,59 @@
 #include <opmip/ll/mac_address.hpp>
 #include <opmip/ll/technology.hpp>
 #include <opmip/ip/mproto.hpp>
+#include <algorithm>
 #include <string>
 #include <vector>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
 
+///////////////////////////////////////////////////////////////////////////////
+static const uint32 k_mn_index_invalid = ~uint32(0); ///Mobile node not in the node database
+
 ///////////////////////////////////////////////////////////////////////////////
 struct proxy_binding_info {
 	proxy_binding_info()
-		: lifetime(0), sequence(0),
+		: mn_index(k_mn_index_invalid), lifetime(0), sequence(0),
 		  handoff(ip::mproto::option::handoff::k_reserved),
 		  status(ip::mproto::pba::status_ok),
 		  link_type(ll::k_tech_unknown)
 	{ }
 
+	///
+	/// Resets to the default state, keeping the capacity already reserved by
+	/// the id and prefix_list so they can be refilled without allocations.
+	///
+	void clear()
+	{
+		id.clear();
+		mn_index = k_mn_index_invalid;
+		address = ip::address_v6();
+		lifetime = 0;
+		sequence = 0;
+		handoff = ip::mproto::option::handoff::k_reserved;
+		status = ip::mproto::pba::status_ok;
+		prefix_list.clear();
+		link_address = ll::mac_address();
+		link_type = ll::k_tech_unknown;
+	}
+
+	void swap(proxy_binding_info& y)
+	{
+		id.swap(y.id);
+		std::swap(mn_index, y.mn_index);
+		std::swap(address, y.address);
+		std::swap(lifetime, y.lifetime);
+		std::swap(sequence, y.sequence);
+		std::swap(handoff, y.handoff);
+		std::swap(status, y.status);
+		prefix_list.swap(y.prefix_list);
+		std::swap(link_address, y.link_address);
+		std::swap(link_type, y.link_type);
+	}
+
 	std::string                       id;
+	uint32                            mn_index; ///node_db index of id, resolved on reception
 	ip::address_v6                    address;
 	uint                              lifetime;
 	uint16                            sequence;
@@ -51,6 +88,11 @@ struct proxy_binding_info {
 	ll::technology                    link_type;
 };
 
+inline void swap(proxy_binding_info& x, proxy_binding_info& y)
+{
+	x.swap(y);
+}
+
 struct router_advertisement_info {
 	router_advertisement_info()
 		: hop_limit(64), lifetime(~0), device_id(~0), mtu(1500)
@@ -0,0 +1,189 @@
+//=============================================================================
+// Brief   : Per-thread Object Pool
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_POOL__HPP_
+#define OPMIP_POOL__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/utility.hpp>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Recycles objects of type T through per-thread freelists. An object goes
+/// back to the freelist of the thread that allocated it, whichever thread
+/// releases it: other threads push it onto the remote stack of that
+/// freelist, which the owner takes whole once its own list runs dry. The
+/// heap is only used when both are empty, which is accounted by
+/// heap_allocations(). Released objects are kept as they are, so any
+/// capacity they hold is reused by the next owner.
+///
+/// The freelist of a thread that exits is adopted by the next thread that
+/// needs one, objects still out return to it meanwhile.
+///
+template<class T, size_t FreelistSize = 64>
+class pool : boost::noncopyable {
+	struct freelist;
+
+	struct node {
+		T         obj;   ///First, so the object and node addresses are the same
+		freelist* owner;
+		node*     next;
+	};
+
+	struct freelist {
+		freelist() : head(nullptr), count(0), remote(nullptr), next(nullptr)
+		{ }
+
+		node*     head;   ///Owner thread only
+		size_t    count;
+		node*     remote; ///Pushed by other threads, taken whole by the owner
+		freelist* next;   ///Orphans list
+	};
+
+public:
+	static T* alloc()
+	{
+		freelist& fl = local();
+
+		if (!fl.head)
+			take_remote(fl);
+
+		if (fl.head) {
+			node* n = fl.head;
+
+			fl.head = n->next;
+			--fl.count;
+			return &n->obj;
+		}
+
+		__atomic_fetch_add(&_heap_allocations, 1, __ATOMIC_RELAXED);
+
+		node* n = new node();
+
+		n->owner = &fl;
+		return &n->obj;
+	}
+
+	static void free(T* obj)
+	{
+		node*     n = reinterpret_cast<node*>(obj);
+		freelist* fl = n->owner;
+
+		if (fl == _local) {
+			if (fl->count < FreelistSize) {
+				n->next = fl->head;
+				fl->head = n;
+				++fl->count;
+			} else
+				delete n;
+			return;
+		}
+
+		n->next = __atomic_load_n(&fl->remote, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&fl->remote, &n->next, n, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+	}
+
+	static uint64 heap_allocations()
+	{
+		return __atomic_load_n(&_heap_allocations, __ATOMIC_RELAXED);
+	}
+
+private:
+	static freelist& local()
+	{
+		if (!_local) {
+			{
+				boost::mutex::scoped_lock lock(_orphans_mutex);
+
+				_local = _orphans;
+				if (_local)
+					_orphans = _local->next;
+			}
+
+			if (!_local)
+				_local = new freelist;
+			_owner.reset(_local);
+		}
+
+		return *_local;
+	}
+
+	///
+	/// Only the owner takes the remote stack, and takes all of it, so a
+	/// node popped there is never pushed back under its feet
+	///
+	static void take_remote(freelist& fl)
+	{
+		node* n = __atomic_exchange_n(&fl.remote, static_cast<node*>(nullptr), __ATOMIC_ACQUIRE);
+
+		fl.head = n;
+		for (; n; n = n->next)
+			++fl.count;
+	}
+
+	static void orphan(freelist* fl)
+	{
+		while (fl->head) {
+			node* n = fl->head;
+
+			fl->head = n->next;
+			delete n;
+		}
+		fl->count = 0;
+		_local = nullptr;
+
+		boost::mutex::scoped_lock lock(_orphans_mutex);
+
+		fl->next = _orphans;
+		_orphans = fl;
+	}
+
+private:
+	static __thread freelist*                   _local;
+	static boost::thread_specific_ptr<freelist> _owner;
+	static freelist*                            _orphans;
+	static boost::mutex                         _orphans_mutex;
+	static uint64                               _heap_allocations;
+};
+
+template<class T, size_t FreelistSize>
+__thread typename pool<T, FreelistSize>::freelist* pool<T, FreelistSize>::_local;
+
+template<class T, size_t FreelistSize>
+boost::thread_specific_ptr<typename pool<T, FreelistSize>::freelist> pool<T, FreelistSize>::_owner(
+	&pool<T, FreelistSize>::orphan);
+
+template<class T, size_t FreelistSize>
+typename pool<T, FreelistSize>::freelist* pool<T, FreelistSize>::_orphans;
+
+template<class T, size_t FreelistSize>
+boost::mutex pool<T, FreelistSize>::_orphans_mutex;
+
+template<class T, size_t FreelistSize>
+uint64 pool<T, FreelistSize>::_heap_allocations;
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+#endif /* OPMIP_POOL__HPP_ */
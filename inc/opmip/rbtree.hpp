@@ -132,7 +132,7 @@ public:
 	const_iterator begin() const
 	{
 		if (!_root)
-			return iterator();
+			return const_iterator();
 
 		return const_iterator(_root->min(), nullptr);
 	}
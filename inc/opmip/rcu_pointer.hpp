@@ -0,0 +1,130 @@
+//=============================================================================
+// Brief   : Read-Copy-Update Pointer
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_RCU_POINTER__HPP_
+#define OPMIP_RCU_POINTER__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <boost/utility.hpp>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Pointer to an object that is replaced as a whole while readers use it.
+/// Readers never block, they hold a reader for as long as they use the
+/// object. The writer exchanges the pointer and reclaims the replaced object
+/// once synchronized returns true, i.e. once the readers that could still
+/// see it are gone.
+///
+/// Readers are counted in one of two counters, picked by the epoch they
+/// entered in. Exchanging flips the epoch, after which the counter of the
+/// previous epoch only drops. There must be a single writer, which waits
+/// for synchronized before the next exchange.
+///
+/// Code that is otherwise known not to overlap the reclamation, such as
+/// handlers serialized with it, may use get without a reader.
+///
+template<class T>
+class rcu_pointer : boost::noncopyable {
+public:
+	class reader : boost::noncopyable {
+	public:
+		explicit reader(const rcu_pointer& ptr)
+			: _ptr(ptr), _epoch(ptr.enter())
+		{ }
+
+		~reader()
+		{
+			_ptr.leave(_epoch);
+		}
+
+		T* get() const        { return _ptr.get(); }
+		T* operator->() const { return _ptr.get(); }
+		T& operator*() const  { return *_ptr.get(); }
+
+	private:
+		const rcu_pointer& _ptr;
+		uint               _epoch;
+	};
+
+public:
+	explicit rcu_pointer(T* ptr)
+		: _ptr(ptr), _epoch(0)
+	{
+		_readers[0] = 0;
+		_readers[1] = 0;
+	}
+
+	T* get() const
+	{
+		return __atomic_load_n(&_ptr, __ATOMIC_ACQUIRE);
+	}
+
+	///
+	/// Publishes ptr, returns the replaced pointer and the epoch to wait on
+	///
+	T* exchange(T* ptr, uint& epoch)
+	{
+		T* prev = __atomic_exchange_n(&_ptr, ptr, __ATOMIC_SEQ_CST);
+
+		epoch = __atomic_fetch_add(&_epoch, 1, __ATOMIC_SEQ_CST);
+		return prev;
+	}
+
+	bool synchronized(uint epoch) const
+	{
+		return !__atomic_load_n(&_readers[epoch & 1], __ATOMIC_SEQ_CST);
+	}
+
+private:
+	///
+	/// A reader only counts if the epoch did not flip while it was being
+	/// counted, otherwise it could be counted in the epoch being waited
+	/// on by the next exchange, after that wait is over
+	///
+	uint enter() const
+	{
+		for (;;) {
+			uint epoch = __atomic_load_n(&_epoch, __ATOMIC_SEQ_CST);
+
+			__atomic_add_fetch(&_readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&_epoch, __ATOMIC_SEQ_CST) == epoch)
+				return epoch;
+
+			__atomic_sub_fetch(&_readers[epoch & 1], 1, __ATOMIC_RELEASE);
+		}
+	}
+
+	void leave(uint epoch) const
+	{
+		__atomic_sub_fetch(&_readers[epoch & 1], 1, __ATOMIC_RELEASE);
+	}
+
+private:
+	T*           _ptr;
+	uint         _epoch;
+	mutable uint _readers[2];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_RCU_POINTER__HPP_ */
@@ -44,6 +44,8 @@ public:
 	                            const ip::address_v6& local_address,
 	                            const ip::address_v6& remote_address,
 	                            boost::system::error_code& ec);
+	void open_external(const char* name);
+	void open_external(const char* name, boost::system::error_code& ec);
 	bool is_open() const;
 	void close();
 	void close(boost::system::error_code& ec);
@@ -59,6 +61,9 @@ public:
 	uint get_device_id();
 	uint get_device_id(boost::system::error_code& ec);
 
+	ip::address_v6 local_address() const;
+	ip::address_v6 remote_address() const;
+
 	bool delete_on_close(bool value);
 	bool delete_on_close() const;
 };
@@ -94,6 +99,18 @@ inline void ip6_tunnel::open(const char* name,
 	service.open(implementation, name, device, local_address, remote_address, ec);
 }
 
+inline void ip6_tunnel::open_external(const char* name)
+{
+	boost::system::error_code ec;
+	service.open_external(implementation, name, ec);
+	throw_on_error(ec, "opmip::ip6_tunnel::open_external");
+}
+
+inline void ip6_tunnel::open_external(const char* name, boost::system::error_code& ec)
+{
+	service.open_external(implementation, name, ec);
+}
+
 inline bool ip6_tunnel::is_open() const
 {
 	return service.is_open(implementation);
@@ -161,6 +178,16 @@ inline uint ip6_tunnel::get_device_id(boost::system::error_code& ec)
 	return service.get_device_id(implementation, ec);
 }
 
+inline ip::address_v6 ip6_tunnel::local_address() const
+{
+	return service.local_address(implementation);
+}
+
+inline ip::address_v6 ip6_tunnel::remote_address() const
+{
+	return service.remote_address(implementation);
+}
+
 inline bool ip6_tunnel::delete_on_close(bool value)
 {
 	return service.delete_on_close(implementation, value);
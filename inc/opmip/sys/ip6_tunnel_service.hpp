@@ -22,6 +22,7 @@
 #include <opmip/base.hpp>
 #include <opmip/list_hook.hpp>
 #include <opmip/sys/netlink.hpp>
+#include <opmip/sys/netlink/message_batch.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/address_v6.hpp>
@@ -47,6 +48,9 @@ class ip6_tunnel_service : public boost::asio::io_service::service {
 	static const int ioctl_remove    = 0x89F2;
 	static const int ioctl_change    = 0x89F3;
 
+	static const uint16 iptun_attr_proto            = 9;
+	static const uint16 iptun_attr_collect_metadata = 19;
+
 public:
 	static boost::asio::io_service::id id;
 
@@ -67,6 +71,8 @@ public:
 	                                     const ip::address_v6& local_address,
 	                                     const ip::address_v6& remote_address,
 	                                     boost::system::error_code& ec);
+	void open_external(implementation_type& impl, const char* name,
+	                                              boost::system::error_code& ec);
 	bool is_open(const implementation_type& impl) const;
 	void close(implementation_type& impl, boost::system::error_code& ec);
 
@@ -79,6 +85,9 @@ public:
 
 	uint get_device_id(implementation_type& impl, boost::system::error_code& ec);
 
+	ip::address_v6 local_address(const implementation_type& impl) const;
+	ip::address_v6 remote_address(const implementation_type& impl) const;
+
 	bool delete_on_close(implementation_type& impl, bool value);
 	bool delete_on_close(const implementation_type& impl) const;
 
@@ -88,6 +97,7 @@ private:
 	void add(parameters& op, boost::system::error_code& ec);
 	void remove(parameters& op, boost::system::error_code& ec);
 	void change(parameters& op, boost::system::error_code& ec);
+	void add_external(const char* name, boost::system::error_code& ec);
 	void io_control(const char* name, int opcode, void* data, boost::system::error_code& ec);
 	void io_control(int opcode, void* data, boost::system::error_code& ec);
 
@@ -0,0 +1,136 @@
+//=============================================================================
+// Brief   : Netlink Message Batch
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_SYS_NETLINK_MESSAGE_BATCH__HPP_
+#define OPMIP_SYS_NETLINK_MESSAGE_BATCH__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/sys/netlink/header.hpp>
+#include <opmip/sys/netlink/message_iterator.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/utility.hpp>
+#include <algorithm>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace sys { namespace nl {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Several netlink messages built back to back in a single arena, ready to
+/// be sent with one sendmsg. Clearing keeps the memory, so a batch reused
+/// for every transaction stops allocating once it has grown to the size of
+/// the largest one. References returned by push_message are invalidated by
+/// the next push. Nested attributes are opened with begin_nested, every
+/// attribute pushed until the matching end_nested goes inside it.
+///
+class message_batch : boost::noncopyable {
+	struct attr_header {
+		uint16 length;
+		uint16 type;
+	};
+
+public:
+	message_batch()
+		: _last(0), _count(0)
+	{ }
+
+	template<class Message>
+	Message& push_message(uint16 mtype, uint16 flags)
+	{
+		const size_t hlen = align_to_<4, sizeof(header)>::value;
+		const size_t len  = hlen + align_to_<4, sizeof(Message)>::value;
+		uchar*       mem  = grow(len);
+		header*      hdr  = reinterpret_cast<header*>(mem);
+
+		hdr->length = len;
+		hdr->type = mtype;
+		hdr->flags = flags;
+
+		_last = mem - &_data[0];
+		++_count;
+
+		return *reinterpret_cast<Message*>(mem + hlen);
+	}
+
+	void push_attribute(uint16 type, const void* data, size_t length)
+	{
+		BOOST_ASSERT(_count);
+
+		const size_t len = align_to_<4, sizeof(attr_header)>::value + length;
+		attr_header* hdr = reinterpret_cast<attr_header*>(grow(align_to<4>(len)));
+		const uchar* src = reinterpret_cast<const uchar*>(data);
+		uchar*       dst = reinterpret_cast<uchar*>(hdr) + align_to_<4, sizeof(attr_header)>::value;
+
+		hdr->length = len;
+		hdr->type = type;
+		std::copy(src, src + length, dst);
+
+		reinterpret_cast<header*>(&_data[_last])->length += align_to<4>(len);
+	}
+
+	size_t begin_nested(uint16 type)
+	{
+		size_t offset = _data.size();
+
+		push_attribute(type, nullptr, 0);
+		return offset;
+	}
+
+	void end_nested(size_t offset)
+	{
+		reinterpret_cast<attr_header*>(&_data[offset])->length = _data.size() - offset;
+	}
+
+	void clear()
+	{
+		_data.clear();
+		_last = 0;
+		_count = 0;
+	}
+
+	message_iterator begin() { return _count ? message_iterator(&_data[0], _data.size()) : message_iterator(); }
+	message_iterator end()   { return message_iterator(); }
+
+	const uchar* data() const   { return _count ? &_data[0] : nullptr; }
+	size_t       length() const { return _data.size(); }
+	size_t       size() const   { return _count; }
+	bool         empty() const  { return !_count; }
+
+	boost::asio::const_buffers_1 cbuffer() const { return boost::asio::const_buffers_1(data(), length()); }
+
+private:
+	uchar* grow(size_t len)
+	{
+		size_t off = _data.size();
+
+		_data.resize(off + len);
+		return &_data[off];
+	}
+
+private:
+	std::vector<uchar> _data;
+	size_t             _last;
+	size_t             _count;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace nl */ } /* namespace sys */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_SYS_NETLINK_MESSAGE_BATCH__HPP_ */
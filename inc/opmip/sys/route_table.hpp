@@ -22,14 +22,27 @@
 #include <opmip/base.hpp>
 #include <opmip/ip/prefix.hpp>
 #include <opmip/ip/address.hpp>
-#include <opmip/sys/netlink.hpp>
+#include <opmip/sys/rtnl_engine.hpp>
 #include <boost/system/error_code.hpp>
+#include <boost/thread/mutex.hpp>
 #include <map>
+#include <vector>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace sys {
 
 ///////////////////////////////////////////////////////////////////////////////
+///
+/// Kernel routes installed on behalf of PMIP. The table is updated right
+/// away while the kernel requests complete asynchronously; the optional
+/// handler reports the kernel result. A route whose creation failed is
+/// dropped from the table before the handler is called. Replacing a route
+/// moves it to another device in place, with a single NLM_F_REPLACE, so
+/// the prefix is never left unroutable; if the kernel refuses it the
+/// previous route is restored in the table. A route with a remote is
+/// installed with ip6 lightweight tunnel encapsulation to that remote, its
+/// device must be an external (collect metadata) ip6tnl tunnel.
+///
 class route_table : boost::noncopyable {
 public:
 	typedef opmip::ip::prefix_v6  ip_prefix;
@@ -41,49 +54,178 @@ public:
 			: device(0)
 		{ }
 
-		entry(uint device_, ip_address gateway_)
-			: device(device_), gateway(gateway_)
+		entry(uint device_, ip_address gateway_, ip_address remote_ = ip_address())
+			: device(device_), gateway(gateway_), remote(remote_)
 		{ }
 
+		friend bool operator==(const entry& rhs, const entry& lhs)
+		{
+			return rhs.device == lhs.device && rhs.gateway == lhs.gateway && rhs.remote == lhs.remote;
+		}
 
 		uint       device;
 		ip_address gateway;
+		ip_address remote;  ///Encapsulation endpoint, unspecified for plain routes
 	};
 
 private:
+	static const uint8 k_encap_hop_limit = 64; ///Same as the ip6tnl devices
+
 	typedef std::map<ip_prefix, entry> map;
-	typedef map::iterator                  iterator;
+	typedef map::iterator              iterator;
 
 public:
-	typedef map::const_iterator const_iterator;
+	typedef rtnl_engine::completion_handler completion_handler;
+
+	struct operation {
+		enum op_type {
+			k_add,
+			k_replace,
+			k_remove,
+			k_purge, ///Remove, known or not, as left in place by a previous run
+		};
+
+		operation(op_type type_, bool by_src_, const ip_prefix& prefix_, const entry& route_,
+		          const completion_handler& handler_)
+			: type(type_), by_src(by_src_), prefix(prefix_), route(route_), handler(handler_)
+		{ }
+
+		op_type            type;
+		bool               by_src;
+		ip_prefix          prefix;
+		entry              route;
+		completion_handler handler;
+	};
+
+public:
+	///
+	/// Route operations committed together, the kernel requests of all of
+	/// them go out in a single netlink send. Operations that do not change
+	/// the table, adding a known prefix, removing an unknown one or
+	/// replacing a route with itself, are skipped and their handlers are
+	/// not called. A purge is always sent, it removes a route the kernel
+	/// may hold from a previous run.
+	///
+	class batch {
+		friend class route_table;
+
+	public:
+		typedef std::vector<operation>::const_iterator const_iterator;
+
+	public:
+		void add_by_src(const ip_prefix& prefix, uint device, const ip_address& gateway = ip_address(),
+		                const completion_handler& handler = completion_handler())
+		{
+			_ops.push_back(operation(operation::k_add, true, prefix, entry(device, gateway), handler));
+		}
+
+		void replace_by_src(const ip_prefix& prefix, uint device, const ip_address& gateway = ip_address(),
+		                    const completion_handler& handler = completion_handler())
+		{
+			_ops.push_back(operation(operation::k_replace, true, prefix, entry(device, gateway), handler));
+		}
+
+		void remove_by_src(const ip_prefix& prefix, const completion_handler& handler = completion_handler())
+		{
+			_ops.push_back(operation(operation::k_remove, true, prefix, entry(), handler));
+		}
+
+		void add_by_dst(const ip_prefix& prefix, uint device, const ip_address& gateway = ip_address(),
+		                const completion_handler& handler = completion_handler())
+		{
+			_ops.push_back(operation(operation::k_add, false, prefix, entry(device, gateway), handler));
+		}
+
+		void replace_by_dst(const ip_prefix& prefix, uint device, const ip_address& gateway = ip_address(),
+		                    const completion_handler& handler = completion_handler())
+		{
+			_ops.push_back(operation(operation::k_replace, false, prefix, entry(device, gateway), handler));
+		}
+
+		void add_by_dst(const ip_prefix& prefix, const entry& route,
+		                const completion_handler& handler = completion_handler())
+		{
+			_ops.push_back(operation(operation::k_add, false, prefix, route, handler));
+		}
+
+		void replace_by_dst(const ip_prefix& prefix, const entry& route,
+		                    const completion_handler& handler = completion_handler())
+		{
+			_ops.push_back(operation(operation::k_replace, false, prefix, route, handler));
+		}
+
+		void remove_by_dst(const ip_prefix& prefix, const completion_handler& handler = completion_handler())
+		{
+			_ops.push_back(operation(operation::k_remove, false, prefix, entry(), handler));
+		}
+
+		void purge_by_dst(const ip_prefix& prefix, const completion_handler& handler = completion_handler())
+		{
+			_ops.push_back(operation(operation::k_purge, false, prefix, entry(), handler));
+		}
+
+		void   clear()       { _ops.clear(); }
+		size_t size() const  { return _ops.size(); }
+		bool   empty() const { return _ops.empty(); }
+
+		const_iterator begin() const { return _ops.begin(); }
+		const_iterator end() const   { return _ops.end(); }
+
+	private:
+		std::vector<operation> _ops;
+	};
 
 public:
 	route_table(boost::asio::io_service& ios);
 	~route_table();
 
-	std::pair<const_iterator, bool> add_by_src(const ip_prefix& prefix, uint device, const ip_address& gateway = ip_address());
-	std::pair<const_iterator, bool> find_by_src(const ip_prefix& prefix) const;
-	bool                            remove_by_src(const ip_prefix& prefix);
-
-	std::pair<const_iterator, bool> add_by_dst(const ip_prefix& prefix, uint device, const ip_address& gateway = ip_address());
-	std::pair<const_iterator, bool> find_by_dst(const ip_prefix& prefix) const;
-	bool                            remove_by_dst(const ip_prefix& prefix);
-
-	void clear();
+	bool add_by_src(const ip_prefix& prefix, uint device, const ip_address& gateway = ip_address(),
+	                const completion_handler& handler = completion_handler());
+	bool replace_by_src(const ip_prefix& prefix, uint device, const ip_address& gateway = ip_address(),
+	                    const completion_handler& handler = completion_handler());
+	bool find_by_src(const ip_prefix& prefix, entry& e) const;
+	bool remove_by_src(const ip_prefix& prefix, const completion_handler& handler = completion_handler());
+
+	bool add_by_dst(const ip_prefix& prefix, uint device, const ip_address& gateway = ip_address(),
+	                const completion_handler& handler = completion_handler());
+	bool replace_by_dst(const ip_prefix& prefix, uint device, const ip_address& gateway = ip_address(),
+	                    const completion_handler& handler = completion_handler());
+	bool add_by_dst(const ip_prefix& prefix, const entry& route,
+	                const completion_handler& handler = completion_handler());
+	bool replace_by_dst(const ip_prefix& prefix, const entry& route,
+	                    const completion_handler& handler = completion_handler());
+	bool find_by_dst(const ip_prefix& prefix, entry& e) const;
+	bool remove_by_dst(const ip_prefix& prefix, const completion_handler& handler = completion_handler());
+
+	size_t commit(batch& b);
+	void   clear();
+
+	///
+	/// Forgets every route, leaving them in the kernel for a later run to
+	/// take over, its adds replace them in place
+	///
+	void release();
 
 private:
-	void add_by_src(iterator& entry, boost::system::error_code& ec);
-	void remove_by_src(iterator& entry, boost::system::error_code& ec);
+	bool commit(const operation& op);
+	bool find(const map& routes, const ip_prefix& prefix, entry& e) const;
+	bool apply(const operation& op);
+	void submit();
 
-	void add_by_dst(iterator& entry, boost::system::error_code& ec);
-	void remove_by_dst(iterator& entry, boost::system::error_code& ec);
+	void add_completion(const boost::system::error_code& ec, map& routes, const ip_prefix& prefix,
+	                    const entry& route, const completion_handler& handler);
+	void replace_completion(const boost::system::error_code& ec, map& routes, const ip_prefix& prefix,
+	                        const entry& prev, const entry& route, const completion_handler& handler);
 
-private:
-	std::map<ip_prefix, entry> _map_by_src;
-	std::map<ip_prefix, entry> _map_by_dst;
+	void push_request(uint16 mtype, bool by_src, const map::value_type& entry, const completion_handler& handler);
 
-	netlink<0>::socket _rtnl;
-	uint               _rtnl_seq;
+private:
+	mutable boost::mutex      _mutex;
+	map                       _map_by_src;
+	map                       _map_by_dst;
+	nl::message_batch         _requests;
+	rtnl_engine::handler_list _handlers;
+	rtnl_engine               _rtnl;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
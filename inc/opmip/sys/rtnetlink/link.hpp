@@ -95,6 +95,16 @@ public:
 		attr_end
 	};
 
+	enum info_attr_type {
+		info_attr_begin = 1,
+
+		info_attr_kind = info_attr_begin,
+		info_attr_data,
+		info_attr_xstats,
+
+		info_attr_end
+	};
+
 	struct stats {
 		uint32 rx_packets;
 		uint32 tx_packets;
@@ -110,9 +110,30 @@ public:
 		attr_priority,
 		attr_prefered_source,
 		//imcomplete
+		attr_encap_type = 21,
+		attr_encap,
 		attr_end
 	};
 
+	enum encap_type {
+		encap_none,
+		encap_mpls,
+		encap_ip,
+		encap_ila,
+		encap_ip6,
+	};
+
+	enum encap_ip6_attr_type {
+		encap_ip6_attr_begin = 1,
+		encap_ip6_attr_id = encap_ip6_attr_begin,
+		encap_ip6_attr_destination,
+		encap_ip6_attr_source,
+		encap_ip6_attr_hop_limit,
+		encap_ip6_attr_traffic_class,
+		encap_ip6_attr_flags,
+		encap_ip6_attr_end
+	};
+
 public:
 	route()
 		: family(0), dst_len(0), src_len(0), tos(0), table(0), protocol(0),
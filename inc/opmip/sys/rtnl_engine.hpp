@@ -0,0 +1,115 @@
+//=============================================================================
+// Brief   : Asynchronous RTNetlink Transaction Engine
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_SYS_RTNL_ENGINE__HPP_
+#define OPMIP_SYS_RTNL_ENGINE__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/sys/netlink.hpp>
+#include <opmip/sys/netlink/header.hpp>
+#include <opmip/sys/netlink/message.hpp>
+#include <opmip/sys/netlink/message_batch.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/function.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+#include <deque>
+#include <map>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace sys {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Pipelined rtnetlink requests. Requests are sent as soon as they are
+/// submitted, without waiting for the kernel reply of the previous ones,
+/// and a batch of requests goes out in a single send. Each reply is matched
+/// back to its request by sequence number and the completion handler is
+/// called from the io_service with the kernel error, if any. The number of
+/// requests in flight is bounded so the replies fit the socket receive
+/// buffer, the excess waits in a backlog. All calls are thread safe.
+///
+class rtnl_engine : boost::noncopyable {
+	typedef netlink<0>::socket socket;
+
+public:
+	typedef boost::function<void(const boost::system::error_code&)> completion_handler;
+	typedef std::vector<completion_handler>                         handler_list;
+
+	static const uint k_default_timeout = 5000;    ///Synchronous drain timeout (ms)
+	static const uint k_max_in_flight   = 128;     ///Requests sent and not yet replied
+	static const int  k_receive_buffer  = 1 << 20; ///Socket receive buffer size (bytes)
+
+public:
+	rtnl_engine(boost::asio::io_service& ios);
+	~rtnl_engine();
+
+	template<class Message>
+	void async_request(nl::message<Message>& msg, const completion_handler& handler);
+	void async_request(nl::message_batch& batch, const handler_list& handlers);
+
+	void   wait(uint timeout = k_default_timeout);
+	size_t pending() const;
+
+private:
+	typedef std::map<uint32, completion_handler>                                   pending_map;
+	typedef std::deque<std::pair<uint32, completion_handler> >                     request_queue;
+	typedef std::vector<std::pair<completion_handler, boost::system::error_code> > completion_list;
+
+	void queue(boost::asio::const_buffers_1 buffer, uint32 sequence, const completion_handler& handler);
+	void flush(completion_list& done);
+	void arm();
+	void receive_handler(const boost::system::error_code& ec);
+	void receive(completion_list& done, boost::system::error_code& ec);
+	void abort(const boost::system::error_code& ec, completion_list& done);
+	void post(completion_list& done);
+
+	static void complete(completion_list& done);
+
+private:
+	mutable boost::mutex _mutex;
+	socket               _rtnl;
+	uint32               _sequence;
+	pending_map          _pending;
+	request_queue        _backlog;
+	std::vector<uchar>   _backlog_data;
+	size_t               _backlog_head;
+	bool                 _armed;
+	uint32               _buffer[2048];
+};
+
+template<class Message>
+inline void rtnl_engine::async_request(nl::message<Message>& msg, const completion_handler& handler)
+{
+	completion_list           done;
+	boost::mutex::scoped_lock lock(_mutex);
+
+	msg.flags(msg.flags() | nl::header::request | nl::header::ack);
+	msg.sequence(++_sequence);
+	queue(msg.cbuffer(), msg.sequence(), handler);
+	flush(done);
+	post(done);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace sys */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_SYS_RTNL_ENGINE__HPP_ */
@@ -0,0 +1,155 @@
+//=============================================================================
+// Brief   : Hierarchical Timer Wheel
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_TIMER_WHEEL__HPP_
+#define OPMIP_TIMER_WHEEL__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/list_hook.hpp>
+#include <opmip/ptime.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/function.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/utility.hpp>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Timer wheel slot link, to be embedded in the object being timed. The
+/// owner is recovered with parent_of when the timer expires.
+///
+struct timer_wheel_hook : private list_hook {
+	friend class timer_wheel;
+
+	timer_wheel_hook()
+		: expires(0)
+	{
+		init();
+	}
+
+	~timer_wheel_hook()
+	{
+		BOOST_ASSERT(!is_scheduled());
+	}
+
+	bool is_scheduled() const { return !empty(); }
+
+private:
+	uint64 expires; ///Expiration tick
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Hashed hierarchical timing wheel driven by a single asio timer tick.
+/// Scheduling, cancelation and rescheduling are O(1), entries only cost
+/// the embedded hook. All calls, including the expiration handler, must
+/// be made from the strand given at construction. The tick handler is
+/// allocated from the wheel itself, so ticking never touches the heap.
+///
+class timer_wheel : boost::noncopyable {
+	typedef boost::asio::io_service::strand strand;
+
+	static const size_t k_tick_memory_size = 256;
+
+	///
+	/// Only one wait is outstanding at a time, and asio releases the memory
+	/// of an operation before calling its handler, so a single block serves
+	/// the wait and the strand dispatch that follows
+	///
+	struct tick_handler {
+		explicit tick_handler(timer_wheel* wheel)
+			: wheel(wheel)
+		{ }
+
+		void operator()(const boost::system::error_code& ec) const
+		{
+			wheel->tick(ec);
+		}
+
+		void* allocate(size_t size) { return wheel->tick_allocate(size); }
+		void  deallocate(void* ptr) { wheel->tick_deallocate(ptr); }
+
+		friend void* asio_handler_allocate(size_t size, tick_handler* h)
+		{
+			return h->allocate(size);
+		}
+
+		friend void asio_handler_deallocate(void* ptr, size_t, tick_handler* h)
+		{
+			h->deallocate(ptr);
+		}
+
+		timer_wheel* wheel;
+	};
+
+	static const uint   k_slot_bits = 8;
+	static const uint   k_levels    = 4;
+	static const uint64 k_slots     = uint64(1) << k_slot_bits;
+	static const uint64 k_slot_mask = k_slots - 1;
+	static const uint64 k_max_ticks = (uint64(1) << (k_slot_bits * k_levels)) - 1;
+
+public:
+	typedef boost::function<void(timer_wheel_hook&)> handler_type;
+
+	static const uint k_default_resolution = 100; ///Tick resolution (ms)
+
+public:
+	timer_wheel(strand& srv, const handler_type& handler, uint resolution = k_default_resolution);
+	~timer_wheel();
+
+	void schedule(timer_wheel_hook& hook, uint64 ms);
+	void cancel(timer_wheel_hook& hook);
+	void clear();
+
+	size_t size() const       { return _count; }
+	uint   resolution() const { return _resolution; }
+
+private:
+	void   tick(const boost::system::error_code& ec);
+	void   step();
+	void   insert(timer_wheel_hook& hook);
+	void   arm();
+	uint64 current() const;
+
+	void* tick_allocate(size_t size);
+	void  tick_deallocate(void* ptr);
+
+private:
+	strand&                     _service;
+	boost::asio::deadline_timer _timer;
+	handler_type                _handler;
+	uint                        _resolution;
+	ptime                       _epoch;
+	uint64                      _now;
+	size_t                      _count;
+	bool                        _armed;
+	list_hook                   _slots[k_levels][k_slots];
+
+	boost::aligned_storage<k_tick_memory_size>::type _tick_memory;
+	bool                                             _tick_memory_used;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_TIMER_WHEEL__HPP_ */
@@ -0,0 +1,132 @@
+//=============================================================================
+// Brief   : Per Stage Latency Tracer
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#ifndef OPMIP_TRACER__HPP_
+#define OPMIP_TRACER__HPP_
+
+///////////////////////////////////////////////////////////////////////////////
+#include <opmip/base.hpp>
+#include <opmip/metrics.hpp>
+#include <boost/utility.hpp>
+#include <algorithm>
+#include <string>
+#include <time.h>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Follows items through a fixed sequence of processing stages. Each item
+/// carries a record with the time it reached every stage. Committed records
+/// feed one histogram per stage, with the time since the previous stage
+/// reached, and one for the whole pipeline. One in every sample_rate records
+/// is also written to a binary ring file, when one is open.
+///
+/// The ring file starts with a file_header followed by capacity
+/// file_record slots. The header head field counts the records ever written,
+/// slot n % capacity holds record n and its sequence is n + 1 once complete.
+///
+class tracer : boost::noncopyable {
+public:
+	static const uint k_max_stages = 8;
+	static const uint k_name_size  = 16;
+
+	struct record {
+		record()
+		{
+			clear();
+		}
+
+		void clear()
+		{
+			std::fill(stamps, stamps + k_max_stages, 0);
+		}
+
+		void stamp(uint stage)
+		{
+			BOOST_ASSERT(stage < k_max_stages);
+			stamps[stage] = now();
+		}
+
+		uint64 stamps[k_max_stages]; ///Nanoseconds, 0 if the stage was not reached
+	};
+
+	struct file_header {
+		char   magic[8];     ///"OPMIPTRC"
+		uint32 version;
+		uint32 stages;
+		uint32 capacity;
+		uint32 record_size;
+		uint64 head;
+		char   names[k_max_stages][k_name_size];
+	};
+
+	struct file_record {
+		uint64 sequence;
+		uint64 stamps[k_max_stages];
+	};
+
+	///
+	/// Monotonic time in nanoseconds, served by the vDSO without entering
+	/// the kernel
+	///
+	static uint64 now()
+	{
+		::timespec ts;
+
+		::clock_gettime(CLOCK_MONOTONIC, &ts);
+		return uint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+	}
+
+public:
+	tracer(const char* const names[], uint stages);
+	~tracer();
+
+	void open(const std::string& path, uint sample_rate, uint capacity = 1 << 16);
+	void close();
+
+	void commit(const record& rec);
+
+	uint                      stages() const           { return _stages; }
+	const char*               stage_name(uint i) const { return _names[i]; }
+	const metrics::histogram& stage(uint i) const      { return _histograms[i]; }
+	const metrics::histogram& total() const            { return _total; }
+
+	void register_metrics(metrics::registry& reg, const std::string& name, const std::string& help) const;
+
+private:
+	void sample(const record& rec);
+
+private:
+	const char* const* _names;
+	uint               _stages;
+	metrics::histogram _histograms[k_max_stages];
+	metrics::histogram _total;
+
+	uint         _sample_rate;
+	uint64       _sampled;
+	file_header* _file;
+	file_record* _ring;
+	size_t       _file_size;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
+#endif /* OPMIP_TRACER__HPP_ */
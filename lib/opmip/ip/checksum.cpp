@@ -0,0 +1,261 @@
+//=============================================================================
+// Brief   : IP One's Complemente Checksum
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/ip/checksum.hpp>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#	define OPMIP_IP_CHECKSUM_X86
+#	include <immintrin.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace ip {
+
+///////////////////////////////////////////////////////////////////////////////
+typedef uint16 (*sum_function)(const uchar* data, size_t len);
+
+static uint16 fold(uint64 sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return static_cast<uint16>(sum);
+}
+
+///
+/// Sums 32 bit words, 2^32 being 1 modulo 0xffff the folded result is the
+/// same as summing the 16 bit words
+///
+static uint64 sum_tail(const uchar* data, size_t len, uint64 sum)
+{
+	uint32 w32;
+	uint16 w16;
+
+	while (len >= 4) {
+		std::memcpy(&w32, data, 4);
+		sum += w32;
+		data += 4;
+		len -= 4;
+	}
+
+	if (len >= 2) {
+		std::memcpy(&w16, data, 2);
+		sum += w16;
+		data += 2;
+		len -= 2;
+	}
+
+	//
+	// The odd byte is padded with a zero byte in memory
+	//
+	if (len) {
+		w16 = 0;
+		std::memcpy(&w16, data, 1);
+		sum += w16;
+	}
+
+	return sum;
+}
+
+static uint16 sum_scalar(const uchar* data, size_t len)
+{
+	return fold(sum_tail(data, len, 0));
+}
+
+#ifdef OPMIP_IP_CHECKSUM_X86
+///
+/// Each 32 bit lane takes two 16 bit words per iteration, so the lanes are
+/// drained before they can overflow
+///
+static const size_t k_lane_iterations = 16384;
+
+__attribute__((target("sse2")))
+static uint16 sum_sse2(const uchar* data, size_t len)
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint64        sum = 0;
+
+	while (len >= 16) {
+		size_t  n = std::min(len / 16, k_lane_iterations);
+		__m128i acc = _mm_setzero_si128();
+		uint32  lanes[4];
+
+		len -= n * 16;
+		while (n--) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+
+			acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+			acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+			data += 16;
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+		sum += uint64(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+	}
+
+	return fold(sum_tail(data, len, sum));
+}
+
+__attribute__((target("avx2")))
+static uint16 sum_avx2(const uchar* data, size_t len)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	uint64        sum = 0;
+
+	while (len >= 32) {
+		size_t  n = std::min(len / 32, k_lane_iterations);
+		__m256i acc = _mm256_setzero_si256();
+		uint32  lanes[8];
+
+		len -= n * 32;
+		while (n--) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+
+			acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+			acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+			data += 32;
+		}
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+		for (size_t i = 0; i < 8; ++i)
+			sum += lanes[i];
+	}
+
+	return fold(sum_tail(data, len, sum));
+}
+#endif /* OPMIP_IP_CHECKSUM_X86 */
+
+///////////////////////////////////////////////////////////////////////////////
+static bool supported(checksum::kernel k)
+{
+	switch (k) {
+	case checksum::k_scalar:
+		return true;
+
+#ifdef OPMIP_IP_CHECKSUM_X86
+	case checksum::k_sse2:
+		return __builtin_cpu_supports("sse2");
+
+	case checksum::k_avx2:
+		return __builtin_cpu_supports("avx2");
+#endif
+
+	default:
+		return false;
+	}
+}
+
+static sum_function function_of(checksum::kernel k)
+{
+	switch (k) {
+#ifdef OPMIP_IP_CHECKSUM_X86
+	case checksum::k_sse2: return sum_sse2;
+	case checksum::k_avx2: return sum_avx2;
+#endif
+	default:               return sum_scalar;
+	}
+}
+
+static uint16 sum_dispatch(const uchar* data, size_t len);
+
+///
+/// Resolved on first use, so checksums can be taken during static
+/// initialization. Races are harmless, every thread resolves the same kernel.
+///
+static sum_function     sum_current = sum_dispatch;
+static checksum::kernel kernel_current = checksum::k_scalar;
+
+static void resolve()
+{
+	static const checksum::kernel order[] = { checksum::k_avx2, checksum::k_sse2, checksum::k_scalar };
+
+	for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); ++i) {
+		if (supported(order[i])) {
+			checksum::select(order[i]);
+			return;
+		}
+	}
+}
+
+static uint16 sum_dispatch(const uchar* data, size_t len)
+{
+	resolve();
+	return __atomic_load_n(&sum_current, __ATOMIC_ACQUIRE)(data, len);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void checksum::update_pseudo_header(const address_v6& src, const address_v6& dst, uint32 len, uint8 next_header)
+{
+	struct {
+		address_v6::bytes_type src;
+		address_v6::bytes_type dst;
+		uint32                 len;
+		uint8                  zero[3];
+		uint8                  next_header;
+	} ph;
+
+	ph.src = src.to_bytes();
+	ph.dst = dst.to_bytes();
+	ph.len = htonl(len);
+	ph.zero[0] = 0;
+	ph.zero[1] = 0;
+	ph.zero[2] = 0;
+	ph.next_header = next_header;
+
+	update(&ph, sizeof(ph));
+}
+
+uint16 checksum::partial(const void* data, size_t len)
+{
+	return __atomic_load_n(&sum_current, __ATOMIC_ACQUIRE)(static_cast<const uchar*>(data), len);
+}
+
+bool checksum::select(kernel k)
+{
+	if (!supported(k))
+		return false;
+
+	__atomic_store_n(&kernel_current, k, __ATOMIC_RELAXED);
+	__atomic_store_n(&sum_current, function_of(k), __ATOMIC_RELEASE);
+	return true;
+}
+
+checksum::kernel checksum::selected()
+{
+	if (__atomic_load_n(&sum_current, __ATOMIC_ACQUIRE) == sum_dispatch)
+		resolve();
+
+	return __atomic_load_n(&kernel_current, __ATOMIC_RELAXED);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+uint16 ipv6_checksum(const address_v6& src, const address_v6& dst, uint8 next_header,
+                     const void* data, size_t len)
+{
+	checksum cs;
+
+	cs.update_pseudo_header(src, dst, len, next_header);
+	cs.update(data, len);
+	return cs.final();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace ip */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,329 @@
+//=============================================================================
+// Brief   : Streaming JSON Reader
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/json_reader.hpp>
+#include <opmip/exception.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+static void append_utf8(std::string& str, uint32 cp)
+{
+	if (cp < 0x80) {
+		str += char(cp);
+
+	} else if (cp < 0x800) {
+		str += char(0xc0 | (cp >> 6));
+		str += char(0x80 | (cp & 0x3f));
+
+	} else if (cp < 0x10000) {
+		str += char(0xe0 | (cp >> 12));
+		str += char(0x80 | ((cp >> 6) & 0x3f));
+		str += char(0x80 | (cp & 0x3f));
+
+	} else {
+		str += char(0xf0 | (cp >> 18));
+		str += char(0x80 | ((cp >> 12) & 0x3f));
+		str += char(0x80 | ((cp >> 6) & 0x3f));
+		str += char(0x80 | (cp & 0x3f));
+	}
+}
+
+static bool is_literal(char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+	       || c == '-' || c == '+' || c == '.';
+}
+
+///////////////////////////////////////////////////////////////////////////////
+json_reader::json_reader(const char* begin, const char* end)
+	: _begin(begin), _end(end), _pos(begin)
+{
+}
+
+void json_reader::begin_object()
+{
+	expect('{');
+	_first.push_back(true);
+}
+
+bool json_reader::next_member(std::string& name)
+{
+	if (!next('}'))
+		return false;
+
+	if (!at_string())
+		error("member name expected");
+
+	string(name);
+	expect(':');
+	skip_space();
+	return true;
+}
+
+void json_reader::begin_array()
+{
+	expect('[');
+	_first.push_back(true);
+}
+
+bool json_reader::next_element()
+{
+	return next(']');
+}
+
+bool json_reader::at_array()
+{
+	skip_space();
+	return _pos != _end && *_pos == '[';
+}
+
+bool json_reader::at_string()
+{
+	skip_space();
+	return _pos != _end && *_pos == '"';
+}
+
+void json_reader::value(std::string& str)
+{
+	if (at_string()) {
+		string(str);
+		return;
+	}
+
+	const char* first = _pos;
+
+	while (_pos != _end && is_literal(*_pos))
+		++_pos;
+
+	if (first == _pos)
+		error("value expected");
+
+	str.assign(first, _pos);
+}
+
+void json_reader::skip()
+{
+	skip_space();
+	if (_pos == _end)
+		error("value expected");
+
+	if (*_pos == '"') {
+		skip_string();
+		return;
+	}
+
+	if (*_pos != '{' && *_pos != '[') {
+		const char* first = _pos;
+
+		while (_pos != _end && is_literal(*_pos))
+			++_pos;
+		if (first == _pos)
+			error("value expected");
+		return;
+	}
+
+	//
+	// Only the nesting is followed, the skipped value is not validated
+	//
+	size_t depth = 0;
+
+	do {
+		if (_pos == _end)
+			error("unexpected end of text");
+
+		switch (*_pos) {
+		case '"':
+			skip_string();
+			continue;
+
+		case '{':
+		case '[':
+			++depth;
+			break;
+
+		case '}':
+		case ']':
+			--depth;
+			break;
+		}
+		++_pos;
+	} while (depth);
+}
+
+void json_reader::seek(const char* pos)
+{
+	BOOST_ASSERT(pos >= _begin && pos <= _end);
+
+	_pos = pos;
+	_first.clear();
+}
+
+void json_reader::error(const std::string& what) const
+{
+	size_t line = std::count(_begin, _pos, '\n') + 1;
+
+	throw_exception(errc::make_error_code(errc::invalid_argument),
+	                "JSON " + what + " at line " + boost::lexical_cast<std::string>(line));
+}
+
+void json_reader::skip_space()
+{
+	while (_pos != _end && (*_pos == ' ' || *_pos == '\t' || *_pos == '\n' || *_pos == '\r'))
+		++_pos;
+}
+
+void json_reader::expect(char c)
+{
+	skip_space();
+	if (_pos == _end || *_pos != c)
+		error(std::string("'") + c + "' expected");
+
+	++_pos;
+}
+
+bool json_reader::next(char close)
+{
+	BOOST_ASSERT(!_first.empty());
+
+	skip_space();
+	if (_pos != _end && *_pos == close) {
+		++_pos;
+		_first.pop_back();
+		return false;
+	}
+
+	if (!_first.back())
+		expect(',');
+
+	_first.back() = false;
+	skip_space();
+	return true;
+}
+
+void json_reader::string(std::string& str)
+{
+	const char* first = ++_pos;
+
+	//
+	// Most strings have no escapes and are copied at once
+	//
+	while (_pos != _end && *_pos != '"' && *_pos != '\\')
+		++_pos;
+
+	str.assign(first, _pos);
+
+	while (_pos != _end && *_pos != '"') {
+		if (*_pos != '\\') {
+			str += *_pos++;
+			continue;
+		}
+
+		if (++_pos == _end)
+			break;
+
+		switch (*_pos++) {
+		case '"':  str += '"'; break;
+		case '\\': str += '\\'; break;
+		case '/':  str += '/'; break;
+		case 'b':  str += '\b'; break;
+		case 'f':  str += '\f'; break;
+		case 'n':  str += '\n'; break;
+		case 'r':  str += '\r'; break;
+		case 't':  str += '\t'; break;
+		case 'u': {
+			uint32 cp = 0;
+
+			for (uint i = 0; i < 4; ++i, ++_pos) {
+				int d = (_pos != _end) ? hex_digit(*_pos) : -1;
+
+				if (d < 0)
+					error("bad unicode escape");
+				cp = (cp << 4) | d;
+			}
+
+			//
+			// A high surrogate must be followed by the low one
+			//
+			if (cp >= 0xd800 && cp < 0xdc00) {
+				uint32 lo = 0;
+
+				if (_end - _pos < 6 || _pos[0] != '\\' || _pos[1] != 'u')
+					error("bad unicode escape");
+				_pos += 2;
+				for (uint i = 0; i < 4; ++i, ++_pos) {
+					int d = hex_digit(*_pos);
+
+					if (d < 0)
+						error("bad unicode escape");
+					lo = (lo << 4) | d;
+				}
+				if (lo < 0xdc00 || lo >= 0xe000)
+					error("bad unicode escape");
+				cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+			}
+
+			append_utf8(str, cp);
+			break;
+		}
+
+		default:
+			--_pos;
+			error("bad escape");
+		}
+	}
+
+	if (_pos == _end)
+		error("unterminated string");
+
+	++_pos;
+}
+
+void json_reader::skip_string()
+{
+	++_pos;
+	while (_pos != _end && *_pos != '"') {
+		if (*_pos == '\\' && _pos + 1 != _end)
+			++_pos;
+		++_pos;
+	}
+
+	if (_pos == _end)
+		error("unterminated string");
+
+	++_pos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
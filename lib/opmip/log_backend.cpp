@@ -0,0 +1,238 @@
+//=============================================================================
+// Brief   : Asynchronous Logging Backend
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/log_backend.hpp>
+#include <boost/bind.hpp>
+#include <boost/throw_exception.hpp>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+static const size_t k_max_drain = 4096; ///Records written between sink flushes
+
+static bool earlier(const ptime& lhs, const ptime& rhs)
+{
+	return (lhs.seconds() < rhs.seconds())
+	       || ((lhs.seconds() == rhs.seconds()) && (lhs.nanoseconds() < rhs.nanoseconds()));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+log_backend* log_backend::_instance = nullptr;
+
+log_backend::log_backend()
+	: _local(&release_ring), _released_dropped(0), _stop(false), _idle(false)
+{
+	if (__atomic_load_n(&_instance, __ATOMIC_ACQUIRE))
+		boost::throw_exception(std::logic_error("opmip::log_backend: only one backend may exist"));
+
+	_thread = boost::thread(boost::bind(&log_backend::run, this));
+	__atomic_store_n(&_instance, this, __ATOMIC_RELEASE);
+}
+
+log_backend::~log_backend()
+{
+	//
+	// New records are formatted synchronously from now on, the ones
+	// already queued are written before the thread exits
+	//
+	__atomic_store_n(&_instance, static_cast<log_backend*>(nullptr), __ATOMIC_RELEASE);
+	__atomic_store_n(&_stop, true, __ATOMIC_RELEASE);
+	wake();
+	_thread.join();
+
+	//
+	// Rings of threads still running are left to them, _local no longer
+	// reaches them but their cleanup runs when they exit
+	//
+	_local.reset();
+	for (size_t i = _rings.size(); i--; ) {
+		if (!_rings[i].release())
+			_rings.release(_rings.begin() + i).release();
+	}
+}
+
+uint64 log_backend::dropped() const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	uint64                    n = _released_dropped;
+
+	for (boost::ptr_vector<detail::log_ring>::const_iterator i = _rings.begin(), e = _rings.end(); i != e; ++i)
+		n += i->dropped();
+
+	return n;
+}
+
+detail::log_ring& log_backend::ring()
+{
+	detail::log_ring* rg = _local.get();
+
+	if (!rg) {
+		rg = new detail::log_ring(k_ring_size);
+		_local.reset(rg);
+
+		boost::mutex::scoped_lock lock(_mutex);
+
+		_rings.push_back(rg);
+		_reported.push_back(0);
+	}
+
+	return *rg;
+}
+
+void log_backend::release_ring(detail::log_ring* rg)
+{
+	//
+	// A record may still be in the ring when its thread exits, the backend
+	// frees it once drained. If the backend is already gone the ring was
+	// left to this thread.
+	//
+	if (rg->release()) {
+		delete rg;
+		return;
+	}
+
+	log_backend* self = __atomic_load_n(&_instance, __ATOMIC_ACQUIRE);
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (self && __atomic_load_n(&self->_idle, __ATOMIC_RELAXED))
+		self->wake();
+}
+
+void log_backend::run()
+{
+	for (;;) {
+		bool stop = __atomic_load_n(&_stop, __ATOMIC_ACQUIRE);
+
+		if (drain())
+			continue;
+		if (stop)
+			break;
+
+		//
+		// A record committed after the rings were last looked at finds the
+		// flag set, its producer then waits on the mutex until this thread
+		// is waiting on the condition
+		//
+		boost::mutex::scoped_lock lock(_wake_mutex);
+
+		__atomic_store_n(&_idle, true, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (!pending() && !__atomic_load_n(&_stop, __ATOMIC_ACQUIRE))
+			_wake.wait(lock);
+		__atomic_store_n(&_idle, false, __ATOMIC_RELAXED);
+	}
+}
+
+bool log_backend::pending() const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	for (boost::ptr_vector<detail::log_ring>::const_iterator i = _rings.begin(), e = _rings.end(); i != e; ++i)
+		if (!i->empty() || i->released())
+			return true;
+
+	return false;
+}
+
+void log_backend::wake()
+{
+	boost::mutex::scoped_lock lock(_wake_mutex);
+
+	_wake.notify_one();
+}
+
+bool log_backend::drain()
+{
+	std::vector<detail::log_ring*> rings;
+	std::vector<std::ostream*>     sinks;
+	size_t                         count = 0;
+
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		for (size_t i = 0; i < _rings.size(); ) {
+			uint64 dropped = _rings[i].dropped();
+
+			if (dropped != _reported[i]) {
+				std::cerr << "log: " << (dropped - _reported[i]) << " records dropped" << std::endl;
+				_reported[i] = dropped;
+			}
+
+			//
+			// The owner exited, nothing more is pushed after what is
+			// already in the ring
+			//
+			if (_rings[i].released() && _rings[i].empty()) {
+				_released_dropped += dropped;
+				_rings.erase(_rings.begin() + i);
+				_reported.erase(_reported.begin() + i);
+				continue;
+			}
+
+			rings.push_back(&_rings[i]);
+			++i;
+		}
+	}
+
+	//
+	// Each ring is in order, the oldest front record among them is the
+	// next one written
+	//
+	const size_t hlen = align_to_<detail::k_log_record_align, sizeof(detail::log_record)>::value;
+
+	for (; count < k_max_drain; ++count) {
+		detail::log_ring*   from = nullptr;
+		detail::log_record* rec = nullptr;
+
+		for (std::vector<detail::log_ring*>::iterator i = rings.begin(), e = rings.end(); i != e; ++i) {
+			detail::log_record* tmp = (*i)->front();
+
+			if (tmp && (!rec || earlier(tmp->time, rec->time))) {
+				rec = tmp;
+				from = *i;
+			}
+		}
+
+		if (!rec)
+			break;
+
+		std::ostream& os = *rec->sink;
+
+		os << rec->name << ": ";
+		rec->format(os, reinterpret_cast<uchar*>(rec) + hlen);
+		os << '\n';
+
+		if (std::find(sinks.begin(), sinks.end(), &os) == sinks.end())
+			sinks.push_back(&os);
+
+		from->pop(rec);
+	}
+
+	for (std::vector<std::ostream*>::iterator i = sinks.begin(), e = sinks.end(); i != e; ++i)
+		std::flush(**i);
+
+	return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
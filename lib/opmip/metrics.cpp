@@ -0,0 +1,211 @@
+//=============================================================================
+// Brief   : Performance Metrics
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/metrics.hpp>
+#include <boost/io/ios_state.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace metrics {
+
+///////////////////////////////////////////////////////////////////////////////
+static const uint k_export_buckets = 26; ///Exported bucket bounds, 1 us to 2^25 us (~33 s)
+
+static void write_seconds(std::ostream& os, uint64 usec)
+{
+	boost::io::ios_all_saver ias(os);
+
+	os << (usec / 1000000) << '.' << std::setfill('0') << std::setw(6) << (usec % 1000000);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+histogram::histogram()
+	: _sum(0)
+{
+	std::fill(_buckets, _buckets + k_buckets, 0);
+}
+
+uint64 histogram::count() const
+{
+	uint64 n = 0;
+
+	for (uint i = 0; i < k_buckets; ++i)
+		n += __atomic_load_n(&_buckets[i], __ATOMIC_RELAXED);
+
+	return n;
+}
+
+uint64 histogram::count_below(uint64 usec) const
+{
+	uint64 n = 0;
+
+	for (uint i = 0; i < k_buckets && bucket_high(i) < usec; ++i)
+		n += __atomic_load_n(&_buckets[i], __ATOMIC_RELAXED);
+
+	return n;
+}
+
+uint64 histogram::quantile(double q) const
+{
+	uint64 counts[k_buckets];
+	uint64 total = 0;
+
+	for (uint i = 0; i < k_buckets; ++i)
+		total += counts[i] = __atomic_load_n(&_buckets[i], __ATOMIC_RELAXED);
+
+	if (!total)
+		return 0;
+
+	uint64 rank = std::max<uint64>(1, uint64(std::ceil(std::min(std::max(q, 0.0), 1.0) * total)));
+	uint64 n = 0;
+
+	for (uint i = 0; i < k_buckets; ++i) {
+		n += counts[i];
+		if (n >= rank)
+			return bucket_high(i);
+	}
+
+	return bucket_high(k_buckets - 1);
+}
+
+uint histogram::bucket(uint64 usec)
+{
+	if (usec < k_sub_count)
+		return usec;
+
+	uint msb = 63 - __builtin_clzll(usec);
+
+	if (msb >= k_max_bits)
+		return k_buckets - 1;
+
+	return (msb - k_sub_bits + 1) * k_sub_count + ((usec >> (msb - k_sub_bits)) & (k_sub_count - 1));
+}
+
+uint64 histogram::bucket_low(uint index)
+{
+	if (index < k_sub_count)
+		return index;
+
+	uint octave = index / k_sub_count;
+	uint sub = index % k_sub_count;
+
+	return uint64(k_sub_count + sub) << (octave - 1);
+}
+
+uint64 histogram::bucket_high(uint index)
+{
+	if (index + 1 >= k_buckets)
+		return ~uint64(0);
+
+	return bucket_low(index + 1) - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+registry::registry()
+{
+}
+
+void registry::add(const std::string& name, const std::string& help, const counter& c, const std::string& labels)
+{
+	add(name, help, k_counter, labels, &c);
+}
+
+void registry::add(const std::string& name, const std::string& help, const gauge& g, const std::string& labels)
+{
+	add(name, help, k_gauge, labels, &g);
+}
+
+void registry::add(const std::string& name, const std::string& help, const histogram& h, const std::string& labels)
+{
+	add(name, help, k_histogram, labels, &h);
+}
+
+void registry::add(const std::string& name, const std::string& help, kind type,
+                   const std::string& labels, const void* value)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	family_map::iterator      i = _families.find(name);
+
+	if (i == _families.end()) {
+		i = _families.insert(family_map::value_type(name, family())).first;
+		i->second.help = help;
+		i->second.type = type;
+		_order.push_back(name);
+	}
+
+	BOOST_ASSERT(i->second.type == type);
+	i->second.metrics.push_back(metric(labels, value));
+}
+
+void registry::write(std::ostream& os) const
+{
+	static const char* const types[] = { "counter", "gauge", "histogram" };
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	for (std::vector<std::string>::const_iterator i = _order.begin(), e = _order.end(); i != e; ++i) {
+		const family& fm = _families.find(*i)->second;
+
+		os << "# HELP " << *i << ' ' << fm.help << '\n'
+		   << "# TYPE " << *i << ' ' << types[fm.type] << '\n';
+
+		for (std::vector<metric>::const_iterator j = fm.metrics.begin(), f = fm.metrics.end(); j != f; ++j) {
+			std::string labels = j->labels.empty() ? std::string() : '{' + j->labels + '}';
+
+			switch (fm.type) {
+			case k_counter:
+				os << *i << labels << ' ' << static_cast<const counter*>(j->value)->value() << '\n';
+				break;
+
+			case k_gauge:
+				os << *i << labels << ' ' << static_cast<const gauge*>(j->value)->value() << '\n';
+				break;
+
+			case k_histogram: {
+				const histogram& h = *static_cast<const histogram*>(j->value);
+				std::string      prefix = j->labels.empty() ? std::string("{") : '{' + j->labels + ',';
+
+				//
+				// Prometheus bounds are inclusive, each bucket counts the
+				// values up to its bound. The total is read last so it is
+				// never below a bucket recorded meanwhile
+				//
+				for (uint k = 0; k < k_export_buckets; ++k) {
+					os << *i << "_bucket" << prefix << "le=\"";
+					write_seconds(os, uint64(1) << k);
+					os << "\"} " << h.count_below((uint64(1) << k) + 1) << '\n';
+				}
+
+				uint64 count = h.count();
+
+				os << *i << "_bucket" << prefix << "le=\"+Inf\"} " << count << '\n';
+				os << *i << "_sum" << labels << ' ';
+				write_seconds(os, h.sum());
+				os << '\n' << *i << "_count" << labels << ' ' << count << '\n';
+				break;
+			}
+			}
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace metrics */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,246 @@
+//=============================================================================
+// Brief   : Performance Metrics Export Endpoint
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/metrics_server.hpp>
+#include <opmip/exception.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace metrics {
+
+///////////////////////////////////////////////////////////////////////////////
+static const size_t k_max_request = 4096;
+
+///
+/// One scrape: the request is read up to the end of its headers, whatever
+/// it asks for, and answered with the registry contents. The socket is
+/// closed if that takes longer than the session timeout.
+///
+template<class Socket>
+class session {
+	typedef boost::shared_ptr<session> pointer;
+
+public:
+	static void start(const boost::shared_ptr<Socket>& sock, const registry& reg)
+	{
+		pointer ss(new session(sock, reg));
+
+		ss->_timer.expires_from_now(boost::posix_time::seconds(server::k_session_timeout));
+		ss->_timer.async_wait(boost::bind(&session::timeout_handler, _1, ss));
+		boost::asio::async_read_until(*ss->_sock, ss->_request, "\r\n\r\n",
+		                              boost::bind(&session::read_handler, _1, ss));
+	}
+
+private:
+	session(const boost::shared_ptr<Socket>& sock, const registry& reg)
+		: _sock(sock), _registry(reg), _request(k_max_request), _timer(sock->get_io_service())
+	{ }
+
+	static void timeout_handler(const boost::system::error_code& ec, pointer& ss)
+	{
+		if (ec == boost::asio::error::operation_aborted)
+			return;
+
+		boost::system::error_code ignore;
+
+		ss->_sock->close(ignore);
+	}
+
+	static void read_handler(const boost::system::error_code& ec, pointer& ss)
+	{
+		if (ec) {
+			ss->_timer.cancel();
+			return;
+		}
+
+		std::ostringstream body;
+
+		ss->_registry.write(body);
+		ss->_response = "HTTP/1.0 200 OK\r\n"
+		                "Content-Type: text/plain; version=0.0.4\r\n"
+		                "Content-Length: " + boost::lexical_cast<std::string>(body.str().length()) + "\r\n"
+		                "Connection: close\r\n"
+		                "\r\n" + body.str();
+
+		boost::asio::async_write(*ss->_sock, boost::asio::buffer(ss->_response),
+		                         boost::bind(&session::write_handler, _1, ss));
+	}
+
+	static void write_handler(const boost::system::error_code&, pointer& ss)
+	{
+		boost::system::error_code ignore;
+
+		ss->_timer.cancel();
+		ss->_sock->shutdown(Socket::shutdown_both, ignore);
+		ss->_sock->close(ignore);
+	}
+
+private:
+	boost::shared_ptr<Socket>   _sock;
+	const registry&             _registry;
+	boost::asio::streambuf      _request;
+	std::string                 _response;
+	boost::asio::deadline_timer _timer;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+server::server(boost::asio::io_service& ios, const registry& reg)
+	: _registry(reg), _tcp(ios), _local(ios), _tcp_retry(ios), _local_retry(ios), _log("metrics", std::cout)
+{
+}
+
+server::~server()
+{
+	close();
+}
+
+void server::open(const std::string& endpoint)
+{
+	close();
+
+	if (!endpoint.compare(0, 5, "unix:")) {
+		_path = endpoint.substr(5);
+		::unlink(_path.c_str());
+
+		_local.open(local());
+		_local.bind(local::endpoint(_path));
+		_local.listen();
+		accept_local();
+		return;
+	}
+
+	//
+	// [address]:port, address:port or port
+	//
+	std::string::size_type    sep = endpoint.rfind(':');
+	std::string               addr = (sep == std::string::npos) ? std::string("::1") : endpoint.substr(0, sep);
+	std::string               port = (sep == std::string::npos) ? endpoint : endpoint.substr(sep + 1);
+	boost::system::error_code ec;
+
+	if (addr.size() > 1 && addr[0] == '[' && addr[addr.size() - 1] == ']')
+		addr = addr.substr(1, addr.size() - 2);
+
+	tcp::endpoint ep(boost::asio::ip::address::from_string(addr, ec), 0);
+	if (!ec) {
+		try {
+			ep.port(boost::lexical_cast<uint16>(port));
+
+		} catch (boost::bad_lexical_cast&) {
+			ec = errc::make_error_code(errc::invalid_argument);
+		}
+	}
+	if (ec)
+		throw_exception(ec, "Invalid metrics endpoint \"" + endpoint + "\"");
+
+	_tcp.open(ep.protocol());
+	_tcp.set_option(tcp::acceptor::reuse_address(true));
+	_tcp.bind(ep);
+	_tcp.listen();
+	accept_tcp();
+}
+
+void server::close()
+{
+	boost::system::error_code ignore;
+
+	_tcp_retry.cancel();
+	_local_retry.cancel();
+
+	if (_tcp.is_open())
+		_tcp.close(ignore);
+
+	if (_local.is_open()) {
+		_local.close(ignore);
+		::unlink(_path.c_str());
+		_path.clear();
+	}
+}
+
+void server::accept_tcp()
+{
+	boost::shared_ptr<tcp::socket> sock(boost::make_shared<tcp::socket>(boost::ref(_tcp.get_io_service())));
+
+	_tcp.async_accept(*sock, boost::bind(&server::tcp_accept_handler, this, _1, sock));
+}
+
+void server::accept_local()
+{
+	boost::shared_ptr<local::socket> sock(boost::make_shared<local::socket>(boost::ref(_local.get_io_service())));
+
+	_local.async_accept(*sock, boost::bind(&server::local_accept_handler, this, _1, sock));
+}
+
+void server::tcp_accept_handler(const boost::system::error_code& ec, boost::shared_ptr<tcp::socket>& sock)
+{
+	if (ec == boost::asio::error::operation_aborted)
+		return;
+
+	//
+	// Errors like running out of descriptors persist for a while, accepting
+	// again right away would only spin
+	//
+	if (ec) {
+		_log(0, "Accept error: ", ec.message());
+		_tcp_retry.expires_from_now(boost::posix_time::milliseconds(k_accept_retry));
+		_tcp_retry.async_wait(boost::bind(&server::tcp_accept_retry, this, _1));
+		return;
+	}
+
+	session<tcp::socket>::start(sock, _registry);
+	accept_tcp();
+}
+
+void server::local_accept_handler(const boost::system::error_code& ec, boost::shared_ptr<local::socket>& sock)
+{
+	if (ec == boost::asio::error::operation_aborted)
+		return;
+
+	if (ec) {
+		_log(0, "Accept error: ", ec.message());
+		_local_retry.expires_from_now(boost::posix_time::milliseconds(k_accept_retry));
+		_local_retry.async_wait(boost::bind(&server::local_accept_retry, this, _1));
+		return;
+	}
+
+	session<local::socket>::start(sock, _registry);
+	accept_local();
+}
+
+void server::tcp_accept_retry(const boost::system::error_code& ec)
+{
+	if (ec != boost::asio::error::operation_aborted && _tcp.is_open())
+		accept_tcp();
+}
+
+void server::local_accept_retry(const boost::system::error_code& ec)
+{
+	if (ec != boost::asio::error::operation_aborted && _local.is_open())
+		accept_local();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace metrics */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
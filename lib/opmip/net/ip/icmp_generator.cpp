@@ -19,6 +19,7 @@
 #include <opmip/net/ip/icmp_generator.hpp>
 #include <opmip/ip/icmp.hpp>
 #include <opmip/ip/icmp_options.hpp>
+#include <opmip/ip/checksum.hpp>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace net { namespace ip {
@@ -68,6 +69,14 @@ size_t icmp_mld_query_generator(const icmp_mld_query& imq, uchar* buffer, size_t
 	return len;
 }
 
+void icmp_checksum(uchar* buffer, size_t length, const address_v6& src, const address_v6& dst)
+{
+	opmip::ip::icmp::header* hdr = reinterpret_cast<opmip::ip::icmp::header*>(buffer);
+
+	hdr->checksum(0);
+	hdr->checksum(opmip::ip::ipv6_checksum(src, dst, IPPROTO_ICMPV6, buffer, length));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 } /* namespace ip */ } /* namespace net */ } /* namespace opmip */
 
@@ -62,13 +62,13 @@ bool icmp_mld_report_parser::parse(uchar* buffer, size_t length)
 		return false;
 
 	uchar* end = buffer + length;
-	uint count = mld->count;
+	uint count = ntohs(mld->count);
 	icmp::mld_report::mcast_address* mca = mld->mcast_addresses;
 	while (count--) {
 		if (reinterpret_cast<uchar*>(mca->next()) > end)
 			return false;
 
-		const uint scount = mca->source_count;
+		const uint scount = ntohs(mca->source_count);
 		source_list slist;
 
 		for (uint i = 0; i < scount; ++i)
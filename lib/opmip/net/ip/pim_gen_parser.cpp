@@ -18,65 +18,22 @@
 
 #include <opmip/base.hpp>
 #include <opmip/net/ip/pim_gen_parser.hpp>
+#include <opmip/ip/checksum.hpp>
 #include <vector>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip {	namespace net {	namespace ip {
 
 ///////////////////////////////////////////////////////////////////////////////
-//TODO Checksum functions
-/*
-uint16 inchksum(const void *data, uint32 length) {
-        long sum = 0;
-        const uint16 *wrd = reinterpret_cast<const uint16 *>(data);
-        long slen = static_cast<long>(length);
-
-        while (slen > 1) {
-                sum += *wrd++;
-                slen -= 2;
-        }
-
-        if (slen > 0)
-                sum += *reinterpret_cast<const uint8 *>(wrd);
-
-        while (sum >> 16)
-                sum = (sum & 0xffff) + (sum >> 16);
+void pim_checksum(uchar* buffer, size_t length, const address_v6& src, const address_v6& dst)
+{
+	pim::header* hdr = reinterpret_cast<pim::header*>(buffer);
 
-        return static_cast<uint16>(sum);
+	hdr->checksum = 0;
+	hdr->checksum = opmip::ip::ipv6_checksum(src, dst, pim().protocol(), buffer, length);
 }
 
-uint16 ipv6_checksum(uint8 protocol const address_v6 &src, const address_v6 &dst, const void *data, uint16 len) {
-	struct {
-    	address_v6 src;
-        address_v6 dst;
-        uint16 length;
-        uint16 zero1;
-        uint8 zero2;
-        uint8 next;
-    }  __attribute__ ((packed)) pseudo;
-  	uint32 chksum = 0;
-
-  	pseudo.src = src;
-    pseudo.dst = dst;
-    pseudo.length = htons(len);
-    pseudo.zero1 = 0;
-    pseudo.zero2 = 0;
-    pseudo.next = protocol;
-
-    chksum = inchksum(&pseudo, sizeof(pseudo));
-    chksum += inchksum(data, len);
-    chksum = (chksum >> 16) + (chksum & 0xffff);
-    chksum += (chksum >> 16);
-
-    chksum = static_cast<uint16>(~chksum);
-    if (chksum == 0)
-      	chksum = 0xffff;
-
-  	return chksum;
-}
-*/
 ///////////////////////////////////////////////////////////////////////////////
-
 size_t hello_msg::gen(uchar* buffer, size_t length) const
 {
 	size_t pos = /*align_to<4>*/(sizeof(pim::hello));
@@ -129,7 +86,7 @@ size_t hello_msg::gen(uchar* buffer, size_t length) const
 		pos = npos;
 	}
 
-//	hello->cs = ipv6_checksum() // TODO IPv6 checksum
+//	the checksum needs the IPv6 addresses, see pim_checksum
 	return pos;
 }
 
@@ -260,7 +217,7 @@ size_t join_prune_msg::gen(uchar* buffer, size_t length) const
 		pos = npos;
 	}
 
-	//	join_prune->cs = ipv6_checksum() // TODO IPv6 checksum
+	//	the checksum needs the IPv6 addresses, see pim_checksum
 	return pos;
 }
 
@@ -285,8 +242,8 @@ bool join_prune_msg::parse(uchar* buffer, size_t length)
 		if (npos > length)
 			return false;
 
-		const uint jcnt = mg->count_joins;
-		const uint pcnt = mg->count_prunes;
+		const uint jcnt = ntohs(mg->count_joins);
+		const uint pcnt = ntohs(mg->count_prunes);
 		npos += sizeof(enc_source) * (jcnt + pcnt);
 		if (npos > length)
 			return false;
@@ -0,0 +1,142 @@
+//=============================================================================
+// Brief   : Minimal Perfect Hash
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/perfect_hash.hpp>
+#include <algorithm>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// A bucket gives up after k_max_tries times the slot count displacements,
+/// the build is then retried with another salt, up to k_max_salts times.
+/// The last buckets to be placed have a single key and few free slots, they
+/// take about as many tries as there are slots.
+///
+static const uint32 k_max_tries = 32;
+static const uint32 k_max_salts = 8;
+
+///////////////////////////////////////////////////////////////////////////////
+bool perfect_hash::build(const std::vector<uint64>& hashes)
+{
+	clear();
+	if (hashes.empty())
+		return true;
+
+	std::vector<uint64> mixed(hashes);
+
+	std::sort(mixed.begin(), mixed.end());
+	if (std::adjacent_find(mixed.begin(), mixed.end()) != mixed.end())
+		return false;
+
+	uint32 buckets = (hashes.size() + k_bucket_size - 1) / k_bucket_size;
+
+	for (uint32 n = 0; n < k_max_salts; ++n) {
+		_salt = n * 0x9e3779b97f4a7c15ULL;
+		for (size_t i = 0; i < hashes.size(); ++i)
+			mixed[i] = mix(hashes[i] ^ _salt);
+
+		if (place(mixed, buckets))
+			return true;
+	}
+
+	clear();
+	return false;
+}
+
+///
+/// The buckets are placed from the largest, while there are many free slots
+///
+bool perfect_hash::place(const std::vector<uint64>& mixed, uint32 buckets)
+{
+	uint32              size = mixed.size();
+	std::vector<uint32> start(buckets + 1, 0);
+	std::vector<uint64> keys(size);
+
+	for (uint32 i = 0; i < size; ++i)
+		++start[range(uint32(mixed[i] >> 32), buckets) + 1];
+	for (uint32 b = 0; b < buckets; ++b)
+		start[b + 1] += start[b];
+
+	std::vector<uint32> fill(start.begin(), start.end() - 1);
+
+	for (uint32 i = 0; i < size; ++i)
+		keys[fill[range(uint32(mixed[i] >> 32), buckets)]++] = mixed[i];
+
+	//
+	// Buckets sorted by decreasing size with a counting sort, the sizes
+	// being small
+	//
+	uint32 largest = 0;
+
+	for (uint32 b = 0; b < buckets; ++b)
+		largest = std::max(largest, start[b + 1] - start[b]);
+
+	std::vector<uint32> by_size(largest + 2, 0);
+	std::vector<uint32> order(buckets);
+
+	for (uint32 b = 0; b < buckets; ++b)
+		++by_size[largest - (start[b + 1] - start[b]) + 1];
+	for (uint32 s = 0; s <= largest; ++s)
+		by_size[s + 1] += by_size[s];
+	for (uint32 b = 0; b < buckets; ++b)
+		order[by_size[largest - (start[b + 1] - start[b])]++] = b;
+
+	std::vector<bool>   taken(size, false);
+	std::vector<uint32> slots(largest);
+	uint64              tries = uint64(k_max_tries) * size;
+
+	_displacements.assign(buckets, 0);
+	for (uint32 o = 0; o < buckets; ++o) {
+		uint32 b = order[o];
+		uint32 count = start[b + 1] - start[b];
+
+		if (!count)
+			break;
+
+		for (uint64 d = 0; ; ++d) {
+			uint32 n = 0;
+
+			if (d == tries)
+				return false;
+
+			for (; n < count; ++n) {
+				uint32 s = range(uint32(mix(keys[start[b] + n] + d)), size);
+
+				if (taken[s] || std::find(slots.begin(), slots.begin() + n, s) != slots.begin() + n)
+					break;
+				slots[n] = s;
+			}
+
+			if (n == count) {
+				for (n = 0; n < count; ++n)
+					taken[slots[n]] = true;
+				_displacements[b] = d;
+				break;
+			}
+		}
+	}
+
+	_size = size;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -136,6 +136,13 @@ void addrconf_server::clear()
 	_clients.clear();
 }
 
+void addrconf_server::register_metrics(metrics::registry& reg) const
+{
+	reg.add("opmip_mag_ra_sent_total", "Router advertisements sent", _stats.ra_sent);
+	reg.add("opmip_mag_dhcp6_received_total", "DHCPv6 messages received", _stats.dhcp6_received);
+	reg.add("opmip_mag_dhcp6_replied_total", "DHCPv6 replies sent", _stats.dhcp6_replied);
+}
+
 void addrconf_server::router_advertisement(const boost::system::error_code& ec,
                                            icmp_ra_sender_ptr& ras,
                                            net::link::ethernet::endpoint& ep,
@@ -147,6 +154,7 @@ void addrconf_server::router_advertisement(const boost::system::error_code& ec,
 	}
 
 	ras->async_send(_link_sock, ep, boost::bind(ra_send_handler, _1));
+	_stats.ra_sent.inc();
 	timer->expires_from_now(boost::posix_time::seconds(3)); //FIXME: set a proper timer
 	timer->async_wait(boost::bind(&addrconf_server::router_advertisement, this, _1, ras, ep, timer));
 }
@@ -167,6 +175,7 @@ void addrconf_server::dhcp6_receive_handler(const boost::system::error_code& ec,
 	                             boost::bind(&addrconf_server::dhcp6_receive_handler,
 	                                         this, _1, _2, rd));
 
+	_stats.dhcp6_received.inc();
 	dhcp6_handle_message(dhcp6::buffer_type(data->buffer, data->buffer + blen), data->source);
 }
 
@@ -281,6 +290,7 @@ void addrconf_server::dhcp6_reply_message(const boost::asio::ip::udp::endpoint&
 
 		_udp_sock.async_send_to(boost::asio::buffer(buffer.get(), buff.first - buffer.get()),
 		                        ep, boost::bind(dhcp6_send_handler, _1, buffer));
+		_stats.dhcp6_replied.inc();
 	}
 }
 
@@ -17,13 +17,14 @@
 
 #include <opmip/disposer.hpp>
 #include <opmip/pmip/bcache.hpp>
-#include <boost/utility.hpp>
+#include <algorithm>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
 
 ///////////////////////////////////////////////////////////////////////////////
-bcache::bcache()
+bcache::bcache(uint32 stride)
+	: _stride(stride ? stride : 1), _size(0)
 {
 }
 
@@ -34,32 +35,41 @@ bcache::~bcache()
 
 bool bcache::insert(bcache_entry* entry)
 {
-	if (!_id_tree.insert_unique(*entry).second) {
+	BOOST_ASSERT((entry->mn_index() != k_mn_index_invalid));
+
+	uint32 i = entry->mn_index() / _stride;
+
+	if (i >= _entries.size())
+		_entries.resize(i + 1);
+
+	if (_entries[i]) {
 		delete entry;
 		return false;
 	}
 
+	_entries[i] = entry;
+	++_size;
 	return true;
 }
 
 bool bcache::remove(bcache_entry* entry)
 {
-	return _id_tree.erase_and_dispose(*entry, disposer<bcache_entry>()) != 0;
-}
-
-bcache_entry* bcache::find(const std::string& mn_id)
-{
-	id_tree::iterator entry = _id_tree.find(mn_id, compare());
+	uint32 i = entry->mn_index() / _stride;
 
-	if (entry == _id_tree.end())
-		return nullptr;
+	if (i >= _entries.size() || _entries[i] != entry)
+		return false;
 
-	return boost::addressof(*entry);
+	_entries[i] = nullptr;
+	--_size;
+	delete entry;
+	return true;
 }
 
 void bcache::clear()
 {
-	_id_tree.clear_and_dispose(disposer<bcache_entry>());
+	std::for_each(_entries.begin(), _entries.end(), disposer<bcache_entry>());
+	entry_table().swap(_entries);
+	_size = 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,448 @@
+//=============================================================================
+// Brief   : Binding Cache Journal
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/pmip/bcache_journal.hpp>
+#include <opmip/exception.hpp>
+#include <boost/bind.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace pmip {
+
+///////////////////////////////////////////////////////////////////////////////
+static const uint32 k_journal_version = 2;
+
+///
+/// The journal and the snapshot are a journal_header followed by records,
+/// each a journal_record, the NAI and the prefixes
+///
+struct journal_header {
+	char   magic[8];    ///"OPMIPBCJ"
+	uint32 version;
+	uint32 record_size;
+};
+
+struct journal_record {
+	uint32 check;           ///FNV-1a of the rest of the record and the NAI
+	uint16 id_length;
+	uint16 sequence;
+	uint32 lifetime;
+	uint8  link_type;
+	uint8  prefix_count;
+	uint8  reserved[2];
+	uint64 expiry;
+	uint8  care_of_address[16];
+};
+
+struct journal_prefix {
+	uint8 address[16];
+	uint8 length;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+static uint32 record_check(const uchar* rec, size_t size)
+{
+	uint32 h = 2166136261u;
+
+	for (size_t i = sizeof(uint32); i < size; ++i)
+		h = (h ^ rec[i]) * 16777619u;
+
+	return h;
+}
+
+static void push_header(std::vector<uchar>& buf)
+{
+	journal_header hdr;
+
+	std::memcpy(hdr.magic, "OPMIPBCJ", sizeof(hdr.magic));
+	hdr.version = k_journal_version;
+	hdr.record_size = sizeof(journal_record);
+	buf.insert(buf.end(), reinterpret_cast<uchar*>(&hdr), reinterpret_cast<uchar*>(&hdr + 1));
+}
+
+static void push_record(std::vector<uchar>& buf, const bcache_journal::binding& b)
+{
+	journal_record             rec;
+	ip::address_v6::bytes_type coa = b.care_of_address.to_bytes();
+	size_t                     pos = buf.size();
+
+	BOOST_ASSERT(b.id.length() <= 0xffff && b.prefixes.size() <= 0xff);
+
+	std::memset(&rec, 0, sizeof(rec));
+	rec.id_length = b.id.length();
+	rec.prefix_count = b.prefixes.size();
+	rec.sequence = b.sequence;
+	rec.lifetime = b.lifetime;
+	rec.link_type = b.link_type;
+	rec.expiry = b.expiry;
+	std::copy(coa.begin(), coa.end(), rec.care_of_address);
+
+	buf.insert(buf.end(), reinterpret_cast<uchar*>(&rec), reinterpret_cast<uchar*>(&rec + 1));
+	buf.insert(buf.end(), b.id.begin(), b.id.end());
+
+	for (bcache_journal::ip_prefix_list::const_iterator i = b.prefixes.begin(), e = b.prefixes.end(); i != e; ++i) {
+		journal_prefix            pfx;
+		ip::prefix_v6::bytes_type addr = i->bytes();
+
+		std::copy(addr.begin(), addr.end(), pfx.address);
+		pfx.length = i->length();
+		buf.insert(buf.end(), reinterpret_cast<uchar*>(&pfx), reinterpret_cast<uchar*>(&pfx + 1));
+	}
+
+	rec.check = record_check(&buf[pos], buf.size() - pos);
+	std::memcpy(&buf[pos], &rec.check, sizeof(rec.check));
+}
+
+static bool write_all(int fd, const std::vector<uchar>& buf, boost::system::error_code& ec)
+{
+	for (size_t done = 0; done < buf.size(); ) {
+		ssize_t n = ::write(fd, &buf[done], buf.size() - done);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			ec = boost::system::error_code(errno, boost::system::system_category());
+			return false;
+		}
+		done += n;
+	}
+
+	return true;
+}
+
+static bool read_all(int fd, std::vector<uchar>& buf)
+{
+	uchar tmp[1 << 16];
+
+	buf.clear();
+	for (;;) {
+		ssize_t n = ::read(fd, tmp, sizeof(tmp));
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return !n;
+
+		buf.insert(buf.end(), tmp, tmp + n);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bcache_journal::bcache_journal()
+	: _fd(-1), _records(0), _rotated(false), _compacting(false)
+{
+}
+
+bcache_journal::~bcache_journal()
+{
+	close();
+}
+
+void bcache_journal::open(const std::string& path, binding_list& bindings)
+{
+	std::string snap = path + ".snap";
+	std::string prev = path + ".prev";
+
+	close();
+	_bindings.clear();
+	_records = 0;
+	_rotated = false;
+	_compact_ec.clear();
+
+	//
+	// The snapshot first, then the journal set aside by a compaction cut
+	// short, if any, the journal holds what came after them
+	//
+	int fd = ::open(snap.c_str(), O_RDONLY);
+
+	if (fd < 0 && errno != ENOENT)
+		throw_exception(boost::system::error_code(errno, boost::system::system_category()),
+		                "Failed to open \"" + snap + "\" binding journal snapshot");
+	if (fd >= 0) {
+		bool ok = replay(fd, false);
+
+		::close(fd);
+		if (!ok)
+			throw_exception(boost::system::error_code(EINVAL, boost::system::system_category()),
+			                "\"" + snap + "\" is not a binding journal snapshot");
+	}
+
+	fd = ::open(prev.c_str(), O_RDONLY);
+	if (fd < 0 && errno != ENOENT)
+		throw_exception(boost::system::error_code(errno, boost::system::system_category()),
+		                "Failed to open \"" + prev + "\" binding journal");
+	if (fd >= 0) {
+		bool ok = replay(fd, false);
+
+		::close(fd);
+		if (!ok)
+			throw_exception(boost::system::error_code(EINVAL, boost::system::system_category()),
+			                "\"" + prev + "\" is not a binding journal");
+		_rotated = true;
+	}
+
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+	if (fd < 0)
+		throw_exception(boost::system::error_code(errno, boost::system::system_category()),
+		                "Failed to open \"" + path + "\" binding journal");
+
+	if (!replay(fd, true)) {
+		::close(fd);
+		throw_exception(boost::system::error_code(EINVAL, boost::system::system_category()),
+		                "\"" + path + "\" is not a binding journal");
+	}
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	_path = path;
+	_fd = fd;
+
+	bindings.reserve(bindings.size() + _bindings.size());
+	for (binding_map::const_iterator i = _bindings.begin(), e = _bindings.end(); i != e; ++i)
+		bindings.push_back(i->second);
+}
+
+///
+/// Waits for a compaction under way, no other starts once closed
+///
+void bcache_journal::close()
+{
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+
+		if (_fd >= 0)
+			::close(_fd);
+		_fd = -1;
+	}
+
+	if (_compactor.joinable())
+		_compactor.join();
+}
+
+void bcache_journal::commit(binding_list& batch, boost::system::error_code& ec)
+{
+	std::vector<uchar> buf;
+
+	for (binding_list::const_iterator i = batch.begin(), e = batch.end(); i != e; ++i)
+		push_record(buf, *i);
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	if (_compact_ec) {
+		ec = _compact_ec;
+		_compact_ec.clear();
+	}
+
+	if (_fd >= 0 && write_all(_fd, buf, ec)) {
+		for (binding_list::const_iterator i = batch.begin(), e = batch.end(); i != e; ++i) {
+			if (i->expiry)
+				_bindings[i->id] = *i;
+			else
+				_bindings.erase(i->id);
+		}
+
+		_records += batch.size();
+		if (!_compacting && _records >= k_min_compact && _records >= 2 * _bindings.size())
+			compact(ec);
+	}
+
+	batch.clear();
+}
+
+///
+/// Applies the records of fd to the bindings. A journal is given its
+/// header if empty and is cut at the first record that does not check,
+/// the tail of an interrupted write. Fails if fd is not a journal.
+///
+bool bcache_journal::replay(int fd, bool truncate)
+{
+	std::vector<uchar> buf;
+
+	if (!read_all(fd, buf))
+		return false;
+
+	if (buf.size() < sizeof(journal_header)) {
+		if (!truncate)
+			return buf.empty();
+
+		std::vector<uchar>        hdr;
+		boost::system::error_code ec;
+
+		push_header(hdr);
+		return ::ftruncate(fd, 0) == 0 && write_all(fd, hdr, ec);
+	}
+
+	journal_header hdr;
+
+	std::memcpy(&hdr, &buf[0], sizeof(hdr));
+	if (std::memcmp(hdr.magic, "OPMIPBCJ", sizeof(hdr.magic)) || hdr.version != k_journal_version
+	    || hdr.record_size != sizeof(journal_record))
+		return false;
+
+	size_t pos = sizeof(hdr);
+
+	while (pos + sizeof(journal_record) <= buf.size()) {
+		journal_record rec;
+
+		std::memcpy(&rec, &buf[pos], sizeof(rec));
+
+		size_t size = sizeof(rec) + rec.id_length + rec.prefix_count * sizeof(journal_prefix);
+
+		if (pos + size > buf.size() || rec.check != record_check(&buf[pos], size))
+			break;
+
+		const char*                id = reinterpret_cast<const char*>(&buf[pos + sizeof(rec)]);
+		ip::address_v6::bytes_type coa;
+		binding                    b;
+
+		std::copy(rec.care_of_address, rec.care_of_address + coa.size(), coa.begin());
+		b.id.assign(id, rec.id_length);
+		b.care_of_address = ip::address_v6(coa);
+		b.expiry = rec.expiry;
+		b.lifetime = rec.lifetime;
+		b.sequence = rec.sequence;
+		b.link_type = rec.link_type;
+
+		const uchar* pfxs = &buf[pos + sizeof(rec) + rec.id_length];
+
+		b.prefixes.reserve(rec.prefix_count);
+		for (uint n = 0; n < rec.prefix_count; ++n) {
+			journal_prefix            pfx;
+			ip::prefix_v6::bytes_type addr;
+
+			std::memcpy(&pfx, pfxs + n * sizeof(pfx), sizeof(pfx));
+			std::copy(pfx.address, pfx.address + addr.size(), addr.begin());
+			b.prefixes.push_back(ip::prefix_v6(addr, pfx.length));
+		}
+
+		if (b.expiry)
+			_bindings[b.id] = b;
+		else
+			_bindings.erase(b.id);
+
+		pos += size;
+		if (truncate)
+			++_records;
+	}
+
+	if (truncate && pos != buf.size())
+		return ::ftruncate(fd, pos) == 0;
+
+	return true;
+}
+
+///
+/// The journal is set aside, unless a compaction that failed left one
+/// there, and the compactor gets a copy of the bindings. The journal
+/// commits go on meanwhile, on the new journal.
+///
+void bcache_journal::compact(boost::system::error_code& ec)
+{
+	_records = 0;
+
+	if (!_rotated) {
+		std::string        prev = _path + ".prev";
+		std::vector<uchar> hdr;
+
+		push_header(hdr);
+		if (::rename(_path.c_str(), prev.c_str()) < 0) {
+			ec = boost::system::error_code(errno, boost::system::system_category());
+			return;
+		}
+
+		int fd = ::open(_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+
+		if (fd < 0)
+			ec = boost::system::error_code(errno, boost::system::system_category());
+		if (fd < 0 || !write_all(fd, hdr, ec)) {
+			if (fd >= 0)
+				::close(fd);
+			::rename(prev.c_str(), _path.c_str());
+			return;
+		}
+
+		::close(_fd);
+		_fd = fd;
+		_rotated = true;
+	}
+
+	if (_compactor.joinable())
+		_compactor.join();
+
+	_snapshot = _bindings;
+	_compacting = true;
+	_compactor = boost::thread(boost::bind(&bcache_journal::write_snapshot, this));
+}
+
+///
+/// The snapshot is written aside and renamed into place before the journal
+/// set aside is removed, a crash in between leaves a journal already in
+/// the snapshot. On failure, compaction is tried again after as many
+/// records, keeping the journal set aside.
+///
+void bcache_journal::write_snapshot()
+{
+	std::string               snap = _path + ".snap";
+	std::string               tmp = snap + ".tmp";
+	std::vector<uchar>        buf;
+	boost::system::error_code ec;
+
+	push_header(buf);
+	for (binding_map::const_iterator i = _snapshot.begin(), e = _snapshot.end(); i != e; ++i)
+		push_record(buf, i->second);
+	binding_map().swap(_snapshot);
+
+	int  fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	bool ok = fd >= 0;
+
+	if (!ok)
+		ec = boost::system::error_code(errno, boost::system::system_category());
+	else {
+		ok = write_all(fd, buf, ec);
+		if (ok && ::fsync(fd) < 0) {
+			ec = boost::system::error_code(errno, boost::system::system_category());
+			ok = false;
+		}
+		::close(fd);
+	}
+
+	if (ok && ::rename(tmp.c_str(), snap.c_str()) < 0) {
+		ec = boost::system::error_code(errno, boost::system::system_category());
+		ok = false;
+	}
+
+	if (ok)
+		::unlink((_path + ".prev").c_str());
+	else
+		::unlink(tmp.c_str());
+
+	boost::mutex::scoped_lock lock(_mutex);
+
+	if (ok)
+		_rotated = false;
+	_compact_ec = ec;
+	_compacting = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace pmip */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -17,7 +17,7 @@
 
 #include <opmip/disposer.hpp>
 #include <opmip/pmip/bulist.hpp>
-#include <boost/utility.hpp>
+#include <algorithm>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
@@ -34,50 +34,50 @@ bulist::~bulist()
 
 bool bulist::insert(bulist_entry* entry)
 {
-	std::pair<mn_id_tree::iterator, bool> ins = _mn_id_tree.insert_unique(*entry);
-	if (!ins.second) {
+	uint32 i = entry->mn_index();
+
+	BOOST_ASSERT((i != k_mn_index_invalid));
+
+	if (i >= _entries.size())
+		_entries.resize(i + 1);
+
+	if (_entries[i]) {
 		delete entry;
 		return false;
 	}
 
-	if (!_mn_link_addr_tree.insert_unique(*entry).second) {
-		_mn_id_tree.erase_and_dispose(ins.first, disposer<bulist_entry>());
+	if (!_mn_link_addr_index.insert_unique(*entry)) {
+		delete entry;
 		return false;
 	}
 
+	_entries[i] = entry;
 	return true;
 }
 
 bool bulist::remove(bulist_entry* entry)
 {
-	_mn_link_addr_tree.erase_and_dispose(*entry, disposer<void>());
-	return _mn_id_tree.erase_and_dispose(*entry, disposer<bulist_entry>()) != 0;
-}
+	uint32 i = entry->mn_index();
 
-bulist_entry* bulist::find(const std::string& mn_id)
-{
-	mn_id_tree::iterator entry = _mn_id_tree.find(mn_id, compare_mn_id());
-
-	if (entry == _mn_id_tree.end())
-		return nullptr;
+	if (i >= _entries.size() || _entries[i] != entry)
+		return false;
 
-	return boost::addressof(*entry);
+	_mn_link_addr_index.erase(*entry);
+	_entries[i] = nullptr;
+	delete entry;
+	return true;
 }
 
 bulist_entry* bulist::find(const link_address& mn_link_address)
 {
-	mn_link_addr_tree::iterator entry = _mn_link_addr_tree.find(mn_link_address, compare_mn_link_address());
-
-	if (entry == _mn_link_addr_tree.end())
-		return nullptr;
-
-	return boost::addressof(*entry);
+	return _mn_link_addr_index.find(mn_link_address);
 }
 
 void bulist::clear()
 {
-	_mn_id_tree.clear_and_dispose(disposer<void>());
-	_mn_link_addr_tree.clear_and_dispose(disposer<bulist_entry>());
+	_mn_link_addr_index.clear();
+	std::for_each(_entries.begin(), _entries.end(), disposer<bulist_entry>());
+	entry_table().swap(_entries);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,433 @@
+//=============================================================================
+// Brief   : PMIP Data Plane Backends
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/pmip/data_plane.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <set>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace pmip {
+
+///////////////////////////////////////////////////////////////////////////////
+kernel_data_plane::kernel_data_plane(boost::asio::io_service& ios)
+	: _tunnels(ios), _routes(ios)
+{
+}
+
+void kernel_data_plane::open(const ip_address& local, uint prefix_length, bool global_address, bool external)
+{
+	_tunnels.open(local, prefix_length, global_address, external);
+}
+
+void kernel_data_plane::close()
+{
+	_tunnels.close();
+}
+
+void kernel_data_plane::detach()
+{
+	_tunnels.detach();
+	_routes.release();
+}
+
+uint kernel_data_plane::acquire_tunnel(const ip_address& remote)
+{
+	return _tunnels.get(remote);
+}
+
+void kernel_data_plane::release_tunnel(const ip_address& remote)
+{
+	_tunnels.del(remote);
+}
+
+uint kernel_data_plane::move_tunnel(const ip_address& from, const ip_address& to)
+{
+	return _tunnels.move(from, to);
+}
+
+size_t kernel_data_plane::provision_tunnels(const std::vector<ip_address>& remotes, size_t concurrency)
+{
+	return _tunnels.provision(remotes, concurrency);
+}
+
+size_t kernel_data_plane::collect_tunnels()
+{
+	return _tunnels.collect();
+}
+
+size_t kernel_data_plane::tunnel_count() const
+{
+	return _tunnels.size();
+}
+
+bool kernel_data_plane::is_external() const
+{
+	return _tunnels.is_external();
+}
+
+size_t kernel_data_plane::commit(route_batch& routes)
+{
+	return _routes.commit(routes);
+}
+
+void kernel_data_plane::flush()
+{
+	_routes.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+memory_data_plane::memory_data_plane(boost::asio::io_service& ios)
+	: _io_service(ios), _external(false), _next_device(k_first_device),
+	  _commit_delay(0), _completion_delay(0), _recording(false)
+{
+}
+
+void memory_data_plane::recording(bool enable)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	_recording = enable;
+}
+
+void memory_data_plane::take_records(std::vector<record>& records)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	records.clear();
+	records.swap(_records);
+}
+
+void memory_data_plane::open(const ip_address& local, uint prefix_length, bool global_address, bool external)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	_tunnels.clear();
+	_external = external;
+}
+
+void memory_data_plane::close()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	_tunnels.clear();
+	_external = false;
+}
+
+///
+/// The routes are kept, as the kernel would, until taken over by the next
+/// run. The tunnels get new devices when acquired again.
+///
+void memory_data_plane::detach()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	for (uint n = 0; n < 2; ++n) {
+		route_map& routes = n ? _by_dst : _by_src;
+		route_map& left = n ? _left_by_dst : _left_by_src;
+
+		for (route_map::const_iterator i = routes.begin(), e = routes.end(); i != e; ++i)
+			left[i->first] = i->second;
+		routes.clear();
+	}
+
+	_tunnels.clear();
+	_external = false;
+}
+
+uint memory_data_plane::acquire_tunnel(const ip_address& remote)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	return acquire(remote);
+}
+
+void memory_data_plane::release_tunnel(const ip_address& remote)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	release(remote);
+}
+
+uint memory_data_plane::move_tunnel(const ip_address& from, const ip_address& to)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	uint                      dev = acquire(to);
+
+	release(from);
+	return dev;
+}
+
+size_t memory_data_plane::provision_tunnels(const std::vector<ip_address>& remotes, size_t)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	if (!_external) {
+		for (std::vector<ip_address>::const_iterator i = remotes.begin(), e = remotes.end(); i != e; ++i) {
+			if (_tunnels.find(*i) == _tunnels.end()) {
+				_tunnels.insert(tunnel_map::value_type(*i, tunnel(_next_device)));
+				log(record::k_tunnel_acquire, *i, _next_device++);
+			}
+		}
+	}
+
+	return remotes.size();
+}
+
+///
+/// The devices of a previous run are never taken over, they go with the
+/// routes left through them, as the kernel drops the routes of a deleted
+/// device
+///
+size_t memory_data_plane::collect_tunnels()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	std::set<uint>            stale;
+
+	for (uint n = 0; n < 2; ++n) {
+		route_map& left = n ? _left_by_dst : _left_by_src;
+
+		for (route_map::const_iterator i = left.begin(), e = left.end(); i != e; ++i) {
+			if (i->second.device != k_external_device)
+				stale.insert(i->second.device);
+			log(sys::route_table::operation(sys::route_table::operation::k_purge, !n, i->first, route_entry(),
+			                                completion_handler()));
+		}
+		left.clear();
+	}
+
+	return stale.size();
+}
+
+size_t memory_data_plane::tunnel_count() const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	return _external ? 1 : _tunnels.size();
+}
+
+bool memory_data_plane::is_external() const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	return _external;
+}
+
+size_t memory_data_plane::commit(route_batch& routes)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	handler_list_ptr          handlers;
+	size_t                    n = 0;
+
+	if (_completion_delay)
+		handlers = boost::make_shared<handler_list>();
+
+	for (route_batch::const_iterator i = routes.begin(), e = routes.end(); i != e; ++i) {
+		if (!apply(*i))
+			continue;
+
+		log(*i);
+		if (i->handler) {
+			if (handlers)
+				handlers->push_back(i->handler);
+			else
+				_io_service.post(boost::bind(i->handler, boost::system::error_code()));
+		}
+		++n;
+	}
+
+	//
+	// A single send carries the whole batch, so the cost is paid once per
+	// commit and while holding the lock, as route_table does. The caller
+	// sleeps through it as it would waiting on the kernel
+	//
+	if (n && _commit_delay)
+		boost::this_thread::sleep(boost::posix_time::microseconds(_commit_delay));
+
+	if (handlers && !handlers->empty()) {
+		timer_ptr timer(new boost::asio::deadline_timer(_io_service));
+
+		timer->expires_from_now(boost::posix_time::microseconds(_completion_delay));
+		timer->async_wait(boost::bind(&memory_data_plane::delayed_completion, _1, timer, handlers));
+	}
+
+	routes.clear();
+	return n;
+}
+
+void memory_data_plane::flush()
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	_by_src.clear();
+	_by_dst.clear();
+	_left_by_src.clear();
+	_left_by_dst.clear();
+	log(record::k_flush, ip_address(), 0);
+}
+
+bool memory_data_plane::find_by_src(const ip_prefix& prefix, route_entry& route) const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	return find(_by_src, prefix, route) || find(_left_by_src, prefix, route);
+}
+
+bool memory_data_plane::find_by_dst(const ip_prefix& prefix, route_entry& route) const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	return find(_by_dst, prefix, route) || find(_left_by_dst, prefix, route);
+}
+
+size_t memory_data_plane::route_count() const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	return _by_src.size() + _by_dst.size() + _left_by_src.size() + _left_by_dst.size();
+}
+
+bool memory_data_plane::find(const route_map& routes, const ip_prefix& prefix, route_entry& route)
+{
+	route_map::const_iterator i = routes.find(prefix);
+
+	if (i == routes.end())
+		return false;
+
+	route = i->second;
+	return true;
+}
+
+uint memory_data_plane::acquire(const ip_address& remote)
+{
+	if (_external)
+		return k_external_device;
+
+	tunnel_map::iterator i = _tunnels.find(remote);
+
+	if (i == _tunnels.end())
+		i = _tunnels.insert(tunnel_map::value_type(remote, tunnel(_next_device++))).first;
+
+	++i->second.refcount;
+	log(record::k_tunnel_acquire, remote, i->second.device);
+	return i->second.device;
+}
+
+void memory_data_plane::release(const ip_address& remote)
+{
+	if (_external)
+		return;
+
+	tunnel_map::iterator i = _tunnels.find(remote);
+
+	if (i != _tunnels.end() && i->second.refcount) {
+		--i->second.refcount;
+		log(record::k_tunnel_release, remote, i->second.device);
+	}
+}
+
+bool memory_data_plane::apply(const sys::route_table::operation& op)
+{
+	typedef sys::route_table::operation operation;
+
+	route_map&                           routes = op.by_src ? _by_src : _by_dst;
+	route_map&                           left = op.by_src ? _left_by_src : _left_by_dst;
+	std::pair<route_map::iterator, bool> res;
+
+	//
+	// Adding a route left by a previous run takes it over
+	//
+	switch (op.type) {
+	case operation::k_add:
+		left.erase(op.prefix);
+		return routes.insert(route_map::value_type(op.prefix, op.route)).second;
+
+	case operation::k_replace:
+		left.erase(op.prefix);
+		res = routes.insert(route_map::value_type(op.prefix, op.route));
+		if (res.second)
+			return true;
+
+		if (res.first->second == op.route)
+			return false;
+
+		res.first->second = op.route;
+		return true;
+
+	case operation::k_remove:
+		return routes.erase(op.prefix) != 0;
+
+	case operation::k_purge:
+		return (routes.erase(op.prefix) + left.erase(op.prefix)) != 0;
+	}
+
+	return false;
+}
+
+void memory_data_plane::log(record::kind type, const ip_address& remote, uint device)
+{
+	if (!_recording)
+		return;
+
+	record rec;
+
+	rec.type = type;
+	rec.time = ptime::get_monotonic();
+	rec.remote = remote;
+	rec.device = device;
+	rec.by_src = false;
+	_records.push_back(rec);
+}
+
+void memory_data_plane::log(const sys::route_table::operation& op)
+{
+	typedef sys::route_table::operation operation;
+
+	if (!_recording)
+		return;
+
+	record rec;
+
+	switch (op.type) {
+	case operation::k_add:     rec.type = record::k_route_add; break;
+	case operation::k_replace: rec.type = record::k_route_replace; break;
+	case operation::k_remove:  rec.type = record::k_route_remove; break;
+	case operation::k_purge:   rec.type = record::k_route_remove; break;
+	}
+	rec.time = ptime::get_monotonic();
+	rec.remote = op.route.remote;
+	rec.device = op.route.device;
+	rec.by_src = op.by_src;
+	rec.prefix = op.prefix;
+	_records.push_back(rec);
+}
+
+void memory_data_plane::delayed_completion(const boost::system::error_code& ec, timer_ptr& timer,
+                                           handler_list_ptr& handlers)
+{
+	//
+	// The data plane state was updated at commit, only the report is late
+	//
+	for (handler_list::iterator i = handlers->begin(), e = handlers->end(); i != e; ++i)
+		(*i)(boost::system::error_code());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace pmip */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -20,11 +20,17 @@
 #include <opmip/pmip/mp_sender.hpp>
 #include <opmip/exception.hpp>
 #include <boost/bind.hpp>
+#include <algorithm>
 #include <iostream>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
 
+///////////////////////////////////////////////////////////////////////////////
+static const char* const k_trace_stage_names[] = {
+	"readable", "parsed", "strand", "lookup", "routes", "pba_queued", "pba_sent"
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 bool validate_sequence_number(uint16 prev, uint16 current)
 {
@@ -34,15 +40,40 @@ bool validate_sequence_number(uint16 prev, uint16 current)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-lma::lma(boost::asio::io_service& ios, node_db& ndb, size_t concurrency)
-	: _service(ios), _node_db(ndb), _log("LMA", std::cout), _mp_sock(ios),
-	  _tunnels(ios), _route_table(ios), _concurrency(concurrency)
+lma::lma(boost::asio::io_service& ios, node_db& ndb, size_t concurrency, data_plane* dp)
+	: _service(ios), _node_db(&ndb), _initial_node_db(ndb), _log("LMA", std::cout), _reclaim_timer(ios),
+	  _stop_pending(0), _restore_pending(0),
+	  _mp_sock(ios), _own_data_plane(dp ? nullptr : new kernel_data_plane(ios)),
+	  _data_plane(dp ? *dp : *_own_data_plane), _concurrency(concurrency),
+	  _tracer(k_trace_stage_names, k_trace_stages)
 {
+	size_t n = std::min(std::max<size_t>(concurrency, 1), k_max_shards);
+
+	for (size_t i = 0; i < n; ++i)
+		_shards.push_back(new shard(ios, *this, n));
+
+	ndb.set_cache_stripes(n);
+
+	register_metrics();
 }
 
-void lma::start(const std::string& id, bool tunnel_global_address)
+lma::~lma()
 {
-	_service.dispatch(boost::bind(&lma::start_, this, id, tunnel_global_address));
+	if (_reload_thread.joinable())
+		_reload_thread.join();
+
+	delete _reload.loaded;
+	if (_reload.previous != &_initial_node_db)
+		delete _reload.previous;
+	if (_node_db.get() != &_initial_node_db)
+		delete _node_db.get();
+}
+
+void lma::start(const std::string& id, bool tunnel_global_address, bool tunnel_provisioning, bool flow_tunnel,
+                uint tunnel_prefix_length)
+{
+	_service.dispatch(boost::bind(&lma::start_, this, id, tunnel_global_address, tunnel_provisioning, flow_tunnel,
+	                              tunnel_prefix_length));
 }
 
 void lma::stop()
@@ -50,13 +81,19 @@ void lma::stop()
 	_service.dispatch(boost::bind(&lma::stop_, this));
 }
 
-void lma::mp_send_handler(const boost::system::error_code& ec)
+void lma::reload(const std::string& file_name)
 {
-	if (ec && ec != boost::system::errc::make_error_condition(boost::system::errc::operation_canceled))
-		_log(0, "PBA sender error: ", ec.message());
+	_service.dispatch(boost::bind(&lma::reload_, this, file_name));
 }
 
-void lma::mp_receive_handler(const boost::system::error_code& ec, const proxy_binding_info& pbinfo, pbu_receiver_ptr& pbur, chrono& delay)
+void lma::open_journal(const std::string& path)
+{
+	_restored.clear();
+	_journal.open(path, _restored);
+	_log(0, "Binding journal opened [file = ", path, ", bindings = ", _restored.size(), "]");
+}
+
+void lma::mp_receive_handler(const boost::system::error_code& ec, mp_batch_receiver_ptr& mbr, chrono& delay)
 {
 	if (ec) {
 		if (ec != boost::system::errc::make_error_condition(boost::system::errc::operation_canceled))
@@ -64,13 +101,86 @@ void lma::mp_receive_handler(const boost::system::error_code& ec, const proxy_bi
 		return;
 	}
 
-	_service.dispatch(boost::bind(&lma::proxy_binding_update, this, pbinfo, delay));
-	pbur->async_receive(_mp_sock, boost::bind(&lma::mp_receive_handler, this, _1, _2, _3, _4));
+	pbinfo_batch_ptr pbb = pbinfo_batch::make();
+
+	for (size_t i = 0, n = mbr->size(); i < n; ++i) {
+		if (!mbr->parse_pbu(i, pbb->push())) {
+			_log(0, "PBU receiver error: malformed message");
+			pbb->pop();
+		}
+	}
+
+	pbb->trace().stamps[k_trace_readable] = mbr->readable();
+	dispatch_pbus(*pbb, delay);
+
+	mbr->async_receive(_mp_sock, boost::bind(&lma::mp_receive_handler, this, _1, _2, _3));
+}
+
+void lma::receive(const pbinfo_batch_ptr& pbb)
+{
+	chrono delay;
+
+	delay.start();
+	pbb->trace().stamp(k_trace_readable);
+	dispatch_pbus(*pbb, delay);
+}
+
+void lma::dispatch_pbus(pbinfo_batch& received, chrono& delay)
+{
+	//
+	// Split the received batch by shard, each shard processes its share
+	// in a single pass. The PBUs are moved, slot by slot, to the batch of
+	// the owning shard. The MN is resolved to its node_db index here, once
+	// per PBU.
+	//
+	pbinfo_batch_ptr              batches[k_max_shards];
+	rcu_pointer<node_db>::reader ndb(_node_db);
+
+	for (pbinfo_batch::iterator i = received.begin(), e = received.end(); i != e; ++i) {
+		_stats.pbu_received.inc();
+
+		i->mn_index = ndb->index_of(i->id);
+
+		pbinfo_batch_ptr& pbb = batches[shard_index(i->mn_index)];
+		if (!pbb)
+			pbb = pbinfo_batch::make();
+
+		swap(pbb->push(), *i);
+	}
+
+	uint64 parsed = tracer::now();
+
+	for (size_t i = 0; i < _shards.size(); ++i) {
+		if (!batches[i])
+			continue;
+
+		batches[i]->trace().stamps[k_trace_readable] = received.trace().stamps[k_trace_readable];
+		batches[i]->trace().stamps[k_trace_parsed] = parsed;
+		_shards[i].service.dispatch(batches[i]->wrap(boost::bind(&lma::proxy_binding_update, this,
+		                                                         boost::ref(_shards[i]), batches[i], delay)));
+	}
 }
 
-void lma::start_(const std::string& id, bool tunnel_global_address)
+void lma::mp_flush(shard& sh)
 {
-	const router_node* node = _node_db.find_router(id);
+	boost::system::error_code ec;
+
+	if (_local_pba) {
+		sh.pba_batch.clear();
+		return;
+	}
+
+	size_t queued = sh.pba_batch.size();
+
+	_stats.pba_dropped.inc(queued - sh.pba_batch.flush(_mp_sock, ec));
+	if (ec && ec != boost::asio::error::would_block)
+		_log(0, "PBA sender error: ", ec.message());
+}
+
+void lma::start_(const std::string& id, bool tunnel_global_address, bool tunnel_provisioning, bool flow_tunnel,
+                 uint tunnel_prefix_length)
+{
+	const router_node* node = _node_db.get()->find_router(id);
 	if (!node) {
 		error_code ec(boost::system::errc::invalid_argument, boost::system::get_generic_category());
 
@@ -78,58 +188,610 @@ void lma::start_(const std::string& id, bool tunnel_global_address)
 	}
 	_log(0, "Started [id = ", id, ", address = ", node->address(), "]");
 
-	_mp_sock.open(ip::mproto());
-	_mp_sock.bind(ip::mproto::endpoint(node->address()));
-
 	_identifier = id;
 
-	_tunnels.open(ip::address_v6(node->address().to_bytes(), node->device_id()), tunnel_global_address);
+	_data_plane.open(ip::address_v6(node->address().to_bytes(), node->device_id()), tunnel_prefix_length,
+	                 tunnel_global_address, flow_tunnel);
+	if (flow_tunnel)
+		_log(0, "Flow based tunneling [device = ", _data_plane.acquire_tunnel(ip_address()), "]");
+	else if (tunnel_provisioning)
+		provision_tunnels();
+
+	if (_journal.is_open())
+		restore_bindings();
+
+	if (_local_pba)
+		return;
+
+	_mp_sock.open(ip::mproto());
+	_mp_sock.bind(ip::mproto::endpoint(node->address()));
 
 	for (size_t i = 0; i < _concurrency; ++i) {
-		pbu_receiver_ptr pbur(new pbu_receiver());
+		mp_batch_receiver_ptr mbr(new mp_batch_receiver());
 
-		pbur->async_receive(_mp_sock, boost::bind(&lma::mp_receive_handler, this, _1, _2, _3, _4));
+		mbr->async_receive(_mp_sock, boost::bind(&lma::mp_receive_handler, this, _1, _2, _3));
 	}
 }
 
+void lma::provision_tunnels()
+{
+	chrono delay;
+
+	delay.start();
+
+	//
+	// Every other router in the node database is a MAG allowed to register
+	// with this LMA
+	//
+	std::vector<ip_address> mags;
+	node_db&                ndb = *_node_db.get();
+
+	for (node_db::router_node_iterator i = ndb.router_node_begin(), e = ndb.router_node_end(); i != e; ++i)
+		if (i->id() != _identifier)
+			mags.push_back(i->address());
+
+	boost::mutex::scoped_lock lock(_dp_mutex);
+
+	size_t ready = _data_plane.provision_tunnels(mags, _concurrency);
+
+	_stats.tunnels.set(_data_plane.tunnel_count());
+
+	delay.stop();
+	_log(0, "Tunnel provisioning [count = ", ready, ", failed = ", mags.size() - ready, ", delay = ", delay.get(), "]");
+}
+
 void lma::stop_()
 {
-	_bcache.clear();
+	//
+	// Shards may still be programming routes and sending PBAs, the socket
+	// and the data plane are released once every shard is stopped. A
+	// restore still under way no longer collects the tunnels.
+	//
+	boost::system::error_code ec;
+
+	_stop_pending = _shards.size();
+	_restore_pending = 0;
+	for (shard_list::iterator i = _shards.begin(), e = _shards.end(); i != e; ++i)
+		i->service.post(boost::bind(&lma::stop_shard, this, boost::ref(*i)));
+
+	_reclaim_timer.cancel(ec);
+	_mp_sock.cancel(ec);
+}
+
+void lma::stop_shard(shard& sh)
+{
+	sh.timers.clear();
+	_stats.bindings.add(-sint64(sh.cache.size()));
+	sh.cache.clear();
+
+	_service.post(boost::bind(&lma::stop_shard_done, this));
+}
+
+void lma::stop_shard_done()
+{
+	if (--_stop_pending)
+		return;
+
 	_mp_sock.close();
-	_route_table.clear();
-	_tunnels.close();
+
+	boost::mutex::scoped_lock lock(_dp_mutex);
+
+	//
+	// The bindings are left in the journal, for the next run to take them
+	// back along with their tunnels and routes
+	//
+	if (_journal.is_open()) {
+		_data_plane.detach();
+		return;
+	}
+
+	_data_plane.flush();
+	_data_plane.close();
+}
+
+///
+/// The bindings taken from the journal are handed to their shards once the
+/// node database loader thread has read their mobile nodes. Those that
+/// expired meanwhile, or whose mobile node is gone, are dropped from the
+/// journal and their routes purged, the previous run having left them in
+/// place.
+///
+void lma::restore_bindings()
+{
+	const node_db&                            ndb = *_node_db.get();
+	uint64                                    now = ptime::get_realtime().seconds();
+	std::vector<bcache_journal::binding_list> shares(_shards.size());
+	std::vector<std::vector<uint32> >         indexes(_shards.size());
+	bcache_journal::binding_list              dropped;
+	boost::system::error_code                 ec;
+
+	for (bcache_journal::binding_list::iterator i = _restored.begin(), e = _restored.end(); i != e; ++i) {
+		uint32 index = ndb.index_of(i->id);
+
+		if (i->expiry <= now || index == k_mn_index_invalid) {
+			i->expiry = 0;
+			dropped.push_back(*i);
+			continue;
+		}
+
+		shares[shard_index(index)].push_back(*i);
+		indexes[shard_index(index)].push_back(index);
+	}
+
+	_log(0, "Binding cache restore [bindings = ", _restored.size() - dropped.size(), ", dropped = ", dropped.size(), "]");
+
+	purge_route_entries(dropped);
+	_journal.commit(dropped, ec);
+	if (ec)
+		_log(0, "Binding journal error: ", ec.message());
+
+	_restore_pending = 1;
+	for (size_t i = 0; i < _shards.size(); ++i) {
+		if (shares[i].empty())
+			continue;
+
+		++_restore_pending;
+		ndb.async_load(indexes[i], _shards[i].service.wrap(boost::bind(&lma::restore_shard, this,
+		                                                               boost::ref(_shards[i]), shares[i], _1)));
+	}
+
+	bcache_journal::binding_list().swap(_restored);
+	restore_done();
+}
+
+///
+/// Once every restored binding holds its tunnel, the tunnels of the
+/// previous run left without one are deleted, with the routes through them
+///
+void lma::restore_done()
+{
+	if (!_restore_pending || --_restore_pending)
+		return;
+
+	boost::mutex::scoped_lock lock(_dp_mutex);
+	size_t                    n = _data_plane.collect_tunnels();
+
+	_log(0, "Binding cache restore done [collected tunnels = ", n, "]");
+}
+
+void lma::purge_route_entries(const bcache_journal::binding_list& bindings)
+{
+	sys::route_table::batch routes;
+
+	for (bcache_journal::binding_list::const_iterator i = bindings.begin(), e = bindings.end(); i != e; ++i) {
+		for (bcache_journal::ip_prefix_list::const_iterator j = i->prefixes.begin(), f = i->prefixes.end(); j != f; ++j)
+			routes.purge_by_dst(*j);
+	}
+
+	if (routes.empty())
+		return;
+
+	boost::mutex::scoped_lock lock(_dp_mutex);
+
+	_data_plane.commit(routes);
 }
 
-void lma::proxy_binding_update(proxy_binding_info& pbinfo, chrono& delay)
+///
+/// A restored binding gets its routes again, which take over the ones left
+/// in place by the previous run, and the rest of its lifetime. A PBU handled
+/// while the mobile nodes were being read has the newer binding. With no
+/// mobile nodes the database went away first, the journal keeps the
+/// bindings.
+///
+void lma::restore_shard(shard& sh, bcache_journal::binding_list& bindings, const node_db::mobile_node_ptr_list& mns)
 {
-	if (pbinfo.status != ip::mproto::pba::status_ok)
-		return; //error
+	uint64                       now = ptime::get_realtime().seconds();
+	bcache_journal::binding_list dropped;
+
+	if (mns.size() != bindings.size()) {
+		_service.post(boost::bind(&lma::restore_done, this));
+		return;
+	}
+
+	for (size_t n = 0; n < bindings.size(); ++n) {
+		bcache_journal::binding_list::iterator i = bindings.begin() + n;
+		const mobile_node_ptr&                 mn = mns[n];
+
+		if (mn && sh.cache.find(mn->index()))
+			continue;
+
+		if (!mn || mn->lma_id() != _identifier) {
+			_log(0, "Binding restore error: mobile node not found or not anchored here [id = ", i->id, "]");
+			i->expiry = 0;
+			dropped.push_back(*i);
+			sh.journal.push_back(*i);
+			continue;
+		}
+
+		bcache_entry* be = new bcache_entry(*mn);
 
-	pbu_process(pbinfo);
+		be->care_of_address = i->care_of_address;
+		be->lifetime = i->lifetime;
+		be->sequence = i->sequence;
+		be->link_type = ll::technology(i->link_type);
+		be->bind_status = bcache_entry::k_bind_registered;
+
+		sh.cache.insert(be);
+		_stats.bindings.inc();
+		_stats.restored.inc();
+
+		add_route_entries(be);
+		sh.timers.schedule(be->timer, (i->expiry > now) ? (i->expiry - now) * 1000 : 0);
+	}
 
-	pba_sender_ptr pbas(new pba_sender(pbinfo));
+	purge_route_entries(dropped);
+	journal_flush(sh);
+	_service.post(boost::bind(&lma::restore_done, this));
+}
+
+void lma::journal_binding(shard& sh, const bcache_entry& be)
+{
+	if (!_journal.is_open())
+		return;
 
-	pbas->async_send(_mp_sock, boost::bind(&lma::mp_send_handler, this, _1));
+	bcache_journal::binding b;
+
+	b.id = be.id();
+	b.care_of_address = be.care_of_address;
+	b.expiry = ptime::get_realtime().seconds() + be.lifetime;
+	b.lifetime = be.lifetime;
+	b.sequence = be.sequence;
+	b.link_type = be.link_type;
+	b.prefixes = be.prefix_list();
+	sh.journal.push_back(b);
+}
+
+void lma::journal_removal(shard& sh, const bcache_entry& be)
+{
+	if (!_journal.is_open())
+		return;
+
+	bcache_journal::binding b;
+
+	b.id = be.id();
+	sh.journal.push_back(b);
+}
+
+void lma::journal_flush(shard& sh)
+{
+	if (sh.journal.empty())
+		return;
+
+	boost::system::error_code ec;
+
+	_journal.commit(sh.journal, ec);
+	if (ec)
+		_log(0, "Binding journal error: ", ec.message());
+}
+
+void lma::reload_(const std::string& file_name)
+{
+	if (_reload.running) {
+		_log(0, "Node database reload already in progress, request ignored [file = ", file_name, "]");
+		return;
+	}
+
+	_log(0, "Node database reload [file = ", file_name, "]");
+
+	_reload.running = true;
+	_reload.delay.start();
+
+	if (_reload_thread.joinable())
+		_reload_thread.join();
+	_reload_thread = boost::thread(boost::bind(&lma::reload_load, this, file_name));
+}
+
+void lma::reload_load(const std::string& file_name)
+{
+	//
+	// Runs on its own thread. The current database is stable until this
+	// one is published, being published only from here.
+	//
+	std::auto_ptr<node_db> ndb(new node_db);
+
+	ndb->set_cache_capacity(_node_db.get()->cache_capacity());
+	ndb->set_cache_stripes(_node_db.get()->cache_stripes());
+	try {
+		std::pair<size_t, size_t> n = ndb->load_file(file_name);
+
+		ndb->keep_indexes(*_node_db.get());
+		_log(0, "Node database loaded [router nodes = ", n.first, ", mobile nodes = ", n.second, "]");
+
+		_reload.loaded = ndb.release();
+
+	} catch (std::exception& e) {
+		_log(0, "Node database reload error: ", e.what());
+	}
+
+	_service.post(boost::bind(&lma::reload_publish, this));
+}
+
+void lma::reload_publish()
+{
+	if (!_reload.loaded) {
+		_reload.running = false;
+		return;
+	}
+
+	//
+	// New lookups see the new database from here on. Each shard then walks
+	// its bindings, after which no shard refers to the previous database.
+	//
+	_reload.previous = _node_db.exchange(_reload.loaded, _reload.epoch);
+	_reload.loaded = nullptr;
+	__atomic_add_fetch(&_reload.generation, 1, __ATOMIC_RELEASE);
+	_reload.shards_pending = _shards.size();
+	_reload.revoked = 0;
+	_reload.rebound = 0;
+
+	for (size_t i = 0; i < _shards.size(); ++i)
+		_shards[i].service.post(boost::bind(&lma::reload_shard, this, boost::ref(_shards[i]), uint32(i),
+		                                    size_t(0), size_t(0)));
+}
+
+void lma::reload_shard(shard& sh, uint32 first, size_t revoked, size_t rebound)
+{
+	const node_db&      ndb = *_node_db.get();
+	uint32              end = _reload.previous->mobile_node_count();
+	uint32              step = _shards.size();
+	uint32              i = first;
+	std::vector<uint32> indexes;
+
+	//
+	// A batch of indexes at a time, so PBUs queued on the shard are not
+	// held back by a large binding cache. The mobile nodes not at hand are
+	// read by the node database loader thread.
+	//
+	for (uint32 n = 0; i < end && n < k_reload_batch; i += step, ++n) {
+		bcache_entry* be = sh.cache.find(i);
+		if (!be)
+			continue;
+
+		mobile_node_ptr mn = ndb.peek_mobile_node(i);
+		if (!mn) {
+			indexes.push_back(i);
+			continue;
+		}
+
+		if (reload_rebind(sh, *be, mn))
+			++rebound;
+		else
+			++revoked;
+	}
+
+	if (!indexes.empty())
+		ndb.async_load(indexes, sh.service.wrap(boost::bind(&lma::reload_shard_fetched, this, boost::ref(sh), i,
+		                                                    revoked, rebound, indexes, _1)));
+	else
+		reload_shard_next(sh, i, revoked, rebound);
+}
+
+///
+/// The bindings found again are checked against the mobile nodes read,
+/// those removed meanwhile are skipped
+///
+void lma::reload_shard_fetched(shard& sh, uint32 next, size_t revoked, size_t rebound,
+                               const std::vector<uint32>& indexes, const node_db::mobile_node_ptr_list& mns)
+{
+	for (size_t n = 0; n < mns.size(); ++n) {
+		bcache_entry* be = sh.cache.find(indexes[n]);
+		if (!be)
+			continue;
+
+		if (reload_rebind(sh, *be, mns[n]))
+			++rebound;
+		else
+			++revoked;
+	}
+
+	reload_shard_next(sh, next, revoked, rebound);
+}
+
+void lma::reload_shard_next(shard& sh, uint32 next, size_t revoked, size_t rebound)
+{
+	journal_flush(sh);
+
+	if (next < _reload.previous->mobile_node_count())
+		sh.service.post(boost::bind(&lma::reload_shard, this, boost::ref(sh), next, revoked, rebound));
+	else
+		_service.post(boost::bind(&lma::reload_shard_done, this, revoked, rebound));
+}
+
+///
+/// Rebinds the entry to the reloaded mobile node, or revokes it if the
+/// mobile node is gone or changed. Returns true if rebound.
+///
+bool lma::reload_rebind(shard& sh, bcache_entry& be, const mobile_node_ptr& mn)
+{
+	if (mn && mn->equivalent(be.mn())) {
+		be.rebind(*mn);
+		return true;
+	}
+
+	_log(0, "Binding revoked by node database reload [id = ", be.id(), "]");
+
+	if (be.bind_status == bcache_entry::k_bind_registered) {
+		del_route_entries(&be);
+		journal_removal(sh, be);
+	}
+	sh.timers.cancel(be.timer);
+	sh.cache.remove(&be);
+	_stats.bindings.dec();
+	_stats.revocations.inc();
+	return false;
+}
+
+void lma::reload_shard_done(size_t revoked, size_t rebound)
+{
+	_reload.revoked += revoked;
+	_reload.rebound += rebound;
+	if (!--_reload.shards_pending)
+		reload_reclaim(boost::system::error_code());
+}
+
+void lma::reload_reclaim(const boost::system::error_code& ec)
+{
+	if (ec)
+		return;
+
+	//
+	// Only dispatch_pbus reads the database outside the strands, for the
+	// time it takes to look up a batch of PBUs
+	//
+	if (!_node_db.synchronized(_reload.epoch)) {
+		_reclaim_timer.expires_from_now(boost::posix_time::milliseconds(k_reload_reclaim_retry));
+		_reclaim_timer.async_wait(_service.wrap(boost::bind(&lma::reload_reclaim, this, _1)));
+		return;
+	}
+
+	if (_reload.previous != &_initial_node_db)
+		delete _reload.previous;
+	_reload.previous = nullptr;
+	_reload.running = false;
+	_stats.reloads.inc();
+
+	_reload.delay.stop();
+	_log(0, "Node database reloaded [revoked = ", _reload.revoked, ", rebound = ", _reload.rebound,
+	        ", delay = ", _reload.delay.get(), "]");
+}
+
+size_t lma::shard_index(uint32 mn_index) const
+{
+	return mn_index % _shards.size();
+}
+
+void lma::proxy_binding_update(shard& sh, pbinfo_batch_ptr& pbb, chrono& delay)
+{
+	//
+	// Each PBU gets its own trace record, starting from the batch stamps.
+	// Records are committed once the PBA batch holding them is sent.
+	//
+	tracer::record traces[k_mp_batch_size];
+	size_t         traced = 0;
+	size_t         sent = 0;
+	bool           deferred[k_mp_batch_size];
+
+	pbb->trace().stamp(k_trace_strand);
+	proxy_binding_defer(sh, *pbb, deferred, delay);
+
+	for (pbinfo_batch::iterator i = pbb->begin(), e = pbb->end(); i != e; ++i) {
+		if (deferred[i - pbb->begin()])
+			continue;
+		if (i->status != ip::mproto::pba::status_ok)
+			continue; //error
+
+		tracer::record& tr = traces[traced++];
+
+		tr = pbb->trace();
+		pbu_process(sh, *i, tr);
+
+		count_pba(i->status);
+		sh.pba_batch.push_pba(*i);
+		tr.stamp(k_trace_pba_queued);
+		if (_local_pba)
+			_local_pba(*i);
+		if (sh.pba_batch.full()) {
+			journal_flush(sh);
+			mp_flush(sh);
+			for (uint64 now = tracer::now(); sent < traced; ++sent) {
+				traces[sent].stamps[k_trace_pba_sent] = now;
+				_tracer.commit(traces[sent]);
+			}
+		}
+	}
+
+	journal_flush(sh);
+	mp_flush(sh);
+	for (uint64 now = tracer::now(); sent < traced; ++sent) {
+		traces[sent].stamps[k_trace_pba_sent] = now;
+		_tracer.commit(traces[sent]);
+	}
 
 	delay.stop();
-	_log(0, "PBU ", !pbinfo.lifetime ? "de-" : "", "register processing delay ", delay.get());
+	_stats.pbu_batch_delay.record(delay.get());
+	_log(0, "PBU batch processing delay ", delay.get(), " [count = ", pbb->size(), "]");
+}
+
+///
+/// PBUs of mobile nodes that are not at hand are moved to a batch of their
+/// own, processed once the node database loader thread has read them from
+/// the store, so the strand never waits on it. A PBU following one that was
+/// set aside for the same mobile node is set aside too, keeping their order.
+///
+void lma::proxy_binding_defer(shard& sh, pbinfo_batch& pbb, bool* deferred, chrono& delay)
+{
+	//
+	// The generation is read first, a database published meanwhile only
+	// makes the resumed PBUs look the mobile node up again
+	//
+	uint                generation = __atomic_load_n(&_reload.generation, __ATOMIC_ACQUIRE);
+	const node_db&      ndb = *_node_db.get();
+	pbinfo_batch_ptr    pending;
+	std::vector<uint32> indexes;
+
+	for (size_t n = 0; n < pbb.size(); ++n) {
+		proxy_binding_info& pbinfo = pbb.begin()[n];
+
+		deferred[n] = false;
+		if (pbinfo.status != ip::mproto::pba::status_ok || pbinfo.mn_index == k_mn_index_invalid
+		    || sh.cache.find(pbinfo.mn_index))
+			continue;
+
+		if (ndb.peek_mobile_node(pbinfo.mn_index)
+		    && std::find(indexes.begin(), indexes.end(), pbinfo.mn_index) == indexes.end())
+			continue;
+
+		if (!pending) {
+			pending = pbinfo_batch::make();
+			pending->trace() = pbb.trace();
+		}
+
+		indexes.push_back(pbinfo.mn_index);
+		swap(pending->push(), pbinfo);
+		deferred[n] = true;
+		_stats.fetches.inc();
+	}
+
+	if (pending)
+		ndb.async_load(indexes, sh.service.wrap(boost::bind(&lma::proxy_binding_fetched, this, boost::ref(sh),
+		                                                    pending, delay, generation, _1)));
+}
+
+///
+/// The loaded mobile nodes are held while the PBUs are processed, which
+/// then find them at hand. A mobile node not found is only final if the
+/// database was not reloaded meanwhile.
+///
+void lma::proxy_binding_fetched(shard& sh, pbinfo_batch_ptr& pbb, chrono& delay, uint generation,
+                                const node_db::mobile_node_ptr_list& mns)
+{
+	if (generation == __atomic_load_n(&_reload.generation, __ATOMIC_ACQUIRE)) {
+		for (size_t n = 0; n < mns.size(); ++n) {
+			if (!mns[n])
+				pbb->begin()[n].mn_index = k_mn_index_invalid;
+		}
+	}
+
+	proxy_binding_update(sh, pbb, delay);
 }
 
-bcache_entry* lma::pbu_get_be(proxy_binding_info& pbinfo)
+bcache_entry* lma::pbu_get_be(shard& sh, proxy_binding_info& pbinfo)
 {
 	BOOST_ASSERT((pbinfo.status == ip::mproto::pba::status_ok));
 
-	bcache_entry* be = _bcache.find(pbinfo.id);
+	bcache_entry* be = sh.cache.find(pbinfo.mn_index);
 	if (be)
 		return be;
 
-	if (!_node_db.find_router(pbinfo.address)) {
+	const node_db& ndb = *_node_db.get();
+
+	if (!ndb.find_router(pbinfo.address)) {
 		_log(0, "PBU registration error: MAG not authorized [id = ", pbinfo.id, ", mag = ", pbinfo.address, "]");
 		pbinfo.status = ip::mproto::pba::status_not_authorized_for_proxy_reg;
 		return nullptr;
 	}
 
-	const mobile_node* mn = _node_db.find_mobile_node(pbinfo.id);
+	mobile_node_ptr mn = ndb.mobile_node_at(pbinfo.mn_index);
 	if (!mn) {
 		_log(0, "PBU registration error: unknown mobile node [id = ", pbinfo.id, ", mag = ", pbinfo.address, "]");
 		pbinfo.status = ip::mproto::pba::status_not_lma_for_this_mn;
@@ -147,8 +809,9 @@ bcache_entry* lma::pbu_get_be(proxy_binding_info& pbinfo)
 		return nullptr; //note: no error for this
 	}
 
-	be = new bcache_entry(_service.get_io_service(), pbinfo.id, mn->prefix_list());
-	_bcache.insert(be);
+	be = new bcache_entry(*mn);
+	sh.cache.insert(be);
+	_stats.bindings.inc();
 
 	return be;
 }
@@ -163,7 +826,7 @@ bool lma::pbu_mag_checkin(bcache_entry& be, proxy_binding_info& pbinfo)
 			return false;
 		}
 
-		const router_node* mag = _node_db.find_router(pbinfo.address);
+		const router_node* mag = _node_db.get()->find_router(pbinfo.address);
 		if (!mag) {
 			_log(0, "PBU error: unknown MAG [id = ", pbinfo.id, ", mag = ", pbinfo.address, "]");
 			pbinfo.status = ip::mproto::pba::status_not_authorized_for_proxy_reg;
@@ -174,8 +837,6 @@ bool lma::pbu_mag_checkin(bcache_entry& be, proxy_binding_info& pbinfo)
 			return false; //note: no error for this
 		}
 
-		if (!be.care_of_address.is_unspecified())
-			del_route_entries(&be);
 		be.care_of_address = pbinfo.address;
 		be.lifetime = pbinfo.lifetime;
 		be.sequence = pbinfo.sequence;
@@ -199,30 +860,48 @@ bool lma::pbu_mag_checkin(bcache_entry& be, proxy_binding_info& pbinfo)
 	return true;
 }
 
-void lma::pbu_process(proxy_binding_info& pbinfo)
+void lma::pbu_process(shard& sh, proxy_binding_info& pbinfo, tracer::record& tr)
 {
-	bcache_entry* be = pbu_get_be(pbinfo);
-	if (!be)
+	bcache_entry* be = pbu_get_be(sh, pbinfo);
+	if (!be) {
+		tr.stamp(k_trace_lookup);
 		return;
+	}
 
-	if (!pbu_mag_checkin(*be, pbinfo))
+	ip_address prev_coa = be->care_of_address;
+	bool       checkin = pbu_mag_checkin(*be, pbinfo);
+
+	tr.stamp(k_trace_lookup);
+	if (!checkin)
 		return;
 
 	if (pbinfo.lifetime) {
-		if (be->care_of_address == pbinfo.address)
-			if (be->bind_status == bcache_entry::k_bind_registered)
+		bool handoff = !prev_coa.is_unspecified() && prev_coa != be->care_of_address;
+		bool renewal = !handoff && be->bind_status == bcache_entry::k_bind_registered;
+
+		if (!handoff)
+			if (renewal)
 				_log(0, "PBU re-registration [id = ", pbinfo.id, ", mag = ", pbinfo.address, "]");
 			else
 				_log(0, "PBU registration [id = ", pbinfo.id, ", mag = ", pbinfo.address, "]");
 		else
 			_log(0, "PBU handoff [id = ", pbinfo.id, ", mag = ", pbinfo.address, "]");
 
-		be->timer.cancel();
+		//
+		// A renewal finds its routes and tunnel in place, adding them again
+		// would only take another tunnel reference
+		//
 		be->bind_status = bcache_entry::k_bind_registered;
-		add_route_entries(be);
+		if (handoff) {
+			_stats.handoffs.inc();
+			move_route_entries(be, prev_coa);
+		}
+		else if (!renewal)
+			add_route_entries(be);
+		tr.stamp(k_trace_routes);
 
-		be->timer.expires_from_now(boost::posix_time::seconds(pbinfo.lifetime));
-		be->timer.async_wait(_service.wrap(boost::bind(&lma::expired_entry, this, _1, be->id())));
+		sh.timers.schedule(be->timer, pbinfo.lifetime * 1000);
+		journal_binding(sh, *be);
 	}
 
 	BOOST_ASSERT((be->bind_status != bcache_entry::k_bind_unknown));
@@ -230,55 +909,47 @@ void lma::pbu_process(proxy_binding_info& pbinfo)
 	if (!pbinfo.lifetime && be->bind_status == bcache_entry::k_bind_registered) {
 		_log(0, "PBU de-registration [id = ", pbinfo.id, ", mag = ", pbinfo.address, "]");
 
-		be->timer.cancel();
 		be->bind_status = bcache_entry::k_bind_deregistered;
 		del_route_entries(be);
+		tr.stamp(k_trace_routes);
 		be->care_of_address = ip::address_v6();
+		journal_removal(sh, *be);
 
-		be->timer.expires_from_now(boost::posix_time::milliseconds(_config.min_delay_before_BCE_delete));
-		be->timer.async_wait(_service.wrap(boost::bind(&lma::remove_entry, this, _1, be->id())));
+		sh.timers.schedule(be->timer, _config.min_delay_before_BCE_delete);
 	}
 }
 
-void lma::expired_entry(const boost::system::error_code& ec, const std::string& mn_id)
+void lma::binding_timeout(shard& sh, timer_wheel_hook& timer)
 {
-	if (ec) {
-		if (ec != boost::system::errc::make_error_condition(boost::system::errc::operation_canceled))
-			_log(0, "Binding cache expired entry timer error: ", ec.message());
+	bcache_entry* be = parent_of(&timer, &bcache_entry::timer);
 
-		return;
+	switch (be->bind_status) {
+	case bcache_entry::k_bind_registered:   expired_entry(sh, *be); break;
+	case bcache_entry::k_bind_deregistered: remove_entry(sh, *be); break;
+	default:
+		_log(0, "Binding cache timer error: invalid binding state [id = ", be->id(), "]");
 	}
 
-	bcache_entry* be = _bcache.find(mn_id);
-	if (!be || be->bind_status != bcache_entry::k_bind_registered) {
-		_log(0, "Binding cache expired entry error: not found [id = ", mn_id, "]");
-		return;
-	}
-	_log(0, "Binding expired entry [id = ", mn_id, "]");
-
-	be->bind_status = bcache_entry::k_bind_deregistered;
-
-	be->timer.expires_from_now(boost::posix_time::milliseconds(_config.min_delay_before_BCE_delete));
-	be->timer.async_wait(_service.wrap(boost::bind(&lma::remove_entry, this, _1, be->id())));
+	journal_flush(sh);
 }
 
-void lma::remove_entry(const boost::system::error_code& ec, const std::string& mn_id)
+void lma::expired_entry(shard& sh, bcache_entry& be)
 {
-	if (ec) {
-		if (ec != boost::system::errc::make_error_condition(boost::system::errc::operation_canceled))
-			_log(0, "Binding cache remove entry timer error: ", ec.message());
+	_log(0, "Binding expired entry [id = ", be.id(), "]");
+	_stats.expiries.inc();
 
-		return;
-	}
+	be.bind_status = bcache_entry::k_bind_deregistered;
+	journal_removal(sh, be);
 
-	bcache_entry* be = _bcache.find(mn_id);
-	if (!be || be->bind_status != bcache_entry::k_bind_deregistered) {
-		_log(0, "Binding cache remove entry error: not found [id = ", mn_id, "]");
-		return;
-	}
-	_log(0, "Binding cache remove entry [id = ", mn_id, "]");
+	sh.timers.schedule(be.timer, _config.min_delay_before_BCE_delete);
+}
+
+void lma::remove_entry(shard& sh, bcache_entry& be)
+{
+	_log(0, "Binding cache remove entry [id = ", be.id(), "]");
 
-	_bcache.remove(be);
+	sh.cache.remove(&be);
+	_stats.bindings.dec();
 }
 
 void lma::add_route_entries(bcache_entry* be)
@@ -287,13 +958,23 @@ void lma::add_route_entries(bcache_entry* be)
 
 	delay.start();
 
+	boost::mutex::scoped_lock lock(_dp_mutex);
+
 	const bcache::net_prefix_list& npl = be->prefix_list();
-	uint tdev = _tunnels.get(be->care_of_address);
+	uint tdev = _data_plane.acquire_tunnel(be->care_of_address);
+
+	_stats.tunnels.set(_data_plane.tunnel_count());
 
 	_log(0, "Add route entries [id = ", be->id(), ", tunnel = ", tdev, ", CoA = ", be->care_of_address, "]");
 
+	sys::route_table::batch routes;
+	ptime                   start = ptime::get_monotonic();
+
 	for (bcache::net_prefix_list::const_iterator i = npl.begin(), e = npl.end(); i != e; ++i)
-		_route_table.add_by_dst(*i, tdev);
+		routes.add_by_dst(*i, route_entry(tdev, be->care_of_address),
+		                  boost::bind(&lma::route_entry_completion, this, _1, be->id(), *i, start));
+
+	_data_plane.commit(routes);
 
 	delay.stop();
 	_log(0, "Add route entries delay ", delay.get());
@@ -305,19 +986,116 @@ void lma::del_route_entries(bcache_entry* be)
 
 	delay.start();
 
+	boost::mutex::scoped_lock lock(_dp_mutex);
+
 	const bcache::net_prefix_list& npl = be->prefix_list();
 
 	_log(0, "Remove route entries [id = ", be->id(), ", CoA = ", be->care_of_address, "]");
 
+	sys::route_table::batch routes;
+	ptime                   start = ptime::get_monotonic();
+
 	for (bcache::net_prefix_list::const_iterator i = npl.begin(), e = npl.end(); i != e; ++i)
-		_route_table.remove_by_dst(*i);
+		routes.remove_by_dst(*i, boost::bind(&lma::route_entry_completion, this, _1, be->id(), *i, start));
 
-	_tunnels.del(be->care_of_address);
+	_data_plane.commit(routes);
+
+	_data_plane.release_tunnel(be->care_of_address);
+	_stats.tunnels.set(_data_plane.tunnel_count());
 
 	delay.stop();
 	_log(0, "Remove route entries delay ", delay.get());
 }
 
+void lma::move_route_entries(bcache_entry* be, const ip_address& prev_coa)
+{
+	chrono delay;
+
+	delay.start();
+
+	boost::mutex::scoped_lock lock(_dp_mutex);
+
+	//
+	// The prefix routes are pointed at the new tunnel in place, the old
+	// tunnel reference is only dropped once the new one is held
+	//
+	const bcache::net_prefix_list& npl = be->prefix_list();
+	uint tdev = _data_plane.move_tunnel(prev_coa, be->care_of_address);
+
+	_stats.tunnels.set(_data_plane.tunnel_count());
+
+	_log(0, "Move route entries [id = ", be->id(), ", tunnel = ", tdev, ", CoA = ", prev_coa, " -> ", be->care_of_address, "]");
+
+	sys::route_table::batch routes;
+	ptime                   start = ptime::get_monotonic();
+
+	for (bcache::net_prefix_list::const_iterator i = npl.begin(), e = npl.end(); i != e; ++i)
+		routes.replace_by_dst(*i, route_entry(tdev, be->care_of_address),
+		                      boost::bind(&lma::route_entry_completion, this, _1, be->id(), *i, start));
+
+	_data_plane.commit(routes);
+
+	delay.stop();
+	_log(0, "Move route entries delay ", delay.get());
+}
+
+sys::route_table::entry lma::route_entry(uint tdev, const ip_address& coa) const
+{
+	//
+	// On the external tunnel the MAG is selected by the route itself
+	//
+	return sys::route_table::entry(tdev, ip_address(), _data_plane.is_external() ? coa : ip_address());
+}
+
+void lma::route_entry_completion(const boost::system::error_code& ec, const std::string& id, const ip::prefix_v6& prefix,
+                                 const ptime& start)
+{
+	_stats.netlink_latency.record(ptime::get_monotonic() - start);
+
+	if (ec)
+		_log(0, "Route entry error: ", ec.message(), " [id = ", id, ", prefix = ", prefix, "]");
+}
+
+void lma::register_metrics()
+{
+	_metrics.add("opmip_lma_pbu_received_total", "Proxy binding updates received", _stats.pbu_received);
+	_metrics.add("opmip_lma_pba_sent_total", "Proxy binding acknowledgements sent, by status",
+	             _stats.pba_accepted, "status=\"accepted\"");
+	_metrics.add("opmip_lma_pba_sent_total", "", _stats.pba_bad_sequence, "status=\"bad_sequence\"");
+	_metrics.add("opmip_lma_pba_sent_total", "", _stats.pba_not_lma, "status=\"not_lma_for_this_mn\"");
+	_metrics.add("opmip_lma_pba_sent_total", "", _stats.pba_not_authorized, "status=\"not_authorized\"");
+	_metrics.add("opmip_lma_pba_sent_total", "", _stats.pba_other, "status=\"other\"");
+	_metrics.add("opmip_lma_pba_dropped_total", "Proxy binding acknowledgements dropped on a full socket buffer",
+	             _stats.pba_dropped);
+	_metrics.add("opmip_lma_handoffs_total", "Bindings moved to another MAG", _stats.handoffs);
+	_metrics.add("opmip_lma_expiries_total", "Bindings expired without renewal", _stats.expiries);
+	_metrics.add("opmip_lma_bindings", "Binding cache entries", _stats.bindings);
+	_metrics.add("opmip_lma_tunnels", "Tunnel devices open", _stats.tunnels);
+	_metrics.add("opmip_lma_node_db_reloads_total", "Node database reloads", _stats.reloads);
+	_metrics.add("opmip_lma_revocations_total", "Bindings revoked by node database reloads",
+	             _stats.revocations);
+	_metrics.add("opmip_lma_restored_total", "Bindings taken back from the journal at start", _stats.restored);
+	_metrics.add("opmip_lma_node_db_fetches_total", "PBUs suspended to load the mobile node from the node database store",
+	             _stats.fetches);
+	_metrics.add("opmip_lma_pbu_batch_seconds", "Processing time of a batch of proxy binding updates",
+	             _stats.pbu_batch_delay);
+	_metrics.add("opmip_lma_netlink_seconds", "Time from route request to kernel reply",
+	             _stats.netlink_latency);
+	_tracer.register_metrics(_metrics, "opmip_lma_pbu_pipeline", "PBU processing time");
+}
+
+void lma::count_pba(uint status)
+{
+	switch (status) {
+	case ip::mproto::pba::status_ok:
+	case ip::mproto::pba::status_ok_needs_prefix:              _stats.pba_accepted.inc(); break;
+	case ip::mproto::pba::status_bad_sequence:                 _stats.pba_bad_sequence.inc(); break;
+	case ip::mproto::pba::status_not_lma_for_this_mn:          _stats.pba_not_lma.inc(); break;
+	case ip::mproto::pba::status_not_authorized_for_proxy_reg: _stats.pba_not_authorized.inc(); break;
+	default:                                                   _stats.pba_other.inc(); break;
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 } /* namespace pmip */ } /* namespace opmip */
 
@@ -18,7 +18,6 @@
 
 #include <opmip/exception.hpp>
 #include <opmip/pmip/mag.hpp>
-#include <opmip/pmip/mp_sender.hpp>
 #include <opmip/pmip/icmp_sender.hpp>
 #include <opmip/ip/icmp.hpp>
 #include <boost/asio/ip/unicast.hpp>
@@ -114,16 +113,34 @@ std::string mag::error_category::message(int ev) const
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-mag::mag(boost::asio::io_service& ios, node_db& ndb, addrconf_server& asrv, size_t concurrency)
-	: _service(ios), _node_db(ndb), _log("MAG", std::cout), _addrconf(asrv),
-	  _mp_sock(ios), _tunnels(ios), _route_table(ios),
+mag::mag(boost::asio::io_service& ios, node_db& ndb, addrconf_server& asrv, size_t concurrency,
+         data_plane* dp)
+	: _service(ios), _timers(_service, boost::bind(&mag::proxy_binding_timeout, this, _1)),
+	  _node_db(&ndb), _initial_node_db(ndb), _log("MAG", std::cout), _reclaim_timer(ios), _addrconf(asrv),
+	  _mp_sock(ios), _pbu_flush_pending(false),
+	  _own_data_plane(dp ? nullptr : new kernel_data_plane(ios)), _data_plane(dp ? *dp : *_own_data_plane),
 	  _concurrency(concurrency)
 {
+	register_metrics();
 }
 
-void mag::start(const std::string& id, const ip_address& mn_access_link, bool tunnel_global_address)
+mag::~mag()
 {
-	_service.dispatch(boost::bind(&mag::start_, this, id, mn_access_link, tunnel_global_address));
+	if (_reload_thread.joinable())
+		_reload_thread.join();
+
+	delete _reload.loaded;
+	if (_reload.previous != &_initial_node_db)
+		delete _reload.previous;
+	if (_node_db.get() != &_initial_node_db)
+		delete _node_db.get();
+}
+
+void mag::start(const std::string& id, const ip_address& mn_access_link, bool tunnel_global_address,
+                uint tunnel_prefix_length)
+{
+	_service.dispatch(boost::bind(&mag::start_, this, id, mn_access_link, tunnel_global_address,
+	                              tunnel_prefix_length));
 }
 
 void mag::stop()
@@ -131,27 +148,72 @@ void mag::stop()
 	_service.dispatch(boost::bind(&mag::stop_, this));
 }
 
-void mag::mp_send_handler(const boost::system::error_code& ec)
+void mag::reload(const std::string& file_name)
 {
-	if (ec && ec != boost::system::errc::make_error_condition(boost::system::errc::operation_canceled))
-		_log(0, "PBU send error: ", ec.message());
+	_service.dispatch(boost::bind(&mag::reload_, this, file_name));
 }
 
-void mag::mp_receive_handler(const boost::system::error_code& ec, const proxy_binding_info& pbinfo, pba_receiver_ptr& pbar, chrono& delay)
+void mag::mp_receive_handler(const boost::system::error_code& ec, mp_batch_receiver_ptr& mbr, chrono& delay)
 {
 	if (ec) {
 		 if (ec != boost::system::errc::make_error_condition(boost::system::errc::operation_canceled))
 			_log(0, "PBA receive error: ", ec.message());
 
-	} else {
-		_service.dispatch(boost::bind(&mag::proxy_binding_ack, this, pbinfo, delay));
-		pbar->async_receive(_mp_sock, boost::bind(&mag::mp_receive_handler, this, _1, _2, _3, _4));
+		return;
+	}
+
+	pbinfo_batch_ptr             pbb = pbinfo_batch::make();
+	rcu_pointer<node_db>::reader ndb(_node_db);
+
+	for (size_t i = 0; i < mbr->size(); ++i) {
+		proxy_binding_info& pbinfo = pbb->push();
+
+		if (!mbr->parse_pba(i, pbinfo)) {
+			_log(0, "PBA receive error: malformed message");
+			pbb->pop();
+			continue;
+		}
+
+		pbinfo.mn_index = ndb->index_of(pbinfo.id);
+	}
+
+	if (pbb->size())
+		_service.dispatch(boost::bind(&mag::proxy_binding_ack_list, this, pbb, delay));
+	mbr->async_receive(_mp_sock, boost::bind(&mag::mp_receive_handler, this, _1, _2, _3));
+}
+
+void mag::mp_send(const bulist_entry& be, const proxy_binding_info& pbinfo)
+{
+	if (_pbu_batch.full())
+		mp_flush();
+
+	//
+	// PBUs queued while processing the current strand handlers are sent
+	// together with a single system call
+	//
+	_pbu_batch.push(be.pbu, pbinfo);
+	if (!_pbu_flush_pending) {
+		_pbu_flush_pending = true;
+		_service.post(boost::bind(&mag::mp_flush, this));
 	}
 }
 
-void mag::start_(const std::string& id, const ip_address& link_local_ip, bool tunnel_global_address)
+void mag::mp_flush()
 {
-	const router_node* node = _node_db.find_router(id);
+	boost::system::error_code ec;
+
+	size_t queued = _pbu_batch.size();
+
+	_pbu_flush_pending = false;
+	_stats.dropped.inc(queued - _pbu_batch.flush(_mp_sock, ec));
+	if (ec && ec != boost::asio::error::would_block)
+		_log(0, "PBU send error: ", ec.message());
+}
+
+void mag::start_(const std::string& id, const ip_address& link_local_ip, bool tunnel_global_address,
+                 uint tunnel_prefix_length)
+{
+	const router_node* node = _node_db.get()->find_router(id);
 	if (!node)
 		boost::throw_exception(exception(errc::make_error_code(errc::invalid_argument),
 		                                 "MAG id not found in node database"));
@@ -168,25 +230,209 @@ void mag::start_(const std::string& id, const ip_address& link_local_ip, bool tu
 	_identifier = id;
 	_link_local_ip = link_local_ip;
 
-	_tunnels.open(ip::address_v6(node->address().to_bytes(), node->device_id()), tunnel_global_address);
+	_data_plane.open(ip::address_v6(node->address().to_bytes(), node->device_id()), tunnel_prefix_length,
+	                 tunnel_global_address, false);
 
 	_addrconf.start();
 
 	for (size_t i = 0; i < _concurrency; ++i) {
-		pba_receiver_ptr pbar(new pba_receiver);
+		mp_batch_receiver_ptr mbr(new mp_batch_receiver());
 
-		pbar->async_receive(_mp_sock, boost::bind(&mag::mp_receive_handler, this, _1, _2, _3, _4));
+		mbr->async_receive(_mp_sock, boost::bind(&mag::mp_receive_handler, this, _1, _2, _3));
 	}
 }
 
 void mag::stop_()
 {
+	boost::system::error_code ec;
+
+	_reclaim_timer.cancel(ec);
+	_timers.clear();
+	_stats.bindings.set(0);
 	_bulist.clear();
 	_addrconf.clear();
 	_addrconf.stop();
 	_mp_sock.close();
-	_route_table.clear();
-	_tunnels.close();
+	_data_plane.flush();
+	_data_plane.close();
+}
+
+void mag::reload_(const std::string& file_name)
+{
+	if (_reload.running) {
+		_log(0, "Node database reload already in progress, request ignored [file = ", file_name, "]");
+		return;
+	}
+
+	_log(0, "Node database reload [file = ", file_name, "]");
+
+	_reload.running = true;
+	_reload.delay.start();
+
+	if (_reload_thread.joinable())
+		_reload_thread.join();
+	_reload_thread = boost::thread(boost::bind(&mag::reload_load, this, file_name));
+}
+
+void mag::reload_load(const std::string& file_name)
+{
+	//
+	// Runs on its own thread. The current database is stable until this
+	// one is published, being published only from here.
+	//
+	std::auto_ptr<node_db> ndb(new node_db);
+
+	ndb->set_cache_capacity(_node_db.get()->cache_capacity());
+	try {
+		std::pair<size_t, size_t> n = ndb->load_file(file_name);
+
+		ndb->keep_indexes(*_node_db.get());
+		_log(0, "Node database loaded [router nodes = ", n.first, ", mobile nodes = ", n.second, "]");
+
+		_reload.loaded = ndb.release();
+
+	} catch (std::exception& e) {
+		_log(0, "Node database reload error: ", e.what());
+	}
+
+	_service.post(boost::bind(&mag::reload_publish, this));
+}
+
+void mag::reload_publish()
+{
+	if (!_reload.loaded) {
+		_reload.running = false;
+		return;
+	}
+
+	_reload.previous = _node_db.exchange(_reload.loaded, _reload.epoch);
+	_reload.loaded = nullptr;
+	++_reload.generation;
+	_reload.revoked = 0;
+	_reload.rebound = 0;
+
+	reload_bulist(0);
+}
+
+void mag::reload_bulist(uint32 first)
+{
+	const node_db&      ndb = *_node_db.get();
+	uint32              end = _reload.previous->mobile_node_count();
+	uint32              i = first;
+	std::vector<uint32> indexes;
+
+	//
+	// A batch of indexes at a time, so PBAs and attachments are not held
+	// back by a large binding update list. The mobile nodes not at hand are
+	// read by the node database loader thread.
+	//
+	for (; i < end && i - first < k_reload_batch; ++i) {
+		bulist_entry* be = _bulist.find(i);
+		if (!be)
+			continue;
+
+		mobile_node_ptr mn = ndb.peek_mobile_node(i);
+		if (!mn) {
+			indexes.push_back(i);
+			continue;
+		}
+
+		reload_rebind(*be, mn);
+	}
+
+	if (!indexes.empty())
+		ndb.async_load(indexes, _service.wrap(boost::bind(&mag::reload_bulist_fetched, this, i, indexes, _1)));
+	else
+		reload_bulist_next(i);
+}
+
+///
+/// The bindings found again are checked against the mobile nodes read,
+/// those removed meanwhile are skipped
+///
+void mag::reload_bulist_fetched(uint32 next, const std::vector<uint32>& indexes,
+                                const node_db::mobile_node_ptr_list& mns)
+{
+	for (size_t n = 0; n < mns.size(); ++n) {
+		bulist_entry* be = _bulist.find(indexes[n]);
+
+		if (be)
+			reload_rebind(*be, mns[n]);
+	}
+
+	reload_bulist_next(next);
+}
+
+void mag::reload_bulist_next(uint32 next)
+{
+	if (next < _reload.previous->mobile_node_count())
+		_service.post(boost::bind(&mag::reload_bulist, this, next));
+	else
+		reload_reclaim(boost::system::error_code());
+}
+
+///
+/// Rebinds the entry to the reloaded mobile node, or revokes it if the
+/// mobile node is gone or changed
+///
+void mag::reload_rebind(bulist_entry& be, const mobile_node_ptr& mn)
+{
+	if (mn && mn->equivalent(be.mn())) {
+		be.rebind(*mn);
+		++_reload.rebound;
+		return;
+	}
+
+	_log(0, "Binding revoked by node database reload [id = ", be.mn_id(), ", lma = ", be.lma_address(), "]");
+
+	if (be.bind_status == bulist_entry::k_bind_ack || be.bind_status == bulist_entry::k_bind_renewing)
+		del_route_entries(be);
+
+	//
+	// The LMA is told, once, the binding is gone
+	//
+	if (be.bind_status != bulist_entry::k_bind_detach) {
+		proxy_binding_info pbinfo;
+
+		pbinfo.address = be.lma_address();
+		pbinfo.sequence = ++be.sequence_number;
+		pbinfo.lifetime = 0;
+		pbinfo.handoff = ip::mproto::option::handoff::k_unknown;
+		mp_send(be, pbinfo);
+	}
+
+	_timers.cancel(be.timer);
+	report_completion(_service, be.completion, boost::system::error_code(ec_canceled, mag_error_category()));
+	_bulist.remove(&be);
+	_stats.bindings.dec();
+	_stats.revocations.inc();
+	++_reload.revoked;
+}
+
+void mag::reload_reclaim(const boost::system::error_code& ec)
+{
+	if (ec == boost::asio::error::operation_aborted)
+		return;
+
+	//
+	// Only lookups from outside the strand read the database concurrently,
+	// and they are short
+	//
+	if (!_node_db.synchronized(_reload.epoch)) {
+		_reclaim_timer.expires_from_now(boost::posix_time::milliseconds(k_reload_reclaim_retry));
+		_reclaim_timer.async_wait(_service.wrap(boost::bind(&mag::reload_reclaim, this, _1)));
+		return;
+	}
+
+	if (_reload.previous != &_initial_node_db)
+		delete _reload.previous;
+	_reload.previous = nullptr;
+	_reload.running = false;
+	_stats.reloads.inc();
+
+	_reload.delay.stop();
+	_log(0, "Node database reloaded [revoked = ", _reload.revoked, ", rebound = ", _reload.rebound,
+	        ", delay = ", _reload.delay.get(), "]");
 }
 
 void mag::mobile_node_attach_(const attach_info& ai, completion_functor& completion_handler)
@@ -195,27 +441,39 @@ void mag::mobile_node_attach_(const attach_info& ai, completion_functor& complet
 
 	delay.start();
 
-	bulist_entry* be = _bulist.find(ai.mn_id);
-	if (!be) {
-		const mobile_node* mn = _node_db.find_mobile_node(ai.mn_id);
-		if (!mn) {
-			report_completion(_service, completion_handler, boost::system::error_code(ec_not_authorized, mag_error_category()));
-			_log(0, "Mobile Node attach error: not authorized [id = ", ai.mn_id, " (", ai.mn_address, ")]");
-			return;
-		}
+	//
+	// The strand does not wait on the node database store, the attachment
+	// is resumed once its mobile node is loaded
+	//
+	const node_db&  ndb = *_node_db.get();
+	uint32          index = ndb.index_of(ai.mn_id);
+	mobile_node_ptr mn = ndb.peek_mobile_node(index);
+	if (!mn && index != k_mn_index_invalid) {
+		_stats.fetches.inc();
+		ndb.async_load(std::vector<uint32>(1, index),
+		               _service.wrap(boost::bind(&mag::mobile_node_attach_load, this, ai, completion_handler,
+		                                         _reload.generation, _1)));
+		return;
+	}
+	if (!mn) {
+		report_completion(_service, completion_handler, boost::system::error_code(ec_not_authorized, mag_error_category()));
+		_log(0, "Mobile Node attach error: not authorized [id = ", ai.mn_id, " (", ai.mn_address, ")]");
+		return;
+	}
 
-		const router_node* lma = _node_db.find_router(mn->lma_id());
+	bulist_entry* be = _bulist.find(mn->index());
+	if (!be) {
+		const router_node* lma = ndb.find_router(mn->lma_id());
 		if (!lma) {
 			report_completion(_service, completion_handler, boost::system::error_code(ec_unknown_lma, mag_error_category()));
 			_log(0, "Mobile Node attach error: unknown LMA [id = ", mn->id(), " (", ai.mn_address, "), lma = ", mn->lma_id(), "]");
 			return;
 		}
 
-		be = new bulist_entry(_service.get_io_service(), mn->id(),
-		                      ai.mn_address, mn->prefix_list(), mn->home_address(),
-		                      lma->address(), ai.poa_dev_id, ai.poa_address);
+		be = new bulist_entry(*mn, ai.mn_address, lma->address(), ai.poa_dev_id, ai.poa_address);
 
 		_bulist.insert(be);
+		_stats.bindings.inc();
 		_log(0, "Mobile Node attach [id = ", mn->id(), " (", ai.mn_address, ")"
 		                          ", lma = ", mn->lma_id(), " (", be->lma_address(), ")]");
 	} else {
@@ -238,13 +496,13 @@ void mag::mobile_node_attach_(const attach_info& ai, completion_functor& complet
 	pbinfo.lifetime = be->lifetime;
 	pbinfo.prefix_list = be->mn_prefix_list();
 	pbinfo.handoff = ip::mproto::option::handoff::k_unknown;
-	pbu_sender_ptr pbus(new pbu_sender(pbinfo));
 
 	be->bind_status = bulist_entry::k_bind_requested;
 	be->retry_count = 0;
-	pbus->async_send(_mp_sock, boost::bind(&mag::mp_send_handler, this, _1));
-	be->timer.expires_from_now(boost::posix_time::seconds(1.5)); //FIXME: set a proper timer
-	be->timer.async_wait(_service.wrap(boost::bind(&mag::proxy_binding_retry, this, _1, pbinfo)));
+	be->pbu.encode_pbu(pbinfo);
+	mp_send(*be, pbinfo);
+	_stats.attaches.inc();
+	_timers.schedule(be->timer, 1500); //FIXME: set a proper timer
 
 	report_completion(_service, be->completion, boost::system::error_code(ec_canceled, mag_error_category()));
 	std::swap(be->completion, completion_handler);
@@ -253,26 +511,43 @@ void mag::mobile_node_attach_(const attach_info& ai, completion_functor& complet
 	_log(0, "PBU register send process delay ", delay.get());
 }
 
+///
+/// The loaded mobile node is held until the attachment is retried, which
+/// then finds it at hand. If the database was reloaded meanwhile, the
+/// attachment is retried against the new one.
+///
+void mag::mobile_node_attach_load(const attach_info& ai, completion_functor& completion_handler, uint generation,
+                                  const node_db::mobile_node_ptr_list& mns)
+{
+	if (generation == _reload.generation && !mns.front()) {
+		report_completion(_service, completion_handler, boost::system::error_code(ec_not_authorized, mag_error_category()));
+		_log(0, "Mobile Node attach error: not authorized [id = ", ai.mn_id, " (", ai.mn_address, ")]");
+		return;
+	}
+
+	mobile_node_attach_(ai, completion_handler);
+}
+
 void mag::mobile_node_detach_(const attach_info& ai, completion_functor& completion_handler)
 {
 	chrono delay;
 
 	delay.start();
 
-	const mobile_node* mn = _node_db.find_mobile_node(ai.mn_id);
-	if (!mn) {
+	uint32 index = _node_db.get()->index_of(ai.mn_id);
+	if (index == k_mn_index_invalid) {
 		report_completion(_service, completion_handler, boost::system::error_code(ec_not_authorized, mag_error_category()));
 		_log(0, "Mobile Node detach error: not authorized [id = ", ai.mn_id, "]");
 		return;
 	}
 
-	bulist_entry* be = _bulist.find(mn->id());
+	bulist_entry* be = _bulist.find(index);
 	if (!be || (be->bind_status != bulist_entry::k_bind_requested && be->bind_status != bulist_entry::k_bind_ack)) {
 		report_completion(_service, completion_handler, boost::system::error_code(ec_invalid_state, mag_error_category()));
-		_log(0, "Mobile Node detach error: not attached [id = ", mn->id(), " (", ai.mn_address, ")", "]");
+		_log(0, "Mobile Node detach error: not attached [id = ", ai.mn_id, " (", ai.mn_address, ")", "]");
 		return;
 	}
-	_log(0, "Mobile Node detach [id = ", mn->id(), " (", ai.mn_address, "), lma = ", be->lma_address(), "]");
+	_log(0, "Mobile Node detach [id = ", be->mn_id(), " (", ai.mn_address, "), lma = ", be->lma_address(), "]");
 
 	if (be->bind_status == bulist_entry::k_bind_ack)
 		del_route_entries(*be);
@@ -280,19 +555,16 @@ void mag::mobile_node_detach_(const attach_info& ai, completion_functor& complet
 	proxy_binding_info pbinfo;
 
 	be->handover_delay.start(); //begin chrono handover delay
-	pbinfo.id = be->mn_id();
 	pbinfo.address = be->lma_address();
 	pbinfo.sequence = ++be->sequence_number;
 	pbinfo.lifetime = 0;
-	pbinfo.prefix_list = be->mn_prefix_list();
 	pbinfo.handoff = ip::mproto::option::handoff::k_unknown;
-	pbu_sender_ptr pbus(new pbu_sender(pbinfo));
 
 	be->bind_status = bulist_entry::k_bind_detach;
 	be->retry_count = 0;
-	pbus->async_send(_mp_sock, boost::bind(&mag::mp_send_handler, this, _1));
-	be->timer.expires_from_now(boost::posix_time::milliseconds(1500));
-	be->timer.async_wait(_service.wrap(boost::bind(&mag::proxy_binding_retry, this, _1, pbinfo)));
+	mp_send(*be, pbinfo);
+	_stats.detaches.inc();
+	_timers.schedule(be->timer, 1500);
 
 	report_completion(_service, be->completion, boost::system::error_code(ec_canceled, mag_error_category()));
 	std::swap(be->completion, completion_handler);
@@ -301,9 +573,15 @@ void mag::mobile_node_detach_(const attach_info& ai, completion_functor& complet
 	_log(0, "PBU de-register send process delay ", delay.get());
 }
 
+void mag::proxy_binding_ack_list(pbinfo_batch_ptr& pbb, chrono& delay)
+{
+	for (pbinfo_batch::const_iterator i = pbb->begin(), e = pbb->end(); i != e; ++i)
+		proxy_binding_ack(*i, delay);
+}
+
 void mag::proxy_binding_ack(const proxy_binding_info& pbinfo, chrono& delay)
 {
-	bulist_entry* be = _bulist.find(pbinfo.id);
+	bulist_entry* be = _bulist.find(pbinfo.mn_index);
 	if (!be) {
 		_log(0, "PBA error: binding update list entry not found [id = ", pbinfo.id, ", lma = ", pbinfo.address, "]");
 		return;
@@ -324,19 +602,13 @@ void mag::proxy_binding_ack(const proxy_binding_info& pbinfo, chrono& delay)
 
 		proxy_binding_info pbinfo;
 
-		pbinfo.id = be->mn_id();
 		pbinfo.address = be->lma_address();
 		pbinfo.handoff = ip::mproto::option::handoff::k_unknown;
 		pbinfo.sequence = ++be->sequence_number;
 		pbinfo.lifetime = (be->bind_status != bulist_entry::k_bind_detach) ? be->lifetime : 0;
-		pbinfo.prefix_list = be->mn_prefix_list();
 
-		pbu_sender_ptr pbus(new pbu_sender(pbinfo));
-
-		pbus->async_send(_mp_sock, boost::bind(&mag::mp_send_handler, this, _1));
-		be->timer.cancel();
-		be->timer.expires_from_now(boost::posix_time::milliseconds(1500));
-		be->timer.async_wait(_service.wrap(boost::bind(&mag::proxy_binding_retry, this, _1, pbinfo)));
+		mp_send(*be, pbinfo);
+		_timers.schedule(be->timer, 1500);
 
 		return;
 	}
@@ -361,10 +633,11 @@ void mag::proxy_binding_ack(const proxy_binding_info& pbinfo, chrono& delay)
 			ec = boost::system::error_code(pbinfo.status, pba_error_category());
 		}
 
-		be->timer.cancel();
+		_timers.cancel(be->timer);
 		be->handover_delay.stop();
 
 		if (be->bind_status == bulist_entry::k_bind_requested) {
+			_stats.handover_delay.record(be->handover_delay.get());
 			report_completion(_service, be->completion, ec);
 			_log(0, "PBA registration [delay = ", be->handover_delay.get(),
 			                        ", id = ", pbinfo.id,
@@ -384,10 +657,10 @@ void mag::proxy_binding_ack(const proxy_binding_info& pbinfo, chrono& delay)
 			//Will try to renew 3 seconds before binding expires or 1 second if lifetime <= 6
 			uint expire = (pbinfo.lifetime <= 6) ? pbinfo.lifetime - 1 : pbinfo.lifetime - 3; //FIXME Check used values
 
-			be->timer.expires_from_now(boost::posix_time::seconds(expire));
-			be->timer.async_wait(_service.wrap(boost::bind(&mag::proxy_binding_renew, this, _1, pbinfo.id)));
+			_timers.schedule(be->timer, expire * 1000);
 		} else {
 			_bulist.remove(be);
+			_stats.bindings.dec();
 		}
 
 		delay.stop();
@@ -399,7 +672,7 @@ void mag::proxy_binding_ack(const proxy_binding_info& pbinfo, chrono& delay)
 		if (pbinfo.status == ip::mproto::pba::status_ok)
 			ec = boost::system::error_code(pbinfo.status, pba_error_category());
 
-		be->timer.cancel();
+		_timers.cancel(be->timer);
 		be->handover_delay.stop();
 
 		report_completion(_service, be->completion, ec);
@@ -408,6 +681,7 @@ void mag::proxy_binding_ack(const proxy_binding_info& pbinfo, chrono& delay)
 		                           ", lma = ", pbinfo.address, "]");
 
 		_bulist.remove(be);
+		_stats.bindings.dec();
 
 		delay.stop();
 		_log(0, "PBA de-register process delay ", delay.get());
@@ -417,84 +691,85 @@ void mag::proxy_binding_ack(const proxy_binding_info& pbinfo, chrono& delay)
 	}
 }
 
-void mag::proxy_binding_retry(const boost::system::error_code& ec, proxy_binding_info& pbinfo)
+void mag::proxy_binding_timeout(timer_wheel_hook& timer)
 {
-	if (ec) {
-		 if (ec != boost::system::errc::make_error_condition(boost::system::errc::operation_canceled))
-			_log(0, "PBU retry timer error: ", ec.message());
+	bulist_entry* be = parent_of(&timer, &bulist_entry::timer);
 
-		return;
+	switch (be->bind_status) {
+	case bulist_entry::k_bind_requested:
+	case bulist_entry::k_bind_renewing:
+	case bulist_entry::k_bind_detach:
+		proxy_binding_retry(*be);
+		break;
+
+	case bulist_entry::k_bind_ack:
+		proxy_binding_renew(*be);
+		break;
+
+	default:
+		_log(0, "PBU timer error: invalid binding state [id = ", be->mn_id(), ", status = ", be->bind_status, "]");
 	}
+}
 
-	bulist_entry* be = _bulist.find(pbinfo.id);
-	if (!be || (be->bind_status != bulist_entry::k_bind_requested
-		        && be->bind_status != bulist_entry::k_bind_renewing
-			    && be->bind_status != bulist_entry::k_bind_detach)) {
-		_log(0, "PBU retry error: binding update list entry not found [id = ", pbinfo.id, ", lma = ", pbinfo.address, "]");
+void mag::proxy_binding_retry(bulist_entry& be)
+{
+	++be.retry_count;
+
+	if (be.bind_status == bulist_entry::k_bind_detach && be.retry_count > 3) {
+		report_completion(_service, be.completion, boost::system::error_code(ec_timeout, mag_error_category()));
+		_log(0, "PBU retry error: max retry count [id = ", be.mn_id(), ", lma = ", be.lma_address(), "]");
+		_bulist.remove(&be);
+		_stats.timeouts.inc();
+		_stats.bindings.dec();
 		return;
 	}
 
-	++be->retry_count;
+	_stats.retries.inc();
 
-	if (be->bind_status == bulist_entry::k_bind_detach && be->retry_count > 3) {
-		report_completion(_service, be->completion, boost::system::error_code(ec_timeout, mag_error_category()));
-		_log(0, "PBU retry error: max retry count [id = ", pbinfo.id, ", lma = ", pbinfo.address, "]");
-		_bulist.remove(be);
-		return;
-	}
+	//
+	// Resend the last PBU, as recorded in the binding update list entry
+	//
+	proxy_binding_info pbinfo;
 
-	pbu_sender_ptr pbus(new pbu_sender(pbinfo));
-	double         delay = std::min<double>(32, std::pow(1.5f, be->retry_count)); //FIXME: validate
+	pbinfo.address = be.lma_address();
+	pbinfo.sequence = be.sequence_number;
+	pbinfo.lifetime = (be.bind_status != bulist_entry::k_bind_detach) ? be.lifetime : 0;
+	pbinfo.handoff = (be.bind_status == bulist_entry::k_bind_renewing) ? ip::mproto::option::handoff::k_not_changed
+	                                                                    : ip::mproto::option::handoff::k_unknown;
 
-	pbus->async_send(_mp_sock, boost::bind(&mag::mp_send_handler, this, _1));
-	be->timer.expires_from_now(boost::posix_time::milliseconds(delay * 1000.f));
-	be->timer.async_wait(_service.wrap(boost::bind(&mag::proxy_binding_retry, this, _1, pbinfo)));
+	double delay = std::min<double>(32, std::pow(1.5f, be.retry_count)); //FIXME: validate
+
+	mp_send(be, pbinfo);
+	_timers.schedule(be.timer, delay * 1000.f);
 
 	if (pbinfo.lifetime)
-		_log(0, "PBU register retry [id = ", pbinfo.id,
+		_log(0, "PBU register retry [id = ", be.mn_id(),
 			                      ", lma = ", pbinfo.address,
 			                      ", sequence = ", pbinfo.sequence,
-			                      ", retry_count = ", uint(be->retry_count),
+			                      ", retry_count = ", uint(be.retry_count),
 			                      ", delay = ", delay, "]");
 	else
-		_log(0, "PBU de-register retry [id = ", pbinfo.id,
+		_log(0, "PBU de-register retry [id = ", be.mn_id(),
 			                         ", lma = ", pbinfo.address,
 			                         ", sequence = ", pbinfo.sequence,
-			                         ", retry_count = ", uint(be->retry_count),
+			                         ", retry_count = ", uint(be.retry_count),
 			                         ", delay = ", delay, "]");
 }
 
-void mag::proxy_binding_renew(const boost::system::error_code& ec, const std::string& id)
+void mag::proxy_binding_renew(bulist_entry& be)
 {
-	if (ec) {
-		 if (ec != boost::system::errc::make_error_condition(boost::system::errc::operation_canceled))
-			_log(0, "PBU renew timer error: ", ec.message());
-
-		return;
-	}
-
-	bulist_entry* be = _bulist.find(id);
-	if (!be) {
-		_log(0, "PBU renew timer error: binding update list entry not found [id = ", id, "]");
-		return;
-	}
-
 	proxy_binding_info pbinfo;
 
-	be->handover_delay.start(); //begin chrono handover delay
-	pbinfo.id = be->mn_id();
-	pbinfo.address = be->lma_address();
-	pbinfo.sequence = ++be->sequence_number;
-	pbinfo.lifetime = be->lifetime;
-	pbinfo.prefix_list = be->mn_prefix_list();
+	be.handover_delay.start(); //begin chrono handover delay
+	pbinfo.address = be.lma_address();
+	pbinfo.sequence = ++be.sequence_number;
+	pbinfo.lifetime = be.lifetime;
 	pbinfo.handoff = ip::mproto::option::handoff::k_not_changed;
-	pbu_sender_ptr pbus(new pbu_sender(pbinfo));
 
-	be->bind_status = bulist_entry::k_bind_renewing;
-	be->retry_count = 0;
-	pbus->async_send(_mp_sock, boost::bind(&mag::mp_send_handler, this, _1));
-	be->timer.expires_from_now(boost::posix_time::milliseconds(1500));
-	be->timer.async_wait(_service.wrap(boost::bind(&mag::proxy_binding_retry, this, _1, pbinfo)));
+	be.bind_status = bulist_entry::k_bind_renewing;
+	be.retry_count = 0;
+	mp_send(be, pbinfo);
+	_timers.schedule(be.timer, 1500);
 }
 
 void mag::add_route_entries(bulist_entry& be)
@@ -505,15 +780,21 @@ void mag::add_route_entries(bulist_entry& be)
 
 	const bulist::ip_prefix_list& npl = be.mn_prefix_list();
 	uint adev = be.poa_dev_id();
-	uint tdev = _tunnels.get(be.lma_address());
+	uint tdev = _data_plane.acquire_tunnel(be.lma_address());
 
 	_log(0, "Add route entries [id = ", be.mn_id(), ", tunnel = ", tdev, ", LMA = ", be.lma_address(), "]");
 
+	sys::route_table::batch routes;
+
 	for (bulist::ip_prefix_list::const_iterator i = npl.begin(), e = npl.end(); i != e; ++i)
-		_route_table.add_by_dst(*i, adev);
+		routes.add_by_dst(*i, adev, ip_address(),
+		                  boost::bind(&mag::route_entry_completion, this, _1, be.mn_id(), *i));
 
 	for (bulist::ip_prefix_list::const_iterator i = npl.begin(), e = npl.end(); i != e; ++i)
-		_route_table.add_by_src(*i, tdev);
+		routes.add_by_src(*i, tdev, ip_address(),
+		                  boost::bind(&mag::route_entry_completion, this, _1, be.mn_id(), *i));
+
+	_data_plane.commit(routes);
 
 	router_advertisement_info rainfo;
 
@@ -542,19 +823,48 @@ void mag::del_route_entries(bulist_entry& be)
 
 	_log(0, "Remove route entries [id = ", be.mn_id(), ", LMA = ", be.lma_address(), "]");
 
+	sys::route_table::batch routes;
+
 	for (bulist::ip_prefix_list::const_iterator i = npl.begin(), e = npl.end(); i != e; ++i)
-		_route_table.remove_by_dst(*i);
+		routes.remove_by_dst(*i, boost::bind(&mag::route_entry_completion, this, _1, be.mn_id(), *i));
 
 	for (bulist::ip_prefix_list::const_iterator i = npl.begin(), e = npl.end(); i != e; ++i)
-		_route_table.remove_by_src(*i);
+		routes.remove_by_src(*i, boost::bind(&mag::route_entry_completion, this, _1, be.mn_id(), *i));
+
+	_data_plane.commit(routes);
 
-	_tunnels.del(be.lma_address());
+	_data_plane.release_tunnel(be.lma_address());
 	_addrconf.del(be.mn_link_address());
 
 	delay.stop();
 	_log(0, "Remove route entries delay ", delay.get());
 }
 
+void mag::route_entry_completion(const boost::system::error_code& ec, const std::string& id, const ip::prefix_v6& prefix)
+{
+	if (ec)
+		_log(0, "Route entry error: ", ec.message(), " [id = ", id, ", prefix = ", prefix, "]");
+}
+
+void mag::register_metrics()
+{
+	_metrics.add("opmip_mag_attaches_total", "Mobile node attachments", _stats.attaches);
+	_metrics.add("opmip_mag_detaches_total", "Mobile node detachments", _stats.detaches);
+	_metrics.add("opmip_mag_pbu_retries_total", "Proxy binding updates retransmitted", _stats.retries);
+	_metrics.add("opmip_mag_pbu_timeouts_total", "Proxy binding updates given up on", _stats.timeouts);
+	_metrics.add("opmip_mag_pbu_dropped_total", "Proxy binding updates dropped on a full socket buffer",
+	             _stats.dropped);
+	_metrics.add("opmip_mag_bindings", "Binding update list entries", _stats.bindings);
+	_metrics.add("opmip_mag_node_db_reloads_total", "Node database reloads", _stats.reloads);
+	_metrics.add("opmip_mag_revocations_total", "Bindings revoked by node database reloads",
+	             _stats.revocations);
+	_metrics.add("opmip_mag_node_db_fetches_total", "Attachments suspended to load the mobile node from the node database store",
+	             _stats.fetches);
+	_metrics.add("opmip_mag_handover_seconds", "Time from attachment to the registration acknowledgement",
+	             _stats.handover_delay);
+	_addrconf.register_metrics(_metrics);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 } /* namespace pmip */ } /* namespace opmip */
 
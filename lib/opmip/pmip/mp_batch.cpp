@@ -0,0 +1,172 @@
+//=============================================================================
+// Brief   : Mobility Protocol Batch Receiver/Sender
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/pmip/mp_batch.hpp>
+#include <opmip/pmip/mp_receiver.hpp>
+#include <boost/asio/error.hpp>
+#include <cerrno>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace pmip {
+
+///////////////////////////////////////////////////////////////////////////////
+mp_batch_receiver::mp_batch_receiver()
+	: _count(0), _readable(0)
+{
+	for (size_t i = 0; i < k_mp_batch_size; ++i) {
+		_iovs[i].iov_base = _buffers[i];
+		_iovs[i].iov_len = sizeof(_buffers[i]);
+
+		_msgs[i].msg_hdr.msg_name = _endpoints[i].data();
+		_msgs[i].msg_hdr.msg_namelen = _endpoints[i].capacity();
+		_msgs[i].msg_hdr.msg_iov = &_iovs[i];
+		_msgs[i].msg_hdr.msg_iovlen = 1;
+		_msgs[i].msg_hdr.msg_control = nullptr;
+		_msgs[i].msg_hdr.msg_controllen = 0;
+		_msgs[i].msg_hdr.msg_flags = 0;
+		_msgs[i].msg_len = 0;
+	}
+}
+
+bool mp_batch_receiver::parse_pbu(size_t i, proxy_binding_info& pbinfo)
+{
+	BOOST_ASSERT(i < _count);
+
+	return pmip::parse_pbu(_endpoints[i], _buffers[i], _msgs[i].msg_len, pbinfo);
+}
+
+bool mp_batch_receiver::parse_pba(size_t i, proxy_binding_info& pbinfo)
+{
+	BOOST_ASSERT(i < _count);
+
+	return pmip::parse_pba(_endpoints[i], _buffers[i], _msgs[i].msg_len, pbinfo);
+}
+
+void mp_batch_receiver::receive(ip::mproto::socket& sock, boost::system::error_code& ec)
+{
+	for (size_t i = 0; i < k_mp_batch_size; ++i)
+		_msgs[i].msg_hdr.msg_namelen = _endpoints[i].capacity();
+
+	int res;
+
+	do {
+		res = ::recvmmsg(sock.native_handle(), _msgs, k_mp_batch_size, MSG_DONTWAIT, nullptr);
+	} while (res < 0 && errno == EINTR);
+
+	if (res < 0) {
+		_count = 0;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			ec = boost::asio::error::would_block;
+		else
+			ec = boost::system::error_code(errno, boost::system::system_category());
+		return;
+	}
+
+	_count = res;
+	ec = boost::system::error_code();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+mp_batch_sender::mp_batch_sender()
+	: _count(0)
+{
+	for (size_t i = 0; i < k_mp_batch_size; ++i) {
+		_iovs[i].iov_base = _buffers[i];
+		_iovs[i].iov_len = 0;
+
+		_msgs[i].msg_hdr.msg_name = _endpoints[i].data();
+		_msgs[i].msg_hdr.msg_namelen = _endpoints[i].size();
+		_msgs[i].msg_hdr.msg_iov = &_iovs[i];
+		_msgs[i].msg_hdr.msg_iovlen = 1;
+		_msgs[i].msg_hdr.msg_control = nullptr;
+		_msgs[i].msg_hdr.msg_controllen = 0;
+		_msgs[i].msg_hdr.msg_flags = 0;
+		_msgs[i].msg_len = 0;
+	}
+}
+
+void mp_batch_sender::push_pbu(const proxy_binding_info& pbinfo)
+{
+	::mmsghdr* msg = push(pbinfo.address);
+
+	msg->msg_hdr.msg_iov->iov_len = encode_pbu(pbinfo, _buffers[_count - 1]);
+}
+
+void mp_batch_sender::push_pba(const proxy_binding_info& pbinfo)
+{
+	::mmsghdr* msg = push(pbinfo.address);
+
+	msg->msg_hdr.msg_iov->iov_len = encode_pba(pbinfo, _buffers[_count - 1]);
+}
+
+void mp_batch_sender::push(const mp_template& tpl, const proxy_binding_info& pbinfo)
+{
+	::mmsghdr* msg = push(pbinfo.address);
+
+	msg->msg_hdr.msg_iov->iov_len = tpl.copy(pbinfo, _buffers[_count - 1]);
+}
+
+::mmsghdr* mp_batch_sender::push(const ip::address_v6& address)
+{
+	BOOST_ASSERT(!full());
+
+	_endpoints[_count].address(address);
+
+	return &_msgs[_count++];
+}
+
+size_t mp_batch_sender::flush(ip::mproto::socket& sock, boost::system::error_code& ec)
+{
+	size_t next = 0;
+	size_t sent = 0;
+
+	ec = boost::system::error_code();
+	while (next < _count) {
+		int res = ::sendmmsg(sock.native_handle(), _msgs + next, _count - next, MSG_DONTWAIT);
+
+		if (res >= 0) {
+			next += res;
+			sent += res;
+			continue;
+		}
+
+		if (errno == EINTR)
+			continue;
+
+		ec = boost::system::error_code(errno, boost::system::system_category());
+
+		//
+		// The socket send buffer is full, drop the remaining messages
+		// instead of blocking the strand, the peers retransmit them
+		//
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+
+		//
+		// Skip the offending message, the remaining ones may still go through
+		//
+		++next;
+	}
+
+	_count = 0;
+	return sent;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace pmip */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
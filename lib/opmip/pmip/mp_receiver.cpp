@@ -73,9 +73,9 @@ static bool parse_options(uchar* data, size_t length, proxy_binding_info& pbinfo
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-bool pbu_receiver::parse(size_t rbytes, proxy_binding_info& pbinfo)
+bool parse_pbu(const ip::mproto::endpoint& ep, uchar* buffer, size_t rbytes, proxy_binding_info& pbinfo)
 {
-	ip::mproto::header* hdr = ip::mproto::header::cast(_buffer, rbytes);
+	ip::mproto::header* hdr = ip::mproto::header::cast(buffer, rbytes);
 
 	if (!hdr)
 		return false;
@@ -87,17 +87,17 @@ bool pbu_receiver::parse(size_t rbytes, proxy_binding_info& pbinfo)
 	if (!pbu || !pbu->proxy_reg())
 		return false;
 
-	pbinfo.address  = _endpoint.address();
+	pbinfo.address  = ep.address();
 	pbinfo.sequence = pbu->sequence();
 	pbinfo.lifetime = 4 * pbu->lifetime();
 
-	return parse_options(_buffer + pos, rbytes - pos, pbinfo);
+	return parse_options(buffer + pos, rbytes - pos, pbinfo);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-bool pba_receiver::parse(size_t rbytes, proxy_binding_info& pbinfo)
+bool parse_pba(const ip::mproto::endpoint& ep, uchar* buffer, size_t rbytes, proxy_binding_info& pbinfo)
 {
-	ip::mproto::header* hdr = ip::mproto::header::cast(_buffer, rbytes);
+	ip::mproto::header* hdr = ip::mproto::header::cast(buffer, rbytes);
 
 	if (!hdr)
 		return false;
@@ -108,12 +108,23 @@ bool pba_receiver::parse(size_t rbytes, proxy_binding_info& pbinfo)
 	if (!pba || !pba->proxy_reg())
 		return false;
 
-	pbinfo.address  = _endpoint.address();
+	pbinfo.address  = ep.address();
 	pbinfo.sequence = pba->sequence();
 	pbinfo.lifetime = 4 * pba->lifetime();
 	pbinfo.status   = pba->status();
 
-	return parse_options(_buffer + pos, rbytes - pos, pbinfo);
+	return parse_options(buffer + pos, rbytes - pos, pbinfo);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool pbu_receiver::parse(size_t rbytes, proxy_binding_info& pbinfo)
+{
+	return parse_pbu(_endpoint, _buffer, rbytes, pbinfo);
+}
+
+bool pba_receiver::parse(size_t rbytes, proxy_binding_info& pbinfo)
+{
+	return parse_pba(_endpoint, _buffer, rbytes, pbinfo);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -21,7 +21,37 @@
 namespace opmip { namespace pmip {
 
 ///////////////////////////////////////////////////////////////////////////////
-static size_t append_options(uchar* buffer, size_t len, const proxy_binding_info& pbinfo)
+///
+/// Options of fixed layout, type and length included, are laid out at
+/// compile time and copied in place, only their variable fields are stored
+///
+template<class OptionT>
+struct option_image {
+	static const size_t size = 2 + sizeof(OptionT);
+};
+
+static const size_t k_netprefix_size = option_image<ip::mproto::option::netprefix>::size;
+static const size_t k_handoff_size   = option_image<ip::mproto::option::handoff>::size;
+static const size_t k_att_size       = option_image<ip::mproto::option::att>::size;
+
+static const uchar k_netprefix_image[k_netprefix_size] = {
+	ip::mproto::option::netprefix::type_value, sizeof(ip::mproto::option::netprefix)
+};
+
+///
+/// The handoff indicator and access technology type options trail every
+/// message, they are patched by mp_template
+///
+static const uchar k_trailer_image[k_handoff_size + k_att_size] = {
+	ip::mproto::option::handoff::type_value, sizeof(ip::mproto::option::handoff), 0, 0,
+	ip::mproto::option::att::type_value,     sizeof(ip::mproto::option::att),     0, 0
+};
+
+static const size_t k_trailer_handoff = 3;
+static const size_t k_trailer_att     = k_handoff_size + 3;
+
+///////////////////////////////////////////////////////////////////////////////
+static size_t append_options(uchar* buffer, size_t len, const proxy_binding_info& pbinfo, size_t& trailer)
 {
 	ip::mproto::option* opt;
 
@@ -39,53 +69,44 @@ static size_t append_options(uchar* buffer, size_t len, const proxy_binding_info
 	//
 	// Network Prefix Option
 	//
-	ip::mproto::option::netprefix* npf;
-
 	if (pbinfo.prefix_list.empty()) {
-		opt = new(buffer + len) ip::mproto::option(ip::mproto::option::netprefix());
-		npf = opt->get<ip::mproto::option::netprefix>();
-		len += ip::mproto::option::size(opt);
+		std::copy(k_netprefix_image, k_netprefix_image + k_netprefix_size, buffer + len);
+		len += k_netprefix_size;
 
 	} else {
 		for (std::vector<ip::prefix_v6>::const_iterator i = pbinfo.prefix_list.begin(), e = pbinfo.prefix_list.end(); i != e; ++i) {
-			opt = new(buffer + len) ip::mproto::option(ip::mproto::option::netprefix());
+			ip::mproto::option::netprefix* npf;
+
+			std::copy(k_netprefix_image, k_netprefix_image + k_netprefix_size, buffer + len);
+			opt = reinterpret_cast<ip::mproto::option*>(buffer + len);
 			npf = opt->get<ip::mproto::option::netprefix>();
 			npf->length = i->length();
 			npf->prefix = i->bytes();
-			len += ip::mproto::option::size(opt);
+			len += k_netprefix_size;
 		}
 	}
 
 	//
-	// Handoff Option
+	// Handoff Option and Access Type Technology
 	//
-	ip::mproto::option::handoff* hof;
-
-	opt = new(buffer + len) ip::mproto::option(ip::mproto::option::handoff());
-	hof = opt->get<ip::mproto::option::handoff>();
-	hof->indicator = pbinfo.handoff;
-	len += ip::mproto::option::size(opt);
+	std::copy(k_trailer_image, k_trailer_image + sizeof(k_trailer_image), buffer + len);
+	buffer[len + k_trailer_handoff] = pbinfo.handoff;
+	buffer[len + k_trailer_att] = pbinfo.link_type;
+	trailer = len;
+	len += sizeof(k_trailer_image);
 
 	//
-	//	Access Type Technology
+	// Padded with Pad1 options
 	//
-	ip::mproto::option::att* att;
-
-	opt = new(buffer + len) ip::mproto::option(ip::mproto::option::att());
-	att = opt->get<ip::mproto::option::att>();
-	att->tech_type = pbinfo.link_type;
-	len += ip::mproto::option::size(opt);
+	size_t alen = align_to<8>(len);
 
-	return align_to<8>(len);
+	std::fill(buffer + len, buffer + alen, 0);
+	return alen;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-pbu_sender::pbu_sender(const proxy_binding_info& pbinfo)
-	: _endpoint(pbinfo.address), _length(0)
+static size_t encode_pbu(const proxy_binding_info& pbinfo, uchar* buffer, size_t& trailer)
 {
-	std::fill(_buffer, _buffer + sizeof(_buffer), 0);
-
-	ip::mproto::pbu* pbu = new(_buffer) ip::mproto::pbu;
+	ip::mproto::pbu* pbu = new(buffer) ip::mproto::pbu;
 	size_t           len = sizeof(ip::mproto::pbu);
 
 	pbu->sequence(pbinfo.sequence);
@@ -93,17 +114,15 @@ pbu_sender::pbu_sender(const proxy_binding_info& pbinfo)
 	pbu->proxy_reg(true);
 	pbu->lifetime(pbinfo.lifetime / 4);
 
-	_length = append_options(_buffer, len, pbinfo);
-	pbu->init(ip::mproto::pbu::mh_type, _length);
+	len = append_options(buffer, len, pbinfo, trailer);
+	pbu->init(ip::mproto::pbu::mh_type, len);
+
+	return len;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-pba_sender::pba_sender(const proxy_binding_info& pbinfo)
-	: _endpoint(pbinfo.address), _length(0)
+static size_t encode_pba(const proxy_binding_info& pbinfo, uchar* buffer, size_t& trailer)
 {
-	std::fill(_buffer, _buffer + sizeof(_buffer), 0);
-
-	ip::mproto::pba* pba = new(_buffer) ip::mproto::pba;
+	ip::mproto::pba* pba = new(buffer) ip::mproto::pba;
 	size_t           len = sizeof(ip::mproto::pba);
 
 	pba->status(pbinfo.status);
@@ -111,8 +130,66 @@ pba_sender::pba_sender(const proxy_binding_info& pbinfo)
 	pba->sequence(pbinfo.sequence);
 	pba->lifetime(pbinfo.lifetime / 4);
 
-	_length = append_options(_buffer, len, pbinfo);
-	pba->init(ip::mproto::pba::mh_type, _length);
+	len = append_options(buffer, len, pbinfo, trailer);
+	pba->init(ip::mproto::pba::mh_type, len);
+
+	return len;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+size_t encode_pbu(const proxy_binding_info& pbinfo, uchar* buffer)
+{
+	size_t trailer;
+
+	return encode_pbu(pbinfo, buffer, trailer);
+}
+
+pbu_sender::pbu_sender(const proxy_binding_info& pbinfo)
+	: _endpoint(pbinfo.address), _length(0)
+{
+	_length = encode_pbu(pbinfo, _buffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+size_t encode_pba(const proxy_binding_info& pbinfo, uchar* buffer)
+{
+	size_t trailer;
+
+	return encode_pba(pbinfo, buffer, trailer);
+}
+
+pba_sender::pba_sender(const proxy_binding_info& pbinfo)
+	: _endpoint(pbinfo.address), _length(0)
+{
+	_length = encode_pba(pbinfo, _buffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mp_template::encode_pbu(const proxy_binding_info& pbinfo)
+{
+	uchar  buffer[k_mp_buffer_size];
+	size_t trailer;
+	size_t len = pmip::encode_pbu(pbinfo, buffer, trailer);
+
+	_buffer.assign(buffer, buffer + len);
+	_trailer = trailer;
+}
+
+size_t mp_template::copy(const proxy_binding_info& pbinfo, uchar* buffer) const
+{
+	BOOST_ASSERT(!empty());
+
+	std::copy(_buffer.begin(), _buffer.end(), buffer);
+
+	ip::mproto::pbu* pbu = reinterpret_cast<ip::mproto::pbu*>(buffer);
+
+	pbu->sequence(pbinfo.sequence);
+	pbu->lifetime(pbinfo.lifetime / 4);
+
+	buffer[_trailer + k_trailer_handoff] = pbinfo.handoff;
+	buffer[_trailer + k_trailer_att] = pbinfo.link_type;
+
+	return _buffer.size();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
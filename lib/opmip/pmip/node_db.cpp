@@ -17,14 +17,29 @@
 //=============================================================================
 
 #include <opmip/pmip/node_db.hpp>
+#include <opmip/exception.hpp>
 #include <opmip/logger.hpp>
 #include <opmip/disposer.hpp>
 #include <boost/utility.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/unordered_map.hpp>
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <list>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
@@ -32,68 +47,1126 @@ namespace opmip { namespace pmip {
 ///////////////////////////////////////////////////////////////////////////////
 static logger log_("node-db", std::cout);
 
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Mobile nodes are parsed in parallel when there are at least this many per
+/// thread, and the progress is reported every k_progress_interval nodes
+///
+static const size_t k_parallel_chunk    = 16384;
+static const size_t k_progress_interval = 262144;
+
+static void read_text(std::istream& input, std::vector<char>& text)
+{
+	std::streampos pos = input.tellg();
+
+	//
+	// Sized up front for files, so the text is read in one go and takes
+	// no more memory than the file size
+	//
+	if (pos != std::streampos(-1) && input.seekg(0, std::ios::end)) {
+		std::streampos end = input.tellg();
+
+		input.seekg(pos);
+		if (end > pos)
+			text.reserve(size_t(end - pos));
+	}
+	input.clear();
+
+	char buf[65536];
+
+	while (input.read(buf, sizeof(buf)) || input.gcount())
+		text.insert(text.end(), buf, buf + input.gcount());
+}
+
+static void read_list(json_reader& js, std::vector<std::string>& list)
+{
+	std::string str;
+
+	js.begin_array();
+	while (js.next_element()) {
+		js.value(str);
+		list.push_back(str);
+	}
+}
+
+static mobile_node* parse_mobile_node(json_reader& js)
+{
+	typedef mobile_node::ip_prefix_list    ip_prefix_list;
+	typedef mobile_node::link_address_list link_address_list;
+
+	std::string              name;
+	std::string              id;
+	std::string              home;
+	std::string              lma_id;
+	std::vector<std::string> prefs;
+	std::vector<std::string> laddrs;
+	bool                     has_prefs = false;
+	bool                     has_laddrs = false;
+
+	js.begin_object();
+	while (js.next_member(name)) {
+		if (name == "id") {
+			js.value(id);
+
+		} else if (name == "ip-prefix") {
+			read_list(js, prefs);
+			has_prefs = true;
+
+		} else if (name == "home-address") {
+			js.value(home);
+
+		} else if (name == "link-address") {
+			read_list(js, laddrs);
+			has_laddrs = true;
+
+		} else if (name == "lma-id") {
+			js.value(lma_id);
+
+		} else {
+			js.skip();
+		}
+	}
+
+	if (id.empty() || lma_id.empty() || !has_prefs || !has_laddrs)
+		js.error("mobile node without \"id\", \"ip-prefix\", \"link-address\" or \"lma-id\"");
+
+	ip_prefix_list    prefix_list;
+	link_address_list link_addrs;
+	ip::address_v6    home_addr;
+
+	prefix_list.reserve(prefs.size());
+	for (std::vector<std::string>::const_iterator i = prefs.begin(), e = prefs.end(); i != e; ++i)
+		prefix_list.push_back(ip::prefix_v6::from_string(*i));
+
+	link_addrs.reserve(laddrs.size());
+	for (std::vector<std::string>::const_iterator i = laddrs.begin(), e = laddrs.end(); i != e; ++i)
+		link_addrs.push_back(ll::mac_address::from_string(*i));
+
+	if (!home.empty()) {
+		ip::address_v6 addr = ip::address_v6::from_string(home);
+
+		if (std::find_if(prefix_list.begin(), prefix_list.end(), boost::bind(&ip::prefix_v6::match, _1, addr))
+		    != prefix_list.end())
+			home_addr = addr;
+		else
+			log_(0, "No prefix for this home address [id = ", id, "]");
+	}
+
+	return new mobile_node(id, prefix_list, link_addrs, lma_id, home_addr);
+}
+
+static void parse_mobile_node_range(const char* begin, const char* end, const std::vector<const char*>& offsets,
+                                    size_t first, size_t last, std::vector<mobile_node*>& parsed,
+                                    boost::exception_ptr& error)
+{
+	json_reader js(begin, end);
+
+	try {
+		for (size_t i = first; i < last; ++i) {
+			js.seek(offsets[i]);
+			parsed[i] = parse_mobile_node(js);
+		}
+
+	} catch (...) {
+		error = boost::current_exception();
+	}
+}
+
+///
+/// Each thread parses a contiguous range of the mobile-nodes array into the
+/// same slots of parsed, so the mobile nodes keep the order of the file
+///
+static void parse_mobile_nodes(const char* begin, const char* end, const std::vector<const char*>& offsets,
+                               std::vector<mobile_node*>& parsed)
+{
+	size_t threads = std::min<size_t>(boost::thread::hardware_concurrency(), offsets.size() / k_parallel_chunk);
+
+	std::vector<boost::exception_ptr> errors(std::max<size_t>(threads, 1));
+
+	if (threads <= 1) {
+		parse_mobile_node_range(begin, end, offsets, 0, offsets.size(), parsed, errors[0]);
+
+	} else {
+		boost::thread_group workers;
+		size_t              step = (offsets.size() + threads - 1) / threads;
+
+		for (size_t t = 0; t < threads; ++t)
+			workers.create_thread(boost::bind(parse_mobile_node_range, begin, end, boost::cref(offsets),
+			                                  t * step, std::min(offsets.size(), (t + 1) * step),
+			                                  boost::ref(parsed), boost::ref(errors[t])));
+		workers.join_all();
+	}
+
+	for (std::vector<boost::exception_ptr>::const_iterator i = errors.begin(), e = errors.end(); i != e; ++i)
+		if (*i)
+			boost::rethrow_exception(*i);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Binary image layout. The image_header is followed by the sections it
+/// points to, each 8 byte aligned: router records, mobile node records in
+/// index order, the NAI and MAC hash indexes, and the prefix, link address
+/// and string pools the records refer to. The indexes are open addressing
+/// tables with linear probing and a power of 2 size. Everything is stored in
+/// the byte order of the host that wrote the image.
+///
+static const uint32 k_image_version    = 1;
+static const uint32 k_image_byte_order = 0x01020304;
+
+struct image_header {
+	char   magic[8];          ///"OPMIPNDB"
+	uint32 version;
+	uint32 byte_order;
+	uint64 size;
+	uint32 router_count;
+	uint32 mobile_node_count;
+	uint32 prefix_count;
+	uint32 link_address_count;
+	uint32 nai_index_size;
+	uint32 mac_index_size;
+	uint64 routers;           ///Section offsets from the start of the image
+	uint64 mobile_nodes;
+	uint64 nai_index;
+	uint64 mac_index;
+	uint64 prefixes;
+	uint64 link_addresses;
+	uint64 strings;
+	uint64 strings_size;
+};
+
+struct image_string {
+	uint32 offset;
+	uint32 length;
+};
+
+struct image_router {
+	image_string id;
+	uchar        address[16];
+	uint32       scope_id;
+	uint32       device_id;
+};
+
+struct image_mobile_node {
+	image_string id;
+	image_string lma_id;
+	uchar        home_address[16];
+	uint32       prefix_first;
+	uint32       prefix_count;
+	uint32       link_address_first;
+	uint32       link_address_count;
+};
+
+struct image_prefix {
+	uchar address[16];
+	uchar length;
+	uchar reserved[3];
+};
+
+struct image_link_address {
+	uchar address[6];
+};
+
+struct image_nai_slot {
+	uint32 hash;
+	uint32 index;             ///k_mn_index_invalid when empty
+};
+
+struct image_mac_slot {
+	uint32 index;             ///k_mn_index_invalid when empty
+	uchar  address[6];
+	uchar  reserved[2];
+};
+
+///
+/// FNV-1a, the indexes are written by one build and searched by another,
+/// so the hash must not depend on the library implementation
+///
+static uint32 image_hash(const void* data, size_t len)
+{
+	const uchar* p = static_cast<const uchar*>(data);
+	uint32       h = 2166136261u;
+
+	for (size_t i = 0; i < len; ++i)
+		h = (h ^ p[i]) * 16777619u;
+
+	return h;
+}
+
+///
+/// Lookup keys of the perfect hash indexes, a link address is its own key
+///
+static uint64 key_hash(const void* data, size_t len)
+{
+	const uchar* p = static_cast<const uchar*>(data);
+	uint64       h = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < len; ++i)
+		h = (h ^ p[i]) * 1099511628211ULL;
+
+	return h;
+}
+
+static uint64 key_hash(const std::string& key)
+{
+	return key_hash(key.data(), key.size());
+}
+
+static uint64 key_hash(const mobile_node::link_address& key)
+{
+	const mobile_node::link_address::bytes_type& addr = key.to_bytes();
+	uint64                                       h = 0;
+
+	for (size_t i = 0; i < addr.size(); ++i)
+		h = (h << 8) | addr[i];
+
+	return h;
+}
+
+static uint64 key_hash(const router_node::ip_address& key)
+{
+	router_node::ip_address::bytes_type addr = key.to_bytes();
+
+	return key_hash(addr.data(), addr.size()) ^ key.scope_id();
+}
+
+template<class T>
+static const T* image_section(const uchar* image, uint64 offset)
+{
+	return reinterpret_cast<const T*>(image + offset);
+}
+
+static bool image_check_section(const image_header& hdr, uint64 offset, uint64 count, size_t size)
+{
+	return !(offset % 8) && offset >= sizeof(image_header) && offset <= hdr.size
+	       && count <= (hdr.size - offset) / size;
+}
+
+static bool image_check_index(const image_header& hdr, uint64 offset, uint32 slots, size_t size)
+{
+	return slots && !(slots & (slots - 1)) && image_check_section(hdr, offset, slots, size);
+}
+
+static bool image_check(const image_header& hdr, size_t size)
+{
+	return !std::memcmp(hdr.magic, "OPMIPNDB", sizeof(hdr.magic))
+	       && hdr.version == k_image_version
+	       && hdr.byte_order == k_image_byte_order
+	       && hdr.size == size
+	       && image_check_section(hdr, hdr.routers, hdr.router_count, sizeof(image_router))
+	       && image_check_section(hdr, hdr.mobile_nodes, hdr.mobile_node_count, sizeof(image_mobile_node))
+	       && image_check_index(hdr, hdr.nai_index, hdr.nai_index_size, sizeof(image_nai_slot))
+	       && image_check_index(hdr, hdr.mac_index, hdr.mac_index_size, sizeof(image_mac_slot))
+	       && image_check_section(hdr, hdr.prefixes, hdr.prefix_count, sizeof(image_prefix))
+	       && image_check_section(hdr, hdr.link_addresses, hdr.link_address_count, sizeof(image_link_address))
+	       && image_check_section(hdr, hdr.strings, hdr.strings_size, 1)
+	       && hdr.mobile_node_count < k_mn_index_invalid;
+}
+
+static bool image_check_string(const image_header& hdr, const image_string& str)
+{
+	return str.offset <= hdr.strings_size && str.length <= hdr.strings_size - str.offset;
+}
+
+static bool image_check_range(uint32 first, uint32 count, uint32 size)
+{
+	return first <= size && count <= size - first;
+}
+
+static std::string image_to_string(const uchar* image, const image_header& hdr, const image_string& str)
+{
+	const char* pool = image_section<char>(image, hdr.strings);
+
+	return std::string(pool + str.offset, str.length);
+}
+
+static uint32 image_index_size(size_t count)
+{
+	uint32 n = 16;
+
+	while (n < count * 2)
+		n *= 2;
+
+	return n;
+}
+
+///
+/// Image writer helpers, the sections are padded to 8 bytes
+///
+static uint64 image_align(uint64 pos)
+{
+	return (pos + 7) & ~uint64(7);
+}
+
+template<class T>
+static uint64 image_layout(uint64& pos, const std::vector<T>& section)
+{
+	uint64 offset = pos;
+
+	pos = image_align(pos + section.size() * sizeof(T));
+	return offset;
+}
+
+static void image_write(std::ostream& output, const void* data, size_t len)
+{
+	static const char zero[8] = { 0 };
+
+	output.write(static_cast<const char*>(data), len);
+	output.write(zero, image_align(len) - len);
+}
+
+template<class T>
+static void image_write(std::ostream& output, const std::vector<T>& section)
+{
+	image_write(output, section.empty() ? nullptr : &section[0], section.size() * sizeof(T));
+}
+
+class image_string_pool {
+public:
+	image_string add(const std::string& str)
+	{
+		image_string is;
+
+		is.offset = _pool.size();
+		is.length = str.size();
+		_pool.insert(_pool.end(), str.begin(), str.end());
+		return is;
+	}
+
+	image_string add_shared(const std::string& str)
+	{
+		std::map<std::string, image_string>::iterator i = _shared.find(str);
+
+		if (i == _shared.end())
+			i = _shared.insert(std::make_pair(str, add(str))).first;
+
+		return i->second;
+	}
+
+	const std::vector<char>& pool() const { return _pool; }
+
+private:
+	std::vector<char>                   _pool;
+	std::map<std::string, image_string> _shared;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// The binary image as a subscriber_store, the mapping is owned by the store
+///
+class image_store : public subscriber_store {
+public:
+	image_store(const uchar* image, size_t size)
+		: _image(image), _size(size)
+	{ }
+
+	~image_store()
+	{
+		::munmap(const_cast<uchar*>(_image), _size);
+	}
+
+	uint32       record_count() const { return header().mobile_node_count; }
+	uint32       find_record(const std::string& id) const;
+	uint32       find_record(const ll::mac_address& addr) const;
+	std::string  record_id(uint32 record) const;
+	mobile_node* read_record(uint32 record) const;
+
+private:
+	const image_header& header() const { return *image_section<image_header>(_image, 0); }
+
+private:
+	const uchar* _image;
+	size_t       _size;
+};
+
+uint32 image_store::find_record(const std::string& id) const
+{
+	const image_header&      hdr = header();
+	const image_nai_slot*    index = image_section<image_nai_slot>(_image, hdr.nai_index);
+	const image_mobile_node* mns = image_section<image_mobile_node>(_image, hdr.mobile_nodes);
+	const char*              pool = image_section<char>(_image, hdr.strings);
+	uint32                   mask = hdr.nai_index_size - 1;
+	uint32                   h = image_hash(id.data(), id.size());
+
+	for (uint32 s = h & mask, n = 0; n <= mask; s = (s + 1) & mask, ++n) {
+		const image_nai_slot& slot = index[s];
+
+		if (slot.index == k_mn_index_invalid)
+			break;
+
+		if (slot.hash != h || slot.index >= hdr.mobile_node_count)
+			continue;
+
+		const image_string& str = mns[slot.index].id;
+
+		if (image_check_string(hdr, str) && str.length == id.size()
+		    && !std::memcmp(pool + str.offset, id.data(), str.length))
+			return slot.index;
+	}
+
+	return k_mn_index_invalid;
+}
+
+uint32 image_store::find_record(const ll::mac_address& addr) const
+{
+	const image_header&   hdr = header();
+	const image_mac_slot* index = image_section<image_mac_slot>(_image, hdr.mac_index);
+	uint32                mask = hdr.mac_index_size - 1;
+	const uchar*          bytes = addr.to_bytes().data();
+	uint32                h = image_hash(bytes, addr.to_bytes().size());
+
+	for (uint32 s = h & mask, n = 0; n <= mask; s = (s + 1) & mask, ++n) {
+		const image_mac_slot& slot = index[s];
+
+		if (slot.index == k_mn_index_invalid)
+			break;
+
+		if (std::equal(slot.address, slot.address + sizeof(slot.address), bytes))
+			return (slot.index < hdr.mobile_node_count) ? slot.index : k_mn_index_invalid;
+	}
+
+	return k_mn_index_invalid;
+}
+
+std::string image_store::record_id(uint32 record) const
+{
+	const image_header&      hdr = header();
+	const image_mobile_node& rec = image_section<image_mobile_node>(_image, hdr.mobile_nodes)[record];
+
+	if (!image_check_string(hdr, rec.id))
+		return std::string();
+
+	return image_to_string(_image, hdr, rec.id);
+}
+
+mobile_node* image_store::read_record(uint32 record) const
+{
+	const image_header&      hdr = header();
+	const image_mobile_node& rec = image_section<image_mobile_node>(_image, hdr.mobile_nodes)[record];
+
+	if (!image_check_string(hdr, rec.id) || !image_check_string(hdr, rec.lma_id)
+	    || !image_check_range(rec.prefix_first, rec.prefix_count, hdr.prefix_count)
+	    || !image_check_range(rec.link_address_first, rec.link_address_count, hdr.link_address_count)) {
+		log_(0, "bad mobile node record in image [record = ", record, "]");
+		return nullptr;
+	}
+
+	const image_prefix*           prefixes = image_section<image_prefix>(_image, hdr.prefixes) + rec.prefix_first;
+	const image_link_address*     laddrs = image_section<image_link_address>(_image, hdr.link_addresses)
+	                                       + rec.link_address_first;
+	mobile_node::ip_prefix_list    prefs;
+	mobile_node::link_address_list link_addrs;
+	ip::address_v6::bytes_type     addr;
+
+	prefs.reserve(rec.prefix_count);
+	for (uint32 i = 0; i < rec.prefix_count; ++i) {
+		std::copy(prefixes[i].address, prefixes[i].address + addr.size(), addr.begin());
+		prefs.push_back(mobile_node::ip_prefix(addr, prefixes[i].length));
+	}
+
+	link_addrs.reserve(rec.link_address_count);
+	for (uint32 i = 0; i < rec.link_address_count; ++i)
+		link_addrs.push_back(mobile_node::link_address(laddrs[i].address));
+
+	std::copy(rec.home_address, rec.home_address + addr.size(), addr.begin());
+
+	return new mobile_node(image_to_string(_image, hdr, rec.id), prefs, link_addrs,
+	                       image_to_string(_image, hdr, rec.lma_id), ip::address_v6(addr));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void release_node(mobile_node* mn)
+{
+	if (mn)
+		intrusive_ptr_release(mn);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Mobile nodes built from the store, by index, the least recently used
+/// last. The cache holds a reference to each node and only evicts a node
+/// when that is the last one, a node still in use is moved to the front
+/// instead. With every node in use the cache grows past its capacity.
+///
+/// The indexes are spread over stripes by index modulo the stripe count,
+/// each with its own lock, list and share of the capacity. With as many
+/// stripes as LMA shards, which split the indexes the same way, shards do
+/// not contend on lookups. A hit on the node at the front of its list
+/// leaves the list alone.
+///
+class node_db::mobile_node_cache : boost::noncopyable {
+	typedef std::list<mobile_node*>                          lru_list;
+	typedef boost::unordered_map<uint32, lru_list::iterator> index_map;
+
+	struct stripe {
+		boost::mutex mutex;
+		lru_list     lru;
+		index_map    index;
+	};
+
+	static const size_t k_evict_scan = 8;
+
+public:
+	mobile_node_cache(size_t capacity, size_t stripes)
+		: _stripe_count(std::max<size_t>(stripes, 1))
+	{
+		_stripes.reset(new stripe[_stripe_count]);
+		_capacity = (capacity + _stripe_count - 1) / _stripe_count;
+	}
+
+	~mobile_node_cache()
+	{
+		clear();
+	}
+
+	mobile_node_ptr find(uint32 index)
+	{
+		stripe&                   st = stripe_of(index);
+		boost::mutex::scoped_lock lock(st.mutex);
+		index_map::iterator       i = st.index.find(index);
+
+		if (i == st.index.end())
+			return mobile_node_ptr();
+
+		if (i->second != st.lru.begin())
+			st.lru.splice(st.lru.begin(), st.lru, i->second);
+		return *i->second;
+	}
+
+	///
+	/// Returns the node cached at the same index, if there is one already,
+	/// in which case mn is deleted
+	///
+	mobile_node_ptr insert(mobile_node* mn)
+	{
+		std::auto_ptr<mobile_node> tmp(mn);
+		stripe&                    st = stripe_of(mn->_index);
+		boost::mutex::scoped_lock  lock(st.mutex);
+		std::pair<index_map::iterator, bool> ins = st.index.insert(std::make_pair(mn->_index, st.lru.end()));
+
+		if (!ins.second)
+			return *ins.first->second;
+
+		st.lru.push_front(tmp.release());
+		ins.first->second = st.lru.begin();
+		intrusive_ptr_add_ref(mn);
+
+		mobile_node_ptr ptr(mn);
+
+		evict(st);
+		return ptr;
+	}
+
+	void clear()
+	{
+		for (size_t i = 0; i < _stripe_count; ++i) {
+			stripe&                   st = _stripes[i];
+			boost::mutex::scoped_lock lock(st.mutex);
+
+			std::for_each(st.lru.begin(), st.lru.end(), release_node);
+			st.lru.clear();
+			st.index.clear();
+		}
+	}
+
+private:
+	stripe& stripe_of(uint32 index)
+	{
+		return _stripes[index % _stripe_count];
+	}
+
+	void evict(stripe& st)
+	{
+		for (size_t n = 0; st.index.size() > _capacity && n < k_evict_scan; ++n) {
+			mobile_node* mn = st.lru.back();
+
+			if (__atomic_load_n(&mn->_refcount, __ATOMIC_ACQUIRE) != 1) {
+				st.lru.splice(st.lru.begin(), st.lru, --st.lru.end());
+				continue;
+			}
+
+			st.index.erase(mn->_index);
+			st.lru.pop_back();
+			intrusive_ptr_release(mn);
+		}
+	}
+
+private:
+	boost::scoped_array<stripe> _stripes;
+	size_t                      _stripe_count;
+	size_t                      _capacity; ///Per stripe
+};
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Runs the asynchronous loads of a node_db on its own thread, in the
+/// order they are posted
+///
+class node_db::loader : boost::noncopyable {
+	struct request {
+		std::vector<uint32> indexes;
+		load_handler        handler;
+	};
+
+public:
+	explicit loader(const node_db& db)
+		: _db(db), _stop(false), _thread(boost::bind(&loader::run, this))
+	{ }
+
+	~loader()
+	{
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+
+			_stop = true;
+		}
+		_cond.notify_one();
+		_thread.join();
+	}
+
+	void post(const std::vector<uint32>& indexes, const load_handler& handler)
+	{
+		{
+			boost::mutex::scoped_lock lock(_mutex);
+
+			_requests.push_back(request());
+			_requests.back().indexes = indexes;
+			_requests.back().handler = handler;
+		}
+		_cond.notify_one();
+	}
+
+private:
+	void run()
+	{
+		for (;;) {
+			request req;
+			bool    stop;
+
+			{
+				boost::mutex::scoped_lock lock(_mutex);
+
+				while (_requests.empty() && !_stop)
+					_cond.wait(lock);
+				if (_requests.empty())
+					return;
+
+				std::swap(req.indexes, _requests.front().indexes);
+				std::swap(req.handler, _requests.front().handler);
+				_requests.pop_front();
+				stop = _stop;
+			}
+
+			mobile_node_ptr_list mns(req.indexes.size());
+
+			if (!stop)
+				for (size_t i = 0; i < req.indexes.size(); ++i)
+					mns[i] = _db.mobile_node_at(req.indexes[i]);
+
+			req.handler(mns);
+		}
+	}
+
+private:
+	const node_db&            _db;
+	boost::mutex              _mutex;
+	boost::condition_variable _cond;
+	std::deque<request>       _requests;
+	bool                      _stop;
+	boost::thread             _thread;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 node_db::node_db()
+	: _index_count(0), _cache_capacity(0), _cache_stripes(1), _loader(nullptr)
 {
 }
 
 node_db::~node_db()
 {
+	delete _loader;
+
 	_router_nodes_by_id.clear_and_dispose(disposer<router_node>());
-	_mobile_nodes_by_id.clear_and_dispose(disposer<mobile_node>());
+	_mobile_nodes_by_id.clear_and_dispose(release_node);
+
+	if (_store)
+		std::for_each(_mobile_nodes.begin(), _mobile_nodes.end(), release_node);
 }
 
-std::pair<size_t, size_t> node_db::load(std::istream& input)
+std::pair<size_t, size_t> node_db::load(std::istream& input, const progress_handler& progress)
 {
-	using boost::property_tree::ptree;
-	size_t rcnt = 0;
-	size_t mcnt = 0;
-	ptree  pt;
+	std::vector<char>        text;
+	std::vector<const char*> mobile_nodes;
+	std::string              name;
+	bool                     has_routers = false;
+	bool                     has_mobile_nodes = false;
+	size_t                   rcnt = 0;
+	size_t                   mcnt = 0;
 
-	boost::property_tree::read_json(input, pt);
+	BOOST_ASSERT(!_store);
 
-	BOOST_FOREACH(ptree::value_type &rn, pt.get_child("router-nodes")) {
-		std::string id;
-		ip_address  addr;
-		uint        sid;
+	read_text(input, text);
 
-		id = rn.second.get<std::string>("id");
-		addr = ip_address::from_string(rn.second.get<std::string>("ip-address"));
-		sid = rn.second.get<uint>("ip-scope-id");
+	const char* begin = text.empty() ? nullptr : &text[0];
+	const char* end = begin + text.size();
+	json_reader js(begin, end);
 
-		if (insert_router(id, addr, sid))
-			++rcnt;
+	//
+	// The router nodes are loaded as they are read, the mobile nodes are
+	// only counted and located, to be parsed afterwards in parallel
+	//
+	js.begin_object();
+	while (js.next_member(name)) {
+		if (name == "router-nodes") {
+			js.begin_array();
+			while (js.next_element())
+				if (load_router(js))
+					++rcnt;
+			has_routers = true;
+
+		} else if (name == "mobile-nodes") {
+			js.begin_array();
+			while (js.next_element()) {
+				mobile_nodes.push_back(js.position());
+				js.skip();
+			}
+			has_mobile_nodes = true;
+
+		} else {
+			js.skip();
+		}
 	}
 
-	BOOST_FOREACH(ptree::value_type &mn, pt.get_child("mobile-nodes")) {
-		std::string       id;
-		ip_prefix_list    prefs;
-		ip_address        home_addr;
-		link_address_list laddrs;
-		std::string       lma_id;
+	if (!has_routers)
+		js.error("\"router-nodes\" not found");
+	if (!has_mobile_nodes)
+		js.error("\"mobile-nodes\" not found");
+
+	std::vector<mobile_node*> parsed(mobile_nodes.size(), nullptr);
+
+	try {
+		parse_mobile_nodes(begin, end, mobile_nodes, parsed);
+
+		//
+		// The nodes own copies of what they need, the text can go before the
+		// indexes grow
+		//
+		std::vector<char>().swap(text);
+		std::vector<const char*>().swap(mobile_nodes);
 
-		id = mn.second.get<std::string>("id");
-		BOOST_FOREACH(ptree::value_type &v, mn.second.get_child("ip-prefix"))
-			prefs.push_back(ip_prefix::from_string(v.second.get_value<std::string>()));
-		if (mn.second.get_optional<std::string>("home-address")) {
-			ip_address addr = ip_address::from_string(mn.second.get<std::string>("home-address"));
+		_mobile_nodes.reserve(_mobile_nodes.size() + parsed.size());
+		_mobile_nodes_by_hash.reserve(_mobile_nodes_by_hash.size() + parsed.size());
 
-			if (std::find_if(prefs.begin(), prefs.end(), boost::bind(&ip_prefix::match, _1, addr)) != prefs.end())
-				home_addr = addr;
-			else
-				log_(0, "No prefix for this home address [id = ", id, "]");
+		for (size_t i = 0; i < parsed.size(); ++i) {
+			std::auto_ptr<mobile_node> mn(parsed[i]);
+
+			parsed[i] = nullptr;
+			if (insert_mobile_node(mn))
+				++mcnt;
+
+			if (progress && !((i + 1) % k_progress_interval))
+				progress(i + 1, parsed.size());
 		}
-		BOOST_FOREACH(ptree::value_type &v, mn.second.get_child("link-address"))
-			laddrs.push_back(link_address::from_string(v.second.get_value<std::string>()));
-		lma_id = mn.second.get<std::string>("lma-id");
 
-		if (insert_mobile_node(id, prefs, laddrs, lma_id, home_addr))
-			++mcnt;
+	} catch (...) {
+		std::for_each(parsed.begin(), parsed.end(), disposer<mobile_node>());
+		throw;
 	}
 
+	if (progress)
+		progress(parsed.size(), parsed.size());
+
+	build_lookups();
 	return std::make_pair(rcnt, mcnt);
 }
 
+std::pair<size_t, size_t> node_db::load_image(const std::string& file_name)
+{
+	BOOST_ASSERT(!_store && _router_nodes_by_id.empty() && _mobile_nodes.empty());
+
+	struct stat st;
+	int         fd = ::open(file_name.c_str(), O_RDONLY);
+
+	if (fd < 0 || ::fstat(fd, &st) < 0) {
+		boost::system::error_code ec(errno, boost::system::system_category());
+
+		if (fd >= 0)
+			::close(fd);
+		throw_exception(ec, "Failed to open \"" + file_name + "\" node database image");
+	}
+
+	void* mem = MAP_FAILED;
+
+	if (size_t(st.st_size) >= sizeof(image_header))
+		mem = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (mem == MAP_FAILED || !image_check(*static_cast<const image_header*>(mem), st.st_size)) {
+		if (mem != MAP_FAILED)
+			::munmap(mem, st.st_size);
+		throw_exception(errc::make_error_code(errc::invalid_argument),
+		                "Invalid \"" + file_name + "\" node database image");
+	}
+
+	//
+	// Lookups hit the indexes and records at random, read ahead is wasted
+	//
+	::madvise(mem, st.st_size, MADV_RANDOM);
+
+	const uchar*                    image = static_cast<const uchar*>(mem);
+	std::auto_ptr<subscriber_store> store(new image_store(image, st.st_size));
+	const image_header&             hdr = *image_section<image_header>(image, 0);
+	const image_router*             routers = image_section<image_router>(image, hdr.routers);
+	size_t                          rcnt = 0;
+
+	for (uint32 i = 0; i < hdr.router_count; ++i) {
+		ip_address::bytes_type addr;
+
+		if (!image_check_string(hdr, routers[i].id)) {
+			log_(0, "skipping router node with a bad id in image [index = ", i, "]");
+			continue;
+		}
+
+		std::copy(routers[i].address, routers[i].address + addr.size(), addr.begin());
+		if (insert_router(image_to_string(image, hdr, routers[i].id), ip_address(addr, routers[i].scope_id),
+		                  routers[i].device_id))
+			++rcnt;
+	}
+
+	load_store(store);
+	build_lookups();
+
+	return std::make_pair(rcnt, mobile_node_count());
+}
+
+std::pair<size_t, size_t> node_db::load_file(const std::string& file_name, const progress_handler& progress)
+{
+	if (is_image(file_name))
+		return load_image(file_name);
+
+	std::ifstream in(file_name.c_str());
+
+	if (!in)
+		throw_exception(errc::make_error_code(errc::no_such_file_or_directory),
+		                "Failed to open \"" + file_name + "\" node database file");
+
+	return load(in, progress);
+}
+
+size_t node_db::load_store(std::auto_ptr<subscriber_store> store)
+{
+	BOOST_ASSERT(!_store && _mobile_nodes.empty());
+
+	_store.reset(store.release());
+	if (_cache_capacity) {
+		_cache.reset(new mobile_node_cache(_cache_capacity, _cache_stripes));
+		_index_count = _store->record_count();
+	} else {
+		_mobile_nodes.resize(_store->record_count(), nullptr);
+	}
+
+	return mobile_node_count();
+}
+
+void node_db::write_image(std::ostream& output) const
+{
+	image_header                    hdr;
+	std::vector<image_router>       routers;
+	std::vector<image_mobile_node>  mns;
+	std::vector<image_prefix>       prefixes;
+	std::vector<image_link_address> laddrs;
+	std::vector<image_nai_slot>     nai_index;
+	std::vector<image_mac_slot>     mac_index;
+	image_string_pool               strings;
+
+	for (router_node_tree::const_iterator i = _router_nodes_by_id.begin(), e = _router_nodes_by_id.end();
+	     i != e; ++i) {
+		image_router rn;
+		ip_address::bytes_type addr = i->address().to_bytes();
+
+		std::memset(&rn, 0, sizeof(rn));
+		rn.id = strings.add_shared(i->id());
+		std::copy(addr.begin(), addr.end(), rn.address);
+		rn.scope_id = i->address().scope_id();
+		rn.device_id = i->device_id();
+		routers.push_back(rn);
+	}
+
+	image_nai_slot empty_nai = { 0, k_mn_index_invalid };
+	image_mac_slot empty_mac = { k_mn_index_invalid, { 0 }, { 0 } };
+
+	nai_index.resize(image_index_size(mobile_node_count()), empty_nai);
+	mns.reserve(mobile_node_count());
+
+	//
+	// Unused indexes are dropped, the image records are numbered afresh
+	//
+	for (uint32 n = 0; n < mobile_node_count(); ++n) {
+		mobile_node_ptr ptr = mobile_node_at(n);
+		if (!ptr)
+			continue;
+
+		const mobile_node&     mn = *ptr;
+		uint32                 record = mns.size();
+		image_mobile_node      rec;
+		ip_address::bytes_type home = mn.home_address().to_bytes();
+		uint32                 mask;
+		uint32                 h;
+
+		std::memset(&rec, 0, sizeof(rec));
+		rec.id = strings.add(mn.id());
+		rec.lma_id = strings.add_shared(mn.lma_id());
+		std::copy(home.begin(), home.end(), rec.home_address);
+		rec.prefix_first = prefixes.size();
+		rec.prefix_count = mn.prefix_list().size();
+		rec.link_address_first = laddrs.size();
+		rec.link_address_count = mn.link_addresses().size();
+		mns.push_back(rec);
+
+		for (ip_prefix_list::const_iterator i = mn.prefix_list().begin(), e = mn.prefix_list().end(); i != e; ++i) {
+			image_prefix ip;
+
+			std::memset(&ip, 0, sizeof(ip));
+			std::copy(i->bytes().begin(), i->bytes().end(), ip.address);
+			ip.length = i->length();
+			prefixes.push_back(ip);
+		}
+
+		mask = nai_index.size() - 1;
+		h = image_hash(mn.id().data(), mn.id().size());
+		for (uint32 s = h & mask; ; s = (s + 1) & mask) {
+			if (nai_index[s].index == k_mn_index_invalid) {
+				nai_index[s].hash = h;
+				nai_index[s].index = record;
+				break;
+			}
+		}
+
+		for (link_address_list::const_iterator i = mn.link_addresses().begin(), e = mn.link_addresses().end();
+		     i != e; ++i) {
+			image_link_address la;
+
+			std::copy(i->to_bytes().begin(), i->to_bytes().end(), la.address);
+			laddrs.push_back(la);
+		}
+	}
+
+	//
+	// The link addresses are only counted once every record is written
+	//
+	mac_index.resize(image_index_size(laddrs.size()), empty_mac);
+	for (uint32 record = 0, mask = mac_index.size() - 1; record < mns.size(); ++record) {
+		for (uint32 i = 0; i < mns[record].link_address_count; ++i) {
+			const image_link_address& la = laddrs[mns[record].link_address_first + i];
+			uint32                    h = image_hash(la.address, sizeof(la.address));
+
+			for (uint32 s = h & mask; ; s = (s + 1) & mask) {
+				if (mac_index[s].index == k_mn_index_invalid) {
+					mac_index[s].index = record;
+					std::copy(la.address, la.address + sizeof(la.address), mac_index[s].address);
+					break;
+				}
+			}
+		}
+	}
+
+	uint64 pos = image_align(sizeof(hdr));
+
+	std::memset(&hdr, 0, sizeof(hdr));
+	std::memcpy(hdr.magic, "OPMIPNDB", sizeof(hdr.magic));
+	hdr.version = k_image_version;
+	hdr.byte_order = k_image_byte_order;
+	hdr.router_count = routers.size();
+	hdr.mobile_node_count = mns.size();
+	hdr.prefix_count = prefixes.size();
+	hdr.link_address_count = laddrs.size();
+	hdr.nai_index_size = nai_index.size();
+	hdr.mac_index_size = mac_index.size();
+	hdr.routers = image_layout(pos, routers);
+	hdr.mobile_nodes = image_layout(pos, mns);
+	hdr.nai_index = image_layout(pos, nai_index);
+	hdr.mac_index = image_layout(pos, mac_index);
+	hdr.prefixes = image_layout(pos, prefixes);
+	hdr.link_addresses = image_layout(pos, laddrs);
+	hdr.strings = image_layout(pos, strings.pool());
+	hdr.strings_size = strings.pool().size();
+	hdr.size = pos;
+
+	image_write(output, &hdr, sizeof(hdr));
+	image_write(output, routers);
+	image_write(output, mns);
+	image_write(output, nai_index);
+	image_write(output, mac_index);
+	image_write(output, prefixes);
+	image_write(output, laddrs);
+	image_write(output, strings.pool());
+}
+
+bool node_db::is_image(const std::string& file_name)
+{
+	std::ifstream in(file_name.c_str(), std::ios::binary);
+	char          magic[8];
+
+	return in.read(magic, sizeof(magic)) && !std::memcmp(magic, "OPMIPNDB", sizeof(magic));
+}
+
+void node_db::keep_indexes(const node_db& previous)
+{
+	uint32              records = _store ? _store->record_count() : _mobile_nodes.size();
+	std::vector<uint32> index(records);
+	std::vector<uint32> unused;
+	uint32              next = previous.mobile_node_count();
+
+	BOOST_ASSERT(_store_record.empty());
+
+	//
+	// The indexes previous left unused were freed by an earlier reload,
+	// which revoked their bindings. Those freed by this one may still be
+	// bound until this database is published, so they wait for the next.
+	//
+	for (uint32 i = next; i--; ) {
+		if (!previous.index_used(i))
+			unused.push_back(i);
+	}
+
+	for (uint32 r = 0; r < records; ++r) {
+		uint32 i = _store ? previous.index_of(_store->record_id(r)) : previous.index_of(_mobile_nodes[r]->id());
+
+		if (i == k_mn_index_invalid && !unused.empty()) {
+			i = unused.back();
+			unused.pop_back();
+		}
+		index[r] = (i != k_mn_index_invalid) ? i : next++;
+	}
+
+	if (!_store) {
+		mobile_node_list mns(next, nullptr);
+
+		for (uint32 r = 0; r < records; ++r) {
+			_mobile_nodes[r]->_index = index[r];
+			mns[index[r]] = _mobile_nodes[r];
+		}
+		_mobile_nodes.swap(mns);
+		return;
+	}
+
+	//
+	// Nodes built from the store so far carry their record number
+	//
+	if (_cache) {
+		_cache->clear();
+		_index_count = next;
+	} else {
+		std::for_each(_mobile_nodes.begin(), _mobile_nodes.end(), release_node);
+		_mobile_nodes.assign(next, nullptr);
+	}
+
+	_store_record.assign(next, k_mn_index_invalid);
+	for (uint32 r = 0; r < records; ++r)
+		_store_record[index[r]] = r;
+	_store_index.swap(index);
+}
+
 const router_node* node_db::find_router(const key& key) const
 {
 	router_node_tree::const_iterator i = _router_nodes_by_id.find(key, node::compare());
@@ -104,18 +1177,22 @@ const router_node* node_db::find_router(const key& key) const
 	return nullptr;
 }
 
-const mobile_node* node_db::find_mobile_node(const key& key) const
+mobile_node_ptr node_db::find_mobile_node(const key& key) const
 {
-	mobile_node_tree::const_iterator i = _mobile_nodes_by_id.find(key, node::compare());
-
-	if (i != _mobile_nodes_by_id.end())
-		return static_cast<const mobile_node*>(boost::addressof(*i));
+	if (_store)
+		return mobile_node_at(index_of(key));
 
-	return nullptr;
+	return find_loaded(key);
 }
 
 const router_node* node_db::find_router(const router_key& key) const
 {
+	if (!_router_nodes_by_address.empty()) {
+		const router_node* router = _router_nodes_by_address.find(key_hash(key));
+
+		return (router && router->address() == key) ? router : nullptr;
+	}
+
 	router_node_key_tree::const_iterator i = _router_nodes_by_key.find(key, router_node::compare());
 
 	if (i != _router_nodes_by_key.end())
@@ -124,14 +1201,23 @@ const router_node* node_db::find_router(const router_key& key) const
 	return nullptr;
 }
 
-const mobile_node* node_db::find_mobile_node(const mn_key& key) const
+mobile_node_ptr node_db::find_mobile_node(const mn_key& key) const
 {
+	if (_store) {
+		uint32 record = _store->find_record(key);
+
+		return (record != k_mn_index_invalid) ? mobile_node_at(record_index(record)) : mobile_node_ptr();
+	}
+
+	if (!_mobile_nodes_by_link_address.empty())
+		return _mobile_nodes_by_link_address.find(key_hash(key));
+
 	mobile_node_key_tree::const_iterator i = _mobile_nodes_by_key.find(key);
 
 	if (i != _mobile_nodes_by_key.end())
 		return i->second;
 
-	return nullptr;
+	return mobile_node_ptr();
 }
 
 bool node_db::insert_router(const std::string& id, const ip_address& addr, uint device_id)
@@ -139,6 +1225,8 @@ bool node_db::insert_router(const std::string& id, const ip_address& addr, uint
 	std::auto_ptr<router_node> router(new router_node(id, addr, device_id));
 	std::pair<router_node_tree::iterator, bool> ins = _router_nodes_by_id.insert_unique(*router);
 
+	_router_nodes_by_address.clear();
+
 	if (!ins.second) {
 		log_(0, "cound not insert router node due to duplicate id");
 		return false;
@@ -159,8 +1247,17 @@ bool node_db::insert_mobile_node(const std::string& id, const ip_prefix_list& pr
                                  const ip_address& home_addr)
 {
 	std::auto_ptr<mobile_node> mn(new mobile_node(id, prefs, link_addrs, lma_id, home_addr));
+
+	return insert_mobile_node(mn);
+}
+
+bool node_db::insert_mobile_node(std::auto_ptr<mobile_node>& mn)
+{
+	const link_address_list& link_addrs = mn->link_addresses();
 	std::pair<mobile_node_tree::iterator, bool> ins = _mobile_nodes_by_id.insert_unique(*mn);
 
+	_mobile_nodes_by_nai.clear();
+	_mobile_nodes_by_link_address.clear();
 	if (!ins.second) {
 		log_(0, "cound not insert mobile node due to duplicate id");
 		return false;
@@ -186,10 +1283,175 @@ bool node_db::insert_mobile_node(const std::string& id, const ip_prefix_list& pr
 		throw;
 	}
 
-	mn.release();
+	_mobile_nodes_by_hash.insert_unique(*mn);
+	mn->_index = _mobile_nodes.size();
+	_mobile_nodes.push_back(mn.get());
+	intrusive_ptr_add_ref(mn.release());
 	return true;
 }
 
+bool node_db::load_router(json_reader& js)
+{
+	std::string id;
+	std::string addr;
+	std::string sid;
+	std::string name;
+
+	js.begin_object();
+	while (js.next_member(name)) {
+		if (name == "id")
+			js.value(id);
+		else if (name == "ip-address")
+			js.value(addr);
+		else if (name == "ip-scope-id")
+			js.value(sid);
+		else
+			js.skip();
+	}
+
+	if (id.empty() || addr.empty() || sid.empty())
+		js.error("router node without \"id\", \"ip-address\" or \"ip-scope-id\"");
+
+	return insert_router(id, ip_address::from_string(addr), boost::lexical_cast<uint>(sid));
+}
+
+///
+/// The perfect hash indexes are built for the nodes loaded so far and
+/// dropped by any later insertion. An index that cannot be built, only if
+/// two keys have the same 64 bit hash, is left empty and its lookups fall
+/// back to the trees. The mobile nodes of a store are found by the store.
+///
+void node_db::build_lookups()
+{
+	router_node_lookup::value_list routers;
+
+	for (router_node_key_tree::iterator i = _router_nodes_by_key.begin(), e = _router_nodes_by_key.end();
+	     i != e; ++i)
+		routers.push_back(std::make_pair(key_hash(i->address()), boost::addressof(*i)));
+
+	if (!_router_nodes_by_address.build(routers))
+		log_(0, "router node address lookup not built, falling back to the tree");
+
+	if (_store)
+		return;
+
+	mobile_node_lookup::value_list mns;
+
+	mns.reserve(_mobile_nodes.size());
+	for (mobile_node_list::const_iterator i = _mobile_nodes.begin(), e = _mobile_nodes.end(); i != e; ++i)
+		if (*i)
+			mns.push_back(std::make_pair(key_hash((*i)->id()), *i));
+
+	if (!_mobile_nodes_by_nai.build(mns))
+		log_(0, "mobile node NAI lookup not built, falling back to the hash index");
+
+	mns.clear();
+	mns.reserve(_mobile_nodes_by_key.size());
+	for (mobile_node_key_tree::const_iterator i = _mobile_nodes_by_key.begin(), e = _mobile_nodes_by_key.end();
+	     i != e; ++i)
+		mns.push_back(std::make_pair(key_hash(i->first), i->second));
+
+	if (!_mobile_nodes_by_link_address.build(mns))
+		log_(0, "mobile node link address lookup not built, falling back to the tree");
+}
+
+mobile_node_ptr node_db::load_mobile_node(uint32 index) const
+{
+	if (index >= mobile_node_count())
+		return mobile_node_ptr();
+
+	uint32 record = _store_record.empty() ? index : _store_record[index];
+
+	if (record == k_mn_index_invalid)
+		return mobile_node_ptr();
+
+	mobile_node* mn = _store->read_record(record);
+
+	if (!mn)
+		return mobile_node_ptr();
+
+	mn->_index = index;
+	if (_cache)
+		return _cache->insert(mn);
+
+	//
+	// Lookups run concurrently, the first thread to build the node publishes
+	// it and the others use that one. The slots are only ever written here.
+	//
+	mobile_node* expected = nullptr;
+
+	intrusive_ptr_add_ref(mn);
+	if (!__atomic_compare_exchange_n(const_cast<mobile_node**>(&_mobile_nodes[index]), &expected, mn,
+	                                 false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		delete mn;
+		return expected;
+	}
+
+	return mn;
+}
+
+mobile_node_ptr node_db::cache_find(uint32 index) const
+{
+	return _cache->find(index);
+}
+
+void node_db::async_load(const std::vector<uint32>& indexes, const load_handler& handler) const
+{
+	loader* ld = __atomic_load_n(&_loader, __ATOMIC_ACQUIRE);
+
+	if (!ld) {
+		loader* expected = nullptr;
+
+		ld = new loader(*this);
+		if (!__atomic_compare_exchange_n(&_loader, &expected, ld, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			delete ld;
+			ld = expected;
+		}
+	}
+
+	ld->post(indexes, handler);
+}
+
+uint32 node_db::record_index(uint32 record) const
+{
+	return _store_index.empty() ? record : _store_index[record];
+}
+
+bool node_db::index_used(uint32 index) const
+{
+	if (index >= mobile_node_count())
+		return false;
+
+	if (_store)
+		return _store_record.empty() || _store_record[index] != k_mn_index_invalid;
+
+	return _mobile_nodes[index];
+}
+
+const mobile_node* node_db::find_loaded(const key& key) const
+{
+	if (!_mobile_nodes_by_nai.empty()) {
+		const mobile_node* mn = _mobile_nodes_by_nai.find(key_hash(key));
+
+		return (mn && mn->id() == key) ? mn : nullptr;
+	}
+
+	return static_cast<const mobile_node*>(_mobile_nodes_by_hash.find(key));
+}
+
+uint32 node_db::index_of(const key& key) const
+{
+	if (_store) {
+		uint32 record = _store->find_record(key);
+
+		return (record != k_mn_index_invalid) ? record_index(record) : record;
+	}
+
+	const mobile_node* mn = find_loaded(key);
+
+	return mn ? mn->index() : k_mn_index_invalid;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 } /* namespace pmip */ } /* namespace opmip */
 
@@ -16,14 +16,24 @@
 //=============================================================================
 
 #include <opmip/pmip/tunnels.hpp>
+#include <opmip/sys/error.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <net/if.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace pmip {
 
+///////////////////////////////////////////////////////////////////////////////
+static const char k_external_name[] = "pmip6tnl";
+static const char k_tunnel_prefix[] = "pmip";
+
 ///////////////////////////////////////////////////////////////////////////////
 ip6_tunnels::ip6_tunnels(boost::asio::io_service& ios)
-	: _io_service(ios), _global_address(false)
+	: _io_service(ios), _prefix_length(0), _global_address(false), _external(ios)
 {
 }
 
@@ -31,25 +41,51 @@ ip6_tunnels::~ip6_tunnels()
 {
 }
 
-void ip6_tunnels::open(const ip::address_v6& address, bool global_address)
+void ip6_tunnels::open(const ip::address_v6& address, uint prefix_length, bool global_address, bool external)
 {
 	if (!_tunnels.empty()) {
 		_gc.clear();
 		_tunnels.clear();
 	}
+	if (_external.is_open())
+		_external.close();
 	_local = address;
+	_prefix_length = prefix_length;
 	_global_address = global_address;
+
+	if (external) {
+		_external.open_external(k_external_name);
+		_external.set_enable(true);
+		if (_global_address)
+			_external.add_address(_local, _prefix_length);
+	}
 }
 
 void ip6_tunnels::close()
 {
+	boost::system::error_code ignore;
+
 	_local = ip::address_v6();
 	_gc.clear();
 	_tunnels.clear();
+	if (_external.is_open())
+		_external.close(ignore);
+}
+
+void ip6_tunnels::detach()
+{
+	for (map::iterator i = _tunnels.begin(), e = _tunnels.end(); i != e; ++i)
+		i->second->tunnel.delete_on_close(false);
+	_external.delete_on_close(false);
+
+	close();
 }
 
 uint ip6_tunnels::get(const ip::address_v6& remote)
 {
+	if (_external.is_open())
+		return _external.get_device_id();
+
 	map::iterator i = _tunnels.find(remote);
 	if (i != _tunnels.end()) {
 		if (++i->second->refcount == 1)
@@ -60,16 +96,19 @@ uint ip6_tunnels::get(const ip::address_v6& remote)
 
 	std::auto_ptr<entry> tun(new entry(_io_service));
 	std::pair<map::iterator, bool> res = _tunnels.insert(remote, tun);
+	boost::system::error_code ec;
 
-	try {
-		res.first->second->tunnel.open("", _local.scope_id(), _local, remote);
-		res.first->second->tunnel.set_enable(true);
-		if (_global_address == true)	
-			res.first->second->tunnel.add_address(_local, 64); // TODO make this prefix configurable
-		else {}
-	} catch (...) {
+	//
+	// Another remote with the same name is left to a kernel given one
+	//
+	open_tunnel(*res.first->second, remote, ec);
+	if (ec == boost::system::errc::make_error_condition(boost::system::errc::file_exists)) {
+		ec = boost::system::error_code();
+		open_tunnel(*res.first->second, "", remote, ec);
+	}
+	if (ec) {
 		_tunnels.erase(res.first);
-		throw;
+		sys::throw_on_error(ec, "opmip::pmip::ip6_tunnels::get");
 	}
 
 	return res.first->second->tunnel.get_device_id();
@@ -77,9 +116,12 @@ uint ip6_tunnels::get(const ip::address_v6& remote)
 
 void ip6_tunnels::del(const ip::address_v6& remote)
 {
+	if (_external.is_open())
+		return;
+
 	map::iterator i = _tunnels.find(remote);
 	if (i != _tunnels.end() && i->second->refcount) {
-		if (!--i->second->refcount)
+		if (!--i->second->refcount && !i->second->pinned)
 			_gc.insert(i->first);
 	}
 
@@ -93,6 +135,160 @@ void ip6_tunnels::del(const ip::address_v6& remote)
 	}
 }
 
+uint ip6_tunnels::move(const ip::address_v6& from, const ip::address_v6& to)
+{
+	//
+	// Take the new reference first, if opening the tunnel fails the old
+	// one is kept
+	//
+	uint dev = get(to);
+
+	del(from);
+	return dev;
+}
+
+size_t ip6_tunnels::provision(const std::vector<ip::address_v6>& remotes, size_t concurrency)
+{
+	if (_external.is_open())
+		return remotes.size();
+
+	std::vector<std::pair<ip::address_v6, entry*> > tunnels;
+
+	for (std::vector<ip::address_v6>::const_iterator i = remotes.begin(), e = remotes.end(); i != e; ++i) {
+		map::iterator j = _tunnels.find(*i);
+
+		if (j != _tunnels.end()) {
+			j->second->pinned = true;
+			_gc.erase(*i);
+			continue;
+		}
+
+		std::auto_ptr<entry> tun(new entry(_io_service));
+
+		tun->refcount = 0;
+		tun->pinned = true;
+		tunnels.push_back(std::make_pair(*i, tun.get()));
+		_tunnels.insert(*i, tun);
+	}
+
+	size_t threads = std::min(std::max<size_t>(concurrency, 1), tunnels.size());
+
+	if (threads > 1) {
+		boost::thread_group tg;
+
+		for (size_t i = 0; i < threads; ++i)
+			tg.create_thread(boost::bind(&ip6_tunnels::provision_range, this, boost::cref(tunnels), i, threads));
+		tg.join_all();
+
+	} else {
+		provision_range(tunnels, 0, 1);
+	}
+
+	size_t ready = remotes.size() - tunnels.size();
+
+	for (size_t i = 0; i < tunnels.size(); ++i) {
+		if (tunnels[i].second->tunnel.is_open())
+			++ready;
+		else
+			_tunnels.erase(tunnels[i].first);
+	}
+
+	return ready;
+}
+
+size_t ip6_tunnels::collect()
+{
+	if (_external.is_open())
+		return 0;
+
+	std::set<uint> held;
+
+	for (map::iterator i = _tunnels.begin(), e = _tunnels.end(); i != e; ++i) {
+		if (i->second->tunnel.is_open())
+			held.insert(i->second->tunnel.get_device_id());
+	}
+
+	struct if_nameindex* ifs = ::if_nameindex();
+	size_t               n = 0;
+
+	if (!ifs)
+		return 0;
+
+	for (struct if_nameindex* i = ifs; i->if_index; ++i) {
+		if (std::strncmp(i->if_name, k_tunnel_prefix, sizeof(k_tunnel_prefix) - 1)
+		    || std::strlen(i->if_name) != sizeof(k_tunnel_prefix) - 1 + 8 || held.count(i->if_index))
+			continue;
+
+		sys::ip6_tunnel           tun(_io_service);
+		boost::system::error_code ec;
+
+		tun.open(i->if_name, ec);
+		if (ec)
+			continue;
+
+		if (tun.local_address().to_bytes() == _local.to_bytes()) {
+			tun.delete_on_close(true);
+			++n;
+		}
+		tun.close(ec);
+	}
+
+	::if_freenameindex(ifs);
+	return n;
+}
+
+void ip6_tunnels::provision_range(const std::vector<std::pair<ip::address_v6, entry*> >& tunnels,
+                                  size_t first, size_t step)
+{
+	for (size_t i = first; i < tunnels.size(); i += step) {
+		boost::system::error_code ec;
+
+		open_tunnel(*tunnels[i].second, tunnels[i].first, ec);
+	}
+}
+
+void ip6_tunnels::open_tunnel(entry& tun, const ip::address_v6& remote, boost::system::error_code& ec)
+{
+	ip::address_v6::bytes_type addr = remote.to_bytes();
+	uint32                     hash = 2166136261u;
+	char                       name[16];
+
+	for (size_t j = 0; j < addr.size(); ++j)
+		hash = (hash ^ addr[j]) * 16777619u;
+	std::snprintf(name, sizeof(name), "%s%08x", k_tunnel_prefix, hash);
+
+	open_tunnel(tun, name, remote, ec);
+	if (ec == boost::system::errc::make_error_condition(boost::system::errc::file_exists)) {
+		//
+		// Left behind by a previous run, adopted if it still goes to
+		// the same MAG, and then owned as if opened here
+		//
+		ec = boost::system::error_code();
+		tun.tunnel.open(name, ec);
+		if (!ec && tun.tunnel.remote_address() != remote)
+			ec = boost::system::errc::make_error_code(boost::system::errc::file_exists);
+		if (!ec)
+			tun.tunnel.set_enable(true, ec);
+		if (!ec)
+			tun.tunnel.delete_on_close(true);
+	}
+
+	if (ec && tun.tunnel.is_open()) {
+		boost::system::error_code ignore;
+
+		tun.tunnel.close(ignore);
+	}
+}
+
+void ip6_tunnels::open_tunnel(entry& tun, const char* name, const ip::address_v6& remote, boost::system::error_code& ec)
+{
+	tun.tunnel.open(name, _local.scope_id(), _local, remote, ec);
+	if (!ec)
+		tun.tunnel.set_enable(true, ec);
+	if (!ec && _global_address)
+		tun.tunnel.add_address(_local, _prefix_length, ec);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 } /* namespace pmip */ } /* namespace opmip */
 
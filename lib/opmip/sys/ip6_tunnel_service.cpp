@@ -20,6 +20,7 @@
 #include <opmip/sys/netlink/error.hpp>
 #include <opmip/sys/netlink/message.hpp>
 #include <opmip/sys/rtnetlink/address.hpp>
+#include <opmip/sys/rtnetlink/link.hpp>
 #include <boost/throw_exception.hpp>
 #include <boost/array.hpp>
 #include <algorithm>
@@ -108,6 +109,37 @@ void ip6_tunnel_service::open(implementation_type& impl, const char* name,
 		impl.data.clear();
 }
 
+void ip6_tunnel_service::open_external(implementation_type& impl, const char* name,
+                                                                  boost::system::error_code& ec)
+{
+	if (is_open(impl))
+		close(impl, ec);
+
+	if (!ec)
+		add_external(name, ec);
+
+	//
+	// A device left behind by a previous run is taken over, the name is
+	// reserved for the external tunnel
+	//
+	if (ec == boost::system::errc::make_error_condition(boost::system::errc::file_exists))
+		ec = boost::system::error_code();
+
+	if (!ec) {
+		impl.data.name(name);
+		impl.delete_on_close = true;
+		get(impl.data, ec);
+		if (ec) {
+			boost::system::error_code ignore;
+
+			remove(impl.data, ignore);
+		}
+	}
+
+	if (ec)
+		impl.data.clear();
+}
+
 bool ip6_tunnel_service::is_open(const implementation_type& impl) const
 {
 	return impl.data.name()[0] != '\0';
@@ -292,6 +324,16 @@ uint ip6_tunnel_service::get_device_id(implementation_type& impl, boost::system:
 	return req.dev;
 }
 
+ip::address_v6 ip6_tunnel_service::local_address(const implementation_type& impl) const
+{
+	return impl.data.local_address();
+}
+
+ip::address_v6 ip6_tunnel_service::remote_address(const implementation_type& impl) const
+{
+	return impl.data.remote_address();
+}
+
 void ip6_tunnel_service::shutdown_service()
 {
 	boost::mutex::scoped_lock(_mutex);
@@ -330,6 +372,72 @@ void ip6_tunnel_service::change(parameters& op, boost::system::error_code& ec)
 	io_control(op.name(), ioctl_change, op.data(), ec);
 }
 
+void ip6_tunnel_service::add_external(const char* name, boost::system::error_code& ec)
+{
+	//
+	// The ioctl interface has no way of setting collect metadata mode, the
+	// device is created through rtnetlink instead
+	//
+	nl::message_batch msg;
+	uchar             proto = parameters::default_protocol;
+
+	rtnl::link& lnk = msg.push_message<rtnl::link>(rtnl::link::m_new, nl::header::request
+	                                                                  | nl::header::create
+	                                                                  | nl::header::exclusive
+	                                                                  | nl::header::ack);
+	lnk.family = AF_UNSPEC;
+	lnk.flags = rtnl::link::up;
+	lnk.change = rtnl::link::up;
+
+	msg.push_attribute(rtnl::link::attr_ifname, name, std::strlen(name) + 1);
+
+	size_t info = msg.begin_nested(rtnl::link::attr_link_info);
+	msg.push_attribute(rtnl::link::info_attr_kind, "ip6tnl", sizeof("ip6tnl"));
+
+	size_t data = msg.begin_nested(rtnl::link::info_attr_data);
+	msg.push_attribute(iptun_attr_proto, &proto, sizeof(proto));
+	msg.push_attribute(iptun_attr_collect_metadata, nullptr, 0);
+	msg.end_nested(data);
+	msg.end_nested(info);
+
+
+	uchar  resp[512];
+	size_t rlen;
+	uint   seq;
+	{
+		boost::mutex::scoped_lock lc(_rtnl_mutex);
+		msg.begin()->sequence = seq = ++_rtnl_seq;
+
+		_rtnl.send(msg.cbuffer(), 0, ec);
+		if (ec)
+			return;
+
+		rlen = _rtnl.receive(boost::asio::buffer(resp), 0, ec);
+		if (ec)
+			return;
+	}
+
+
+	nl::message_iterator mit(resp, rlen);
+	nl::message_iterator end;
+	int                  errc = EIO;
+
+	for (; mit != end; ++mit) {
+		if (mit->type == nl::header::m_error) {
+			nl::message<nl::error> err(mit);
+
+			assert(mit->sequence == seq);
+			errc = -err->error;
+			break;
+		}
+	}
+
+	if (errc)
+		ec = boost::system::error_code(errc, boost::system::system_category());
+	else
+		ec = boost::system::error_code();
+}
+
 void ip6_tunnel_service::io_control(const char* name, int opcode, void* data, boost::system::error_code& ec)
 {
 	struct if_req {
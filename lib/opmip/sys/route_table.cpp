@@ -16,20 +16,16 @@
 //=============================================================================
 
 #include <opmip/sys/route_table.hpp>
-#include <opmip/sys/netlink/message.hpp>
-#include <opmip/sys/netlink/utils.hpp>
 #include <opmip/sys/rtnetlink/route.hpp>
-#include <opmip/sys/error.hpp>
+#include <boost/bind.hpp>
 
 ///////////////////////////////////////////////////////////////////////////////
 namespace opmip { namespace sys {
 
 ///////////////////////////////////////////////////////////////////////////////
 route_table::route_table(boost::asio::io_service& ios)
-	: _rtnl(ios), _rtnl_seq(0)
+	: _rtnl(ios)
 {
-	_rtnl.open(netlink<0>());
-	_rtnl.bind(netlink<0>::endpoint());
 }
 
 route_table::~route_table()
@@ -37,227 +33,280 @@ route_table::~route_table()
 	clear();
 }
 
-std::pair<route_table::const_iterator, bool> route_table::add_by_src(const ip::prefix_v6& prefix, uint device, const ip::address_v6& gateway)
+bool route_table::add_by_src(const ip_prefix& prefix, uint device, const ip_address& gateway,
+                             const completion_handler& handler)
 {
-	std::pair<iterator, bool> res = _map_by_src.insert(map::value_type(prefix, entry(device, gateway)));
-
-	if (!res.second)
-		return res;
-
+	return commit(operation(operation::k_add, true, prefix, entry(device, gateway), handler));
+}
 
-	boost::system::error_code ec;
+bool route_table::replace_by_src(const ip_prefix& prefix, uint device, const ip_address& gateway,
+                                 const completion_handler& handler)
+{
+	return commit(operation(operation::k_replace, true, prefix, entry(device, gateway), handler));
+}
 
-	add_by_src(res.first, ec);
-	if (ec) {
-		_map_by_src.erase(res.first);
-		boost::throw_exception(boost::system::system_error(ec, "opmip::sys::route_table::add_by_src"));
+bool route_table::find_by_src(const ip_prefix& prefix, entry& e) const
+{
+	return find(_map_by_src, prefix, e);
+}
 
-		return std::pair<const_iterator, bool>(_map_by_src.end(), false);
-	}
+bool route_table::remove_by_src(const ip_prefix& prefix, const completion_handler& handler)
+{
+	return commit(operation(operation::k_remove, true, prefix, entry(), handler));
+}
 
-	return res;
+bool route_table::add_by_dst(const ip_prefix& prefix, uint device, const ip_address& gateway,
+                             const completion_handler& handler)
+{
+	return commit(operation(operation::k_add, false, prefix, entry(device, gateway), handler));
 }
 
-std::pair<route_table::const_iterator, bool> route_table::find_by_src(const ip::prefix_v6& prefix) const
+bool route_table::replace_by_dst(const ip_prefix& prefix, uint device, const ip_address& gateway,
+                                 const completion_handler& handler)
 {
-	std::pair<const_iterator, bool> res(_map_by_src.find(prefix), true);
+	return commit(operation(operation::k_replace, false, prefix, entry(device, gateway), handler));
+}
 
-	if (res.first == _map_by_src.end())
-		res.second = false;
+bool route_table::add_by_dst(const ip_prefix& prefix, const entry& route, const completion_handler& handler)
+{
+	return commit(operation(operation::k_add, false, prefix, route, handler));
+}
 
-	return res;
+bool route_table::replace_by_dst(const ip_prefix& prefix, const entry& route, const completion_handler& handler)
+{
+	return commit(operation(operation::k_replace, false, prefix, route, handler));
 }
 
-bool route_table::remove_by_src(const ip::prefix_v6& prefix)
+bool route_table::find_by_dst(const ip_prefix& prefix, entry& e) const
 {
-	iterator res = _map_by_src.find(prefix);
+	return find(_map_by_dst, prefix, e);
+}
 
-	if (res == _map_by_src.end())
-		return false;
+bool route_table::remove_by_dst(const ip_prefix& prefix, const completion_handler& handler)
+{
+	return commit(operation(operation::k_remove, false, prefix, entry(), handler));
+}
 
+size_t route_table::commit(batch& b)
+{
+	boost::mutex::scoped_lock lock(_mutex);
+	size_t                    n = 0;
 
-	boost::system::error_code ec;
+	for (std::vector<operation>::const_iterator i = b._ops.begin(), e = b._ops.end(); i != e; ++i)
+		n += apply(*i);
 
-	remove_by_src(res, ec);
-	_map_by_src.erase(res);
-	throw_on_error(ec, "opmip::sys::route_table::remove_by_src");
+	submit();
+	b.clear();
 
-	return true;
+	return n;
 }
 
-std::pair<route_table::const_iterator, bool> route_table::add_by_dst(const ip::prefix_v6& prefix, uint device, const ip::address_v6& gateway)
+void route_table::clear()
 {
-	std::pair<iterator, bool> res = _map_by_dst.insert(map::value_type(prefix, entry(device, gateway)));
-
-	if (!res.second)
-		return res;
+	boost::mutex::scoped_lock lock(_mutex);
 
+	for (iterator i = _map_by_src.begin(), e = _map_by_src.end(); i != e; ++i)
+		push_request(rtnl::route::m_del, true, *i, completion_handler());
 
-	boost::system::error_code ec;
-
-	add_by_dst(res.first, ec);
-	if (ec) {
-		_map_by_dst.erase(res.first);
-		boost::throw_exception(boost::system::system_error(ec, "opmip::sys::route_table::add_by_dst"));
+	for (iterator i = _map_by_dst.begin(), e = _map_by_dst.end(); i != e; ++i)
+		push_request(rtnl::route::m_del, false, *i, completion_handler());
 
-		return std::pair<const_iterator, bool>(_map_by_dst.end(), false);
-	}
+	_map_by_src.clear();
+	_map_by_dst.clear();
+	submit();
+	lock.unlock();
 
-	return res;
+	_rtnl.wait();
 }
 
-std::pair<route_table::const_iterator, bool> route_table::find_by_dst(const ip::prefix_v6& prefix) const
+void route_table::release()
 {
-	std::pair<const_iterator, bool> res(_map_by_dst.find(prefix), true);
+	boost::mutex::scoped_lock lock(_mutex);
 
-	if (res.first == _map_by_dst.end())
-		res.second = false;
+	_map_by_src.clear();
+	_map_by_dst.clear();
+	lock.unlock();
 
-	return res;
+	_rtnl.wait();
 }
 
-bool route_table::remove_by_dst(const ip::prefix_v6& prefix)
+bool route_table::commit(const operation& op)
 {
-	iterator res = _map_by_dst.find(prefix);
+	boost::mutex::scoped_lock lock(_mutex);
 
-	if (res == _map_by_dst.end())
+	if (!apply(op))
 		return false;
 
-
-	boost::system::error_code ec;
-
-	remove_by_dst(res, ec);
-	_map_by_dst.erase(res);
-	throw_on_error(ec, "opmip::sys::route_table::remove_by_dst");
-
+	submit();
 	return true;
 }
 
-void route_table::clear()
+bool route_table::find(const map& routes, const ip_prefix& prefix, entry& e) const
 {
-	boost::system::error_code ec;
+	boost::mutex::scoped_lock lock(_mutex);
+	map::const_iterator       i = routes.find(prefix);
 
-	for (iterator i = _map_by_src.begin(), e = _map_by_src.end(); i != e; ++i)
-		remove_by_src(i, ec);
+	if (i == routes.end())
+		return false;
 
-	for (iterator i = _map_by_dst.begin(), e = _map_by_dst.end(); i != e; ++i)
-		remove_by_dst(i, ec);
+	e = i->second;
+	return true;
 }
 
-void route_table::add_by_src(iterator& entry, boost::system::error_code& ec)
+bool route_table::apply(const operation& op)
 {
-	BOOST_ASSERT(entry->first.length() <= 128);
-
-	nl::message<rtnl::route> rtmsg;
-
-	rtmsg.mtype(rtnl::route::m_new);
-	rtmsg.flags(nl::header::request | nl::header::ack | nl::header::create | nl::header::replace);
-	rtmsg.sequence(++_rtnl_seq);
-	rtmsg->family = AF_INET6;
-	rtmsg->src_len = entry->first.length();
-	rtmsg->table = rtnl::route::table_main;
-	rtmsg->protocol = rtnl::route::proto_static;
-	rtmsg->type = rtnl::route::r_unicast;
-
-	if (!entry->second.gateway.is_unspecified()) {
-		ip::prefix_v6::bytes_type gw = entry->second.gateway.to_bytes();
-		rtmsg.push_attribute(rtnl::route::attr_gateway, gw.begin(), gw.size());
+	map&                      routes = op.by_src ? _map_by_src : _map_by_dst;
+	std::pair<iterator, bool> res;
+
+	switch (op.type) {
+	case operation::k_add:
+		res = routes.insert(map::value_type(op.prefix, op.route));
+		if (!res.second)
+			return false;
+
+		push_request(rtnl::route::m_new, op.by_src, *res.first,
+		             boost::bind(&route_table::add_completion, this, _1, boost::ref(routes),
+		                         op.prefix, op.route, op.handler));
+		break;
+
+	case operation::k_replace:
+		res = routes.insert(map::value_type(op.prefix, op.route));
+		if (res.second) {
+			push_request(rtnl::route::m_new, op.by_src, *res.first,
+			             boost::bind(&route_table::add_completion, this, _1, boost::ref(routes),
+			                         op.prefix, op.route, op.handler));
+			break;
+		}
+
+		if (res.first->second == op.route)
+			return false;
+
+		push_request(rtnl::route::m_new, op.by_src, map::value_type(op.prefix, op.route),
+		             boost::bind(&route_table::replace_completion, this, _1, boost::ref(routes),
+		                         op.prefix, res.first->second, op.route, op.handler));
+		res.first->second = op.route;
+		break;
+
+	case operation::k_remove:
+		res.first = routes.find(op.prefix);
+		if (res.first == routes.end())
+			return false;
+
+		push_request(rtnl::route::m_del, op.by_src, *res.first, op.handler);
+		routes.erase(res.first);
+		break;
+
+	case operation::k_purge:
+		//
+		// Any output device, the route is not known here
+		//
+		routes.erase(op.prefix);
+		push_request(rtnl::route::m_del, op.by_src, map::value_type(op.prefix, entry()), op.handler);
+		break;
 	}
 
-	ip::prefix_v6::bytes_type src = entry->first.bytes();
-	rtmsg.push_attribute(rtnl::route::attr_source, src.begin(), src.size());
+	return true;
+}
 
-	uint32 dev = entry->second.device;
-	rtmsg.push_attribute(rtnl::route::attr_output_device, &dev, sizeof(dev));
+void route_table::submit()
+{
+	if (!_requests.empty())
+		_rtnl.async_request(_requests, _handlers);
 
-	nl::checked_send(_rtnl, rtmsg.cbuffer(), ec);
-	if (ec == boost::system::errc::make_error_condition(boost::system::errc::file_exists))
-		ec = boost::system::error_code();
+	_requests.clear();
+	_handlers.clear();
 }
 
-void route_table::remove_by_src(iterator& entry, boost::system::error_code& ec)
+void route_table::add_completion(const boost::system::error_code& ec, map& routes, const ip_prefix& prefix,
+                                 const entry& route, const completion_handler& handler)
 {
-	BOOST_ASSERT(entry->first.length() <= 128);
+	boost::system::error_code res = ec;
 
-	nl::message<rtnl::route> rtmsg;
+	if (res == boost::system::errc::make_error_condition(boost::system::errc::file_exists))
+		res = boost::system::error_code();
 
-	rtmsg.mtype(rtnl::route::m_del);
-	rtmsg.flags(nl::header::request | nl::header::ack);
-	rtmsg.sequence(++_rtnl_seq);
-	rtmsg->family = AF_INET6;
-	rtmsg->src_len = entry->first.length();
-	rtmsg->table = rtnl::route::table_main;
+	if (res) {
+		boost::mutex::scoped_lock lock(_mutex);
+		iterator                  i = routes.find(prefix);
 
-	if (!entry->second.gateway.is_unspecified()) {
-		ip::prefix_v6::bytes_type gw = entry->second.gateway.to_bytes();
-		rtmsg.push_attribute(rtnl::route::attr_gateway, gw.begin(), gw.size());
+		//
+		// The route may have been removed, or removed and added again,
+		// while the request was in flight
+		//
+		if (i != routes.end() && i->second == route)
+			routes.erase(i);
 	}
 
-	ip::prefix_v6::bytes_type src = entry->first.bytes();
-	rtmsg.push_attribute(rtnl::route::attr_source, src.begin(), src.size());
-
-	uint32 dev = entry->second.device;
-	rtmsg.push_attribute(rtnl::route::attr_output_device, &dev, sizeof(dev));
-
-	nl::checked_send(_rtnl, rtmsg.cbuffer(), ec);
+	if (handler)
+		handler(res);
 }
 
-void route_table::add_by_dst(iterator& entry, boost::system::error_code& ec)
+void route_table::replace_completion(const boost::system::error_code& ec, map& routes, const ip_prefix& prefix,
+                                     const entry& prev, const entry& route, const completion_handler& handler)
 {
-	BOOST_ASSERT(entry->first.length() <= 128);
-
-	nl::message<rtnl::route> rtmsg;
-
-	rtmsg.mtype(rtnl::route::m_new);
-	rtmsg.flags(nl::header::request | nl::header::ack | nl::header::create | nl::header::replace);
-	rtmsg.sequence(++_rtnl_seq);
-	rtmsg->family = AF_INET6;
-	rtmsg->dst_len = entry->first.length();
-	rtmsg->table = rtnl::route::table_main;
-	rtmsg->protocol = rtnl::route::proto_static;
-	rtmsg->type = rtnl::route::r_unicast;
-
-	if (!entry->second.gateway.is_unspecified()) {
-		ip::prefix_v6::bytes_type gw = entry->second.gateway.to_bytes();
-		rtmsg.push_attribute(rtnl::route::attr_gateway, gw.begin(), gw.size());
+	if (ec) {
+		boost::mutex::scoped_lock lock(_mutex);
+		iterator                  i = routes.find(prefix);
+
+		//
+		// A failed replace leaves the kernel route untouched, restore it
+		// unless the entry changed again meanwhile
+		//
+		if (i != routes.end() && i->second == route)
+			i->second = prev;
 	}
 
-	ip::prefix_v6::bytes_type dst = entry->first.bytes();
-	rtmsg.push_attribute(rtnl::route::attr_destination, dst.begin(), dst.size());
-
-	uint32 dev = entry->second.device;
-	rtmsg.push_attribute(rtnl::route::attr_output_device, &dev, sizeof(dev));
-
-	nl::checked_send(_rtnl, rtmsg.cbuffer(), ec);
-	if (ec == boost::system::errc::make_error_condition(boost::system::errc::file_exists))
-		ec = boost::system::error_code();
+	if (handler)
+		handler(ec);
 }
 
-void route_table::remove_by_dst(iterator& entry, boost::system::error_code& ec)
+void route_table::push_request(uint16 mtype, bool by_src, const map::value_type& entry, const completion_handler& handler)
 {
-	BOOST_ASSERT(entry->first.length() <= 128);
+	BOOST_ASSERT(entry.first.length() <= 128);
 
-	nl::message<rtnl::route> rtmsg;
+	uint16       flags = (mtype == rtnl::route::m_new) ? (nl::header::create | nl::header::replace) : 0;
+	rtnl::route& rt = _requests.push_message<rtnl::route>(mtype, flags);
 
-	rtmsg.mtype(rtnl::route::m_del);
-	rtmsg.flags(nl::header::request | nl::header::ack);
-	rtmsg.sequence(++_rtnl_seq);
-	rtmsg->family = AF_INET6;
-	rtmsg->dst_len = entry->first.length();
-	rtmsg->table = rtnl::route::table_main;
+	rt.family = AF_INET6;
+	rt.table = rtnl::route::table_main;
 
-	if (!entry->second.gateway.is_unspecified()) {
-		ip::prefix_v6::bytes_type gw = entry->second.gateway.to_bytes();
-		rtmsg.push_attribute(rtnl::route::attr_gateway, gw.begin(), gw.size());
+	if (mtype == rtnl::route::m_new) {
+		rt.protocol = rtnl::route::proto_static;
+		rt.type = rtnl::route::r_unicast;
 	}
 
-	ip::prefix_v6::bytes_type dst = entry->first.bytes();
-	rtmsg.push_attribute(rtnl::route::attr_destination, dst.begin(), dst.size());
+	if (by_src)
+		rt.src_len = entry.first.length();
+	else
+		rt.dst_len = entry.first.length();
+
+	if (!entry.second.gateway.is_unspecified()) {
+		ip::prefix_v6::bytes_type gw = entry.second.gateway.to_bytes();
+		_requests.push_attribute(rtnl::route::attr_gateway, gw.begin(), gw.size());
+	}
 
-	uint32 dev = entry->second.device;
-	rtmsg.push_attribute(rtnl::route::attr_output_device, &dev, sizeof(dev));
+	ip::prefix_v6::bytes_type pfx = entry.first.bytes();
+
+	_requests.push_attribute(by_src ? rtnl::route::attr_source : rtnl::route::attr_destination,
+	                         pfx.begin(), pfx.size());
+
+	uint32 dev = entry.second.device;
+	_requests.push_attribute(rtnl::route::attr_output_device, &dev, sizeof(dev));
+
+	if (mtype == rtnl::route::m_new && !entry.second.remote.is_unspecified()) {
+		uint16                     type = rtnl::route::encap_ip6;
+		uint8                      hlim = k_encap_hop_limit;
+		ip::address_v6::bytes_type dst = entry.second.remote.to_bytes();
+
+		_requests.push_attribute(rtnl::route::attr_encap_type, &type, sizeof(type));
+
+		size_t encap = _requests.begin_nested(rtnl::route::attr_encap);
+		_requests.push_attribute(rtnl::route::encap_ip6_attr_destination, dst.begin(), dst.size());
+		_requests.push_attribute(rtnl::route::encap_ip6_attr_hop_limit, &hlim, sizeof(hlim));
+		_requests.end_nested(encap);
+	}
 
-	nl::checked_send(_rtnl, rtmsg.cbuffer(), ec);
+	_handlers.push_back(handler);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
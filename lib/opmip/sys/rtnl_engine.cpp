@@ -0,0 +1,293 @@
+//=============================================================================
+// Brief   : Asynchronous RTNetlink Transaction Engine
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/sys/rtnl_engine.hpp>
+#include <opmip/sys/netlink/error.hpp>
+#include <opmip/sys/netlink/message_iterator.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <linux/netlink.h>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip { namespace sys {
+
+///////////////////////////////////////////////////////////////////////////////
+rtnl_engine::rtnl_engine(boost::asio::io_service& ios)
+	: _rtnl(ios), _sequence(0), _backlog_head(0), _armed(false)
+{
+	_rtnl.open(netlink<0>());
+	_rtnl.bind(netlink<0>::endpoint());
+	_rtnl.set_option(boost::asio::socket_base::receive_buffer_size(k_receive_buffer));
+
+#ifdef NETLINK_CAP_ACK
+	//
+	// Error replies without the copy of the request, only the header is
+	// needed to match them
+	//
+	int on = 1;
+
+	::setsockopt(_rtnl.native_handle(), SOL_NETLINK, NETLINK_CAP_ACK, &on, sizeof(on));
+#endif
+}
+
+rtnl_engine::~rtnl_engine()
+{
+	wait();
+	_rtnl.close();
+}
+
+void rtnl_engine::async_request(nl::message_batch& batch, const handler_list& handlers)
+{
+	BOOST_ASSERT(handlers.empty() || handlers.size() == batch.size());
+
+	completion_list           done;
+	boost::mutex::scoped_lock lock(_mutex);
+	size_t                    n = 0;
+
+	for (nl::message_iterator i = batch.begin(), e = batch.end(); i != e; ++i, ++n) {
+		i->flags |= nl::header::request | nl::header::ack;
+		i->sequence = ++_sequence;
+		_backlog.push_back(request_queue::value_type(i->sequence,
+		                                             handlers.empty() ? completion_handler() : handlers[n]));
+	}
+
+	_backlog_data.insert(_backlog_data.end(), batch.data(), batch.data() + batch.length());
+	flush(done);
+	post(done);
+}
+
+void rtnl_engine::wait(uint timeout)
+{
+	completion_list           done;
+	boost::mutex::scoped_lock lock(_mutex);
+
+	//
+	// Replies are read here directly, cooperating with the asynchronous
+	// reader, the io_service may no longer be running when draining
+	//
+	for (;;) {
+		flush(done);
+		if (_pending.empty()) {
+			if (_backlog.empty())
+				break;
+			continue;
+		}
+
+		::pollfd pfd = { _rtnl.native_handle(), POLLIN, 0 };
+		int      res;
+
+		lock.unlock();
+		res = ::poll(&pfd, 1, timeout);
+		lock.lock();
+
+		if (res < 0 && errno == EINTR)
+			continue;
+
+		boost::system::error_code ec;
+
+		if (res < 0)
+			ec = boost::system::error_code(errno, boost::system::system_category());
+		else if (!res)
+			ec = boost::asio::error::timed_out;
+		else
+			receive(done, ec);
+
+		if (ec) {
+			abort(ec, done);
+			for (request_queue::iterator i = _backlog.begin(), e = _backlog.end(); i != e; ++i)
+				if (i->second)
+					done.push_back(completion_list::value_type(i->second, ec));
+			_backlog.clear();
+			_backlog_data.clear();
+			_backlog_head = 0;
+			break;
+		}
+	}
+
+	lock.unlock();
+	complete(done);
+}
+
+size_t rtnl_engine::pending() const
+{
+	boost::mutex::scoped_lock lock(_mutex);
+
+	return _pending.size() + _backlog.size();
+}
+
+void rtnl_engine::queue(boost::asio::const_buffers_1 buffer, uint32 sequence, const completion_handler& handler)
+{
+	const uchar* data = boost::asio::buffer_cast<const uchar*>(buffer);
+
+	_backlog.push_back(request_queue::value_type(sequence, handler));
+	_backlog_data.insert(_backlog_data.end(), data, data + boost::asio::buffer_size(buffer));
+}
+
+void rtnl_engine::flush(completion_list& done)
+{
+	if (_backlog.empty() || _pending.size() >= k_max_in_flight)
+		return;
+
+	//
+	// The backlog messages are contiguous, as many as the window allows go
+	// out in a single send
+	//
+	size_t count = std::min<size_t>(k_max_in_flight - _pending.size(), _backlog.size());
+	uchar* data = &_backlog_data[_backlog_head];
+	size_t length = 0;
+
+	for (size_t i = 0; i < count; ++i)
+		length += align_to<4>(reinterpret_cast<nl::header*>(data + length)->length);
+
+	boost::system::error_code ec;
+
+	_rtnl.send(boost::asio::const_buffers_1(data, length), 0, ec);
+
+	for (size_t i = 0; i < count; ++i) {
+		if (!ec)
+			_pending.insert(_backlog.front());
+		else if (_backlog.front().second)
+			done.push_back(completion_list::value_type(_backlog.front().second, ec));
+		_backlog.pop_front();
+	}
+
+	_backlog_head += length;
+	if (_backlog.empty()) {
+		_backlog_data.clear();
+		_backlog_head = 0;
+
+	} else if (_backlog_head > _backlog_data.size() / 2) {
+		_backlog_data.erase(_backlog_data.begin(), _backlog_data.begin() + _backlog_head);
+		_backlog_head = 0;
+	}
+
+	if (!_pending.empty() && !_armed)
+		arm();
+}
+
+void rtnl_engine::arm()
+{
+	_armed = true;
+	_rtnl.async_receive(boost::asio::null_buffers(),
+	                    boost::bind(&rtnl_engine::receive_handler, this, _1));
+}
+
+void rtnl_engine::receive_handler(const boost::system::error_code& ec)
+{
+	if (ec == boost::asio::error::operation_aborted)
+		return;
+
+	completion_list           done;
+	boost::mutex::scoped_lock lock(_mutex);
+
+	boost::system::error_code rec = ec;
+
+	_armed = false;
+	if (!rec)
+		receive(done, rec);
+	if (rec)
+		abort(rec, done);
+
+	flush(done);
+	if (!_pending.empty() && !_armed)
+		arm();
+
+	lock.unlock();
+	complete(done);
+}
+
+void rtnl_engine::receive(completion_list& done, boost::system::error_code& ec)
+{
+	for (;;) {
+		ssize_t len = ::recv(_rtnl.native_handle(), _buffer, sizeof(_buffer), MSG_DONTWAIT);
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+
+			//
+			// On overrun the kernel dropped replies, there is no way of
+			// knowing which, so every request in flight is failed. What is
+			// still queued is drained, the kernel stops queueing replies
+			// until the socket is read
+			//
+			if (errno == ENOBUFS) {
+				abort(boost::system::error_code(errno, boost::system::system_category()), done);
+				continue;
+			}
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				ec = boost::system::error_code(errno, boost::system::system_category());
+			return;
+		}
+
+		nl::message_iterator mit(_buffer, len);
+		nl::message_iterator end;
+
+		for (; mit != end; ++mit) {
+			if (mit->type != nl::header::m_error)
+				continue;
+
+			pending_map::iterator i = _pending.find(mit->sequence);
+
+			if (i == _pending.end())
+				continue;
+
+			nl::message<nl::error>    err(mit);
+			boost::system::error_code rec;
+
+			if (err->error)
+				rec = boost::system::error_code(-err->error, boost::system::system_category());
+			if (i->second)
+				done.push_back(completion_list::value_type(i->second, rec));
+			_pending.erase(i);
+		}
+	}
+}
+
+void rtnl_engine::abort(const boost::system::error_code& ec, completion_list& done)
+{
+	for (pending_map::iterator i = _pending.begin(), e = _pending.end(); i != e; ++i)
+		if (i->second)
+			done.push_back(completion_list::value_type(i->second, ec));
+
+	_pending.clear();
+}
+
+void rtnl_engine::post(completion_list& done)
+{
+	//
+	// Submission errors are reported from the io_service, the caller may
+	// hold locks its completion handlers also take
+	//
+	for (completion_list::iterator i = done.begin(), e = done.end(); i != e; ++i)
+		_rtnl.get_io_service().post(boost::bind(i->first, i->second));
+}
+
+void rtnl_engine::complete(completion_list& done)
+{
+	for (completion_list::iterator i = done.begin(), e = done.end(); i != e; ++i)
+		i->first(i->second);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace sys */ } /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,187 @@
+//=============================================================================
+// Brief   : Hierarchical Timer Wheel
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/timer_wheel.hpp>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+timer_wheel::timer_wheel(strand& srv, const handler_type& handler, uint resolution)
+	: _service(srv), _timer(srv.get_io_service()), _handler(handler),
+	  _resolution(resolution ? resolution : 1), _epoch(ptime::get_monotonic()),
+	  _now(0), _count(0), _armed(false), _tick_memory_used(false)
+{
+	for (uint l = 0; l < k_levels; ++l)
+		for (uint64 i = 0; i < k_slots; ++i)
+			_slots[l][i].init();
+}
+
+timer_wheel::~timer_wheel()
+{
+	clear();
+	_timer.cancel();
+}
+
+void timer_wheel::schedule(timer_wheel_hook& hook, uint64 ms)
+{
+	uint64 ticks = (ms + _resolution - 1) / _resolution;
+
+	if (hook.is_scheduled())
+		cancel(hook);
+
+	//
+	// The wheel stops ticking when empty, catch up with the clock before
+	// using it as the reference for the new expiration
+	//
+	if (!_armed)
+		_now = current();
+
+	if (!ticks)
+		ticks = 1;
+	else if (ticks > k_max_ticks)
+		ticks = k_max_ticks;
+
+	hook.expires = _now + ticks;
+	insert(hook);
+	++_count;
+
+	if (!_armed)
+		arm();
+}
+
+void timer_wheel::cancel(timer_wheel_hook& hook)
+{
+	if (!hook.is_scheduled())
+		return;
+
+	hook.remove();
+	hook.init();
+	--_count;
+}
+
+void timer_wheel::clear()
+{
+	for (uint l = 0; l < k_levels; ++l) {
+		for (uint64 i = 0; i < k_slots; ++i) {
+			list_hook& slot = _slots[l][i];
+
+			while (!slot.empty())
+				slot.pop_front()->init();
+		}
+	}
+
+	_count = 0;
+}
+
+void timer_wheel::tick(const boost::system::error_code& ec)
+{
+	if (ec) {
+		_armed = false;
+		return;
+	}
+
+	uint64 target = current();
+
+	//
+	// Handlers may reschedule while stepping, the wheel is still armed so
+	// the reference tick is kept until all pending ticks are processed
+	//
+	while (_now < target && _count)
+		step();
+
+	if (!_count) {
+		_now = target;
+		_armed = false;
+		return;
+	}
+
+	arm();
+}
+
+void timer_wheel::step()
+{
+	++_now;
+
+	//
+	// When the lower level wraps around move the entries of the next slot
+	// of the upper level down, they now fall within the lower level range
+	//
+	for (uint l = 1; l < k_levels && !(_now & ((uint64(1) << (l * k_slot_bits)) - 1)); ++l) {
+		list_hook& slot = _slots[l][(_now >> (l * k_slot_bits)) & k_slot_mask];
+
+		while (!slot.empty())
+			insert(*static_cast<timer_wheel_hook*>(slot.pop_front()));
+	}
+
+	list_hook& slot = _slots[0][_now & k_slot_mask];
+
+	while (!slot.empty()) {
+		timer_wheel_hook& hook = *static_cast<timer_wheel_hook*>(slot.pop_front());
+
+		hook.init();
+		--_count;
+		_handler(hook);
+	}
+}
+
+void timer_wheel::insert(timer_wheel_hook& hook)
+{
+	uint64 delta = hook.expires - _now;
+	uint   level = 0;
+
+	while (level < (k_levels - 1) && delta >= (uint64(1) << ((level + 1) * k_slot_bits)))
+		++level;
+
+	_slots[level][(hook.expires >> (level * k_slot_bits)) & k_slot_mask].push_back(&hook);
+}
+
+void timer_wheel::arm()
+{
+	_armed = true;
+	_timer.expires_from_now(boost::posix_time::milliseconds(_resolution));
+	_timer.async_wait(_service.wrap(tick_handler(this)));
+}
+
+void* timer_wheel::tick_allocate(size_t size)
+{
+	if (_tick_memory_used || size > sizeof(_tick_memory))
+		return ::operator new(size);
+
+	_tick_memory_used = true;
+	return &_tick_memory;
+}
+
+void timer_wheel::tick_deallocate(void* ptr)
+{
+	if (ptr != &_tick_memory)
+		::operator delete(ptr);
+	else
+		_tick_memory_used = false;
+}
+
+uint64 timer_wheel::current() const
+{
+	ptime elapsed = ptime::get_monotonic() - _epoch;
+
+	return (uint64(elapsed.seconds()) * 1000 + elapsed.nanoseconds() / 1000000) / _resolution;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
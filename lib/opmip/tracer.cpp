@@ -0,0 +1,148 @@
+//=============================================================================
+// Brief   : Per Stage Latency Tracer
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/tracer.hpp>
+#include <opmip/exception.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+namespace opmip {
+
+///////////////////////////////////////////////////////////////////////////////
+static const uint32 k_file_version = 1;
+
+///////////////////////////////////////////////////////////////////////////////
+tracer::tracer(const char* const names[], uint stages)
+	: _names(names), _stages(stages), _sample_rate(0), _sampled(0),
+	  _file(nullptr), _ring(nullptr), _file_size(0)
+{
+	BOOST_ASSERT(stages > 1 && stages <= k_max_stages);
+}
+
+tracer::~tracer()
+{
+	close();
+}
+
+void tracer::open(const std::string& path, uint sample_rate, uint capacity)
+{
+	BOOST_ASSERT(sample_rate && capacity);
+
+	close();
+
+	size_t size = sizeof(file_header) + sizeof(file_record) * capacity;
+	int    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0 || ::ftruncate(fd, size) < 0) {
+		boost::system::error_code ec(errno, boost::system::system_category());
+
+		if (fd >= 0)
+			::close(fd);
+		throw_exception(ec, "Failed to create \"" + path + "\" trace file");
+	}
+
+	void* mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mem == MAP_FAILED)
+		throw_exception(boost::system::error_code(errno, boost::system::system_category()),
+		                "Failed to map \"" + path + "\" trace file");
+
+	//
+	// The file is truncated to zero first, so every slot starts with a
+	// sequence of 0, i.e. empty
+	//
+	file_header* hdr = static_cast<file_header*>(mem);
+
+	std::memcpy(hdr->magic, "OPMIPTRC", sizeof(hdr->magic));
+	hdr->version = k_file_version;
+	hdr->stages = _stages;
+	hdr->capacity = capacity;
+	hdr->record_size = sizeof(file_record);
+	hdr->head = 0;
+	for (uint i = 0; i < _stages; ++i)
+		std::strncpy(hdr->names[i], _names[i], k_name_size - 1);
+
+	_ring = reinterpret_cast<file_record*>(hdr + 1);
+	_file_size = size;
+	_sample_rate = sample_rate;
+	__atomic_store_n(&_file, hdr, __ATOMIC_RELEASE);
+}
+
+void tracer::close()
+{
+	file_header* hdr = __atomic_exchange_n(&_file, nullptr, __ATOMIC_ACQ_REL);
+
+	if (hdr)
+		::munmap(hdr, _file_size);
+}
+
+void tracer::commit(const record& rec)
+{
+	uint64 first = rec.stamps[0];
+	uint64 prev = first;
+
+	for (uint i = 1; i < _stages; ++i) {
+		if (!rec.stamps[i])
+			continue;
+
+		if (prev)
+			_histograms[i].record((rec.stamps[i] - prev) / 1000);
+		prev = rec.stamps[i];
+	}
+
+	if (first && prev)
+		_total.record((prev - first) / 1000);
+
+	if (_file && !(__atomic_fetch_add(&_sampled, 1, __ATOMIC_RELAXED) % _sample_rate))
+		sample(rec);
+}
+
+void tracer::sample(const record& rec)
+{
+	file_header* hdr = __atomic_load_n(&_file, __ATOMIC_ACQUIRE);
+	if (!hdr)
+		return;
+
+	uint64       n = __atomic_fetch_add(&hdr->head, 1, __ATOMIC_RELAXED);
+	file_record& slot = _ring[n % hdr->capacity];
+
+	//
+	// Readers skip the slot while it is being written
+	//
+	__atomic_store_n(&slot.sequence, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	std::copy(rec.stamps, rec.stamps + k_max_stages, slot.stamps);
+	__atomic_store_n(&slot.sequence, n + 1, __ATOMIC_RELEASE);
+}
+
+void tracer::register_metrics(metrics::registry& reg, const std::string& name, const std::string& help) const
+{
+	for (uint i = 1; i < _stages; ++i)
+		reg.add(name + "_stage_seconds", help + ", time since the previous stage", _histograms[i],
+		        std::string("stage=\"") + _names[i] + '"');
+
+	reg.add(name + "_seconds", help + ", end to end", _total);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+} /* namespace opmip */
+
+// EOF ////////////////////////////////////////////////////////////////////////
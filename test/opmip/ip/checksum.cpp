@@ -0,0 +1,175 @@
+//=============================================================================
+// Brief   : IP One's Complemente Checksum Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/ip/checksum.hpp>
+#include <opmip/ip/icmp_options.hpp>
+#include <opmip/net/ip/icmp6_ra_packet.hpp>
+#include <opmip/net/ip/ipv6_packet.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const char* kernel_name[] = { "scalar", "sse2", "avx2" };
+
+///
+/// RFC 1071 straight from the definition, in network byte order
+///
+static uint16 reference(const uchar* data, size_t len)
+{
+	uint64 sum = 0;
+
+	for (size_t i = 0; i < len; i += 2)
+		sum += (uint64(data[i]) << 8) | (i + 1 < len ? data[i + 1] : 0);
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~uint16(sum);
+}
+
+static uint16 one_shot(const uchar* data, size_t len)
+{
+	ip::checksum cs;
+
+	cs.update(data, len);
+	return ntohs(cs.final());
+}
+
+static uint ra_checksum(const net::ip::icmp6_ra_packet& ra)
+{
+	const uchar* hdr = boost::asio::buffer_cast<const uchar*>(ra.cbuffer().front());
+
+	return (uint(hdr[2]) << 8) | hdr[3];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	std::vector<uchar> data(1 << 20);
+	uint               errors = 0;
+
+	std::srand(1);
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = uchar(std::rand());
+
+	//
+	// RFC 1071, section 3
+	//
+	static const uchar rfc1071[] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7 };
+
+	if (one_shot(rfc1071, sizeof(rfc1071)) != uint16(~0xddf2))
+		++errors;
+
+	//
+	// Every kernel, every length up to a few vectors and every alignment,
+	// and the lane overflow on large runs of ones
+	//
+	for (uint k = ip::checksum::k_scalar; k <= ip::checksum::k_avx2; ++k) {
+		if (!ip::checksum::select(ip::checksum::kernel(k)))
+			continue;
+
+		for (size_t off = 0; off < 4; ++off)
+			for (size_t len = 0; len < 300; ++len)
+				if (one_shot(&data[off], len) != reference(&data[off], len))
+					++errors;
+
+		std::vector<uchar> ones(data.size(), 0xff);
+
+		if (one_shot(&data[0], data.size()) != reference(&data[0], data.size())
+		    || one_shot(&ones[0], ones.size()) != reference(&ones[0], ones.size()))
+			++errors;
+
+		std::cout << "checksum: " << kernel_name[k] << " errors = " << errors << std::endl;
+	}
+
+	//
+	// Chunks of any length sum as the contiguous data
+	//
+	for (size_t i = 0; i < 1000; ++i) {
+		size_t       len = std::rand() % 1500;
+		size_t       pos = 0;
+		ip::checksum cs;
+
+		while (pos < len) {
+			size_t n = std::min(len - pos, size_t(std::rand() % 64));
+
+			cs.update(&data[pos], n);
+			pos += n;
+		}
+
+		if (ntohs(cs.final()) != reference(&data[0], len))
+			++errors;
+	}
+
+	//
+	// Incremental updates
+	//
+	for (size_t i = 0; i < 1000; ++i) {
+		std::vector<uchar> pkt(data.begin(), data.begin() + 64);
+		ip::checksum       cs;
+		size_t             pos = (std::rand() % 28) * 2;
+		uchar              old_data[8];
+		uint16             old_word;
+		uint16             new_word = uint16(std::rand());
+		uint16             sum;
+
+		cs.update(&pkt[0], pkt.size());
+		sum = cs.final();
+
+		std::memcpy(&old_word, &pkt[pos], 2);
+		std::memcpy(&pkt[pos], &new_word, 2);
+		sum = ip::checksum::adjust(sum, old_word, new_word);
+
+		std::memcpy(old_data, &pkt[pos], sizeof(old_data));
+		std::memcpy(&pkt[pos], &data[1000 + i], sizeof(old_data));
+		sum = ip::checksum::adjust(sum, old_data, &pkt[pos], sizeof(old_data));
+
+		if (ntohs(sum) != reference(&pkt[0], pkt.size()))
+			++errors;
+	}
+
+	//
+	// Router advertisements rechecksummed in place
+	//
+	ip::address_v6           src = ip::address_v6::from_string("fe80::1");
+	ip::address_v6           dst = ip::address_v6::from_string("ff02::1");
+	net::ip::icmp6_ra_packet ra1(64, 1800, 0, 0);
+	net::ip::icmp6_ra_packet ra2(64, 0, 0, 0);
+
+	ra1.add_option<ip::opt_mtu>()->set(1460);
+	ra2.add_option<ip::opt_mtu>()->set(1460);
+
+	net::ip::ipv6_packet pkt1(src, dst, 255, ra1);
+	net::ip::ipv6_packet pkt2(src, dst, 255, ra2);
+
+	ra1.lifetime(0);
+	if (ra_checksum(ra1) != ra_checksum(ra2))
+		++errors;
+
+	std::cout << "checksum: kernel = " << kernel_name[ip::checksum::selected()]
+	          << ", errors = " << errors << std::endl;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,227 @@
+//=============================================================================
+// Brief   : Asynchronous Logging Backend Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/logger.hpp>
+#include <opmip/log_backend.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <new>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Ring buffers are the only arrays of the ring size, those alive are counted.
+// Arrays keep their size in front of them.
+//
+static const std::size_t k_header = 16;
+static int               rings;
+
+void* operator new[](std::size_t n)
+{
+	opmip::uchar* p = static_cast<opmip::uchar*>(std::malloc(k_header + n));
+
+	if (!p)
+		throw std::bad_alloc();
+
+	*reinterpret_cast<std::size_t*>(p) = n;
+	if (n == opmip::log_backend::k_ring_size)
+		__atomic_fetch_add(&rings, 1, __ATOMIC_RELAXED);
+	return p + k_header;
+}
+
+void operator delete[](void* p) throw()
+{
+	if (!p)
+		return;
+
+	opmip::uchar* h = static_cast<opmip::uchar*>(p) - k_header;
+
+	if (*reinterpret_cast<std::size_t*>(h) == opmip::log_backend::k_ring_size)
+		__atomic_fetch_sub(&rings, 1, __ATOMIC_RELAXED);
+	std::free(h);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const uint k_threads       = 4;
+static const uint k_lines         = 20000;
+static const uint k_short_threads = 64;
+
+static std::ostringstream sink;
+static logger             log_("test", sink);
+
+///////////////////////////////////////////////////////////////////////////////
+static void run(uint id)
+{
+	//
+	// The non literal string must be copied, its buffer is gone by the
+	// time the backend formats the record
+	//
+	for (uint i = 0; i < k_lines; ++i) {
+		std::string tmp("thread");
+		log_(0, tmp.c_str(), " ", id, " line ", i);
+
+		if (!(i % 1000))
+			boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+	}
+}
+
+static void run_short(uint id)
+{
+	log_(0, "short thread ", id);
+}
+
+static void run_late(boost::barrier& logged, boost::barrier& gone)
+{
+	log_(0, "late thread");
+	logged.wait();
+	gone.wait();
+}
+
+static bool wait_rings(int n)
+{
+	for (uint i = 0; i < 1000; ++i) {
+		if (__atomic_load_n(&rings, __ATOMIC_RELAXED) == n)
+			return true;
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	uint64 dropped;
+	{
+		log_backend         backend;
+		boost::thread_group tg;
+
+		for (uint i = 0; i < k_threads; ++i)
+			tg.create_thread(boost::bind(&run, i));
+		tg.join_all();
+
+		dropped = backend.dropped();
+	}
+
+	//
+	// Lines of each thread are written in order, some may be missing if
+	// its ring overflowed
+	//
+	std::istringstream in(sink.str());
+	std::string        line;
+	std::vector<int>   last(k_threads, -1);
+	uint64             lines = 0;
+	uint               errors = 0;
+
+	while (std::getline(in, line)) {
+		std::istringstream ln(line);
+		std::string        name, thread, word;
+		uint               id;
+		int                n;
+
+		ln >> name >> thread >> id >> word >> n;
+		if (name != "test:" || thread != "thread" || id >= k_threads || word != "line" || n <= last[id]) {
+			std::cerr << "bad line: " << line << std::endl;
+			++errors;
+			continue;
+		}
+
+		last[id] = n;
+		++lines;
+	}
+
+	std::cout << "log backend: " << lines << " lines, " << dropped << " dropped" << std::endl;
+
+	if (lines + dropped != k_threads * k_lines)
+		++errors;
+
+	//
+	// Without a backend lines are written right away
+	//
+	sink.str(std::string());
+	log_(0, "sync");
+	if (sink.str() != "test: sync\n")
+		++errors;
+
+	//
+	// A string too long to be copied into the record is not cut, the line
+	// is written right away instead
+	//
+	{
+		log_backend backend;
+		std::string str(3 * detail::k_log_string_size, 'x');
+
+		sink.str(std::string());
+		log_(0, str, "!");
+		if (sink.str() != "test: " + str + "!\n")
+			++errors;
+	}
+
+	//
+	// The ring of a thread is freed once drained after the thread exits,
+	// the ring of a thread outliving the backend by the thread itself
+	//
+	{
+		boost::barrier logged(2);
+		boost::barrier gone(2);
+		boost::thread  late;
+
+		{
+			log_backend backend;
+
+			sink.str(std::string());
+			for (uint i = 0; i < k_short_threads; ++i)
+				boost::thread(boost::bind(&run_short, i)).join();
+
+			late = boost::thread(boost::bind(&run_late, boost::ref(logged), boost::ref(gone)));
+			logged.wait();
+
+			if (!wait_rings(1)) {
+				std::cerr << "rings of exited threads not freed: " << rings << std::endl;
+				++errors;
+			}
+		}
+
+		gone.wait();
+		late.join();
+
+		if (rings) {
+			std::cerr << "ring of the late thread not freed" << std::endl;
+			++errors;
+		}
+
+		std::istringstream in(sink.str());
+		uint               n = 0;
+
+		while (std::getline(in, line))
+			++n;
+		if (n != k_short_threads + 1)
+			++errors;
+	}
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,165 @@
+//=============================================================================
+// Brief   : Performance Metrics Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/metrics.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const uint k_threads = 4;
+static const uint k_records = 100000;
+
+///////////////////////////////////////////////////////////////////////////////
+static void run(metrics::histogram& h, metrics::counter& c)
+{
+	for (uint i = 0; i < k_records; ++i) {
+		h.record(i % 1000);
+		c.inc();
+	}
+}
+
+static bool contains(const std::string& str, const std::string& line)
+{
+	return str.find(line + '\n') != std::string::npos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	typedef metrics::histogram histogram;
+
+	uint errors = 0;
+
+	//
+	// Every value falls in a bucket whose bounds hold it, bucket bounds
+	// are contiguous and within 1/8 of each other
+	//
+	for (uint64 v = 0; v < (uint64(1) << 20); v = v < 64 ? v + 1 : v + v / 7) {
+		uint b = histogram::bucket(v);
+
+		if (histogram::bucket_low(b) > v || histogram::bucket_high(b) < v) {
+			std::cerr << "bad bucket " << b << " for " << v << std::endl;
+			++errors;
+		}
+	}
+	for (uint b = 1; b < histogram::k_buckets; ++b) {
+		if (histogram::bucket_high(b - 1) + 1 != histogram::bucket_low(b))
+			++errors;
+		if (b + 1 < histogram::k_buckets && histogram::bucket_low(b) >= histogram::k_sub_count
+		    && (histogram::bucket_high(b) - histogram::bucket_low(b)) * histogram::k_sub_count > histogram::bucket_low(b))
+			++errors;
+	}
+
+	//
+	// Values from 2^k_max_bits up are clamped to the last bucket, the ones
+	// just below still have their own
+	//
+	if (histogram::bucket((uint64(1) << histogram::k_max_bits) - 1) != histogram::k_buckets - 1
+	    || histogram::bucket(uint64(1) << histogram::k_max_bits) != histogram::k_buckets - 1
+	    || histogram::bucket(uint64(1) << (histogram::k_max_bits + 1)) != histogram::k_buckets - 1
+	    || histogram::bucket(~uint64(0)) != histogram::k_buckets - 1)
+		++errors;
+	if (histogram::bucket(uint64(1) << (histogram::k_max_bits - 1)) >= histogram::k_buckets - 1)
+		++errors;
+
+	histogram edge;
+
+	edge.record(uint64(1) << histogram::k_max_bits);
+	edge.record(~uint64(0));
+	if (edge.count() != 2 || edge.count_below(~uint64(0)) != 0
+	    || edge.quantile(1.0) != histogram::bucket_high(histogram::k_buckets - 1))
+		++errors;
+
+	//
+	// Concurrent recording loses nothing
+	//
+	histogram           h;
+	metrics::counter    c;
+	metrics::gauge      g;
+	boost::thread_group tg;
+
+	for (uint i = 0; i < k_threads; ++i)
+		tg.create_thread(boost::bind(&run, boost::ref(h), boost::ref(c)));
+	tg.join_all();
+
+	if (h.count() != k_threads * k_records || c.value() != k_threads * k_records)
+		++errors;
+	if (h.sum() != uint64(k_threads) * (k_records / 1000) * (999 * 1000 / 2))
+		++errors;
+
+	uint64 p50 = h.quantile(0.5);
+	uint64 p99 = h.quantile(0.99);
+
+	std::cout << "histogram: count = " << h.count() << ", p50 = " << p50 << ", p99 = " << p99 << std::endl;
+
+	if (p50 < 499 || p50 > 499 + 499 / 8 || p99 < 989 || p99 > 989 + 989 / 8)
+		++errors;
+
+	if (h.count_below(64) != k_threads * (k_records / 1000) * 64)
+		++errors;
+
+	//
+	// Prometheus text export
+	//
+	metrics::registry  reg;
+	std::ostringstream out;
+
+	g.set(3);
+	g.dec();
+	reg.add("test_total", "Test counter", c, "kind=\"a\"");
+	reg.add("test_gauge", "Test gauge", g);
+	reg.add("test_seconds", "Test histogram", h);
+	reg.write(out);
+
+	std::cout << out.str();
+
+	//
+	// A value equal to a bound is counted in that bound's bucket
+	//
+	histogram          bound;
+	metrics::registry  breg;
+	std::ostringstream bout;
+
+	bound.record(4);
+	bound.record(5);
+	breg.add("bound_seconds", "Bound histogram", bound);
+	breg.write(bout);
+
+	if (!contains(bout.str(), "bound_seconds_bucket{le=\"0.000002\"} 0")
+	    || !contains(bout.str(), "bound_seconds_bucket{le=\"0.000004\"} 1")
+	    || !contains(bout.str(), "bound_seconds_bucket{le=\"0.000008\"} 2"))
+		++errors;
+
+	if (!contains(out.str(), "# TYPE test_total counter")
+	    || !contains(out.str(), "test_total{kind=\"a\"} 400000")
+	    || !contains(out.str(), "test_gauge 2")
+	    || !contains(out.str(), "test_seconds_bucket{le=\"0.000128\"} 51200")
+	    || !contains(out.str(), "test_seconds_bucket{le=\"+Inf\"} 400000")
+	    || !contains(out.str(), "test_seconds_sum 199.800000")
+	    || !contains(out.str(), "test_seconds_count 400000"))
+		++errors;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
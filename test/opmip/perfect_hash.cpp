@@ -0,0 +1,106 @@
+//=============================================================================
+// Brief   : Minimal Perfect Hash Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/perfect_hash.hpp>
+#include <iostream>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const size_t k_sizes[] = { 0, 1, 2, 3, 7, 100, 4096, 100000 };
+
+static uint64 next_hash(uint64& state)
+{
+	state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return state ^ (state >> 29);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	uint errors = 0;
+
+	for (size_t t = 0; t < sizeof(k_sizes) / sizeof(k_sizes[0]); ++t) {
+		std::vector<uint64> hashes;
+		std::vector<bool>   used(k_sizes[t], false);
+		uint64              state = k_sizes[t];
+		perfect_hash        ph;
+
+		for (size_t i = 0; i < k_sizes[t]; ++i)
+			hashes.push_back(next_hash(state));
+
+		if (!ph.build(hashes) || ph.size() != k_sizes[t]) {
+			std::cerr << "build failed for " << k_sizes[t] << " keys" << std::endl;
+			++errors;
+			continue;
+		}
+
+		//
+		// Every key gets its own slot, and there are no more slots than keys
+		//
+		for (size_t i = 0; i < hashes.size(); ++i) {
+			uint32 s = ph.slot(hashes[i]);
+
+			if (s >= k_sizes[t] || used[s]) {
+				std::cerr << "slot " << s << " reused or out of range for " << k_sizes[t] << " keys" << std::endl;
+				++errors;
+				break;
+			}
+			used[s] = true;
+		}
+	}
+
+	//
+	// Consecutive keys, as link addresses often are
+	//
+	std::vector<std::pair<uint64, const size_t*> > values;
+	std::vector<size_t>                           objs(50000);
+	perfect_hash_index<const size_t>              index;
+
+	for (size_t i = 0; i < objs.size(); ++i) {
+		objs[i] = i;
+		values.push_back(std::make_pair(0x020000000000ULL + i, &objs[i]));
+	}
+
+	if (!index.build(values)) {
+		std::cerr << "index build failed" << std::endl;
+		++errors;
+	}
+
+	for (size_t i = 0; i < objs.size(); ++i)
+		if (index.find(0x020000000000ULL + i) != &objs[i])
+			++errors;
+
+	for (size_t i = 0; i < objs.size(); ++i)
+		if (index.find(0x030000000000ULL + i))
+			++errors;
+
+	//
+	// Duplicate hashes are refused and leave the index empty
+	//
+	values.push_back(values.front());
+	if (index.build(values) || !index.empty() || index.find(0x020000000000ULL))
+		++errors;
+
+	std::cout << "perfect_hash: " << errors << " errors" << std::endl;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
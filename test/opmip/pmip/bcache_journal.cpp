@@ -0,0 +1,223 @@
+//=============================================================================
+// Brief   : Binding Cache Journal Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/pmip/bcache_journal.hpp>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const uint k_rounds = 1 << 17;
+
+///////////////////////////////////////////////////////////////////////////////
+static pmip::bcache_journal::binding make_binding(uint n, uint16 sequence)
+{
+	pmip::bcache_journal::binding b;
+	std::ostringstream            id;
+	std::ostringstream            prefix;
+
+	id << "mn" << n << "@example.org";
+	prefix << "2001:db8:" << std::hex << (n & 0xffff) << "::";
+	b.id = id.str();
+	b.prefixes.push_back(ip::prefix_v6(ip::address_v6::from_string(prefix.str()), 64));
+	b.care_of_address = ip::address_v6::from_string("2001:db8::1");
+	b.expiry = 2000000000ULL + n;
+	b.lifetime = 3600;
+	b.sequence = sequence;
+	b.link_type = 1;
+	return b;
+}
+
+static bool find_binding(const pmip::bcache_journal::binding_list& bindings, uint n, uint16 sequence)
+{
+	pmip::bcache_journal::binding b = make_binding(n, sequence);
+
+	for (size_t i = 0; i < bindings.size(); ++i) {
+		const pmip::bcache_journal::binding& r = bindings[i];
+
+		if (r.id == b.id)
+			return r.care_of_address == b.care_of_address && r.expiry == b.expiry && r.lifetime == b.lifetime
+			       && r.sequence == b.sequence && r.link_type == b.link_type && r.prefixes == b.prefixes;
+	}
+
+	return false;
+}
+
+static off_t file_size(const std::string& path)
+{
+	struct stat st;
+
+	return ::stat(path.c_str(), &st) ? -1 : st.st_size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	char                               dir[] = "/tmp/bcache_journal-XXXXXX";
+	boost::system::error_code          ec;
+	pmip::bcache_journal::binding_list batch;
+	pmip::bcache_journal::binding_list bindings;
+	uint                               errors = 0;
+
+	if (!::mkdtemp(dir)) {
+		std::cerr << "bcache_journal: failed to create a temporary directory\n\n";
+		return 1;
+	}
+
+	std::string path = std::string(dir) + "/bcache";
+
+	//
+	// Bindings and removals survive the journal being opened again
+	//
+	{
+		pmip::bcache_journal j;
+
+		j.open(path, bindings);
+		if (!bindings.empty())
+			++errors;
+
+		for (uint n = 0; n < 3; ++n)
+			batch.push_back(make_binding(n, 1));
+		batch.push_back(make_binding(0, 2));
+		j.commit(batch, ec);
+
+		batch.push_back(pmip::bcache_journal::binding());
+		batch.back().id = make_binding(1, 0).id;
+		j.commit(batch, ec);
+
+		if (ec || !batch.empty() || j.size() != 2)
+			++errors;
+	}
+
+	{
+		pmip::bcache_journal j;
+
+		j.open(path, bindings);
+		if (bindings.size() != 2 || !find_binding(bindings, 0, 2) || !find_binding(bindings, 2, 1))
+			++errors;
+	}
+
+	//
+	// A record cut short is dropped, here the removal of mn1, and the
+	// journal goes on after the last whole one
+	//
+	off_t whole = file_size(path);
+
+	if (::truncate(path.c_str(), whole - 5) < 0)
+		++errors;
+
+	{
+		pmip::bcache_journal j;
+
+		bindings.clear();
+		j.open(path, bindings);
+		if (bindings.size() != 3 || !find_binding(bindings, 1, 1) || file_size(path) >= whole - 5)
+			++errors;
+
+		batch.push_back(make_binding(3, 1));
+		j.commit(batch, ec);
+	}
+
+	{
+		pmip::bcache_journal j;
+
+		bindings.clear();
+		j.open(path, bindings);
+		if (bindings.size() != 4 || !find_binding(bindings, 0, 2) || !find_binding(bindings, 3, 1))
+			++errors;
+	}
+
+	//
+	// Superseded records are compacted into the snapshot, in the
+	// background, done once the journal is closed
+	//
+	{
+		pmip::bcache_journal j;
+
+		bindings.clear();
+		j.open(path, bindings);
+		for (uint n = 0; n < k_rounds; ++n) {
+			batch.push_back(make_binding(n % 16, uint16(n)));
+			j.commit(batch, ec);
+			if (ec)
+				++errors;
+		}
+	}
+
+	if (file_size(path + ".snap") <= 0 || file_size(path + ".prev") >= 0 || file_size(path) >= off_t(k_rounds * 16))
+		++errors;
+
+	{
+		pmip::bcache_journal j;
+
+		bindings.clear();
+		j.open(path, bindings);
+		if (bindings.size() != 16 || !find_binding(bindings, 0, uint16(k_rounds - 16))
+		    || !find_binding(bindings, 15, uint16(k_rounds - 1)))
+			++errors;
+
+		batch.push_back(make_binding(16, 1));
+		j.commit(batch, ec);
+	}
+
+	//
+	// A journal set aside by a compaction cut short is replayed before the
+	// one that followed it, and removed by the next compaction
+	//
+	if (::rename(path.c_str(), (path + ".prev").c_str()) < 0)
+		++errors;
+
+	{
+		pmip::bcache_journal j;
+
+		bindings.clear();
+		j.open(path, bindings);
+		if (bindings.size() != 17 || !find_binding(bindings, 16, 1))
+			++errors;
+
+		batch.push_back(make_binding(16, 2));
+		j.commit(batch, ec);
+		for (uint n = 0; n < k_rounds / 2; ++n) {
+			batch.push_back(make_binding(n % 16, uint16(n)));
+			j.commit(batch, ec);
+		}
+	}
+
+	{
+		pmip::bcache_journal j;
+
+		bindings.clear();
+		j.open(path, bindings);
+		if (bindings.size() != 17 || !find_binding(bindings, 16, 2) || file_size(path + ".prev") >= 0)
+			++errors;
+	}
+
+	std::remove((path + ".snap").c_str());
+	std::remove(path.c_str());
+	::rmdir(dir);
+
+	std::cout << "bcache_journal: errors = " << errors << std::endl;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
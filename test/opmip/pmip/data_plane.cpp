@@ -0,0 +1,131 @@
+//=============================================================================
+// Brief   : Memory Data Plane Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/chrono.hpp>
+#include <opmip/pmip/data_plane.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+typedef pmip::memory_data_plane::record record;
+
+static uint completions;
+
+static void completion(const boost::system::error_code& ec)
+{
+	if (!ec)
+		++completions;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	boost::asio::io_service ios;
+	pmip::memory_data_plane dp(ios);
+	ip::address_v6          mag1 = ip::address_v6::from_string("2001:db8::1");
+	ip::address_v6          mag2 = ip::address_v6::from_string("2001:db8::2");
+	ip::prefix_v6           p1 = ip::prefix_v6::from_string("2001:db8:1::/64");
+	ip::prefix_v6           p2 = ip::prefix_v6::from_string("2001:db8:2::/64");
+	uint                    errors = 0;
+
+	dp.open(ip::address_v6::from_string("2001:db8::100"), 64, false, false);
+	dp.recording(true);
+
+	//
+	// Tunnels are shared by reference count and kept once provisioned
+	//
+	uint dev1 = dp.acquire_tunnel(mag1);
+	if (dp.acquire_tunnel(mag1) != dev1)
+		++errors;
+
+	uint dev2 = dp.move_tunnel(mag1, mag2);
+	if (dev2 == dev1 || dp.tunnel_count() != 2)
+		++errors;
+
+	//
+	// Operations that do not change the table are skipped, as route_table
+	// does, and do not get a completion
+	//
+	pmip::data_plane::route_batch routes;
+
+	routes.add_by_dst(p1, pmip::data_plane::route_entry(dev1, ip::address_v6()), completion);
+	routes.add_by_dst(p1, pmip::data_plane::route_entry(dev1, ip::address_v6()), completion);
+	routes.replace_by_dst(p1, pmip::data_plane::route_entry(dev2, ip::address_v6()), completion);
+	routes.remove_by_dst(p2, completion);
+	routes.add_by_src(p2, dev2, ip::address_v6(), completion);
+
+	if (dp.commit(routes) != 3 || !routes.empty())
+		++errors;
+
+	pmip::data_plane::route_entry route;
+
+	if (!dp.find_by_dst(p1, route) || route.device != dev2 || !dp.find_by_src(p2, route) || dp.route_count() != 2)
+		++errors;
+
+	ios.run();
+	ios.reset();
+	if (completions != 3)
+		++errors;
+
+	//
+	// Delayed completions only run once the delay expires, the state is
+	// updated right away
+	//
+	chrono cr;
+
+	dp.completion_delay(20000);
+	routes.remove_by_dst(p1, completion);
+	routes.remove_by_src(p2, completion);
+	cr.start();
+	dp.commit(routes);
+	if (dp.route_count())
+		++errors;
+
+	ios.run();
+	cr.stop();
+	if (completions != 5 || (cr.get().seconds() == 0 && cr.get().nanoseconds() < 20000000))
+		++errors;
+
+	dp.flush();
+
+	std::vector<record> records;
+	static const record::kind expected[] = {
+		record::k_tunnel_acquire, record::k_tunnel_acquire, record::k_tunnel_acquire, record::k_tunnel_release,
+		record::k_route_add, record::k_route_replace, record::k_route_add,
+		record::k_route_remove, record::k_route_remove, record::k_flush
+	};
+
+	dp.take_records(records);
+	if (records.size() != sizeof(expected) / sizeof(expected[0]))
+		++errors;
+	else
+		for (size_t i = 0; i < records.size(); ++i)
+			if (records[i].type != expected[i])
+				++errors;
+
+	std::cout << "data plane: records = " << records.size() << ", completions = " << completions
+	          << ", delayed completion = " << cr.get() << std::endl;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
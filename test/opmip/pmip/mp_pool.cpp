@@ -0,0 +1,311 @@
+//=============================================================================
+// Brief   : Mobility Protocol Pipeline Allocation Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/log_backend.hpp>
+#include <opmip/logger.hpp>
+#include <opmip/pmip/data_plane.hpp>
+#include <opmip/pmip/lma.hpp>
+#include <opmip/pmip/mp_batch.hpp>
+#include <opmip/pmip/mp_receiver.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+#include <cstdlib>
+#include <new>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Only the allocations of the threads running the LMA are counted, the log
+// backend thread formats on its own
+//
+static opmip::uint64 heap_allocations;
+static bool          counting;
+static __thread bool worker;
+
+void* operator new(std::size_t n)
+{
+	void* p = std::malloc(n ? n : 1);
+
+	if (!p)
+		throw std::bad_alloc();
+
+	if (worker && __atomic_load_n(&counting, __ATOMIC_RELAXED))
+		__atomic_fetch_add(&heap_allocations, 1, __ATOMIC_RELAXED);
+	return p;
+}
+
+void operator delete(void* p) throw()
+{
+	std::free(p);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const char* k_mag_address = "2001:db8::2";
+static const size_t k_threads     = 4;
+static const size_t k_prefill     = 16;
+
+static uchar  rx_buffers[pmip::k_mp_batch_size][pmip::k_mp_buffer_size];
+static size_t rx_length[pmip::k_mp_batch_size];
+
+///////////////////////////////////////////////////////////////////////////////
+class null_buffer : public std::streambuf {
+protected:
+	int_type overflow(int_type c) { return traits_type::not_eof(c); }
+};
+
+static std::string make_node_db()
+{
+	std::ostringstream db;
+
+	db << "{\n\"router-nodes\": [\n"
+	      "  { \"id\": \"lma\", \"ip-address\": \"2001:db8::1\", \"ip-scope-id\": 0 },\n"
+	      "  { \"id\": \"mag\", \"ip-address\": \"" << k_mag_address << "\", \"ip-scope-id\": 0 }\n"
+	      "],\n\"mobile-nodes\": [\n";
+
+	for (size_t i = 0; i < pmip::k_mp_batch_size; ++i) {
+		db << (i ? ",\n" : "")
+		   << "  { \"id\": \"mobile-node-" << i << "@opmip.example.org\", \"ip-prefix\": [ \"2001:db8:" << std::hex
+		   << (i + 1) << std::dec << "::/64\" ], \"link-address\": [ \"00:11:22:33:44:" << std::hex << (0x10 + i)
+		   << std::dec << "\" ], \"lma-id\": \"lma\" }";
+	}
+
+	db << "\n]\n}\n";
+	return db.str();
+}
+
+static void make_input(pmip::mp_batch_sender& tx)
+{
+	for (size_t i = 0; i < pmip::k_mp_batch_size; ++i) {
+		pmip::proxy_binding_info pbinfo;
+
+		pbinfo.id = "mobile-node-" + boost::lexical_cast<std::string>(i) + "@opmip.example.org";
+		pbinfo.address = ip::address_v6::from_string(k_mag_address);
+		pbinfo.sequence = i;
+		pbinfo.lifetime = 3600;
+		pbinfo.prefix_list.push_back(ip::prefix_v6::from_string("2001:db8:1::/64"));
+		pbinfo.handoff = ip::mproto::option::handoff::k_unknown;
+		tx.push_pbu(pbinfo);
+
+		std::copy(tx.data(i), tx.data(i) + tx.length(i), rx_buffers[i]);
+		rx_length[i] = tx.length(i);
+	}
+	tx.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Feeds received batches to the LMA steady state path, as its receive
+/// handler does: each batch is parsed into a pooled batch, split by shard
+/// and processed on the shard strands. Passes run as handlers of the
+/// io_service, on any of its threads, the next one once every PBA of the
+/// last is out, so batches are released on other threads than the one
+/// that took them. Allocations are counted once the warm up passes
+/// registered the bindings and filled the pools of every thread.
+///
+class pipeline {
+public:
+	pipeline(boost::asio::io_service& ios, pmip::lma& lma, size_t warmup, size_t passes)
+		: _ios(ios), _lma(lma), _warmup(warmup), _passes(passes), _sequence(0), _outstanding(0),
+		  _failed(false), accepted(0), heap(0), miss(0)
+	{ }
+
+	void pass()
+	{
+		if (_sequence == _warmup) {
+			heap = heap_allocations;
+			miss = pool<pmip::pbinfo_batch>::heap_allocations();
+			__atomic_store_n(&counting, true, __ATOMIC_RELAXED);
+		}
+
+		if (_sequence == _warmup + _passes) {
+			__atomic_store_n(&counting, false, __ATOMIC_RELAXED);
+			heap = heap_allocations - heap;
+			miss = pool<pmip::pbinfo_batch>::heap_allocations() - miss;
+			_ios.stop();
+			return;
+		}
+
+		ip::mproto::endpoint   ep(ip::address_v6::from_string(k_mag_address));
+		pmip::pbinfo_batch_ptr pbb = pmip::pbinfo_batch::make();
+
+		++_sequence;
+		_outstanding = pmip::k_mp_batch_size;
+		for (size_t i = 0; i < pmip::k_mp_batch_size; ++i) {
+			pmip::proxy_binding_info& pbinfo = pbb->push();
+
+			if (!pmip::parse_pbu(ep, rx_buffers[i], rx_length[i], pbinfo)) {
+				_failed = true;
+				_ios.stop();
+				return;
+			}
+			pbinfo.sequence = _sequence;
+		}
+
+		_lma.receive(pbb);
+	}
+
+	void pba(const pmip::proxy_binding_info& pbinfo)
+	{
+		if (pbinfo.status == ip::mproto::pba::status_ok)
+			__atomic_fetch_add(&accepted, 1, __ATOMIC_RELAXED);
+
+		if (__atomic_sub_fetch(&_outstanding, 1, __ATOMIC_ACQ_REL) == 0)
+			_ios.post(next_pass(this));
+	}
+
+	bool failed() const { return _failed; }
+
+private:
+	///
+	/// Only one pass is queued at a time, its handler is allocated from the
+	/// pipeline so the harness does not count against the LMA
+	///
+	struct next_pass {
+		explicit next_pass(pipeline* pl) : pl(pl) { }
+
+		void operator()() { pl->pass(); }
+
+		void* memory(size_t size)
+		{
+			BOOST_ASSERT(size <= sizeof(pl->_pass_memory));
+			return &pl->_pass_memory;
+		}
+
+		friend void* asio_handler_allocate(size_t size, next_pass* h)
+		{
+			return h->memory(size);
+		}
+
+		friend void asio_handler_deallocate(void*, size_t, next_pass*)
+		{ }
+
+		pipeline* pl;
+	};
+
+private:
+	boost::aligned_storage<64>::type _pass_memory;
+	boost::asio::io_service& _ios;
+	pmip::lma&               _lma;
+	size_t                   _warmup;
+	size_t                   _passes;
+	uint16                   _sequence;
+	size_t                   _outstanding;
+	bool                     _failed;
+
+public:
+	size_t accepted;
+	uint64 heap;
+	uint64 miss;
+};
+
+///
+/// A pass takes a batch and one per shard from its thread, which get back
+/// once released on the shard threads. A thread preempted past its last
+/// PBA keeps at most two of them a while longer, so with every thread
+/// holding k_prefill batches no pass misses the pool however they are
+/// scheduled. The thread log ring is set up as well, before any thread
+/// runs the passes.
+///
+static void run_worker(boost::asio::io_service& ios, boost::barrier& ready)
+{
+	{
+		std::vector<pmip::pbinfo_batch_ptr> prefill;
+
+		for (size_t i = 0; i < k_prefill; ++i)
+			prefill.push_back(pmip::pbinfo_batch::make());
+	}
+
+	logger log("mp_pool", std::cout);
+
+	log(0, "worker started");
+	ready.wait();
+
+	worker = true;
+	ios.run();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	static pmip::mp_batch_sender tx;
+	const size_t                 warmup = 100;
+	const size_t                 passes = 10000;
+	null_buffer                  null;
+	std::streambuf*              out = std::cout.rdbuf(&null);
+	uint64                       heap;
+	uint64                       miss;
+	size_t                       accepted;
+
+	{
+		opmip::log_backend      logging;
+		boost::asio::io_service ios;
+		pmip::node_db           ndb;
+		std::istringstream      db(make_node_db());
+		pmip::memory_data_plane dp(ios);
+		pmip::lma               lma(ios, ndb, k_threads, &dp);
+		pipeline                pl(ios, lma, warmup, passes);
+		boost::thread_group     workers;
+		boost::barrier          ready(k_threads);
+
+		ndb.load(db);
+		make_input(tx);
+
+		lma.use_local_transport(boost::bind(&pipeline::pba, &pl, _1));
+		lma.start("lma", false);
+		ios.poll();
+		ios.reset();
+
+		ios.post(boost::bind(&pipeline::pass, &pl));
+		for (size_t i = 0; i < k_threads; ++i)
+			workers.create_thread(boost::bind(run_worker, boost::ref(ios), boost::ref(ready)));
+		workers.join_all();
+		ios.reset();
+
+		lma.stop();
+		ios.poll();
+
+		if (pl.failed()) {
+			std::cout.rdbuf(out);
+			std::cerr << "failed to parse PBU\n";
+			return 1;
+		}
+
+		heap = pl.heap;
+		miss = pl.miss;
+		accepted = pl.accepted;
+	}
+
+	std::cout.rdbuf(out);
+	std::cout << "messages processed : " << (warmup + passes) * pmip::k_mp_batch_size << "\n"
+	          << "PBAs accepted      : " << accepted << "\n"
+	          << "heap allocations   : " << heap << "\n"
+	          << "pool misses        : " << miss << std::endl;
+
+	return (heap || miss || accepted != (warmup + passes) * pmip::k_mp_batch_size) ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,104 @@
+//=============================================================================
+// Brief   : Mobility Message Templates Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/pmip/mp_receiver.hpp>
+#include <opmip/pmip/mp_sender.hpp>
+#include <algorithm>
+#include <iostream>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+typedef ip::mproto::option::handoff handoff;
+
+static uint compare(const char* what, const uchar* a, size_t alen, const uchar* b, size_t blen)
+{
+	if (alen == blen && std::equal(a, a + alen, b))
+		return 0;
+
+	std::cout << "mp_template: " << what << " differs from the full encoding" << std::endl;
+	return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	pmip::proxy_binding_info pbinfo;
+	pmip::mp_template        pbu_tpl;
+	uchar                    encoded[pmip::k_mp_buffer_size];
+	uchar                    copied[pmip::k_mp_buffer_size];
+	size_t                   elen, clen;
+	uint                     errors = 0;
+
+	pbinfo.id = "mn1@opmip.example.org";
+	pbinfo.address = ip::address_v6::from_string("2001:db8::1");
+	pbinfo.sequence = 100;
+	pbinfo.lifetime = 60;
+	pbinfo.handoff = handoff::k_unknown;
+	pbinfo.link_type = ll::k_tech_ieee802_3;
+	pbinfo.prefix_list.push_back(ip::prefix_v6::from_string("2001:db8:1::/64"));
+	pbinfo.prefix_list.push_back(ip::prefix_v6::from_string("2001:db8:2::/64"));
+
+	pbu_tpl.encode_pbu(pbinfo);
+
+	//
+	// Renewal, retry and de-registration as the MAG sends them
+	//
+	pbinfo.sequence = 101;
+	pbinfo.handoff = handoff::k_not_changed;
+	elen = pmip::encode_pbu(pbinfo, encoded);
+	clen = pbu_tpl.copy(pbinfo, copied);
+	errors += compare("renew PBU", encoded, elen, copied, clen);
+
+	pbinfo.lifetime = 0;
+	pbinfo.sequence = 102;
+	pbinfo.handoff = handoff::k_unknown;
+	elen = pmip::encode_pbu(pbinfo, encoded);
+	clen = pbu_tpl.copy(pbinfo, copied);
+	errors += compare("de-register PBU", encoded, elen, copied, clen);
+
+	//
+	// Access technology of a handoff
+	//
+	pbinfo.lifetime = 120;
+	pbinfo.sequence = 103;
+	pbinfo.handoff = handoff::k_diff_interface;
+	pbinfo.link_type = ll::k_tech_ieee802_11abg;
+	elen = pmip::encode_pbu(pbinfo, encoded);
+	clen = pbu_tpl.copy(pbinfo, copied);
+	errors += compare("handoff PBU", encoded, elen, copied, clen);
+
+	//
+	// And parsed back
+	//
+	pmip::proxy_binding_info parsed;
+	ip::mproto::endpoint     ep(pbinfo.address);
+
+	if (!pmip::parse_pbu(ep, copied, clen, parsed)
+	    || parsed.id != pbinfo.id || parsed.sequence != pbinfo.sequence
+	    || parsed.lifetime != pbinfo.lifetime
+	    || parsed.handoff != pbinfo.handoff || parsed.link_type != pbinfo.link_type
+	    || parsed.prefix_list != pbinfo.prefix_list)
+		++errors;
+
+	std::cout << "mp_template: PBU length = " << pbu_tpl.length() << ", errors = " << errors << std::endl;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,218 @@
+//=============================================================================
+// Brief   : Node Database Cache Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/pmip/node_db.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+#include <sstream>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const uint32 k_mobile_nodes = 8;
+static const size_t k_cache_capacity = 2;
+
+static const char* k_routers =
+	"{\n"
+	"\"router-nodes\": [\n"
+	"  { \"id\": \"lma\", \"ip-address\": \"2001:db8::1\", \"ip-scope-id\": 0 }\n"
+	"],\n"
+	"\"mobile-nodes\": [ ]\n"
+	"}\n";
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Mobile nodes mn0 to mn7, counting the records read
+///
+class memory_store : public pmip::subscriber_store {
+public:
+	memory_store(uint& reads)
+		: _reads(reads)
+	{ }
+
+	uint32 record_count() const
+	{
+		return k_mobile_nodes;
+	}
+
+	uint32 find_record(const std::string& id) const
+	{
+		for (uint32 i = 0; i < k_mobile_nodes; ++i)
+			if (id == record_id(i))
+				return i;
+
+		return pmip::k_mn_index_invalid;
+	}
+
+	uint32 find_record(const ll::mac_address& addr) const
+	{
+		for (uint32 i = 0; i < k_mobile_nodes; ++i)
+			if (addr == link_address(i))
+				return i;
+
+		return pmip::k_mn_index_invalid;
+	}
+
+	std::string record_id(uint32 record) const
+	{
+		std::ostringstream id;
+
+		id << "mn" << record;
+		return id.str();
+	}
+
+	pmip::mobile_node* read_record(uint32 record) const
+	{
+		__atomic_fetch_add(&_reads, 1, __ATOMIC_RELAXED);
+
+		return new pmip::mobile_node(record_id(record), pmip::mobile_node::ip_prefix_list(),
+		                             pmip::mobile_node::link_address_list(1, link_address(record)),
+		                             "lma", ip::address_v6());
+	}
+
+private:
+	static ll::mac_address link_address(uint32 record)
+	{
+		std::ostringstream addr;
+
+		addr << "00:11:22:33:44:0" << record;
+		return ll::mac_address::from_string(addr.str());
+	}
+
+private:
+	uint& _reads;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+struct load_result {
+	load_result()
+		: done(false)
+	{ }
+
+	void complete(const pmip::node_db::mobile_node_ptr_list& nodes)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+
+		mns = nodes;
+		done = true;
+		cond.notify_one();
+	}
+
+	void wait()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+
+		while (!done)
+			cond.wait(lock);
+	}
+
+	boost::mutex                         mutex;
+	boost::condition_variable            cond;
+	bool                                 done;
+	pmip::node_db::mobile_node_ptr_list mns;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	pmip::node_db      db;
+	std::istringstream in(k_routers);
+	uint               reads = 0;
+	uint               errors = 0;
+
+	db.set_cache_capacity(k_cache_capacity);
+	db.load(in);
+	if (db.load_store(std::auto_ptr<pmip::subscriber_store>(new memory_store(reads))) != k_mobile_nodes) {
+		std::cerr << "node_db-cache: mobile node count mismatch\n\n";
+		return 1;
+	}
+
+	//
+	// Keys are found without reading the store, the mobile nodes on their
+	// first lookup only
+	//
+	if (db.index_of(std::string("mn3")) != 3 || db.index_of(std::string("mn9")) != pmip::k_mn_index_invalid
+	    || db.peek_mobile_node(0) || reads)
+		++errors;
+
+	pmip::mobile_node_ptr mn0 = db.mobile_node_at(0);
+
+	if (!mn0 || mn0->id() != "mn0" || mn0->index() != 0 || db.peek_mobile_node(0) != mn0
+	    || db.find_mobile_node(std::string("mn0")) != mn0 || reads != 1)
+		++errors;
+
+	//
+	// Unused mobile nodes are evicted beyond the capacity, mn0 is in use
+	//
+	for (uint32 i = 1; i < k_mobile_nodes; ++i) {
+		pmip::mobile_node_ptr mn = db.find_mobile_node(ll::mac_address::from_string("00:11:22:33:44:0"
+		                                                                            + std::string(1, '0' + i)));
+
+		if (!mn || mn->index() != i)
+			++errors;
+	}
+
+	if (db.peek_mobile_node(0) != mn0 || db.peek_mobile_node(1) || !db.peek_mobile_node(k_mobile_nodes - 1)
+	    || reads != k_mobile_nodes)
+		++errors;
+
+	//
+	// Asynchronous loads complete in the order asked for
+	//
+	load_result         result;
+	std::vector<uint32> indexes;
+
+	indexes.push_back(5);
+	indexes.push_back(1);
+	indexes.push_back(k_mobile_nodes);
+	db.async_load(indexes, boost::bind(&load_result::complete, &result, _1));
+	result.wait();
+
+	if (result.mns.size() != 3 || !result.mns[0] || result.mns[0]->id() != "mn5"
+	    || !result.mns[1] || result.mns[1]->id() != "mn1" || result.mns[2])
+		++errors;
+
+	//
+	// With three stripes of one node each, the last node looked up of each
+	// index modulo three is kept
+	//
+	pmip::node_db      striped;
+	std::istringstream sin(k_routers);
+	uint               sreads = 0;
+
+	striped.set_cache_capacity(3);
+	striped.set_cache_stripes(3);
+	striped.load(sin);
+	striped.load_store(std::auto_ptr<pmip::subscriber_store>(new memory_store(sreads)));
+
+	for (uint32 i = 0; i < k_mobile_nodes; ++i)
+		if (!striped.mobile_node_at(i))
+			++errors;
+
+	for (uint32 i = 0; i < k_mobile_nodes; ++i)
+		if (!striped.peek_mobile_node(i) != (i < k_mobile_nodes - 3))
+			++errors;
+
+	std::cout << "node_db-cache: errors = " << errors << std::endl;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,142 @@
+//=============================================================================
+// Brief   : Node Database Image Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/pmip/node_db.hpp>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const char* k_database =
+	"{\n"
+	"\"router-nodes\": [\n"
+	"  { \"id\": \"lma\", \"ip-address\": \"2001:db8::1\", \"ip-scope-id\": 0 },\n"
+	"  { \"id\": \"mag1\", \"ip-address\": \"2001:db8::2\", \"ip-scope-id\": 2 }\n"
+	"],\n"
+	"\"mobile-nodes\": [\n"
+	"  { \"id\": \"mn1@opmip.example.org\", \"ip-prefix\": [ \"2001:db8:1::/64\" ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:01\" ], \"lma-id\": \"lma\" },\n"
+	"  { \"id\": \"mn2@opmip.example.org\", \"ip-prefix\": [ \"2001:db8:2::/64\", \"2001:db8:3::/48\" ],\n"
+	"    \"home-address\": \"2001:db8:2::2\",\n"
+	"    \"link-address\": [ \"00:11:22:33:44:02\", \"00:11:22:33:44:03\" ], \"lma-id\": \"lma\" },\n"
+	"  { \"id\": \"mn3@opmip.example.org\", \"ip-prefix\": [ ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:04\" ], \"lma-id\": \"lma2\" }\n"
+	"]\n"
+	"}\n";
+
+static bool same(const pmip::mobile_node& a, const pmip::mobile_node& b)
+{
+	return a.id() == b.id() && a.index() == b.index() && a.prefix_list() == b.prefix_list()
+	       && a.link_addresses() == b.link_addresses() && a.lma_id() == b.lma_id()
+	       && a.home_address() == b.home_address();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	pmip::node_db      json;
+	pmip::node_db      image;
+	std::istringstream in(k_database);
+	std::string        file = "node_db-image.ndb";
+	uint               errors = 0;
+
+	json.load(in);
+	{
+		std::ofstream out(file.c_str(), std::ios::binary);
+
+		json.write_image(out);
+	}
+
+	if (!pmip::node_db::is_image(file)) {
+		std::cerr << "node_db-image: image not recognized\n\n";
+		return 1;
+	}
+
+	std::pair<size_t, size_t> cnt = image.load_image(file);
+
+	//
+	// Every mobile node, by index, NAI and link address
+	//
+	if (cnt.first != 2 || cnt.second != json.mobile_node_count() || image.mobile_node_count() != cnt.second)
+		++errors;
+
+	for (uint32 i = 0; i < image.mobile_node_count(); ++i) {
+		pmip::mobile_node_ptr mn = image.mobile_node_at(i);
+
+		if (!mn || !same(*mn, *json.mobile_node_at(i))) {
+			++errors;
+			continue;
+		}
+
+		if (image.find_mobile_node(mn->id()) != mn)
+			++errors;
+
+		for (size_t j = 0; j < mn->link_addresses().size(); ++j)
+			if (image.find_mobile_node(mn->link_addresses()[j]) != mn)
+				++errors;
+	}
+
+	if (image.find_mobile_node(std::string("mn4@opmip.example.org"))
+	    || image.find_mobile_node(ll::mac_address::from_string("00:11:22:33:44:05"))
+	    || image.mobile_node_at(uint32(image.mobile_node_count())))
+		++errors;
+
+	//
+	// Router nodes, by id and address
+	//
+	const pmip::router_node* rn = image.find_router(std::string("mag1"));
+
+	if (!rn || rn->device_id() != 2 || image.find_router(rn->address()) != rn
+	    || rn->address() != json.find_router(std::string("mag1"))->address())
+		++errors;
+
+	//
+	// A truncated image is rejected
+	//
+	{
+		std::ifstream      src(file.c_str(), std::ios::binary);
+		std::ostringstream buf;
+
+		buf << src.rdbuf();
+
+		std::string   data = buf.str();
+		std::ofstream out(file.c_str(), std::ios::binary | std::ios::trunc);
+
+		out.write(data.data(), data.size() - 1);
+	}
+
+	try {
+		pmip::node_db bad;
+
+		bad.load_image(file);
+		++errors;
+
+	} catch (std::exception&) {
+	}
+
+	std::remove(file.c_str());
+
+	std::cout << "node_db-image: errors = " << errors << std::endl;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
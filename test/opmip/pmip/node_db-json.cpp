@@ -0,0 +1,150 @@
+//=============================================================================
+// Brief   : Node Database JSON Loader Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/pmip/node_db.hpp>
+#include <boost/bind.hpp>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const size_t k_mobile_nodes = 100000;
+
+static std::string mn_id(size_t i)
+{
+	char buf[64];
+
+	std::sprintf(buf, "mn%u@opmip.example.org", uint(i));
+	return buf;
+}
+
+static std::string mn_link_address(size_t i)
+{
+	char buf[32];
+
+	std::sprintf(buf, "02:00:%02x:%02x:%02x:%02x",
+	             uint(i >> 24) & 0xff, uint(i >> 16) & 0xff, uint(i >> 8) & 0xff, uint(i) & 0xff);
+	return buf;
+}
+
+static std::string mn_prefix(size_t i)
+{
+	char buf[64];
+
+	std::sprintf(buf, "2001:db8:%x:%x::/64", uint(i >> 16), uint(i & 0xffff));
+	return buf;
+}
+
+static void progress(size_t done, size_t total, size_t& last, uint& errors)
+{
+	if (done <= last || done > total)
+		++errors;
+	last = done;
+}
+
+static bool rejects(const std::string& text)
+{
+	std::istringstream in(text);
+	pmip::node_db      db;
+
+	try {
+		db.load(in);
+
+	} catch (std::exception&) {
+		return true;
+	}
+
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	std::ostringstream os;
+	uint               errors = 0;
+
+	//
+	// Unknown members are skipped wherever they are, scope ids may be
+	// strings, and names may have escapes
+	//
+	os << "{\n"
+	      "  \"version\": { \"major\": 1, \"list\": [ 1, \"]\", { } ] },\n"
+	      "  \"router-nodes\": [\n"
+	      "    { \"id\": \"lma\", \"ip-address\": \"2001:db8::1\", \"ip-scope-id\": \"2\" },\n"
+	      "    { \"id\": \"m\\u00e1g\\\"1\\\"\", \"comment\": null, \"ip-address\": \"2001:db8::2\", \"ip-scope-id\": 3 }\n"
+	      "  ],\n"
+	      "  \"mobile-nodes\": [\n";
+	for (size_t i = 0; i < k_mobile_nodes; ++i) {
+		os << (i ? ",\n" : "") << "    { \"id\": \"" << mn_id(i) << "\", \"ip-prefix\": [ \"" << mn_prefix(i) << "\" ]";
+		if (!(i % 7))
+			os << ", \"home-address\": \"" << mn_prefix(i).substr(0, mn_prefix(i).size() - 3) << "1\"";
+		os << ", \"link-address\": [ \"" << mn_link_address(i) << "\" ], \"lma-id\": \"lma\", \"extra\": true }";
+	}
+	os << "\n  ]\n}\n";
+
+	std::istringstream        in(os.str());
+	pmip::node_db             db;
+	size_t                    last = 0;
+	std::pair<size_t, size_t> cnt;
+
+	cnt = db.load(in, boost::bind(progress, _1, _2, boost::ref(last), boost::ref(errors)));
+
+	if (cnt.first != 2 || cnt.second != k_mobile_nodes || last != k_mobile_nodes)
+		++errors;
+
+	const pmip::router_node* rn = db.find_router(std::string("m\xc3\xa1g\"1\""));
+
+	if (!rn || rn->device_id() != 3 || !db.find_router(std::string("lma"))
+	    || db.find_router(std::string("lma"))->device_id() != 2)
+		++errors;
+
+	//
+	// Mobile nodes keep the order of the file
+	//
+	for (size_t i = 0; i < k_mobile_nodes; ++i) {
+		pmip::mobile_node_ptr mn = db.mobile_node_at(i);
+
+		if (!mn || mn->id() != mn_id(i) || mn->lma_id() != "lma"
+		    || mn->prefix_list().size() != 1 || mn->prefix_list()[0] != ip::prefix_v6::from_string(mn_prefix(i))
+		    || mn->link_addresses().size() != 1
+		    || db.find_mobile_node(ll::mac_address::from_string(mn_link_address(i))) != mn
+		    || mn->home_address().is_unspecified() != bool(i % 7)) {
+			++errors;
+			break;
+		}
+	}
+
+	//
+	// Malformed databases
+	//
+	if (!rejects("{ \"router-nodes\": [ ] }")
+	    || !rejects("{ \"router-nodes\": [ ], \"mobile-nodes\": [ { \"id\": \"mn\" } ] }")
+	    || !rejects("{ \"router-nodes\": [ ], \"mobile-nodes\": [ ] ")
+	    || !rejects("{ \"router-nodes\": [ ], \"mobile-nodes\": [ { \"id\": \"mn ] }")
+	    || !rejects("{ \"router-nodes\": [ { \"id\": \"lma\" \"ip-address\": \"::1\" } ], \"mobile-nodes\": [ ] }")
+	    || rejects("{ \"router-nodes\": [ ], \"mobile-nodes\": [ ] }"))
+		++errors;
+
+	std::cout << "node_db-json: errors = " << errors << std::endl;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -23,9 +23,9 @@
 ///////////////////////////////////////////////////////////////////////////////
 int main(int argc, char** argv)
 {
-	opmip::pmip::node_db db;
-	std::ifstream in;
-	size_t cnt;
+	opmip::pmip::node_db      db;
+	std::ifstream             in;
+	std::pair<size_t, size_t> cnt;
 
 	if (argc != 2) {
 		std::cerr << "usage: node-dabase-file\n\n";
@@ -40,12 +40,30 @@ int main(int argc, char** argv)
 
 	try {
 		cnt = db.load(in);
-		std::cout << "loaded " << cnt << " node entries from database file\n";
+		std::cout << "loaded " << cnt.first << " router and " << cnt.second
+		          << " mobile node entries from database file\n";
 
 	} catch (std::exception& e) {
 		std::cerr << "database parse error: " << e.what() << "\n\n";
 		return 1;
 	}
+
+	//
+	// Mobile node indexes must be dense and resolve back to the same node
+	//
+	if (db.mobile_node_count() != cnt.second) {
+		std::cerr << "mobile node count mismatch\n\n";
+		return 1;
+	}
+
+	for (opmip::pmip::node_db::mobile_node_iterator i = db.mobile_node_begin(), e = db.mobile_node_end(); i != e; ++i) {
+		const opmip::pmip::mobile_node* mn = &i;
+
+		if (db.mobile_node_at(mn->index()) != mn || db.find_mobile_node(mn->id()) != mn) {
+			std::cerr << "mobile node index mismatch [id = " << mn->id() << "]\n\n";
+			return 1;
+		}
+	}
 }
 
 // EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,203 @@
+//=============================================================================
+// Brief   : Node Database Reload Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/rcu_pointer.hpp>
+#include <opmip/pmip/node_db.hpp>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const char* k_before =
+	"{\n"
+	"\"router-nodes\": [\n"
+	"  { \"id\": \"lma\", \"ip-address\": \"2001:db8::1\", \"ip-scope-id\": 0 }\n"
+	"],\n"
+	"\"mobile-nodes\": [\n"
+	"  { \"id\": \"mn1\", \"ip-prefix\": [ \"2001:db8:1::/64\" ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:01\" ], \"lma-id\": \"lma\" },\n"
+	"  { \"id\": \"mn2\", \"ip-prefix\": [ \"2001:db8:2::/64\" ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:02\" ], \"lma-id\": \"lma\" },\n"
+	"  { \"id\": \"mn3\", \"ip-prefix\": [ \"2001:db8:3::/64\" ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:03\" ], \"lma-id\": \"lma\" }\n"
+	"]\n"
+	"}\n";
+
+//
+// mn1 removed, mn2 moved to another prefix, mn3 unchanged and mn4 added,
+// in a different order
+//
+static const char* k_after =
+	"{\n"
+	"\"router-nodes\": [\n"
+	"  { \"id\": \"lma\", \"ip-address\": \"2001:db8::1\", \"ip-scope-id\": 0 }\n"
+	"],\n"
+	"\"mobile-nodes\": [\n"
+	"  { \"id\": \"mn4\", \"ip-prefix\": [ \"2001:db8:4::/64\" ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:04\" ], \"lma-id\": \"lma\" },\n"
+	"  { \"id\": \"mn3\", \"ip-prefix\": [ \"2001:db8:3::/64\" ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:03\" ], \"lma-id\": \"lma\" },\n"
+	"  { \"id\": \"mn2\", \"ip-prefix\": [ \"2001:db8:5::/64\" ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:02\" ], \"lma-id\": \"lma\" }\n"
+	"]\n"
+	"}\n";
+
+//
+// mn5 added, mn3 removed
+//
+static const char* k_again =
+	"{\n"
+	"\"router-nodes\": [\n"
+	"  { \"id\": \"lma\", \"ip-address\": \"2001:db8::1\", \"ip-scope-id\": 0 }\n"
+	"],\n"
+	"\"mobile-nodes\": [\n"
+	"  { \"id\": \"mn5\", \"ip-prefix\": [ \"2001:db8:6::/64\" ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:05\" ], \"lma-id\": \"lma\" },\n"
+	"  { \"id\": \"mn4\", \"ip-prefix\": [ \"2001:db8:4::/64\" ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:04\" ], \"lma-id\": \"lma\" },\n"
+	"  { \"id\": \"mn2\", \"ip-prefix\": [ \"2001:db8:5::/64\" ],\n"
+	"    \"link-address\": [ \"00:11:22:33:44:02\" ], \"lma-id\": \"lma\" }\n"
+	"]\n"
+	"}\n";
+
+static uint check(const char* what, const pmip::node_db& before, const pmip::node_db& after)
+{
+	pmip::mobile_node_ptr    mn1 = before.find_mobile_node(std::string("mn1"));
+	pmip::mobile_node_ptr    mn2 = before.find_mobile_node(std::string("mn2"));
+	pmip::mobile_node_ptr    mn3 = before.find_mobile_node(std::string("mn3"));
+	pmip::mobile_node_ptr    mn2r = after.find_mobile_node(std::string("mn2"));
+	pmip::mobile_node_ptr    mn3r = after.find_mobile_node(std::string("mn3"));
+	pmip::mobile_node_ptr    mn4r = after.find_mobile_node(std::string("mn4"));
+	uint                     errors = 0;
+
+	if (!mn2r || !mn3r || !mn4r || after.find_mobile_node(std::string("mn1"))) {
+		std::cout << "node_db-reload: " << what << " mobile nodes not found" << std::endl;
+		return 1;
+	}
+
+	//
+	// Kept indexes, the removed one left unused and the new one last
+	//
+	if (mn2r->index() != mn2->index() || mn3r->index() != mn3->index()
+	    || mn4r->index() != before.mobile_node_count()
+	    || after.mobile_node_count() != before.mobile_node_count() + 1
+	    || after.mobile_node_at(mn1->index())
+	    || after.mobile_node_at(mn2->index()) != mn2r || after.mobile_node_at(mn4r->index()) != mn4r)
+		++errors;
+
+	if (after.find_mobile_node(ll::mac_address::from_string("00:11:22:33:44:03")) != mn3r
+	    || after.find_mobile_node(ll::mac_address::from_string("00:11:22:33:44:04")) != mn4r
+	    || after.find_mobile_node(ll::mac_address::from_string("00:11:22:33:44:01")))
+		++errors;
+
+	if (!mn3r->equivalent(*mn3) || mn2r->equivalent(*mn2))
+		++errors;
+
+	std::cout << "node_db-reload: " << what << " errors = " << errors << std::endl;
+	return errors;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	pmip::node_db      before;
+	pmip::node_db      after;
+	pmip::node_db      image;
+	std::istringstream in1(k_before);
+	std::istringstream in2(k_after);
+	std::string        file = "node_db-reload.ndb";
+	uint               errors = 0;
+
+	before.load(in1);
+	after.load(in2);
+	after.keep_indexes(before);
+	errors += check("json", before, after);
+
+	//
+	// The image leaves the unused index out, keep_indexes puts it back
+	//
+	{
+		std::ofstream out(file.c_str(), std::ios::binary);
+
+		after.write_image(out);
+	}
+
+	if (image.load_image(file).second != 3)
+		++errors;
+	image.keep_indexes(after);
+	errors += check("image", before, image);
+
+	std::remove(file.c_str());
+
+	//
+	// The next reload gives the index of mn1 to mn5, the one of mn3 is only
+	// left unused
+	//
+	pmip::node_db      again;
+	std::istringstream in3(k_again);
+
+	again.load(in3);
+	again.keep_indexes(after);
+
+	pmip::mobile_node_ptr mn5 = again.find_mobile_node(std::string("mn5"));
+
+	if (!mn5 || mn5->index() != before.find_mobile_node(std::string("mn1"))->index()
+	    || again.mobile_node_count() != after.mobile_node_count()
+	    || again.mobile_node_at(after.find_mobile_node(std::string("mn3"))->index())
+	    || again.find_mobile_node(std::string("mn4"))->index() != after.find_mobile_node(std::string("mn4"))->index())
+		++errors;
+
+	//
+	// The replaced object is only released once its readers are gone
+	//
+	int                       a = 1;
+	int                       b = 2;
+	int                       c = 3;
+	rcu_pointer<int>          ptr(&a);
+	uint                      epoch;
+	rcu_pointer<int>::reader* r1 = new rcu_pointer<int>::reader(ptr);
+
+	if (ptr.exchange(&b, epoch) != &a || ptr.synchronized(epoch) || *ptr.get() != 2)
+		++errors;
+
+	{
+		rcu_pointer<int>::reader r2(ptr);
+
+		if (*r2 != 2 || ptr.synchronized(epoch))
+			++errors;
+
+		delete r1;
+		if (!ptr.synchronized(epoch))
+			++errors;
+
+		if (ptr.exchange(&c, epoch) != &b || ptr.synchronized(epoch))
+			++errors;
+	}
+
+	if (!ptr.synchronized(epoch) || *ptr.get() != 3)
+		++errors;
+
+	std::cout << "node_db-reload: errors = " << errors << std::endl;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
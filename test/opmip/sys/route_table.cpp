@@ -17,27 +17,79 @@
 
 #include <opmip/base.hpp>
 #include <opmip/sys/route_table.hpp>
+#include <boost/bind.hpp>
 #include <iostream>
 
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static uint completed;
+static uint errors;
+
+static void completion(const boost::system::error_code& ec, const char* what)
+{
+	++completed;
+	if (ec) {
+		++errors;
+		std::cerr << what << ": " << ec.message() << std::endl;
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 int main()
 {
-	using namespace opmip;
 	boost::asio::io_service ios;
 	sys::route_table rt(ios);
 
 	ip::prefix_v6 pref1(ip::address_v6::from_string("3001:c188:5d9a:a::"), 64);
 	ip::prefix_v6 pref2(ip::address_v6::from_string("3001:c188:5d9a:b::"), 64);
 
-	rt.add_by_dst(pref1, 2, ip::address_v6::from_string("2001:106:2222::1"));
-	rt.add_by_dst(pref2, 3);
-	rt.remove_by_dst(pref1);
-	rt.remove_by_dst(pref2);
+	//
+	// All requests are in flight before the first reply is processed
+	//
+	rt.add_by_dst(pref1, 2, ip::address_v6::from_string("2001:106:2222::1"), boost::bind(&completion, _1, "add_by_dst"));
+	rt.add_by_dst(pref2, 3, ip::address_v6(), boost::bind(&completion, _1, "add_by_dst"));
+	rt.replace_by_dst(pref1, 3, ip::address_v6(), boost::bind(&completion, _1, "replace_by_dst"));
+	rt.remove_by_dst(pref1, boost::bind(&completion, _1, "remove_by_dst"));
+	rt.remove_by_dst(pref2, boost::bind(&completion, _1, "remove_by_dst"));
+
+	rt.add_by_src(pref1, 2, ip::address_v6::from_string("2001:106:2222::1"), boost::bind(&completion, _1, "add_by_src"));
+	rt.add_by_src(pref2, 3, ip::address_v6(), boost::bind(&completion, _1, "add_by_src"));
+	rt.remove_by_src(pref1, boost::bind(&completion, _1, "remove_by_src"));
+	rt.remove_by_src(pref2, boost::bind(&completion, _1, "remove_by_src"));
+
+	//
+	// The same routes again, each direction in a single netlink send
+	//
+	sys::route_table::batch batch;
+
+	batch.add_by_dst(pref1, 2, ip::address_v6::from_string("2001:106:2222::1"), boost::bind(&completion, _1, "batch add_by_dst"));
+	batch.add_by_dst(pref2, 3, ip::address_v6(), boost::bind(&completion, _1, "batch add_by_dst"));
+	batch.add_by_src(pref1, 2, ip::address_v6::from_string("2001:106:2222::1"), boost::bind(&completion, _1, "batch add_by_src"));
+	batch.add_by_src(pref2, 3, ip::address_v6(), boost::bind(&completion, _1, "batch add_by_src"));
+	rt.commit(batch);
+
+	batch.remove_by_dst(pref1, boost::bind(&completion, _1, "batch remove_by_dst"));
+	batch.remove_by_dst(pref2, boost::bind(&completion, _1, "batch remove_by_dst"));
+	batch.remove_by_src(pref1, boost::bind(&completion, _1, "batch remove_by_src"));
+	batch.remove_by_src(pref2, boost::bind(&completion, _1, "batch remove_by_src"));
+	rt.commit(batch);
+
+	//
+	// Encapsulated routes, moved to another remote in place
+	//
+	sys::route_table::entry encap1(2, ip::address_v6(), ip::address_v6::from_string("2001:db8::1"));
+	sys::route_table::entry encap2(2, ip::address_v6(), ip::address_v6::from_string("2001:db8::2"));
+
+	rt.add_by_dst(pref1, encap1, boost::bind(&completion, _1, "add_by_dst encap"));
+	rt.replace_by_dst(pref1, encap2, boost::bind(&completion, _1, "replace_by_dst encap"));
+	rt.remove_by_dst(pref1, boost::bind(&completion, _1, "remove_by_dst encap"));
+
+	ios.run();
+
+	std::cout << "route table: " << completed << " requests completed, " << errors << " errors" << std::endl;
 
-	rt.add_by_src(pref1, 2, ip::address_v6::from_string("2001:106:2222::1"));
-	rt.add_by_src(pref2, 3);
-	rt.remove_by_src(pref1);
-	rt.remove_by_src(pref2);
+	return (completed == 20 && !errors) ? 0 : 1;
 }
 
 // EOF ////////////////////////////////////////////////////////////////////////
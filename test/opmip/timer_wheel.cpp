@@ -0,0 +1,128 @@
+//=============================================================================
+// Brief   : Timer Wheel Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/chrono.hpp>
+#include <opmip/timer_wheel.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+struct entry {
+	entry() : delay(0), fired(0)
+	{ }
+
+	uint64           delay;  ///Requested delay (ms)
+	uint             fired;  ///Expiration count
+	ptime            when;   ///Expiration time
+	timer_wheel_hook timer;
+};
+
+static const uint k_entries    = 64;
+static const uint k_resolution = 10;
+
+static entry        entries[k_entries];
+static timer_wheel* wheel;
+static ptime        start;
+static uint         errors;
+
+///////////////////////////////////////////////////////////////////////////////
+static uint64 to_ms(const ptime& tm)
+{
+	return uint64(tm.seconds()) * 1000 + tm.nanoseconds() / 1000000;
+}
+
+static void expired(timer_wheel_hook& timer)
+{
+	entry* e = parent_of(&timer, &entry::timer);
+
+	e->when = ptime::get_monotonic() - start;
+	++e->fired;
+
+	//
+	// Entry 0 is rescheduled from its own handler once
+	//
+	if (e == entries && e->fired == 1) {
+		e->delay = to_ms(e->when) + 100;
+		wheel->schedule(e->timer, 100);
+	}
+}
+
+static void run()
+{
+	start = ptime::get_monotonic();
+
+	for (uint i = 0; i < k_entries; ++i) {
+		entries[i].delay = (i * 37) % 600 + 1;
+		wheel->schedule(entries[i].timer, entries[i].delay);
+	}
+
+	//
+	// Odd entries are canceled, multiples of 4 are moved 300 ms later
+	//
+	for (uint i = 1; i < k_entries; i += 2)
+		wheel->cancel(entries[i].timer);
+
+	for (uint i = 4; i < k_entries; i += 4) {
+		entries[i].delay += 300;
+		wheel->schedule(entries[i].timer, entries[i].delay);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	boost::asio::io_service         ios;
+	boost::asio::io_service::strand srv(ios);
+	timer_wheel                     tw(srv, &expired, k_resolution);
+
+	wheel = &tw;
+	srv.dispatch(&run);
+	ios.run();
+
+	for (uint i = 0; i < k_entries; ++i) {
+		const entry& e = entries[i];
+		uint         expected = (i & 1) ? 0 : (i ? 1 : 2);
+
+		if (e.fired != expected) {
+			std::cerr << "entry " << i << ": fired " << e.fired << " times, expected " << expected << "\n";
+			++errors;
+			continue;
+		}
+
+		if (!e.fired)
+			continue;
+
+		uint64 ms = to_ms(e.when);
+
+		if (ms < e.delay || ms > e.delay + 4 * k_resolution + 50) {
+			std::cerr << "entry " << i << ": expired at " << ms << " ms, expected " << e.delay << " ms\n";
+			++errors;
+		}
+	}
+
+	std::cout << "timer wheel: " << (errors ? "failed" : "ok")
+	          << " [pending = " << tw.size() << ", errors = " << errors << "]" << std::endl;
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,104 @@
+//=============================================================================
+// Brief   : Per Stage Latency Tracer Test
+// Authors : Bruno Santos <bsantos@av.it.pt>
+// ----------------------------------------------------------------------------
+// OPMIP - Open Proxy Mobile IP
+//
+// Copyright (C) 2010-2012 Universidade de Aveiro
+// Copyrigth (C) 2010-2012 Instituto de Telecomunicações - Pólo de Aveiro
+//
+// This software is distributed under a license. The full license
+// agreement can be found in the file LICENSE in this distribution.
+// This software may not be copied, modified, sold or distributed
+// other than expressed in the named license agreement.
+//
+// This software is distributed without any warranty.
+//=============================================================================
+
+#include <opmip/base.hpp>
+#include <opmip/tracer.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+using namespace opmip;
+
+static const char* const k_names[] = { "start", "middle", "end" };
+
+static const uint k_records  = 1000;
+static const uint k_sample   = 10;
+static const uint k_capacity = 64;
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+	const char* path = "tracer.trc";
+	uint        errors = 0;
+	{
+		tracer tr(k_names, 3);
+
+		tr.open(path, k_sample, k_capacity);
+
+		//
+		// middle is 10 us after start and end 100 us after middle, every
+		// other record skips the middle stage
+		//
+		for (uint i = 0; i < k_records; ++i) {
+			tracer::record rec;
+			uint64         base = 1000000000 + i * 1000000;
+
+			rec.stamps[0] = base;
+			if (i % 2)
+				rec.stamps[1] = base + 10000;
+			rec.stamps[2] = base + 110000;
+			tr.commit(rec);
+		}
+
+		std::cout << "tracer: middle = " << tr.stage(1).count() << ", end = " << tr.stage(2).count()
+		          << ", p50 end = " << tr.stage(2).quantile(0.5) << ", p50 total = " << tr.total().quantile(0.5)
+		          << std::endl;
+
+		if (tr.stage(1).count() != k_records / 2 || tr.stage(2).count() != k_records
+		    || tr.total().count() != k_records)
+			++errors;
+		if (tr.stage(1).sum() != 10 * k_records / 2 || tr.total().sum() != 110 * k_records)
+			++errors;
+		if (tr.stage(2).sum() != 100 * k_records / 2 + 110 * k_records / 2)
+			++errors;
+	}
+
+	//
+	// The ring holds the last k_capacity samples, in order
+	//
+	std::ifstream in(path, std::ios::binary);
+	tracer::file_header hdr;
+
+	in.read(reinterpret_cast<char*>(&hdr), sizeof(hdr));
+	if (!in || std::memcmp(hdr.magic, "OPMIPTRC", 8) || hdr.stages != 3 || hdr.capacity != k_capacity
+	    || hdr.record_size != sizeof(tracer::file_record) || hdr.head != k_records / k_sample
+	    || std::strcmp(hdr.names[1], "middle")) {
+		std::cerr << "bad header" << std::endl;
+		++errors;
+	}
+
+	std::vector<tracer::file_record> ring(k_capacity);
+
+	in.read(reinterpret_cast<char*>(&ring[0]), sizeof(tracer::file_record) * k_capacity);
+	for (uint64 n = hdr.head - k_capacity; n < hdr.head; ++n) {
+		const tracer::file_record& rec = ring[n % k_capacity];
+
+		if (rec.sequence != n + 1 || rec.stamps[0] != 1000000000 + n * k_sample * 1000000) {
+			std::cerr << "bad record " << n << std::endl;
+			++errors;
+		}
+	}
+
+	std::remove(path);
+
+	return errors ? 1 : 0;
+}
+
+// EOF ////////////////////////////////////////////////////////////////////////